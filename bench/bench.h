@@ -0,0 +1,31 @@
+#ifndef LF_BENCH_H
+#define LF_BENCH_H
+
+#include <stdio.h>
+#include <time.h>
+
+
+/* Monotonic enough for coarse benchmarks, and C11 only. */
+static inline double bench_now(void)
+{
+	struct timespec ts;
+
+	timespec_get(&ts, TIME_UTC);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Prints the time per operation since start. */
+static inline void bench_report(const char *name, double start, size_t ops)
+{
+	double elapsed = bench_now() - start;
+
+	printf("%-40s %10zu ops %10.2f ms %8.2f ns/op\n",
+	       name, ops, elapsed * 1e3, elapsed * 1e9 / ops);
+}
+
+/* Prevents the compiler from optimizing out the benchmarked results. */
+static volatile size_t bench_sink;
+
+
+#endif
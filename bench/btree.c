@@ -0,0 +1,127 @@
+#include "../include/btree.h"
+#include "../include/map.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#define KEY_CAP 24
+
+
+/* Distinct keys in random order, fixed width so that their byte order is
+ * their numeric order. */
+static char *make_keys(size_t n)
+{
+	char *keys = malloc(n * KEY_CAP);
+
+	for (size_t i = 0; i < n; i++)
+		snprintf(&keys[i * KEY_CAP], KEY_CAP, "%016llx",
+			 (unsigned long long) i * 0x9e3779b97f4a7c15ull);
+
+	return keys;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+	char *keys = make_keys(n);
+	size_t *order = malloc(n * sizeof(size_t));
+
+	struct lf(map) m;
+	struct lf(btree) t;
+	struct lf(entry) e;
+	double start;
+
+	/* Lookups in an order of their own, unrelated to the order the nodes
+	 * are allocated in. */
+	srand(1);
+
+	for (size_t i = 0; i < n; i++)
+		order[i] = i;
+
+	for (size_t i = n - 1; i > 0; i--) {
+		size_t j = (size_t) rand() % (i + 1), tmp = order[i];
+
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+
+	lf(map_xinit)(&m, sizeof(size_t), NULL);
+	lf(btree_xinit)(&t, sizeof(size_t), NULL);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		lf(map_xinsert2)(&m, &keys[i * KEY_CAP], 16, &i);
+	bench_report("map insert", start, n);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		lf(btree_xinsert2)(&t, &keys[i * KEY_CAP], 16, &i);
+	bench_report("btree insert", start, n);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		bench_sink += *(size_t *) lf(map_get2)(&m, &keys[order[i] * KEY_CAP],
+						       16);
+	bench_report("map get, hit", start, n);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		bench_sink += *(size_t *) lf(btree_get2)(&t, &keys[order[i] * KEY_CAP],
+							 16);
+	bench_report("btree get, hit", start, n);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		bench_sink += *(size_t *) lf(map_select)(&m, order[i]).value;
+	bench_report("map select", start, n);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		bench_sink += *(size_t *) lf(btree_select)(&t, order[i]).value;
+	bench_report("btree select", start, n);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		bench_sink += lf(map_rank2)(&m, &keys[order[i] * KEY_CAP], 16);
+	bench_report("map rank", start, n);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		bench_sink += lf(btree_rank2)(&t, &keys[order[i] * KEY_CAP], 16);
+	bench_report("btree rank", start, n);
+
+	struct lf(map_it) mit;
+	struct lf(btree_it) it;
+
+	start = bench_now();
+	lf(map_iter)(&m, &mit);
+	while (lf(entry_is_valid)(e = lf(map_iter_next)(&mit)))
+		bench_sink += *(size_t *) e.value;
+	bench_report("map iterate", start, n);
+
+	start = bench_now();
+	lf(btree_iter)(&t, &it);
+	while (lf(entry_is_valid)(e = lf(btree_iter_next)(&it)))
+		bench_sink += *(size_t *) e.value;
+	bench_report("btree iterate", start, n);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		bench_sink += lf(map_remove2)(&m, &keys[order[i] * KEY_CAP], 16) != NULL;
+	bench_report("map remove", start, n);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		bench_sink += lf(btree_remove2)(&t, &keys[order[i] * KEY_CAP], 16)
+			!= NULL;
+	bench_report("btree remove", start, n);
+
+	lf(map_destroy)(&m);
+	lf(btree_destroy)(&t);
+	free(keys);
+	free(order);
+
+	return EXIT_SUCCESS;
+}
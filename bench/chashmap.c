@@ -0,0 +1,130 @@
+#include "../include/chashmap.h"
+#include "../include/hashmap.h"
+#include "bench.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+
+
+#define KEYSPACE (1 << 20)
+
+#define OPS_PER_THREAD 1000000
+
+
+struct worker {
+	int read_percent;
+	uint64_t rng;
+};
+
+static struct lf(chashmap) c;
+
+/* The baseline, a hashmap behind a single mutex. */
+static struct lf(hashmap) m;
+static mtx_t m_lock;
+
+
+static uint64_t next_key(struct worker *w)
+{
+	w->rng ^= w->rng << 13;
+	w->rng ^= w->rng >> 7;
+	w->rng ^= w->rng << 17;
+
+	return w->rng % KEYSPACE;
+}
+
+static int run_chashmap(void *arg)
+{
+	struct worker *w = arg;
+
+	for (size_t i = 0; i < OPS_PER_THREAD; i++) {
+		uint64_t key = next_key(w), value;
+
+		if ((int) ((w->rng >> 32) % 100) < w->read_percent) {
+			if (lf(chashmap_get2)(&c, &key, sizeof(key), &value))
+				bench_sink += value;
+		} else {
+			lf(chashmap_xupsert2)(&c, &key, sizeof(key), &key, NULL);
+		}
+	}
+
+	return 0;
+}
+
+static int run_locked(void *arg)
+{
+	struct worker *w = arg;
+
+	for (size_t i = 0; i < OPS_PER_THREAD; i++) {
+		uint64_t key = next_key(w);
+
+		mtx_lock(&m_lock);
+
+		if ((int) ((w->rng >> 32) % 100) < w->read_percent) {
+			uint64_t *value = lf(hashmap_get2)(&m, &key, sizeof(key));
+
+			if (value != NULL)
+				bench_sink += *value;
+		} else {
+			lf(hashmap_xupsert2)(&m, &key, sizeof(key), &key, NULL);
+		}
+
+		mtx_unlock(&m_lock);
+	}
+
+	return 0;
+}
+
+static void run(const char *name, thrd_start_t fn, int threads,
+		int read_percent)
+{
+	thrd_t t[threads];
+	struct worker w[threads];
+	char label[64];
+	double start = bench_now();
+
+	for (int i = 0; i < threads; i++) {
+		w[i] = (struct worker) { read_percent, 0x9e3779b97f4a7c15u + i };
+		thrd_create(&t[i], fn, &w[i]);
+	}
+
+	for (int i = 0; i < threads; i++)
+		thrd_join(t[i], NULL);
+
+	snprintf(label, sizeof(label), "%s, %d%% reads, %d threads",
+		 name, read_percent, threads);
+	bench_report(label, start, (size_t) threads * OPS_PER_THREAD);
+}
+
+/* Reports the throughput of 1 to N threads, doubling, for 95/5 and 50/50
+ * read/write mixes. */
+int main(int argc, char *argv[])
+{
+	int max_threads = argc > 1 ? atoi(argv[1]) : 8;
+	int mixes[] = { 95, 50 };
+
+	lf(chashmap_xinit)(&c, sizeof(uint64_t), NULL, 0);
+	lf(hashmap_xinit)(&m, sizeof(uint64_t), NULL, 0);
+	mtx_init(&m_lock, mtx_plain);
+
+	/* Half of the keys exist before the runs. */
+	for (uint64_t key = 0; key < KEYSPACE; key += 2) {
+		lf(chashmap_xupsert2)(&c, &key, sizeof(key), &key, NULL);
+		lf(hashmap_xinsert2)(&m, &key, sizeof(key), &key);
+	}
+
+	for (size_t i = 0; i < sizeof(mixes) / sizeof(*mixes); i++) {
+		for (int threads = 1; threads <= max_threads; threads *= 2) {
+			run("chashmap", run_chashmap, threads, mixes[i]);
+			run("locked hashmap", run_locked, threads,
+			    mixes[i]);
+		}
+	}
+
+	mtx_destroy(&m_lock);
+	lf(hashmap_destroy)(&m);
+	lf(chashmap_destroy)(&c);
+
+	return EXIT_SUCCESS;
+}
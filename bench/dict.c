@@ -0,0 +1,68 @@
+#include "../include/dict.h"
+#include "../include/hashmap.h"
+#include "bench.h"
+
+#include <stdlib.h>
+
+
+/* Iterates a hashmap and a dict that grew to n entries and then shrank to
+ * n / 64 of them through removals. */
+int main(int argc, char *argv[])
+{
+	size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+	size_t rounds = 1000;
+
+	struct lf(hashmap) m;
+	struct lf(dict) d;
+	double start;
+
+	lf(hashmap_xinit)(&m, sizeof(size_t), NULL, 0);
+	lf(dict_xinit)(&d, sizeof(size_t), NULL);
+
+	for (size_t i = 0; i < n; i++) {
+		lf(hashmap_xinsert2)(&m, &i, sizeof(i), &i);
+		lf(dict_xinsert2)(&d, &i, sizeof(i), &i);
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		if (i % 64 == 0)
+			continue;
+
+		bench_sink += lf(hashmap_remove2)(&m, &i, sizeof(i)) != NULL;
+		bench_sink += lf(dict_remove2)(&d, &i, sizeof(i)) != NULL;
+	}
+
+	struct lf(hashmap_it) hit;
+	struct lf(dict_it) dit;
+	struct lf(entry) e;
+
+	start = bench_now();
+	for (size_t r = 0; r < rounds; r++) {
+		lf(hashmap_iter)(&m, &hit);
+
+		while (lf(entry_is_valid)(e = lf(hashmap_iter_next)(&hit)))
+			bench_sink += *(size_t *) e.value;
+	}
+	bench_report("hashmap iterate, after removals", start,
+		     rounds * ((n + 63) / 64));
+
+	start = bench_now();
+	for (size_t r = 0; r < rounds; r++) {
+		lf(dict_iter)(&d, &dit);
+
+		while (lf(entry_is_valid)(e = lf(dict_iter_next)(&dit)))
+			bench_sink += *(size_t *) e.value;
+	}
+	bench_report("dict iterate, after removals", start,
+		     rounds * ((n + 63) / 64));
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		bench_sink += lf(dict_get2)(&d, &i, sizeof(i)) != NULL;
+	bench_report("dict get, hit and miss", start, n);
+
+	lf(hashmap_destroy)(&m);
+	lf(dict_destroy)(&d);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,159 @@
+#include "../include/hashmap.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define KEY_CAP 96
+
+#define BATCH 256
+
+
+/* URL-like keys sharing long prefixes. */
+static char *make_keys(size_t n, const char *fmt, size_t *keylens)
+{
+	char *keys = malloc(n * KEY_CAP);
+
+	for (size_t i = 0; i < n; i++)
+		keylens[i] = snprintf(&keys[i * KEY_CAP], KEY_CAP, fmt,
+				      (unsigned) (i * 2654435761u), i);
+
+	return keys;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+
+	size_t *keylens = malloc(n * sizeof(size_t));
+	size_t *misslens = malloc(n * sizeof(size_t));
+	char *keys = make_keys(n, "https://example.com/api/v1/objects/%08x/"
+				  "revisions/%zu", keylens);
+	char *misses = make_keys(n, "https://example.com/api/v1/objects/%08x/"
+				    "revision/%zu", misslens);
+
+	struct lf(hashmap) m;
+	double start;
+
+	lf(hashmap_xinit)(&m, sizeof(size_t), NULL, 0);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		lf(hashmap_xinsert2)(&m, &keys[i * KEY_CAP], keylens[i], &i);
+	bench_report("insert (with rehashes)", start, n);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		bench_sink += *(size_t *) lf(hashmap_get2)(&m, &keys[i * KEY_CAP],
+							   keylens[i]);
+	bench_report("get, hit", start, n);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		bench_sink += lf(hashmap_get2)(&m, &misses[i * KEY_CAP],
+					       misslens[i]) != NULL;
+	bench_report("get, miss", start, n);
+
+	/* Random order, so that consecutive lookups do not share cache
+	 * lines. */
+	const void **order = malloc(n * sizeof(void *));
+	size_t *orderlens = malloc(n * sizeof(size_t));
+	void **values = malloc(BATCH * sizeof(void *));
+
+	for (size_t i = 0; i < n; i++) {
+		size_t j = (i * 2654435761u) % n;
+
+		order[i] = &keys[j * KEY_CAP];
+		orderlens[i] = keylens[j];
+	}
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		bench_sink += *(size_t *) lf(hashmap_get2)(&m, order[i],
+							   orderlens[i]);
+	bench_report("get, hit, random order", start, n);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i += BATCH) {
+		size_t len = n - i < BATCH ? n - i : BATCH;
+
+		lf(hashmap_get_many)(&m, len, &order[i], &orderlens[i], values);
+
+		for (size_t k = 0; k < len; k++)
+			bench_sink += *(size_t *) values[k];
+	}
+	bench_report("get_many, hit, random order", start, n);
+
+	free(order);
+	free(orderlens);
+	free(values);
+
+	/* Opening a snapshot maps it instead of rebuilding the table. */
+	struct lf(hashmap) mapped;
+
+	start = bench_now();
+	if (lf(hashmap_save)(&m, "hashmap.bench.snapshot"))
+		return EXIT_FAILURE;
+	bench_report("save", start, n);
+
+	start = bench_now();
+	if (lf(hashmap_open_mapped)(&mapped, "hashmap.bench.snapshot", NULL))
+		return EXIT_FAILURE;
+	bench_report("open_mapped", start, 1);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		bench_sink += *(size_t *) lf(hashmap_get2)(&mapped,
+							   &keys[i * KEY_CAP],
+							   keylens[i]);
+	bench_report("get, hit, mapped", start, n);
+
+	lf(hashmap_destroy)(&mapped);
+	remove("hashmap.bench.snapshot");
+
+	/* Cleared and refilled with the table reserved up front, the inserts
+	 * neither rehash nor allocate, apart from the long keys. */
+	lf(hashmap_clear)(&m);
+	lf(hashmap_xreserve)(&m, n);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		lf(hashmap_xinsert2)(&m, &keys[i * KEY_CAP], keylens[i], &i);
+	bench_report("insert (reserved)", start, n);
+
+	lf(hashmap_destroy)(&m);
+
+	/* Worst single insert latency, dominated by the rehashes. */
+	for (int incremental = 0; incremental < 2; incremental++) {
+		double worst = 0;
+
+		lf(hashmap_xinit)(&m, sizeof(size_t), NULL,
+				  incremental ? LF_HASHMAP_INCREMENTAL : 0);
+
+		start = bench_now();
+		for (size_t i = 0; i < n; i++) {
+			double t = bench_now();
+
+			lf(hashmap_xinsert2)(&m, &keys[i * KEY_CAP], keylens[i],
+					     &i);
+
+			if (bench_now() - t > worst)
+				worst = bench_now() - t;
+		}
+		bench_report(incremental ? "insert, incremental rehashing" :
+					   "insert, timed one by one",
+			     start, n);
+		printf("%-40s %29.2f ms\n", "  worst single insert", worst * 1e3);
+
+		lf(hashmap_destroy)(&m);
+	}
+
+	free(keys);
+	free(misses);
+	free(keylens);
+	free(misslens);
+
+	return EXIT_SUCCESS;
+}
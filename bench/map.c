@@ -0,0 +1,173 @@
+#include "../include/map.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static int cmp_bytes(const void *a, const void *b, size_t alen, size_t blen)
+{
+	int res = memcmp(a, b, alen < blen ? alen : blen);
+
+	return res != 0 ? res : (alen > blen) - (alen < blen);
+}
+
+/* Node allocation heavy map operations: filling the map, replacing half of
+ * its entries and destroying it. Also lookups, range queries, splits and
+ * loading sorted keys. */
+int main(int argc, char *argv[])
+{
+	size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+
+	struct lf(map) m;
+	double start;
+
+	lf(map_xinit)(&m, sizeof(size_t), NULL);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++) {
+		size_t key = i * 0x9e3779b97f4a7c15ull;
+
+		lf(map_xinsert2)(&m, &key, sizeof(key), &i);
+	}
+	bench_report("map insert", start, n);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i += 2) {
+		size_t key = i * 0x9e3779b97f4a7c15ull;
+
+		bench_sink += lf(map_remove2)(&m, &key, sizeof(key)) != NULL;
+
+		key = (i + n) * 0x9e3779b97f4a7c15ull;
+		lf(map_xinsert2)(&m, &key, sizeof(key), &i);
+	}
+	bench_report("map remove and insert", start, n);
+
+	start = bench_now();
+	for (size_t i = 1; i < n; i += 2) {
+		size_t key = i * 0x9e3779b97f4a7c15ull;
+
+		bench_sink += *(size_t *) lf(map_get2)(&m, &key, sizeof(key));
+	}
+	bench_report("map get, hit", start, n / 2);
+
+	start = bench_now();
+	for (size_t i = 1; i < n; i += 2) {
+		size_t key = i * 0x9e3779b97f4a7c15ull;
+		struct lf(map_it) it;
+
+		lf(map_lower_bound2)(&m, &it, &key, sizeof(key));
+		bench_sink += lf(map_iter_next)(&it).keylen;
+	}
+	bench_report("map lower_bound", start, n / 2);
+
+	start = bench_now();
+	for (size_t i = 1; i < n; i += 2) {
+		size_t lo = i * 0x9e3779b97f4a7c15ull;
+		size_t hi = lo ^ 0xff00000000000000ull;
+
+		bench_sink += lf(map_count_range2)(&m, &lo, sizeof(lo),
+						   &hi, sizeof(hi));
+	}
+	bench_report("map count_range", start, n / 2);
+
+	size_t rounds = 10000;
+
+	start = bench_now();
+	for (size_t i = 1; i < rounds * 2; i += 2) {
+		size_t key = i * 0x9e3779b97f4a7c15ull;
+		struct lf(map) right;
+
+		lf(map_xsplit2)(&m, &key, sizeof(key), &right);
+		lf(map_xjoin)(&m, &right);
+		lf(map_destroy)(&right);
+	}
+	bench_report("map split and join", start, rounds);
+
+	start = bench_now();
+	lf(map_destroy)(&m);
+	bench_report("map destroy", start, n);
+
+	/* String keys in a map fitting the cache, where the comparisons
+	 * rather than the memory loads take the time. */
+	size_t small = 1 << 16;
+	char (*strs)[24] = malloc(sizeof(*strs) * small);
+
+	lf(map_xinit)(&m, 0, NULL);
+
+	for (size_t i = 0; i < small; i++) {
+		snprintf(strs[i], sizeof(strs[i]), "%016zx",
+			 (size_t) (i * 0x9e3779b97f4a7c15ull));
+		lf(map_xinsert)(&m, strs[i], NULL);
+	}
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		bench_sink += lf(map_get)(&m, strs[i * 7919 % small]) != NULL;
+	bench_report("map get, string keys", start, n);
+
+	lf(map_destroy)(&m);
+	free(strs);
+
+	/* Bulk load of sorted keys, against inserting them one by one. */
+	size_t *sorted = malloc(sizeof(*sorted) * n);
+	const void **keys = malloc(sizeof(*keys) * n);
+	size_t *keylens = malloc(sizeof(*keylens) * n);
+
+	for (size_t i = 0; i < n; i++) {
+		/* Big-endian, so that the default comparison sorts them by
+		 * value. */
+		sorted[i] = __builtin_bswap64(i);
+		keys[i] = &sorted[i];
+		keylens[i] = sizeof(sorted[i]);
+	}
+
+	lf(map_xinit)(&m, sizeof(size_t), NULL);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		lf(map_xinsert2)(&m, keys[i], keylens[i], NULL);
+	bench_report("map insert, sorted", start, n);
+
+	lf(map_destroy)(&m);
+	lf(map_xinit)(&m, sizeof(size_t), NULL);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		lf(map_xinsert_hint2)(&m, NULL, keys[i], keylens[i], NULL);
+	bench_report("map insert_hint, sorted", start, n);
+
+	/* The same with a comparator, which hinted inserts call once per key
+	 * instead of once per level. */
+	lf(map_destroy)(&m);
+	lf(map_xinit)(&m, sizeof(size_t), cmp_bytes);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		lf(map_xinsert2)(&m, keys[i], keylens[i], NULL);
+	bench_report("map insert, sorted, comparator", start, n);
+
+	lf(map_destroy)(&m);
+	lf(map_xinit)(&m, sizeof(size_t), cmp_bytes);
+
+	start = bench_now();
+	for (size_t i = 0; i < n; i++)
+		lf(map_xinsert_hint2)(&m, NULL, keys[i], keylens[i], NULL);
+	bench_report("map insert_hint, sorted, comparator", start, n);
+
+	lf(map_destroy)(&m);
+	lf(map_xinit)(&m, sizeof(size_t), NULL);
+
+	start = bench_now();
+	lf(map_xbuild_sorted2)(&m, keys, keylens, NULL, n);
+	bench_report("map build_sorted", start, n);
+
+	lf(map_destroy)(&m);
+
+	free(sorted);
+	free(keys);
+	free(keylens);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,185 @@
+#include "../include/map.h"
+#include "../include/pmap.h"
+#include "bench.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+
+
+#define KEYS (1 << 18)
+
+#define READS_PER_THREAD 1000000
+
+
+static struct lf(pmap) p;
+
+/* The baseline, a map behind a single mutex. */
+static struct lf(map) m;
+static mtx_t m_lock;
+
+static atomic_bool done;
+
+
+static uint64_t key_at(uint64_t i)
+{
+	return i * 0x9e3779b97f4a7c15u;
+}
+
+/* Keys are looked up in another order than they are inserted in, as the
+ * nodes of the map are laid out in insertion order. */
+static uint64_t probe_at(uint64_t i)
+{
+	return key_at(i * 7919 % KEYS);
+}
+
+static int read_pmap(void *arg)
+{
+	struct lf(pmap_reader) *r = lf(pmap_reader_new)(&p);
+
+	(void) arg;
+
+	if (r == NULL)
+		return 1;
+
+	for (uint64_t i = 0; i < READS_PER_THREAD; i++) {
+		uint64_t key = probe_at(i);
+		struct lf(pmap_snapshot) s = lf(pmap_read_begin)(r);
+		const uint64_t *v = lf(pmap_get2)(s, &key, sizeof(key));
+
+		bench_sink += v ? *v : 0;
+		lf(pmap_read_end)(r);
+	}
+
+	lf(pmap_reader_release)(r);
+
+	return 0;
+}
+
+static int read_locked(void *arg)
+{
+	(void) arg;
+
+	for (uint64_t i = 0; i < READS_PER_THREAD; i++) {
+		uint64_t key = probe_at(i);
+
+		mtx_lock(&m_lock);
+
+		uint64_t *v = lf(map_get2)(&m, &key, sizeof(key));
+
+		bench_sink += v ? *v : 0;
+		mtx_unlock(&m_lock);
+	}
+
+	return 0;
+}
+
+/* Rewrites the values until the readers are done. */
+static int write_pmap(void *arg)
+{
+	(void) arg;
+
+	for (uint64_t i = 0; !atomic_load(&done); i++) {
+		uint64_t key = key_at(i % KEYS);
+
+		lf(pmap_xupsert2)(&p, &key, sizeof(key), &i, NULL);
+	}
+
+	return 0;
+}
+
+static int write_locked(void *arg)
+{
+	(void) arg;
+
+	for (uint64_t i = 0; !atomic_load(&done); i++) {
+		uint64_t key = key_at(i % KEYS);
+
+		mtx_lock(&m_lock);
+		*(uint64_t *) lf(map_get2)(&m, &key, sizeof(key)) = i;
+		mtx_unlock(&m_lock);
+	}
+
+	return 0;
+}
+
+static void run(const char *name, thrd_start_t reader, thrd_start_t writer,
+		int threads)
+{
+	thrd_t t[threads], w;
+	char label[64];
+	double start = bench_now();
+
+	atomic_store(&done, false);
+	thrd_create(&w, writer, NULL);
+
+	for (int i = 0; i < threads; i++)
+		thrd_create(&t[i], reader, NULL);
+
+	for (int i = 0; i < threads; i++)
+		thrd_join(t[i], NULL);
+
+	atomic_store(&done, true);
+	thrd_join(w, NULL);
+
+	snprintf(label, sizeof(label), "%s, %d readers", name, threads);
+	bench_report(label, start, (size_t) threads * READS_PER_THREAD);
+}
+
+/* The cost of path copying for the writer, and the read throughput of 1 to N
+ * threads, doubling, while a writer updates the map. */
+int main(int argc, char *argv[])
+{
+	int max_threads = argc > 1 ? atoi(argv[1]) : 8;
+	double start;
+
+	lf(pmap_xinit)(&p, sizeof(uint64_t), NULL);
+	lf(map_xinit)(&m, sizeof(uint64_t), NULL);
+	mtx_init(&m_lock, mtx_plain);
+
+	start = bench_now();
+	for (uint64_t i = 0; i < KEYS; i++) {
+		uint64_t key = key_at(i);
+
+		lf(map_xinsert2)(&m, &key, sizeof(key), &i);
+	}
+	bench_report("map insert", start, KEYS);
+
+	start = bench_now();
+	for (uint64_t i = 0; i < KEYS; i++) {
+		uint64_t key = key_at(i);
+
+		lf(pmap_xupsert2)(&p, &key, sizeof(key), &i, NULL);
+	}
+	bench_report("pmap upsert", start, KEYS);
+
+	start = bench_now();
+	for (uint64_t i = 0; i < KEYS; i++) {
+		uint64_t key = probe_at(i);
+
+		bench_sink += *(uint64_t *) lf(map_get2)(&m, &key, sizeof(key));
+	}
+	bench_report("map get", start, KEYS);
+
+	start = bench_now();
+	for (uint64_t i = 0; i < KEYS; i++) {
+		uint64_t key = probe_at(i);
+
+		bench_sink += *(const uint64_t *)
+			lf(pmap_get2)(lf(pmap_current)(&p), &key, sizeof(key));
+	}
+	bench_report("pmap get", start, KEYS);
+
+	for (int threads = 1; threads <= max_threads; threads *= 2) {
+		run("pmap get", read_pmap, write_pmap, threads);
+		run("locked map get", read_locked, write_locked, threads);
+	}
+
+	mtx_destroy(&m_lock);
+	lf(map_destroy)(&m);
+	lf(pmap_destroy)(&p);
+
+	return EXIT_SUCCESS;
+}
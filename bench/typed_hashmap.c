@@ -0,0 +1,85 @@
+#include "../include/hashmap.h"
+#include "../include/intmap.h"
+#include "../include/typed_hashmap.h"
+#include "bench.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+
+static uint64_t hash_id(uint64_t id)
+{
+	id ^= id >> 33;
+	id *= 0xff51afd7ed558ccdu;
+	id ^= id >> 33;
+
+	return id;
+}
+
+#define eq_id(a, b) ((a) == (b))
+
+LF_TYPED_HASHMAP(id_map, uint64_t, uint64_t, hash_id, eq_id)
+
+
+/* The same integer keys and values in a hashmap, in a typed hashmap and in
+ * a u64map. */
+int main(int argc, char *argv[])
+{
+	size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+
+	struct lf(hashmap) m;
+	struct lf(id_map) t;
+	struct lf(u64map) u;
+	double start;
+
+	lf(hashmap_xinit)(&m, sizeof(uint64_t), NULL, 0);
+
+	if (lf(id_map_init)(&t) || lf(u64map_init)(&u, sizeof(uint64_t)))
+		return EXIT_FAILURE;
+
+	start = bench_now();
+	for (uint64_t i = 0; i < n; i++)
+		lf(hashmap_xinsert2)(&m, &i, sizeof(i), &i);
+	bench_report("hashmap insert", start, n);
+
+	start = bench_now();
+	for (uint64_t i = 0; i < n; i++)
+		if (!lf(id_map_insert)(&t, i, i))
+			return EXIT_FAILURE;
+	bench_report("typed hashmap insert", start, n);
+
+	start = bench_now();
+	for (uint64_t i = 0; i < n; i++)
+		lf(u64map_xinsert)(&u, i, &i);
+	bench_report("u64map insert", start, n);
+
+	start = bench_now();
+	for (uint64_t i = 0; i < 2 * n; i++) {
+		uint64_t *v = lf(hashmap_get2)(&m, &i, sizeof(i));
+
+		bench_sink += v ? *v : 0;
+	}
+	bench_report("hashmap get, hit and miss", start, 2 * n);
+
+	start = bench_now();
+	for (uint64_t i = 0; i < 2 * n; i++) {
+		uint64_t *v = lf(id_map_get)(&t, i);
+
+		bench_sink += v ? *v : 0;
+	}
+	bench_report("typed hashmap get, hit and miss", start, 2 * n);
+
+	start = bench_now();
+	for (uint64_t i = 0; i < 2 * n; i++) {
+		uint64_t *v = lf(u64map_get)(&u, i);
+
+		bench_sink += v ? *v : 0;
+	}
+	bench_report("u64map get, hit and miss", start, 2 * n);
+
+	lf(hashmap_destroy)(&m);
+	lf(id_map_destroy)(&t);
+	lf(u64map_destroy)(&u);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+#include "../include/map.h"
+#include "../include/typed_map.h"
+#include "bench.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+
+#define less_id(a, b) ((a) < (b))
+
+LF_TYPED_MAP(id_tree, uint64_t, uint64_t, less_id)
+
+static int cmp_id(const void *a, const void *b, size_t alen, size_t blen)
+{
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+
+	(void) alen;
+	(void) blen;
+
+	return (x > y) - (x < y);
+}
+
+
+/* The same integer keys and values in a map, ordered by a comparator, and in
+ * a typed map. Keys are scrambled, so that they are not inserted in order. */
+int main(int argc, char *argv[])
+{
+	size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+
+	struct lf(map) m;
+	struct lf(id_tree) t;
+	double start;
+
+	lf(map_xinit)(&m, sizeof(uint64_t), cmp_id);
+
+	if (lf(id_tree_init)(&t))
+		return EXIT_FAILURE;
+
+	start = bench_now();
+	for (uint64_t i = 0; i < n; i++) {
+		uint64_t key = i * 0x9e3779b97f4a7c15u;
+
+		lf(map_xinsert2)(&m, &key, sizeof(key), &i);
+	}
+	bench_report("map insert", start, n);
+
+	start = bench_now();
+	for (uint64_t i = 0; i < n; i++)
+		if (!lf(id_tree_insert)(&t, i * 0x9e3779b97f4a7c15u, i))
+			return EXIT_FAILURE;
+	bench_report("typed map insert", start, n);
+
+	start = bench_now();
+	for (uint64_t i = 0; i < 2 * n; i++) {
+		uint64_t key = i * 0x9e3779b97f4a7c15u;
+		uint64_t *v = lf(map_get2)(&m, &key, sizeof(key));
+
+		bench_sink += v ? *v : 0;
+	}
+	bench_report("map get, hit and miss", start, 2 * n);
+
+	start = bench_now();
+	for (uint64_t i = 0; i < 2 * n; i++) {
+		uint64_t *v = lf(id_tree_get)(&t, i * 0x9e3779b97f4a7c15u);
+
+		bench_sink += v ? *v : 0;
+	}
+	bench_report("typed map get, hit and miss", start, 2 * n);
+
+	start = bench_now();
+	for (uint64_t i = 0; i < n; i++) {
+		uint64_t key = i * 0x9e3779b97f4a7c15u;
+
+		bench_sink += lf(map_rank2)(&m, &key, sizeof(key));
+	}
+	bench_report("map rank", start, n);
+
+	start = bench_now();
+	for (uint64_t i = 0; i < n; i++)
+		bench_sink += lf(id_tree_rank)(&t, i * 0x9e3779b97f4a7c15u);
+	bench_report("typed map rank", start, n);
+
+	start = bench_now();
+	for (uint64_t i = 0; i < n; i++) {
+		uint64_t key = i * 0x9e3779b97f4a7c15u;
+
+		bench_sink += lf(map_remove2)(&m, &key, sizeof(key)) != NULL;
+	}
+	bench_report("map remove", start, n);
+
+	start = bench_now();
+	for (uint64_t i = 0; i < n; i++)
+		bench_sink += lf(id_tree_remove)(&t, i * 0x9e3779b97f4a7c15u,
+						 NULL);
+	bench_report("typed map remove", start, n);
+
+	lf(map_destroy)(&m);
+	lf(id_tree_destroy)(&t);
+
+	return EXIT_SUCCESS;
+}
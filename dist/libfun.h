@@ -0,0 +1,7986 @@
+#define LF_HEADERONLY
+/**
+ * @file config.h
+ * @brief Library-wide configuration.
+ */
+
+#ifndef LF_HASHMAP_INITIAL_CAP
+/** @brief Initial capacity of the hashmap. Must be a power of two, not less
+ * than 16. */
+#define LF_HASHMAP_INITIAL_CAP 64
+#endif
+
+#ifndef LF_HASHMAP_MAX_LOAD
+/** @brief Default maximum load factor of the hashmap, see
+ * hashmap_set_max_load(). */
+#define LF_HASHMAP_MAX_LOAD 0.75
+#endif
+
+#ifndef LF_HASHMAP_INLINE_KEY_SIZE
+/**
+ * @brief Keys up to this size are stored inside the hashmap and dict entries,
+ * and the btree nodes, without a separate allocation.
+ *
+ * Changes the layout of the hashmap, the library and its users must be
+ * compiled with the same value.
+ */
+#define LF_HASHMAP_INLINE_KEY_SIZE 16
+#endif
+
+#ifndef LF_HASHMAP_STATS_HISTOGRAM_SIZE
+/** @brief Number of buckets in the probe length histogram of
+ * hashmap_stats(). */
+#define LF_HASHMAP_STATS_HISTOGRAM_SIZE 8
+#endif
+
+#ifdef LF_DOXYGEN
+/**
+ * @brief If defined, hashmaps count their lookups, misses, probes and
+ * rehashes, reported by hashmap_stats().
+ *
+ * Not defined by default. Changes the layout of the hashmap, the library and
+ * its users must be compiled with the same value. The counters are not
+ * updated atomically, and must not be enabled for a chashmap read by multiple
+ * threads.
+ */
+#define LF_HASHMAP_COUNTERS
+#endif
+
+#ifndef LF_HASHMAP_MIGRATE_STEP
+/** @brief Number of old table slots migrated by each insert or remove
+ * operation during incremental rehashing of a hashmap. */
+#define LF_HASHMAP_MIGRATE_STEP 32
+#endif
+
+#ifndef LF_CHASHMAP_STRIPES
+/** @brief Number of stripes, each with its own lock, of the concurrent
+ * hashmap. Must be a power of two. */
+#define LF_CHASHMAP_STRIPES 64
+#endif
+
+#ifndef LF_DICT_INITIAL_CAP
+/** @brief Initial number of index slots of the dict. Must be a power of two,
+ * not less than 8. */
+#define LF_DICT_INITIAL_CAP 8
+#endif
+
+#ifndef LF_ARENA_INITIAL_BLOCK_SIZE
+/** @brief Size of the first block of the arena, in bytes. */
+#define LF_ARENA_INITIAL_BLOCK_SIZE 4096
+#endif
+
+#ifndef LF_ARENA_MAX_BLOCK_SIZE
+/** @brief Maximum size of the arena blocks, in bytes. Larger allocations get
+ * blocks of their own size. */
+#define LF_ARENA_MAX_BLOCK_SIZE (1 << 20)
+#endif
+
+#ifndef LF_MAP_POOL_MAX_NODE_SIZE
+/**
+ * @brief Map nodes up to this size, in bytes, are allocated from the slabs of
+ * the map. Must be a multiple of 16.
+ *
+ * Changes the layout of the map, the library and its users must be compiled
+ * with the same value.
+ */
+#define LF_MAP_POOL_MAX_NODE_SIZE 256
+#endif
+
+#ifndef LF_MAP_MAX_SLAB_SIZE
+/** @brief Maximum size of the map slabs, in bytes. Each slab is twice the
+ * size of the previous one, up to this size. */
+#define LF_MAP_MAX_SLAB_SIZE (1 << 20)
+#endif
+
+#ifndef LF_BTREE_DEGREE
+/**
+ * @brief Minimum degree of the btree, nodes hold up to `2 * LF_BTREE_DEGREE -
+ * 1` keys. Must be between 2 and 128.
+ *
+ * Changes the layout of the btree, the library and its users must be
+ * compiled with the same value.
+ */
+#define LF_BTREE_DEGREE 8
+#endif
+
+#ifndef LF_STACK_INITIAL_CAP
+/** @brief Initial capacity of the stack. */
+#define LF_STACK_INITIAL_CAP 64
+#endif
+
+/** Public function prefixing */
+#ifndef LIBFUN_PREFIX
+/** @brief Function prefix. */
+#define LIBFUN_PREFIX f
+#endif
+
+#ifndef lf
+/** @cond */
+#define lfi_concat_inner(prefix, name) prefix ## name
+#define lfi_concat(prefix, name) lfi_concat_inner(prefix, name)
+/** @endcond */
+
+/* libfun public symbols. */
+#define lf(name) lfi_concat(LIBFUN_PREFIX, name)
+#endif
+
+
+/** @cond */
+#ifndef lfi_wur
+#if defined(__GNUC__) || defined(__clang__)
+#define lfi_wur __attribute__((warn_unused_result))
+#else
+#define lfi_wur
+#endif
+#endif
+
+#ifndef lfi
+/* Internal function declaration & name prefixing. */
+#define lfi(name) lf(_libfun_internal_ ## name)
+
+#define lfi_fdecl(ret_ty, name) static ret_ty lfi(name)
+#endif
+/** @endcond */
+/**
+ * @file common.h
+ * @brief Library-wide common types.
+ */
+
+#ifndef LF_COMMON_H
+#define LF_COMMON_H
+
+#ifndef LF_HEADERONLY
+#include "config.h"
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/** @brief Key-value pair stored in the hashmap, entry. */
+struct lf(entry) {
+	/** Key, the unique identifier pointing to the value. */
+	const void *key;
+
+	/** Length of the key. */
+	size_t keylen;
+
+	/** The value assigned to the key by the user. */
+	void *value;
+};
+
+
+/** @brief Returns false if the entry is sentinel or invalid. */
+static inline bool lf(entry_is_valid)(struct lf(entry) entry)
+{
+	return entry.key != NULL;
+}
+
+
+#endif
+/**
+ * @file allocator.h
+ * @brief Pluggable memory allocators.
+ *
+ * stack, hashmap, map and btree take their memory from the allocator given to
+ * their `*_init_with` functions, so they can be placed in arenas, pools or any
+ * other memory than the libc heap. Their `*_init` functions use allocator_libc.
+ *
+ * arena is a bump allocator. Its allocations are carved from large blocks and
+ * never released one by one; destroying the arena releases its blocks at
+ * once. A container allocated in an arena does not need to be destroyed, so a
+ * request-scoped map is torn down without visiting its nodes or keys.
+ */
+
+#ifndef LF_ALLOCATOR_H
+#define LF_ALLOCATOR_H
+
+#ifndef LF_HEADERONLY
+#include "common.h"
+#endif
+
+#include <stddef.h>
+
+
+/**
+ * @brief Memory allocator.
+ *
+ * Allocations must be aligned for any type, as with malloc(). The sizes of
+ * the allocations are passed back on realloc and free, so allocators do not
+ * need to track them.
+ */
+struct lf(allocator) {
+	/** Allocates `size` bytes, returns `NULL` on failure. */
+	void *(*alloc)(void *ctx, size_t size);
+
+	/** Resizes the allocation of `old_size` bytes at `ptr` to `size` bytes,
+	 * as realloc(). Returns `NULL` on failure, leaving the allocation
+	 * intact. */
+	void *(*realloc)(void *ctx, void *ptr, size_t old_size, size_t size);
+
+	/** Releases the allocation of `size` bytes at `ptr`, never `NULL`. */
+	void (*free)(void *ctx, void *ptr, size_t size);
+
+	/** Passed to the functions above. */
+	void *ctx;
+};
+
+/** @brief Allocator using malloc(), realloc() and free(). */
+extern const struct lf(allocator) lf(allocator_libc);
+
+/** @brief Bump allocator, allocations are released with the arena. */
+struct lf(arena) {
+	/** @cond */
+	struct lfi(arena_block) *blocks;
+
+	/* Free space of the current block. */
+	char *top;
+	char *end;
+
+	/* Start of the latest allocation, which can be resized or released in
+	 * place. NULL if none. */
+	char *last;
+
+	/* Size of the next block. */
+	size_t block_size;
+	/** @endcond */
+};
+
+/** @cond */
+struct lfi(arena_block) {
+	struct lfi(arena_block) *next;
+	size_t size;
+	max_align_t data[];
+};
+/** @endcond */
+
+
+/**
+ * @brief Creates a new arena.
+ *
+ * Allocates the first block of `LF_ARENA_INITIAL_BLOCK_SIZE` bytes. Each
+ * following block is twice the size of the previous one, up to
+ * `LF_ARENA_MAX_BLOCK_SIZE`, or as large as the allocation it is made for.
+ *
+ * Returns non-zero if a memory allocation failure occurs.
+ */
+int lf(arena_init)(struct lf(arena) *arena) lfi_wur;
+
+/** @brief Identical to arena_init(), but raises an error if memory allocation
+ * fails. */
+void lf(arena_xinit)(struct lf(arena) *arena);
+
+/**
+ * @brief Releases the blocks of the arena, and all allocations made from it.
+ *
+ * Takes time proportional to the number of blocks, not the number of
+ * allocations.
+ */
+void lf(arena_destroy)(struct lf(arena) *arena);
+
+/**
+ * @brief Releases all allocations made from the arena, keeping its latest
+ * block for the following allocations.
+ */
+void lf(arena_reset)(struct lf(arena) *arena);
+
+/**
+ * @brief Allocates `size` bytes from the arena.
+ *
+ * Returns `NULL` if a memory allocation failure occurs.
+ */
+void *lf(arena_alloc)(struct lf(arena) *arena, size_t size) lfi_wur;
+
+/** @brief Identical to arena_alloc(), but raises an error if memory
+ * allocation fails. */
+void *lf(arena_xalloc)(struct lf(arena) *arena, size_t size);
+
+/**
+ * @brief Returns an allocator allocating from the arena.
+ *
+ * Releasing an allocation only reclaims its memory if it is the latest one,
+ * likewise resizing is done in place only for the latest allocation.
+ *
+ * @warning The arena must outlive the containers using the allocator.
+ */
+struct lf(allocator) lf(arena_allocator)(struct lf(arena) *arena);
+
+
+#endif
+/**
+ * @file stack.h
+ * @brief Basic stack.
+ *
+ * Generally, stacks do not allow random access; an element in the stack is not
+ * accessed by its index. Strict stack implementations only allow access to the
+ * top element (`pop`/`peek`); they even hide the total number of elements and
+ * only provide a function indicating whether the stack is empty.
+ *
+ * This stack implementation is more flexible:
+ * - You can get a reference to any element.
+ * - You can get the total number of elements.
+ *
+ * However, you can still only push to and pop from the top of the stack.
+ */
+
+#ifndef LF_STACK_H
+#define LF_STACK_H
+
+#ifndef LF_HEADERONLY
+#include "allocator.h"
+#include "common.h"
+#endif
+
+#include <stddef.h>
+
+
+/** @brief stack. */
+struct lf(stack) {
+    /** @cond */
+    char *data;
+    size_t cap;
+    size_t len;
+    size_t item_size;
+    struct lf(allocator) allocator;
+    /** @endcond */
+};
+
+
+/**
+ * @brief Creates a new stack.
+ *
+ * Allocates the necessary memory for the stack. The `item_size` parameter
+ * specifies the size of the elements the user will add.
+ *
+ * Returns non-zero if a memory allocation failure occurs.
+ */
+int lf(stack_init)(struct lf(stack) *stack, size_t item_size) lfi_wur;
+
+/** @brief Identical to stack_init(), but raises an error if memory allocation
+ * fails. */
+void lf(stack_xinit)(struct lf(stack) *stack, size_t value_size);
+
+/**
+ * @brief Identical to stack_init(), but takes the memory of the stack from the
+ * `allocator`.
+ *
+ * The allocator is copied into the stack. Defaults to allocator_libc if
+ * `NULL`.
+ *
+ * @see allocator.h
+ */
+int lf(stack_init_with)(struct lf(stack) *stack,
+			size_t item_size,
+			const struct lf(allocator) *allocator) lfi_wur;
+
+/** @brief Identical to stack_init_with(), but raises an error if memory
+ * allocation fails. */
+void lf(stack_xinit_with)(struct lf(stack) *stack,
+			  size_t item_size,
+			  const struct lf(allocator) *allocator);
+
+/** @brief Clears the memory allocated by the stack. */
+void lf(stack_destroy)(struct lf(stack) *stack);
+
+/** @brief Removes and returns the top element from the stack. */
+const void *lf(stack_pop)(struct lf(stack) *stack);
+
+/** @brief Pushes an element to the top of the stack. */
+void *lf(stack_push)(struct lf(stack) *stack, const void *item) lfi_wur;
+
+/** @brief Identical to stack_push(), but raises an error if memory allocation
+ * fails. */
+void *lf(stack_xpush)(struct lf(stack) *stack, const void *item);
+
+/** @brief Returns the top element of the stack. */
+void *lf(stack_top)(struct lf(stack) *stack);
+
+/** @brief Returns the element at the specified `index`. */
+void *lf(stack_at)(struct lf(stack) *stack, ptrdiff_t index);
+
+/** @brief Returns the total number of elements. */
+size_t lf(stack_len)(const struct lf(stack) *stack);
+
+
+#endif
+/**
+ * @file hashmap.h
+ * @brief Basic hashmap.
+ *
+ * hashmap uses open addressing method with a pluggable hash function. It
+ * stores data as key-value pairs, allowing variable-length keys while storing
+ * fixed-length values.
+ *
+ * Slot states live in a separate control array, one byte per slot, holding a
+ * 7-bit tag of the key hash. Lookups scan the control bytes a group of slots
+ * at a time (using SSE2 if available), and only touch the entries whose tag
+ * matches.
+ */
+
+#ifndef LF_HASHMAP_H
+#define LF_HASHMAP_H
+
+#ifndef LF_HEADERONLY
+#include "allocator.h"
+#include "common.h"
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** @brief hashmap. */
+struct lf(hashmap) {
+	/** @cond */
+	struct lfi(hashmap_entry) *entries;
+	unsigned char *ctrl;
+	size_t cap;
+	size_t used;
+	size_t deleted;
+	size_t value_size;
+	uint64_t (*hash)(const void *, size_t);
+	int flags;
+	struct lf(allocator) allocator;
+
+	/* The table grows when an insert would make the number of used and
+	 * deleted slots exceed grow_at. */
+	double max_load;
+	size_t grow_at;
+
+	/* Old table during incremental rehashing, NULL if none. */
+	unsigned char *old_ctrl;
+	size_t old_cap;
+	size_t migrated;
+
+	/* File mapping of a hashmap opened by hashmap_open_mapped(), NULL if
+	 * none. The keys stored out of the entries are at the given offsets of
+	 * the key section of keys_size bytes. */
+	void *mapping;
+	size_t mapping_size;
+	const char *keys;
+	size_t keys_size;
+
+#ifdef LF_HASHMAP_COUNTERS
+	struct {
+		uint64_t lookups;
+		uint64_t misses;
+		uint64_t probes;
+		uint64_t rehashes;
+	} counters;
+#endif
+	/** @endcond */
+};
+
+/**
+ * @brief Statistics of a hashmap, see hashmap_stats().
+ *
+ * The probe length of an entry is the number of groups of slots a lookup of
+ * its key scans, one if the entry is in the group of its home slot.
+ */
+struct lf(hashmap_stats) {
+	/** Number of entries. */
+	size_t size;
+
+	/** Number of slots. */
+	size_t capacity;
+
+	/** Number of slots of the old table during incremental rehashing, zero
+	 * otherwise. */
+	size_t old_capacity;
+
+	/** Number of slots holding an entry, in both tables. */
+	size_t live;
+
+	/** Number of slots of the removed entries not reused yet. */
+	size_t tombstones;
+
+	/** Number of empty slots. */
+	size_t empty;
+
+	/** Average probe length of the entries. */
+	double avg_probe;
+
+	/** Maximum probe length of the entries. */
+	size_t max_probe;
+
+	/** Number of entries by their probe length, the last bucket also counts
+	 * the longer ones. */
+	size_t probe_histogram[LF_HASHMAP_STATS_HISTOGRAM_SIZE];
+
+	/** Bytes allocated by the hashmap, including the keys stored out of the
+	 * entries, or the size of the mapping if the hashmap is mapped. */
+	size_t memory;
+
+	/** @name Counters
+	 * Zero unless the library is compiled with `LF_HASHMAP_COUNTERS`. */
+	/** @{ */
+	/** Number of lookups, including the ones made by inserts and
+	 * removals. */
+	uint64_t lookups;
+
+	/** Number of lookups not finding their key. */
+	uint64_t misses;
+
+	/** Number of groups scanned by the lookups. */
+	uint64_t probes;
+
+	/** Number of times the table is rebuilt. */
+	uint64_t rehashes;
+	/** @} */
+};
+
+/** @brief Flags changing the behavior of the hashmap, see hashmap_init(). */
+enum lf(hashmap_flags) {
+	/**
+	 * Robin Hood probing. An entry is never placed farther from its home
+	 * slot than the entries it passes over, which bounds the variance of
+	 * the probe lengths. Removals shift the following entries back instead
+	 * of leaving tombstones, so the probe lengths do not grow with churn.
+	 */
+	LF_HASHMAP_ROBIN_HOOD = 1 << 0,
+
+	/**
+	 * Incremental rehashing. When the hashmap grows, the old table is kept
+	 * beside the new one, and each insert or remove operation moves the
+	 * entries of a bounded number of old slots (`LF_HASHMAP_MIGRATE_STEP`)
+	 * to the new table. This spreads the cost of a rehash over the
+	 * following operations, instead of stalling a single insert.
+	 */
+	LF_HASHMAP_INCREMENTAL = 1 << 1,
+};
+
+/** @brief Iteration handle to retrieve hashmap entries one by one. */
+struct lf(hashmap_it) {
+	/** @cond */
+	struct lf(hashmap) *m;
+	size_t i;
+	/** @endcond */
+};
+
+/** @cond */
+struct lfi(hashmap_entry) {
+	uint64_t hash;
+	size_t keylen;
+
+	/* Keys up to LF_HASHMAP_INLINE_KEY_SIZE bytes are stored in the entry,
+	 * longer keys are copied to the heap. */
+	union {
+		const void *ptr;
+		uint64_t offset;
+		char bytes[LF_HASHMAP_INLINE_KEY_SIZE];
+	} key;
+
+	char value[];
+};
+/** @endcond */
+
+
+/**
+ * @brief Creates a new hashmap.
+ *
+ * Allocates the necessary memory for the hashmap. The `value_size` parameter
+ * specifies the maximum size of the `value`s the user will add.
+ *
+ * Hash is a function pointer used to hash keys. Defaults to
+ * hashmap_default_hash() if `NULL`. `flags` is a bitwise OR of
+ * `lf(hashmap_flags)`, or zero.
+ *
+ * Returns non-zero if a memory allocation failure occurs.
+ */
+int lf(hashmap_init)(struct lf(hashmap) *hashmap,
+		     size_t value_size,
+		     uint64_t (*hash)(const void *key, size_t keylen),
+		     int flags) lfi_wur;
+
+/** @brief Identical to hashmap_init(), but raises an error if memory allocation
+ * fails. */
+void lf(hashmap_xinit)(struct lf(hashmap) *hashmap,
+		       size_t value_size,
+		       uint64_t (*hash)(const void *key, size_t keylen),
+		       int flags);
+
+/**
+ * @brief Identical to hashmap_init(), but takes the memory of the table and
+ * the keys from the `allocator`.
+ *
+ * The allocator is copied into the hashmap. Defaults to allocator_libc if
+ * `NULL`.
+ *
+ * @see allocator.h
+ */
+int lf(hashmap_init_with)(struct lf(hashmap) *hashmap,
+			  size_t value_size,
+			  uint64_t (*hash)(const void *key, size_t keylen),
+			  int flags,
+			  const struct lf(allocator) *allocator) lfi_wur;
+
+/** @brief Identical to hashmap_init_with(), but raises an error if memory
+ * allocation fails. */
+void lf(hashmap_xinit_with)(struct lf(hashmap) *hashmap,
+			    size_t value_size,
+			    uint64_t (*hash)(const void *key, size_t keylen),
+			    int flags,
+			    const struct lf(allocator) *allocator);
+
+/** @brief Clears the memory allocated by the hashmap. */
+void lf(hashmap_destroy)(struct lf(hashmap) *hashmap);
+
+/**
+ * @brief Grows the hashmap so that it holds `n` entries without rehashing.
+ *
+ * Does nothing if the current capacity is already sufficient. Returns non-zero
+ * if a memory allocation failure occurs, leaving the hashmap unchanged.
+ */
+int lf(hashmap_reserve)(struct lf(hashmap) *hashmap, size_t n) lfi_wur;
+
+/** @brief Identical to hashmap_reserve(), but raises an error if memory
+ * allocation fails. */
+void lf(hashmap_xreserve)(struct lf(hashmap) *hashmap, size_t n);
+
+/**
+ * @brief Removes all entries from the hashmap.
+ *
+ * The capacity of the hashmap is kept, so that refilling it up to its earlier
+ * size does not allocate, apart from the keys longer than
+ * `LF_HASHMAP_INLINE_KEY_SIZE`.
+ */
+void lf(hashmap_clear)(struct lf(hashmap) *hashmap);
+
+/**
+ * @brief Shrinks the capacity of the hashmap to the smallest one holding its
+ * entries.
+ *
+ * Deleted slots are dropped as well. Returns non-zero if a memory allocation
+ * failure occurs, leaving the hashmap unchanged.
+ */
+int lf(hashmap_shrink_to_fit)(struct lf(hashmap) *hashmap) lfi_wur;
+
+/**
+ * @brief Sets the maximum load factor of the hashmap.
+ *
+ * The hashmap grows when the ratio of its used slots to its capacity would
+ * exceed `max_load`, which must be in (0, 1]. Defaults to
+ * `LF_HASHMAP_MAX_LOAD`. Lower values trade memory for shorter probe
+ * sequences. The new factor takes effect on the next insert.
+ */
+void lf(hashmap_set_max_load)(struct lf(hashmap) *hashmap, double max_load);
+
+/**
+ * @brief Returns a pointer to the value matching the key, returns `NULL` if
+ * the key is not found.
+ *
+ * The `key` parameter must be null-terminated. Returned pointer will be a
+ * sentinel if the map's `value_size` is zero, and it should not be
+ * dereferenced.
+ */
+void *lf(hashmap_get)(struct lf(hashmap) *hashmap, const void *key);
+
+/** @brief Identical to hashmap_get(), but accepts a non-null-terminated key. */
+void *lf(hashmap_get2)(struct lf(hashmap) *hashmap,
+		       const void *key,
+		       size_t keylen);
+
+/**
+ * @brief Looks up a batch of keys, returns the number of keys found.
+ *
+ * Stores the pointer to the value matching `keys[i]`, whose length is
+ * `keylens[i]`, to `values[i]`, or `NULL` if the key is not found.
+ *
+ * The keys are hashed and their slots are prefetched in batches before
+ * being probed, so the cache misses of the keys overlap rather than each
+ * lookup waiting for the previous one.
+ */
+size_t lf(hashmap_get_many)(struct lf(hashmap) *hashmap,
+			    size_t n,
+			    const void *const *keys,
+			    const size_t *keylens,
+			    void **values);
+
+/**
+ * @brief Inserts a key-value pair into the hashmap.
+ *
+ * @warning The `key` must not already exist in the hashmap. It is only
+ * checked if the library is not compiled with `NDEBUG`, use
+ * hashmap_get_or_insert() if the key may exist.
+ *
+ * The `key` parameter must be null-terminated. Returns `NULL` if a memory
+ * allocation failure occurs.
+ */
+void *lf(hashmap_insert)(struct lf(hashmap) *hashmap,
+			 const void *key,
+			 const void *value) lfi_wur;
+
+/** @brief Identical to hashmap_insert(), but raises an error if memory
+ * allocation fails. */
+void *lf(hashmap_xinsert)(struct lf(hashmap) *hashmap,
+			  const void *key,
+			  const void *value);
+
+/** @brief Identical to hashmap_insert(), but accepts a non-null-terminated
+ * key. */
+void *lf(hashmap_insert2)(struct lf(hashmap) *hashmap,
+			  const void *key,
+			  size_t keylen,
+			  const void *value) lfi_wur;
+
+/** @brief Identical to hashmap_insert2(), but raises an error if memory
+ * allocation fails. */
+void *lf(hashmap_xinsert2)(struct lf(hashmap) *hashmap,
+			   const void *key,
+			   size_t keylen,
+			   const void *value);
+
+/**
+ * @brief Returns a pointer to the value matching the key, inserts the key if
+ * it is not found.
+ *
+ * The key is hashed and looked up once. If the key is inserted, `value` is
+ * copied to the new entry and `*inserted` is set to true, otherwise the
+ * existing value is kept. `inserted` may be `NULL`.
+ *
+ * The `key` parameter must be null-terminated. Returns `NULL` if a memory
+ * allocation failure occurs.
+ */
+void *lf(hashmap_get_or_insert)(struct lf(hashmap) *hashmap,
+				const void *key,
+				const void *value,
+				bool *inserted) lfi_wur;
+
+/** @brief Identical to hashmap_get_or_insert(), but raises an error if memory
+ * allocation fails. */
+void *lf(hashmap_xget_or_insert)(struct lf(hashmap) *hashmap,
+				 const void *key,
+				 const void *value,
+				 bool *inserted);
+
+/** @brief Identical to hashmap_get_or_insert(), but accepts a
+ * non-null-terminated key. */
+void *lf(hashmap_get_or_insert2)(struct lf(hashmap) *hashmap,
+				 const void *key,
+				 size_t keylen,
+				 const void *value,
+				 bool *inserted) lfi_wur;
+
+/** @brief Identical to hashmap_get_or_insert2(), but raises an error if memory
+ * allocation fails. */
+void *lf(hashmap_xget_or_insert2)(struct lf(hashmap) *hashmap,
+				  const void *key,
+				  size_t keylen,
+				  const void *value,
+				  bool *inserted);
+
+/**
+ * @brief Inserts a key-value pair into the hashmap, or overwrites the value
+ * if the key exists.
+ *
+ * Identical to hashmap_get_or_insert(), but `value` is also copied over the
+ * existing value. Returns a pointer to the value.
+ */
+void *lf(hashmap_upsert)(struct lf(hashmap) *hashmap,
+			 const void *key,
+			 const void *value,
+			 bool *inserted) lfi_wur;
+
+/** @brief Identical to hashmap_upsert(), but raises an error if memory
+ * allocation fails. */
+void *lf(hashmap_xupsert)(struct lf(hashmap) *hashmap,
+			  const void *key,
+			  const void *value,
+			  bool *inserted);
+
+/** @brief Identical to hashmap_upsert(), but accepts a non-null-terminated
+ * key. */
+void *lf(hashmap_upsert2)(struct lf(hashmap) *hashmap,
+			  const void *key,
+			  size_t keylen,
+			  const void *value,
+			  bool *inserted) lfi_wur;
+
+/** @brief Identical to hashmap_upsert2(), but raises an error if memory
+ * allocation fails. */
+void *lf(hashmap_xupsert2)(struct lf(hashmap) *hashmap,
+			   const void *key,
+			   size_t keylen,
+			   const void *value,
+			   bool *inserted);
+
+/**
+ * @brief Removes the key-value pair from the hashmap, returns a pointer to the
+ * value.
+ *
+ * @attention The returned value pointer is valid until the next hashmap
+ * operation. If the user wants to continue using the value, they must copy
+ * underlying data.
+ *
+ * The `key` parameter must be `null-terminated`.
+ */
+const void *lf(hashmap_remove)(struct lf(hashmap) *hashmap, const void *key);
+
+/** @brief Identical to hashmap_remove(), but accepts a non-null-terminated
+ * key. */
+const void *lf(hashmap_remove2)(struct lf(hashmap) *hashmap,
+				const void *key,
+				size_t keylen);
+
+/**
+ * @brief The default hash function of the hashmap.
+ *
+ * Consumes keys a 64-bit word at a time, and finalizes the hash so that
+ * sequential integer keys spread over the whole table.
+ */
+uint64_t lf(hashmap_default_hash)(const void *key, size_t keylen);
+
+/**
+ * @brief 64-bit FNV hash function.
+ *
+ * Hashes a byte at a time. It is kept for the compatibility with the hashes
+ * computed by the earlier versions of the hashmap.
+ */
+uint64_t lf(hashmap_fnv_hash)(const void *key, size_t keylen);
+
+/**
+ * @brief Collects the statistics of the hashmap.
+ *
+ * Walks all slots of the hashmap, taking time proportional to its capacity.
+ *
+ * @see struct hashmap_stats
+ */
+void lf(hashmap_stats)(struct lf(hashmap) *hashmap,
+		       struct lf(hashmap_stats) *stats);
+
+/**
+ * @brief Writes the hashmap to a file, to be opened by hashmap_open_mapped().
+ *
+ * The file holds the table as it is in memory, except that the keys stored
+ * out of the entries are moved to a section of their own and referred to by
+ * their offsets, so that the file can be mapped at any address. An incremental
+ * rehash in progress is finished first.
+ *
+ * Returns non-zero if an I/O error or a memory allocation failure occurs.
+ */
+int lf(hashmap_save)(struct lf(hashmap) *hashmap, const char *path) lfi_wur;
+
+/**
+ * @brief Opens a file written by hashmap_save() as a read-only hashmap.
+ *
+ * The file is memory mapped on POSIX systems, and lookups and iteration read
+ * the table directly from the mapping. Opening takes constant time and the
+ * pages are shared by the processes mapping the same file. Elsewhere the file
+ * is read into memory.
+ *
+ * Opening checks the header, and each key stored out of the entries is checked
+ * as it is read, so that a damaged file is not read out of bounds. The entries
+ * whose keys lie out of the file are not found by the lookups and are skipped
+ * by the iteration.
+ *
+ * `hash` must be the hash function the hashmap is saved with, `NULL` for
+ * hashmap_default_hash(). The hashmap must not be modified, and the values it
+ * returns must not be written. hashmap_destroy() unmaps the file.
+ *
+ * Returns non-zero if the file cannot be read, if it is not written by
+ * hashmap_save() with the same hash function and the same
+ * `LF_HASHMAP_INLINE_KEY_SIZE`, or if it is truncated or its sections lie out
+ * of the file.
+ */
+int lf(hashmap_open_mapped)(struct lf(hashmap) *hashmap,
+			    const char *path,
+			    uint64_t (*hash)(const void *key, size_t keylen))
+	lfi_wur;
+
+/** @brief Creates an iteration handle to retrieve the entries in the hashmap
+ * one by one. */
+void lf(hashmap_iter)(struct lf(hashmap) *hashmap, struct lf(hashmap_it) *it);
+
+/**
+ * @brief Retrieves the next entry from the iteration handle.
+ *
+ * If all entries have been retrieved, it returns a sentinel entry. Use
+ * entry_is_valid() to check wheter or not the returned entry is sentinel.
+ *
+ * @attention Short keys are stored inside the hashmap, the key of the
+ * returned entry is valid until the next insert or remove operation.
+ *
+ * @see common.h
+ */
+struct lf(entry) lf(hashmap_iter_next)(struct lf(hashmap_it) *it);
+
+
+#endif
+#ifndef LF_HASHMAP_CTRL_H
+#define LF_HASHMAP_CTRL_H
+
+#ifndef LF_HEADERONLY
+#include "../include/config.h"
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+/* Control bytes of the hashmaps, one per slot. A full slot holds the 7-bit tag
+ * taken from the top bits of the key hash, empty and deleted slots have the
+ * high bit set. Shared by hashmap.h, typed_hashmap.h and intmap.h. */
+#define LF_HASHMAP_CTRL_EMPTY ((unsigned char) 0x80)
+#define LF_HASHMAP_CTRL_DELETED ((unsigned char) 0xfe)
+
+#define lf_hashmap_ctrl_is_full(c) (((c) & 0x80) == 0)
+
+#define lf_hashmap_tag(hash) ((unsigned char) ((hash) >> 57))
+
+/* Number of control bytes scanned at once. */
+#define LF_HASHMAP_GROUP_WIDTH 16
+
+
+/* Bitmask of the slots in the group whose control byte equals c. */
+inline lfi_fdecl(uint32_t, hashmap_group_match)(const unsigned char *group,
+						unsigned char c)
+{
+#ifdef __SSE2__
+	__m128i ctrl = _mm_loadu_si128((const __m128i *) group);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(c)));
+#else
+	uint32_t mask = 0;
+
+	for (int i = 0; i < LF_HASHMAP_GROUP_WIDTH; i++)
+		mask |= (uint32_t) (group[i] == c) << i;
+
+	return mask;
+#endif
+}
+
+/* Bitmask of the empty or deleted slots in the group. */
+inline lfi_fdecl(uint32_t, hashmap_group_match_free)(const unsigned char *group)
+{
+#ifdef __SSE2__
+	return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) group));
+#else
+	uint32_t mask = 0;
+
+	for (int i = 0; i < LF_HASHMAP_GROUP_WIDTH; i++)
+		mask |= (uint32_t) (group[i] >> 7) << i;
+
+	return mask;
+#endif
+}
+
+/* Index of the lowest set bit, mask must not be zero. */
+inline lfi_fdecl(unsigned, hashmap_ctz)(uint32_t mask)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctz(mask);
+#else
+	unsigned i = 0;
+
+	while (!(mask & 1)) {
+		mask >>= 1;
+		i++;
+	}
+
+	return i;
+#endif
+}
+
+
+/* Tables of the typed hashmaps and of the integer maps: `cap` control bytes
+ * and as many entries of `stride` bytes. Groups are probed in order from the
+ * one holding the home slot, and a probe ends at a group with an empty slot.
+ * The functions are inlined with the entry comparison and hash functions
+ * given to them. */
+#define lf_group_table_first(hash, cap) \
+	((hash) & ((cap) - 1) & ~(size_t) (LF_HASHMAP_GROUP_WIDTH - 1))
+
+/* Slot of the entry for which eq(entry, key) holds in the probe sequence of
+ * the hash, or SIZE_MAX. */
+inline lfi_fdecl(size_t, group_table_find)(
+	const unsigned char *ctrl,
+	const char *entries,
+	size_t cap,
+	size_t stride,
+	uint64_t hash,
+	const void *key,
+	bool (*eq)(const void *entry, const void *key))
+{
+	unsigned char tag = lf_hashmap_tag(hash);
+	size_t g = lf_group_table_first(hash, cap);
+
+	for (;;) {
+		const unsigned char *group = &ctrl[g];
+		uint32_t match = lfi(hashmap_group_match)(group, tag);
+
+		while (match) {
+			size_t i = g + lfi(hashmap_ctz)(match);
+
+			if (eq(&entries[i * stride], key))
+				return i;
+
+			match &= match - 1;
+		}
+
+		if (lfi(hashmap_group_match)(group, LF_HASHMAP_CTRL_EMPTY))
+			return SIZE_MAX;
+
+		g = (g + LF_HASHMAP_GROUP_WIDTH) & (cap - 1);
+	}
+}
+
+/* Claims the first free slot in the probe sequence of the hash, and tags it
+ * with the hash. */
+inline lfi_fdecl(size_t, group_table_claim)(unsigned char *ctrl,
+					    size_t cap,
+					    uint64_t hash,
+					    size_t *deleted)
+{
+	size_t g = lf_group_table_first(hash, cap);
+	uint32_t free_slots;
+
+	while (!(free_slots = lfi(hashmap_group_match_free)(&ctrl[g])))
+		g = (g + LF_HASHMAP_GROUP_WIDTH) & (cap - 1);
+
+	size_t i = g + lfi(hashmap_ctz)(free_slots);
+
+	if (ctrl[i] == LF_HASHMAP_CTRL_DELETED)
+		(*deleted)--;
+
+	ctrl[i] = lf_hashmap_tag(hash);
+
+	return i;
+}
+
+/* Empties the slot of a removed entry. Probes end at a group with an empty
+ * slot, so the slot can be emptied if its group already has one. */
+inline lfi_fdecl(void, group_table_release)(unsigned char *ctrl,
+					    size_t i,
+					    size_t *deleted)
+{
+	size_t g = i & ~(size_t) (LF_HASHMAP_GROUP_WIDTH - 1);
+
+	if (lfi(hashmap_group_match)(&ctrl[g], LF_HASHMAP_CTRL_EMPTY)) {
+		ctrl[i] = LF_HASHMAP_CTRL_EMPTY;
+	} else {
+		ctrl[i] = LF_HASHMAP_CTRL_DELETED;
+		(*deleted)++;
+	}
+}
+
+/* Copies the entries of a table to an empty one, hash(entry) hashing their
+ * keys. */
+inline lfi_fdecl(void, group_table_move)(const unsigned char *old_ctrl,
+					 const char *old_entries,
+					 size_t old_cap,
+					 unsigned char *ctrl,
+					 char *entries,
+					 size_t cap,
+					 size_t stride,
+					 uint64_t (*hash)(const void *entry))
+{
+	size_t deleted = 0;
+
+	for (size_t i = 0; i < old_cap; i++) {
+		if (!lf_hashmap_ctrl_is_full(old_ctrl[i]))
+			continue;
+
+		const char *e = &old_entries[i * stride];
+		size_t j = lfi(group_table_claim)(ctrl, cap, hash(e), &deleted);
+
+		memcpy(&entries[j * stride], e, stride);
+	}
+}
+
+/* Capacity to rehash to before inserting, or zero if the entry fits. Deleted
+ * slots are dropped without growing if they make up the most of the load. */
+inline lfi_fdecl(size_t, group_table_grow)(size_t cap,
+					   size_t used,
+					   size_t deleted)
+{
+	if (used + deleted < cap / 4 * 3)
+		return 0;
+
+	return used * 2 >= cap / 4 * 3 ? cap * 2 : cap;
+}
+
+/* Smallest capacity whose three quarters hold n entries, zero if it
+ * overflows. */
+inline lfi_fdecl(size_t, group_table_cap_for)(size_t n)
+{
+	size_t cap = LF_HASHMAP_GROUP_WIDTH;
+
+	while (cap / 4 * 3 < n) {
+		if (cap > SIZE_MAX / 4)
+			return 0;
+
+		cap *= 2;
+	}
+
+	return cap;
+}
+
+#endif
+/**
+ * @file typed_hashmap.h
+ * @brief Hashmaps specialized for a key and a value type.
+ *
+ * LF_TYPED_HASHMAP() instantiates a hashmap for concrete key and value types,
+ * with its hash and equality functions known at compile time. Keys and values
+ * are stored by value in the entries, so that the compiler inlines the hash
+ * and the comparison, indexes the entries with a constant stride, and copies
+ * values by assignment.
+ *
+ * The table uses the same control byte layout as hashmap.h, and probes it a
+ * group of 16 slots at a time (using SSE2 if available).
+ *
+ * Example:
+ * @code
+ * static uint64_t hash_id(uint64_t id) { return id * 0x9e3779b97f4a7c15u; }
+ * static bool eq_id(uint64_t a, uint64_t b) { return a == b; }
+ *
+ * LF_TYPED_HASHMAP(id_map, uint64_t, struct point, hash_id, eq_id)
+ *
+ * struct fid_map m;
+ * fid_map_init(&m);
+ * fid_map_upsert(&m, 42, (struct point) { 1, 2 }, NULL);
+ * struct point *p = fid_map_get(&m, 42);
+ * @endcode
+ */
+
+#ifndef LF_TYPED_HASHMAP_H
+#define LF_TYPED_HASHMAP_H
+
+#ifndef LF_HEADERONLY
+#include "common.h"
+#include "../src/hashmap_ctrl.h"
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/**
+ * @brief Instantiates a hashmap named `name` from `key_t` to `value_t`.
+ *
+ * `hash_fn` is called as `uint64_t hash_fn(key_t key)`, and `eq_fn` as
+ * `bool eq_fn(key_t a, key_t b)`; both may be functions or function-like
+ * macros. The high bits of the hash are used as the tags in the control bytes,
+ * and the low bits pick the slots, so the hash must mix all of its bits.
+ *
+ * The following are defined, where `lf(x)` is `x` with the library prefix:
+ * - `struct lf(name)`, the hashmap.
+ * - `struct lf(name_entry)`, an entry with `key` and `value` fields.
+ * - `struct lf(name_it)`, an iteration handle.
+ * - `int lf(name_init)(m)` creates a hashmap, returns non-zero if a memory
+ *   allocation failure occurs.
+ * - `void lf(name_destroy)(m)` clears the memory allocated by the hashmap.
+ * - `value_t *lf(name_get)(m, key)` returns a pointer to the value matching
+ *   the key, or `NULL`.
+ * - `value_t *lf(name_insert)(m, key, value)` inserts a key that must not
+ *   already exist in the hashmap, without looking it up.
+ * - `value_t *lf(name_get_or_insert)(m, key, value, bool *inserted)` and
+ *   `value_t *lf(name_upsert)(m, key, value, bool *inserted)` are as in
+ *   hashmap.h.
+ * - `bool lf(name_remove)(m, key, value_t *value)` removes the key, copying
+ *   its value to `value` unless it is `NULL`, and returns whether the key is
+ *   found.
+ * - `int lf(name_reserve)(m, n)` grows the hashmap to hold `n` entries
+ *   without rehashing.
+ * - `void lf(name_clear)(m)` removes all entries, keeping the capacity.
+ * - `size_t lf(name_size)(m)` returns the number of entries.
+ * - `void lf(name_iter)(m, it)` and `struct lf(name_entry)
+ *   *lf(name_iter_next)(it)`, which returns `NULL` after the last entry.
+ *
+ * Inserting functions return `NULL` if a memory allocation failure occurs.
+ * The returned pointers are valid until the next insert or remove
+ * operation. All functions are `static inline`, the macro is meant to be used
+ * once per map type in a source file or in a header.
+ */
+#define LF_TYPED_HASHMAP(name, key_t, value_t, hash_fn, eq_fn) \
+\
+struct lf(name##_entry) { \
+	key_t key; \
+	value_t value; \
+}; \
+\
+struct lf(name) { \
+	unsigned char *ctrl; \
+	struct lf(name##_entry) *entries; \
+	size_t cap; \
+	size_t used; \
+	size_t deleted; \
+}; \
+\
+struct lf(name##_it) { \
+	struct lf(name) *m; \
+	size_t i; \
+}; \
+\
+/* The entry functions given to the table functions of hashmap_ctrl.h. */ \
+inline lfi_fdecl(bool, name##_eq)(const void *entry, const void *key) \
+{ \
+	return eq_fn(((const struct lf(name##_entry) *) entry)->key, \
+		     *(const key_t *) key); \
+} \
+\
+inline lfi_fdecl(uint64_t, name##_hash)(const void *entry) \
+{ \
+	return hash_fn(((const struct lf(name##_entry) *) entry)->key); \
+} \
+\
+inline lfi_fdecl(int, name##_alloc)(struct lf(name) *m, size_t cap) \
+{ \
+	size_t align = _Alignof(struct lf(name##_entry)); \
+	size_t off = (cap + align - 1) / align * align; \
+	unsigned char *ctrl = \
+		malloc(off + cap * sizeof(struct lf(name##_entry))); \
+\
+	if (ctrl == NULL) \
+		return 1; \
+\
+	memset(ctrl, LF_HASHMAP_CTRL_EMPTY, cap); \
+\
+	m->ctrl = ctrl; \
+	m->entries = (struct lf(name##_entry) *) &ctrl[off]; \
+	m->cap = cap; \
+	m->deleted = 0; \
+\
+	return 0; \
+} \
+\
+inline lfi_fdecl(size_t, name##_find)(struct lf(name) *m, \
+				      key_t key, \
+				      uint64_t hash) \
+{ \
+	return lfi(group_table_find)(m->ctrl, (const char *) m->entries, \
+				     m->cap, sizeof(*m->entries), hash, \
+				     &key, lfi(name##_eq)); \
+} \
+\
+inline lfi_fdecl(int, name##_rehash)(struct lf(name) *m, size_t cap) \
+{ \
+	struct lf(name) old = *m; \
+\
+	if (lfi(name##_alloc)(m, cap)) \
+		return 1; \
+\
+	lfi(group_table_move)(old.ctrl, (const char *) old.entries, old.cap, \
+			      m->ctrl, (char *) m->entries, m->cap, \
+			      sizeof(*m->entries), lfi(name##_hash)); \
+	free(old.ctrl); \
+\
+	return 0; \
+} \
+\
+static inline int lf(name##_init)(struct lf(name) *m) \
+{ \
+	m->used = 0; \
+\
+	return lfi(name##_alloc)(m, LF_HASHMAP_INITIAL_CAP); \
+} \
+\
+static inline void lf(name##_destroy)(struct lf(name) *m) \
+{ \
+	free(m->ctrl); \
+} \
+\
+static inline value_t *lf(name##_get)(struct lf(name) *m, key_t key) \
+{ \
+	size_t i = lfi(name##_find)(m, key, hash_fn(key)); \
+\
+	return i == SIZE_MAX ? NULL : &m->entries[i].value; \
+} \
+\
+inline lfi_fdecl(value_t *, name##_insert_new)(struct lf(name) *m, \
+					       key_t key, \
+					       value_t value, \
+					       uint64_t hash) \
+{ \
+	size_t cap = lfi(group_table_grow)(m->cap, m->used, m->deleted); \
+\
+	if (cap != 0 && lfi(name##_rehash)(m, cap)) \
+		return NULL; \
+\
+	struct lf(name##_entry) *e = \
+		&m->entries[lfi(group_table_claim)(m->ctrl, m->cap, hash, \
+						   &m->deleted)]; \
+\
+	e->key = key; \
+	e->value = value; \
+	m->used++; \
+\
+	return &e->value; \
+} \
+\
+static inline value_t *lf(name##_insert)(struct lf(name) *m, \
+					 key_t key, \
+					 value_t value) \
+{ \
+	return lfi(name##_insert_new)(m, key, value, hash_fn(key)); \
+} \
+\
+static inline value_t *lf(name##_get_or_insert)(struct lf(name) *m, \
+						key_t key, \
+						value_t value, \
+						bool *inserted) \
+{ \
+	uint64_t hash = hash_fn(key); \
+	size_t i = lfi(name##_find)(m, key, hash); \
+\
+	if (inserted != NULL) \
+		*inserted = i == SIZE_MAX; \
+\
+	if (i != SIZE_MAX) \
+		return &m->entries[i].value; \
+\
+	return lfi(name##_insert_new)(m, key, value, hash); \
+} \
+\
+static inline value_t *lf(name##_upsert)(struct lf(name) *m, \
+					 key_t key, \
+					 value_t value, \
+					 bool *inserted) \
+{ \
+	bool inserted_; \
+	value_t *v = lf(name##_get_or_insert)(m, key, value, &inserted_); \
+\
+	if (v != NULL && !inserted_) \
+		*v = value; \
+\
+	if (inserted != NULL) \
+		*inserted = inserted_; \
+\
+	return v; \
+} \
+\
+static inline bool lf(name##_remove)(struct lf(name) *m, \
+				     key_t key, \
+				     value_t *value) \
+{ \
+	size_t i = lfi(name##_find)(m, key, hash_fn(key)); \
+\
+	if (i == SIZE_MAX) \
+		return false; \
+\
+	if (value != NULL) \
+		*value = m->entries[i].value; \
+\
+	lfi(group_table_release)(m->ctrl, i, &m->deleted); \
+	m->used--; \
+\
+	return true; \
+} \
+\
+static inline int lf(name##_reserve)(struct lf(name) *m, size_t n) \
+{ \
+	size_t cap = lfi(group_table_cap_for)(n); \
+\
+	if (cap == 0) \
+		return 1; \
+\
+	return cap > m->cap ? lfi(name##_rehash)(m, cap) : 0; \
+} \
+\
+static inline void lf(name##_clear)(struct lf(name) *m) \
+{ \
+	memset(m->ctrl, LF_HASHMAP_CTRL_EMPTY, m->cap); \
+	m->used = 0; \
+	m->deleted = 0; \
+} \
+\
+static inline size_t lf(name##_size)(struct lf(name) *m) \
+{ \
+	return m->used; \
+} \
+\
+static inline void lf(name##_iter)(struct lf(name) *m, \
+				   struct lf(name##_it) *it) \
+{ \
+	it->m = m; \
+	it->i = 0; \
+} \
+\
+static inline struct lf(name##_entry) *lf(name##_iter_next)( \
+	struct lf(name##_it) *it) \
+{ \
+	while (it->i < it->m->cap) { \
+		size_t i = it->i++; \
+\
+		if (lf_hashmap_ctrl_is_full(it->m->ctrl[i])) \
+			return &it->m->entries[i]; \
+	} \
+\
+	return NULL; \
+}
+
+
+#endif
+/**
+ * @file intmap.h
+ * @brief Hashmaps with integer keys.
+ *
+ * u64map and u32map are hashmaps keyed by `uint64_t` and `uint32_t`
+ * integers, storing fixed-length values. Keys are stored inline in the
+ * entries, next to the values, so inserting does not allocate per key, and an
+ * entry carries no key metadata beyond the key itself. Keys are hashed with
+ * an integer mixer, and compared as integers.
+ *
+ * The table uses the same control byte layout as hashmap.h. Values are
+ * aligned to `sizeof(size_t)`-byte boundary, except in u32map if the
+ * `value_size` is not larger than 4, where the values are 4-byte aligned and
+ * the entries take 8 bytes.
+ */
+
+#ifndef LF_INTMAP_H
+#define LF_INTMAP_H
+
+#ifndef LF_HEADERONLY
+#include "common.h"
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** @brief Hashmap with `uint64_t` keys. */
+struct lf(u64map) {
+	/** @cond */
+	unsigned char *ctrl;
+	char *entries;
+	size_t cap;
+	size_t used;
+	size_t deleted;
+	size_t value_size;
+	size_t value_offset;
+	size_t stride;
+	/** @endcond */
+};
+
+/** @brief Hashmap with `uint32_t` keys. */
+struct lf(u32map) {
+	/** @cond */
+	unsigned char *ctrl;
+	char *entries;
+	size_t cap;
+	size_t used;
+	size_t deleted;
+	size_t value_size;
+	size_t value_offset;
+	size_t stride;
+	/** @endcond */
+};
+
+/** @brief Iteration handle to retrieve u64map entries one by one. */
+struct lf(u64map_it) {
+	/** @cond */
+	struct lf(u64map) *m;
+	size_t i;
+	/** @endcond */
+};
+
+/** @brief Iteration handle to retrieve u32map entries one by one. */
+struct lf(u32map_it) {
+	/** @cond */
+	struct lf(u32map) *m;
+	size_t i;
+	/** @endcond */
+};
+
+
+/**
+ * @brief Creates a new u64map.
+ *
+ * Allocates the necessary memory for the map. The `value_size` parameter
+ * specifies the maximum size of the `value`s the user will add.
+ *
+ * Returns non-zero if a memory allocation failure occurs.
+ */
+int lf(u64map_init)(struct lf(u64map) *map, size_t value_size) lfi_wur;
+
+/** @brief Identical to u64map_init(), but raises an error if memory
+ * allocation fails. */
+void lf(u64map_xinit)(struct lf(u64map) *map, size_t value_size);
+
+/** @brief Clears the memory allocated by the u64map. */
+void lf(u64map_destroy)(struct lf(u64map) *map);
+
+/**
+ * @brief Returns a pointer to the value matching the key, returns `NULL` if
+ * the key is not found.
+ *
+ * Returned pointer will be a sentinel if the map's `value_size` is zero, and
+ * it should not be dereferenced.
+ */
+void *lf(u64map_get)(struct lf(u64map) *map, uint64_t key);
+
+/**
+ * @brief Inserts a key-value pair into the u64map.
+ *
+ * @warning The `key` must not already exist in the map. It is only checked if
+ * the library is not compiled with `NDEBUG`, use u64map_get_or_insert() if
+ * the key may exist.
+ *
+ * Returns `NULL` if a memory allocation failure occurs.
+ */
+void *lf(u64map_insert)(struct lf(u64map) *map,
+			uint64_t key,
+			const void *value) lfi_wur;
+
+/** @brief Identical to u64map_insert(), but raises an error if memory
+ * allocation fails. */
+void *lf(u64map_xinsert)(struct lf(u64map) *map,
+			 uint64_t key,
+			 const void *value);
+
+/**
+ * @brief Returns a pointer to the value matching the key, inserts the key if
+ * it is not found.
+ *
+ * If the key is inserted, `value` is copied to the new entry and `*inserted`
+ * is set to true, otherwise the existing value is kept. `inserted` may be
+ * `NULL`. Returns `NULL` if a memory allocation failure occurs.
+ */
+void *lf(u64map_get_or_insert)(struct lf(u64map) *map,
+			       uint64_t key,
+			       const void *value,
+			       bool *inserted) lfi_wur;
+
+/** @brief Identical to u64map_get_or_insert(), but raises an error if memory
+ * allocation fails. */
+void *lf(u64map_xget_or_insert)(struct lf(u64map) *map,
+				uint64_t key,
+				const void *value,
+				bool *inserted);
+
+/**
+ * @brief Inserts a key-value pair into the u64map, or overwrites the value if
+ * the key exists.
+ *
+ * Identical to u64map_get_or_insert(), but `value` is also copied over the
+ * existing value.
+ */
+void *lf(u64map_upsert)(struct lf(u64map) *map,
+			uint64_t key,
+			const void *value,
+			bool *inserted) lfi_wur;
+
+/** @brief Identical to u64map_upsert(), but raises an error if memory
+ * allocation fails. */
+void *lf(u64map_xupsert)(struct lf(u64map) *map,
+			 uint64_t key,
+			 const void *value,
+			 bool *inserted);
+
+/**
+ * @brief Removes the key-value pair from the u64map, returns a pointer to the
+ * value, or `NULL` if the key is not found.
+ *
+ * @attention The returned value pointer is valid until the next map
+ * operation.
+ */
+const void *lf(u64map_remove)(struct lf(u64map) *map, uint64_t key);
+
+/**
+ * @brief Grows the u64map so that it holds `n` entries without rehashing.
+ *
+ * Returns non-zero if a memory allocation failure occurs, leaving the map
+ * unchanged.
+ */
+int lf(u64map_reserve)(struct lf(u64map) *map, size_t n) lfi_wur;
+
+/** @brief Identical to u64map_reserve(), but raises an error if memory
+ * allocation fails. */
+void lf(u64map_xreserve)(struct lf(u64map) *map, size_t n);
+
+/** @brief Removes all entries from the u64map, keeping its capacity. */
+void lf(u64map_clear)(struct lf(u64map) *map);
+
+/** @brief Creates an iteration handle to retrieve the entries in the u64map
+ * one by one. */
+void lf(u64map_iter)(struct lf(u64map) *map, struct lf(u64map_it) *it);
+
+/**
+ * @brief Retrieves the next entry from the iteration handle.
+ *
+ * The key of the entry points to the `uint64_t` key in the map. If all
+ * entries have been retrieved, it returns a sentinel entry.
+ *
+ * @see common.h
+ */
+struct lf(entry) lf(u64map_iter_next)(struct lf(u64map_it) *it);
+
+/** @brief Identical to u64map_init(), but with `uint32_t` keys. */
+int lf(u32map_init)(struct lf(u32map) *map, size_t value_size) lfi_wur;
+
+/** @brief Identical to u64map_xinit(), but with `uint32_t` keys. */
+void lf(u32map_xinit)(struct lf(u32map) *map, size_t value_size);
+
+/** @brief Identical to u64map_destroy(), but with `uint32_t` keys. */
+void lf(u32map_destroy)(struct lf(u32map) *map);
+
+/** @brief Identical to u64map_get(), but with `uint32_t` keys. */
+void *lf(u32map_get)(struct lf(u32map) *map, uint32_t key);
+
+/** @brief Identical to u64map_insert(), but with `uint32_t` keys. */
+void *lf(u32map_insert)(struct lf(u32map) *map,
+			uint32_t key,
+			const void *value) lfi_wur;
+
+/** @brief Identical to u64map_xinsert(), but with `uint32_t` keys. */
+void *lf(u32map_xinsert)(struct lf(u32map) *map,
+			 uint32_t key,
+			 const void *value);
+
+/** @brief Identical to u64map_get_or_insert(), but with `uint32_t` keys. */
+void *lf(u32map_get_or_insert)(struct lf(u32map) *map,
+			       uint32_t key,
+			       const void *value,
+			       bool *inserted) lfi_wur;
+
+/** @brief Identical to u64map_xget_or_insert(), but with `uint32_t` keys. */
+void *lf(u32map_xget_or_insert)(struct lf(u32map) *map,
+				uint32_t key,
+				const void *value,
+				bool *inserted);
+
+/** @brief Identical to u64map_upsert(), but with `uint32_t` keys. */
+void *lf(u32map_upsert)(struct lf(u32map) *map,
+			uint32_t key,
+			const void *value,
+			bool *inserted) lfi_wur;
+
+/** @brief Identical to u64map_xupsert(), but with `uint32_t` keys. */
+void *lf(u32map_xupsert)(struct lf(u32map) *map,
+			 uint32_t key,
+			 const void *value,
+			 bool *inserted);
+
+/** @brief Identical to u64map_remove(), but with `uint32_t` keys. */
+const void *lf(u32map_remove)(struct lf(u32map) *map, uint32_t key);
+
+/** @brief Identical to u64map_reserve(), but with `uint32_t` keys. */
+int lf(u32map_reserve)(struct lf(u32map) *map, size_t n) lfi_wur;
+
+/** @brief Identical to u64map_xreserve(), but with `uint32_t` keys. */
+void lf(u32map_xreserve)(struct lf(u32map) *map, size_t n);
+
+/** @brief Identical to u64map_clear(), but with `uint32_t` keys. */
+void lf(u32map_clear)(struct lf(u32map) *map);
+
+/** @brief Identical to u64map_iter(), but with `uint32_t` keys. */
+void lf(u32map_iter)(struct lf(u32map) *map, struct lf(u32map_it) *it);
+
+/** @brief Identical to u64map_iter_next(), but with `uint32_t` keys. */
+struct lf(entry) lf(u32map_iter_next)(struct lf(u32map_it) *it);
+
+
+#endif
+/**
+ * @file chashmap.h
+ * @brief Concurrent hashmap.
+ *
+ * chashmap splits its keys over `LF_CHASHMAP_STRIPES` hashmaps by their hash,
+ * each guarded by its own reader-writer spinlock. Lookups of a stripe run in
+ * parallel, and writes only block the operations on the same stripe. A
+ * stripe grows on its own, under its write lock, so that a resize never
+ * stalls the whole map.
+ *
+ * The hash of a key is computed once, and picks both the stripe and the slot
+ * in it. Entries are stored as in hashmap.h.
+ *
+ * Values are copied in and out under the lock, as a pointer to a value would
+ * not outlive a concurrent write to its stripe. Lookups take the lock shared
+ * rather than validating a sequence counter, since a concurrent writer may
+ * free the keys a lookup compares against.
+ */
+
+#ifndef LF_CHASHMAP_H
+#define LF_CHASHMAP_H
+
+#ifndef LF_HEADERONLY
+#include "common.h"
+#include "hashmap.h"
+#endif
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** @brief Concurrent hashmap. */
+struct lf(chashmap) {
+	/** @cond */
+	struct lfi(chashmap_stripe) *stripes;
+	size_t value_size;
+	uint64_t (*hash)(const void *, size_t);
+	/** @endcond */
+};
+
+/** @cond */
+struct lfi(chashmap_stripe) {
+	/* Writer bit and the number of readers. Stripes are aligned to cache
+	 * lines, so that their locks do not share lines. */
+	_Alignas(64) atomic_uint lock;
+
+	struct lf(hashmap) m;
+};
+/** @endcond */
+
+
+/**
+ * @brief Creates a new concurrent hashmap.
+ *
+ * `value_size`, `hash` and `flags` are as in hashmap_init(), and apply to each
+ * stripe.
+ *
+ * Returns non-zero if a memory allocation failure occurs.
+ */
+int lf(chashmap_init)(struct lf(chashmap) *chashmap,
+		      size_t value_size,
+		      uint64_t (*hash)(const void *key, size_t keylen),
+		      int flags) lfi_wur;
+
+/** @brief Identical to chashmap_init(), but raises an error if memory
+ * allocation fails. */
+void lf(chashmap_xinit)(struct lf(chashmap) *chashmap,
+			size_t value_size,
+			uint64_t (*hash)(const void *key, size_t keylen),
+			int flags);
+
+/**
+ * @brief Clears the memory allocated by the concurrent hashmap.
+ *
+ * @warning Must not run concurrently with any other operation.
+ */
+void lf(chashmap_destroy)(struct lf(chashmap) *chashmap);
+
+/**
+ * @brief Looks up the key, returns true if it is found.
+ *
+ * Copies the value matching the key to `value`, unless `value` is `NULL`. The
+ * `key` parameter must be null-terminated.
+ */
+bool lf(chashmap_get)(struct lf(chashmap) *chashmap,
+		      const void *key,
+		      void *value);
+
+/** @brief Identical to chashmap_get(), but accepts a non-null-terminated
+ * key. */
+bool lf(chashmap_get2)(struct lf(chashmap) *chashmap,
+		       const void *key,
+		       size_t keylen,
+		       void *value);
+
+/**
+ * @brief Inserts a key-value pair into the concurrent hashmap, or overwrites
+ * the value if the key exists.
+ *
+ * `*inserted` is set to whether the key is inserted, `inserted` may be `NULL`.
+ *
+ * The `key` parameter must be null-terminated. Returns non-zero if a memory
+ * allocation failure occurs.
+ */
+int lf(chashmap_upsert)(struct lf(chashmap) *chashmap,
+			const void *key,
+			const void *value,
+			bool *inserted) lfi_wur;
+
+/** @brief Identical to chashmap_upsert(), but raises an error if memory
+ * allocation fails. */
+void lf(chashmap_xupsert)(struct lf(chashmap) *chashmap,
+			  const void *key,
+			  const void *value,
+			  bool *inserted);
+
+/** @brief Identical to chashmap_upsert(), but accepts a non-null-terminated
+ * key. */
+int lf(chashmap_upsert2)(struct lf(chashmap) *chashmap,
+			 const void *key,
+			 size_t keylen,
+			 const void *value,
+			 bool *inserted) lfi_wur;
+
+/** @brief Identical to chashmap_upsert2(), but raises an error if memory
+ * allocation fails. */
+void lf(chashmap_xupsert2)(struct lf(chashmap) *chashmap,
+			   const void *key,
+			   size_t keylen,
+			   const void *value,
+			   bool *inserted);
+
+/**
+ * @brief Removes the key-value pair from the concurrent hashmap, returns true
+ * if the key is found.
+ *
+ * Copies the removed value to `value`, unless `value` is `NULL`. The `key`
+ * parameter must be null-terminated.
+ */
+bool lf(chashmap_remove)(struct lf(chashmap) *chashmap,
+			 const void *key,
+			 void *value);
+
+/** @brief Identical to chashmap_remove(), but accepts a non-null-terminated
+ * key. */
+bool lf(chashmap_remove2)(struct lf(chashmap) *chashmap,
+			  const void *key,
+			  size_t keylen,
+			  void *value);
+
+/**
+ * @brief Returns the number of entries in the concurrent hashmap.
+ *
+ * Stripes are counted one at a time, the result may be stale under
+ * concurrent writes.
+ */
+size_t lf(chashmap_size)(struct lf(chashmap) *chashmap);
+
+
+#endif
+/**
+ * @file dict.h
+ * @brief Insertion-ordered hashmap with dense entry storage.
+ *
+ * dict keeps its entries in a dense array, in insertion order, and finds them
+ * through a sparse index table of open addressed slots. Each index slot only
+ * holds the position of an entry in the array, so it takes 1, 2, 4 or 8 bytes
+ * depending on the capacity, and small dicts have small index tables.
+ *
+ * Iteration walks the dense array, touching only the entries rather than
+ * every slot of the table. Removed entries leave holes in the array until
+ * they outnumber the remaining entries, when the array is compacted in place.
+ *
+ * Prefer hashmap.h for lookup-heavy workloads, and dict for the maps that are
+ * iterated often or whose iteration order matters.
+ */
+
+#ifndef LF_DICT_H
+#define LF_DICT_H
+
+#ifndef LF_HEADERONLY
+#include "common.h"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** @brief Insertion-ordered hashmap. */
+struct lf(dict) {
+	/** @cond */
+	void *index;
+	struct lfi(dict_entry) *entries;
+
+	/* Number of index slots, entries can hold three quarters of it. */
+	size_t cap;
+
+	/* Number of entries in the array, including the removed ones. */
+	size_t len;
+	size_t used;
+	size_t value_size;
+	uint64_t (*hash)(const void *, size_t);
+	/** @endcond */
+};
+
+/** @brief Iteration handle to retrieve dict entries in insertion order. */
+struct lf(dict_it) {
+	/** @cond */
+	struct lf(dict) *d;
+	size_t i;
+	/** @endcond */
+};
+
+/** @cond */
+struct lfi(dict_entry) {
+	uint64_t hash;
+
+	/* SIZE_MAX if the entry is removed. */
+	size_t keylen;
+
+	union {
+		const void *ptr;
+		char bytes[LF_HASHMAP_INLINE_KEY_SIZE];
+	} key;
+
+	char value[];
+};
+/** @endcond */
+
+
+/**
+ * @brief Creates a new dict.
+ *
+ * Allocates the necessary memory for the dict. The `value_size` parameter
+ * specifies the maximum size of the `value`s the user will add.
+ *
+ * Hash is a function pointer used to hash keys. Defaults to
+ * hashmap_default_hash() if `NULL`.
+ *
+ * Returns non-zero if a memory allocation failure occurs.
+ */
+int lf(dict_init)(struct lf(dict) *dict,
+		  size_t value_size,
+		  uint64_t (*hash)(const void *key, size_t keylen)) lfi_wur;
+
+/** @brief Identical to dict_init(), but raises an error if memory allocation
+ * fails. */
+void lf(dict_xinit)(struct lf(dict) *dict,
+		    size_t value_size,
+		    uint64_t (*hash)(const void *key, size_t keylen));
+
+/** @brief Clears the memory allocated by the dict. */
+void lf(dict_destroy)(struct lf(dict) *dict);
+
+/**
+ * @brief Returns a pointer to the value matching the key, returns `NULL` if
+ * the key is not found.
+ *
+ * The `key` parameter must be null-terminated. Returned pointer will be a
+ * sentinel if the dict's `value_size` is zero, and it should not be
+ * dereferenced.
+ */
+void *lf(dict_get)(struct lf(dict) *dict, const void *key);
+
+/** @brief Identical to dict_get(), but accepts a non-null-terminated key. */
+void *lf(dict_get2)(struct lf(dict) *dict, const void *key, size_t keylen);
+
+/**
+ * @brief Appends a key-value pair to the dict.
+ *
+ * @warning The `key` must not already exist in the dict. It is only checked if
+ * the library is not compiled with `NDEBUG`.
+ *
+ * The `key` parameter must be null-terminated. Returns `NULL` if a memory
+ * allocation failure occurs.
+ */
+void *lf(dict_insert)(struct lf(dict) *dict,
+		      const void *key,
+		      const void *value) lfi_wur;
+
+/** @brief Identical to dict_insert(), but raises an error if memory
+ * allocation fails. */
+void *lf(dict_xinsert)(struct lf(dict) *dict,
+		       const void *key,
+		       const void *value);
+
+/** @brief Identical to dict_insert(), but accepts a non-null-terminated
+ * key. */
+void *lf(dict_insert2)(struct lf(dict) *dict,
+		       const void *key,
+		       size_t keylen,
+		       const void *value) lfi_wur;
+
+/** @brief Identical to dict_insert2(), but raises an error if memory
+ * allocation fails. */
+void *lf(dict_xinsert2)(struct lf(dict) *dict,
+			const void *key,
+			size_t keylen,
+			const void *value);
+
+/**
+ * @brief Removes the key-value pair from the dict, returns a pointer to the
+ * value.
+ *
+ * @attention The returned value pointer is valid until the next dict
+ * operation. If the user wants to continue using the value, they must copy
+ * underlying data.
+ *
+ * The `key` parameter must be `null-terminated`.
+ */
+const void *lf(dict_remove)(struct lf(dict) *dict, const void *key);
+
+/** @brief Identical to dict_remove(), but accepts a non-null-terminated
+ * key. */
+const void *lf(dict_remove2)(struct lf(dict) *dict,
+			     const void *key,
+			     size_t keylen);
+
+/** @brief Creates an iteration handle to retrieve the entries in the dict
+ * one by one, in insertion order. */
+void lf(dict_iter)(struct lf(dict) *dict, struct lf(dict_it) *it);
+
+/**
+ * @brief Retrieves the next entry from the iteration handle.
+ *
+ * If all entries have been retrieved, it returns a sentinel entry. Use
+ * entry_is_valid() to check wheter or not the returned entry is sentinel.
+ *
+ * @attention Short keys are stored inside the dict, the key of the returned
+ * entry is valid until the next insert or remove operation.
+ *
+ * @see common.h
+ */
+struct lf(entry) lf(dict_iter_next)(struct lf(dict_it) *it);
+
+
+#endif
+/**
+ * @file map.h
+ * @brief Basic map.
+ *
+ * map is an order-statistics tree implemented augmenting Red-Black tree.
+ *
+ * Nodes are carved from slabs owned by the map, and the nodes of removed
+ * entries are kept in a free list per size class for the following inserts.
+ * Nodes allocated together stay close in memory, and destroying the map
+ * releases whole slabs rather than every node. Nodes larger than
+ * `LF_MAP_POOL_MAX_NODE_SIZE` are allocated one by one.
+ *
+ * Maps can be split at a key and joined back in logarithmic time, moving the
+ * nodes rather than copying them. A map split from another one keeps holding
+ * nodes from its slabs, the slabs are released once both of the maps are
+ * destroyed.
+ */
+
+#ifndef LF_MAP_H
+#define LF_MAP_H
+
+#ifndef LF_HEADERONLY
+#include "allocator.h"
+#include "common.h"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** @brief map. */
+struct lf(map) {
+	/** @cond */
+	struct lfi(map_node) *root;
+
+	void *hold_value;
+
+	size_t value_size;
+
+	int (*cmp)(const void *, const void *, size_t, size_t);
+
+	struct lf(allocator) allocator;
+
+	/* Node pool. Slabs holding nodes of other maps are in the share. */
+	struct lfi(map_slab) *slabs;
+	struct lfi(map_share) *share;
+	char *slab_top;
+	size_t slab_left;
+	size_t slab_size;
+	void *free_nodes[LF_MAP_POOL_MAX_NODE_SIZE / 16];
+	size_t large_nodes;
+	/** @endcond */
+};
+
+/** @brief Iteration handle to retrieve map entries one by one. */
+struct lf(map_it) {
+	/** @cond */
+	struct lf(map) *m;
+	struct lfi(map_node) *n;
+
+	/* Nodes just past the range in each direction, NULL if unbounded. */
+	struct lfi(map_node) *end;
+	struct lfi(map_node) *rend;
+	/** @endcond */
+};
+
+/** @cond */
+struct lfi(map_node) {
+	size_t keylen;
+
+	struct lfi(map_node) *p;
+	struct lfi(map_node) *left;
+	struct lfi(map_node) *right;
+
+	/* Number of nodes in the subtree rooted at this node *including*
+	 * this node. */
+	size_t size;
+
+	/* First bytes of the key, compared before the key itself when the
+	 * keys are ordered by their bytes. */
+	uint64_t prefix;
+
+	/* 1 if red, 0 if black. */
+	char color;
+
+	/* Key and value, the value is aligned to sizeof(size_t)-byte
+	 * boundary. */
+	_Alignas(size_t) char kv[];
+};
+/** @endcond */
+
+
+/**
+ * @brief Creates a new map.
+ *
+ * Comparator is a function pointer used to compare keys. It should return an
+ * integer less than, equal to, or greater than zero if key1 is found,
+ * respectively, to be less than, to match, or be greater than key2. Defaults
+ * to memcmp(key1, key2, min(keylen1, keylen2)) if `NULL`.
+ *
+ * Returns non-zero if a memory allocation failure occurs.
+ */
+int lf(map_init)(struct lf(map) *map,
+		 size_t value_size,
+		 int (*comparator)(const void *key1,
+				   const void *key2,
+				   size_t keylen1,
+				   size_t keylen2)) lfi_wur;
+
+/** @brief Identical to map_init(), but raises an error if memory allocation
+ * fails. */
+void lf(map_xinit)(struct lf(map) *map,
+		   size_t value_size,
+		   int (*comparator)(const void *key1,
+				     const void *key2,
+				     size_t keylen1,
+				     size_t keylen2));
+
+/**
+ * @brief Identical to map_init(), but takes the memory of the nodes from the
+ * `allocator`.
+ *
+ * The allocator is copied into the map. Defaults to allocator_libc if `NULL`.
+ *
+ * @see allocator.h
+ */
+int lf(map_init_with)(struct lf(map) *map,
+		      size_t value_size,
+		      int (*comparator)(const void *key1,
+					const void *key2,
+					size_t keylen1,
+					size_t keylen2),
+		      const struct lf(allocator) *allocator) lfi_wur;
+
+/** @brief Identical to map_init_with(), but raises an error if memory
+ * allocation fails. */
+void lf(map_xinit_with)(struct lf(map) *map,
+			size_t value_size,
+			int (*comparator)(const void *key1,
+					  const void *key2,
+					  size_t keylen1,
+					  size_t keylen2),
+			const struct lf(allocator) *allocator);
+
+/** @brief Clears the memory allocated by the map. */
+void lf(map_destroy)(struct lf(map) *map);
+
+/**
+ * @brief Returns a pointer to the value matching the key, returns `NULL` if
+ * the key is not found.
+ *
+ * The `key` parameter must be null-terminated. Returned pointer will be a
+ * sentinel if the map's `value_size` is zero, and it should not be
+ * dereferenced.
+ */
+void *lf(map_get)(struct lf(map) *map, const void *key);
+
+/** @brief Identical to map_get(), but accepts a non-null-terminated key. */
+void *lf(map_get2)(struct lf(map) *map, const void *key, size_t keylen);
+
+/**
+ * @brief Inserts a key-value pair into the map.
+ *
+ * @warning The key must not already exist in the map.
+ */
+void *lf(map_insert)(struct lf(map) *map,
+		     const void *key,
+		     const void *value) lfi_wur;
+
+/** @brief Identical to map_insert(), but raises an error if memory allocation
+ * fails. */
+void *lf(map_xinsert)(struct lf(map) *map, const void *key, const void *value);
+
+/** @brief Identical to map_insert(), but accepts a non-null-terminated key. */
+void *lf(map_insert2)(struct lf(map) *map,
+		      const void *key,
+		      size_t keylen,
+		      const void *value);
+
+/** @brief Identical to map_insert2(), but raises an error if memory allocation
+ * fails. */
+void *lf(map_xinsert2)(struct lf(map) *map,
+		      const void *key,
+		      size_t keylen,
+		      const void *value);
+
+/**
+ * @brief Fills an empty map with `n` entries from sorted arrays.
+ *
+ * `keys` must be null-terminated and in strictly ascending order of the map's
+ * comparator, which is only checked if the library is not compiled with
+ * `NDEBUG`. `values` holds `n` consecutive values of the map's `value_size`,
+ * the values are left uninitialized if it is `NULL`.
+ *
+ * The tree is built balanced in linear time, without the searches and
+ * rebalancing of inserting the entries one by one.
+ *
+ * Returns non-zero if a memory allocation failure occurs, the map is left
+ * empty.
+ */
+int lf(map_build_sorted)(struct lf(map) *map,
+			 const void *const *keys,
+			 const void *values,
+			 size_t n) lfi_wur;
+
+/** @brief Identical to map_build_sorted(), but raises an error if memory
+ * allocation fails. */
+void lf(map_xbuild_sorted)(struct lf(map) *map,
+			   const void *const *keys,
+			   const void *values,
+			   size_t n);
+
+/** @brief Identical to map_build_sorted(), but accepts non-null-terminated
+ * keys of lengths `keylens`. */
+int lf(map_build_sorted2)(struct lf(map) *map,
+			  const void *const *keys,
+			  const size_t *keylens,
+			  const void *values,
+			  size_t n) lfi_wur;
+
+/** @brief Identical to map_build_sorted2(), but raises an error if memory
+ * allocation fails. */
+void lf(map_xbuild_sorted2)(struct lf(map) *map,
+			    const void *const *keys,
+			    const size_t *keylens,
+			    const void *values,
+			    size_t n);
+
+/**
+ * @brief Removes a key-value pair from the map and returns a pointer to the value.
+ *
+ * @attention The returned value pointer points to internal memory that is only
+ * valid until the next remove operation. The user must copy the underlying
+ * data if they wish to retain it.
+ */
+const void *lf(map_remove)(struct lf(map) *map, const void *key);
+
+/** @brief Identical to map_remove(), but accepts a non-null-terminated key. */
+const void *lf(map_remove2)(struct lf(map) *map, const void *key, size_t keylen);
+
+/**
+ * @brief Moves the entries with keys not less than `key` to `right`.
+ *
+ * `right` is initialized with the value size, comparator and allocator of the
+ * map, and must be destroyed by the user. Takes logarithmic time, as the
+ * nodes are moved rather than copied. The `key` parameter must be
+ * null-terminated.
+ *
+ * Returns non-zero if a memory allocation failure occurs, the map is left
+ * unchanged.
+ */
+int lf(map_split)(struct lf(map) *map,
+		  const void *key,
+		  struct lf(map) *right) lfi_wur;
+
+/** @brief Identical to map_split(), but raises an error if memory allocation
+ * fails. */
+void lf(map_xsplit)(struct lf(map) *map,
+		    const void *key,
+		    struct lf(map) *right);
+
+/** @brief Identical to map_split(), but accepts a non-null-terminated key. */
+int lf(map_split2)(struct lf(map) *map,
+		   const void *key,
+		   size_t keylen,
+		   struct lf(map) *right) lfi_wur;
+
+/** @brief Identical to map_split2(), but raises an error if memory allocation
+ * fails. */
+void lf(map_xsplit2)(struct lf(map) *map,
+		     const void *key,
+		     size_t keylen,
+		     struct lf(map) *right);
+
+/**
+ * @brief Moves all entries of `other` to the map, leaving `other` empty.
+ *
+ * All keys of the map must be less than the keys of `other`, which is only
+ * checked if the library is not compiled with `NDEBUG`. Both maps must have
+ * the same value size, comparator and allocator. Takes logarithmic time in
+ * the sizes of the maps. `other` can still be used, and must be destroyed by
+ * the user.
+ *
+ * Returns non-zero if a memory allocation failure occurs, the maps are left
+ * unchanged.
+ */
+int lf(map_join)(struct lf(map) *map, struct lf(map) *other) lfi_wur;
+
+/** @brief Identical to map_join(), but raises an error if memory allocation
+ * fails. */
+void lf(map_xjoin)(struct lf(map) *map, struct lf(map) *other);
+
+/**
+ * @brief Moves all entries of `other` to the map, leaving `other` empty.
+ *
+ * Keys may be in both maps, in which case the value in the map is kept. The
+ * maps are as in map_join(). Takes O(m log(n / m + 1)) time, where m is the
+ * size of the smaller map and n of the larger one.
+ *
+ * Returns non-zero if a memory allocation failure occurs, the maps are left
+ * unchanged.
+ */
+int lf(map_union)(struct lf(map) *map, struct lf(map) *other) lfi_wur;
+
+/** @brief Identical to map_union(), but raises an error if memory allocation
+ * fails. */
+void lf(map_xunion)(struct lf(map) *map, struct lf(map) *other);
+
+/**
+ * @brief Retrieves the map entry at a specific sorted index.
+ *
+ * Raises an error if the index is larger than map size. The entry may be
+ * invalidated after a remove operation.
+ */
+struct lf(entry) lf(map_select)(struct lf(map) *map, ptrdiff_t index);
+
+/**
+ * @brief Determines the 0-based index of a specific key in the sorted map.
+ *
+ * Returns -1 casted to size_t if the key is not found.
+ */
+size_t lf(map_rank)(const struct lf(map) *map, const void *key);
+
+/** @brief Identical to map_rank(), but accepts a non-null-terminated key. */
+size_t lf(map_rank2)(const struct lf(map) *map, const void *key, size_t keylen);
+
+/** @brief Returns the total number of elements currently stored in the map. */
+size_t lf(map_size)(const struct lf(map) *map);
+
+/**
+ * @brief Creates a forward iteration handle for the map.
+ *
+ * Initializes `it` to iterate over all entries in ascending key order. The
+ * first call to map_iter_next() will return the entry with the smallest key.
+ *
+ * @attention The iterator is invalidated by any insert or remove operation
+ * on the map. Do not modify the map while iterating.
+ */
+void lf(map_iter)(struct lf(map) *map, struct lf(map_it) *it);
+
+/**
+ * @brief Creates a reverse handle from specific index for the map.
+ *
+ * See map_iter().
+ */
+void lf(map_iter_from)(struct lf(map) *map,
+		       struct lf(map_it) *it,
+		       ptrdiff_t index);
+
+/**
+ * @brief Creates an iteration handle starting from the first entry whose key
+ * is not less than `key`.
+ *
+ * The handle retrieves the sentinel entry if there is no such entry. The
+ * `key` parameter must be null-terminated. See map_iter().
+ */
+void lf(map_lower_bound)(struct lf(map) *map,
+			 struct lf(map_it) *it,
+			 const void *key);
+
+/** @brief Identical to map_lower_bound(), but accepts a non-null-terminated
+ * key. */
+void lf(map_lower_bound2)(struct lf(map) *map,
+			  struct lf(map_it) *it,
+			  const void *key,
+			  size_t keylen);
+
+/**
+ * @brief Creates an iteration handle starting from the first entry whose key
+ * is greater than `key`.
+ *
+ * See map_lower_bound().
+ */
+void lf(map_upper_bound)(struct lf(map) *map,
+			 struct lf(map_it) *it,
+			 const void *key);
+
+/** @brief Identical to map_upper_bound(), but accepts a non-null-terminated
+ * key. */
+void lf(map_upper_bound2)(struct lf(map) *map,
+			  struct lf(map_it) *it,
+			  const void *key,
+			  size_t keylen);
+
+/**
+ * @brief Creates an iteration handle over the entries with keys in
+ * [`lo`, `hi`).
+ *
+ * Iteration starts from the first entry of the range. Both map_iter_next()
+ * and map_iter_prev() return the sentinel entry once they leave the range.
+ * `lo` must not be greater than `hi`, which is only checked if the library is
+ * not compiled with `NDEBUG`. The keys must be null-terminated.
+ */
+void lf(map_iter_range)(struct lf(map) *map,
+			struct lf(map_it) *it,
+			const void *lo,
+			const void *hi);
+
+/** @brief Identical to map_iter_range(), but accepts non-null-terminated
+ * keys. */
+void lf(map_iter_range2)(struct lf(map) *map,
+			 struct lf(map_it) *it,
+			 const void *lo,
+			 size_t lolen,
+			 const void *hi,
+			 size_t hilen);
+
+/**
+ * @brief Returns the number of entries with keys in [`lo`, `hi`).
+ *
+ * Counted from the subtree sizes in logarithmic time, without visiting the
+ * entries. The keys must be null-terminated.
+ */
+size_t lf(map_count_range)(const struct lf(map) *map,
+			   const void *lo,
+			   const void *hi);
+
+/** @brief Identical to map_count_range(), but accepts non-null-terminated
+ * keys. */
+size_t lf(map_count_range2)(const struct lf(map) *map,
+			    const void *lo,
+			    size_t lolen,
+			    const void *hi,
+			    size_t hilen);
+
+/**
+ * @brief Retrieves the next entry from an iteration handle.
+ *
+ * Returns entries in ascending key order. When all entries have been
+ * retrieved, returns a sentinel entry. Use entry_is_valid() to check wheter
+ * or not the entry is sentinel.
+ *
+ * @see common.h
+ */
+struct lf(entry) lf(map_iter_next)(struct lf(map_it) *it);
+
+/** @brief Identical to map_iter_next, but in reverse direction. */
+struct lf(entry) lf(map_iter_prev)(struct lf(map_it) *it);
+
+
+#endif
+/**
+ * @file btree.h
+ * @brief Ordered map on a B-tree.
+ *
+ * btree is an order-statistics B-tree. Each node holds up to
+ * `2 * LF_BTREE_DEGREE - 1` keys in a contiguous array, short keys stored in
+ * place as in hashmap.h, and internal nodes keep the subtree size of each
+ * child for select and rank. The first bytes of the keys are also kept as
+ * integers in an array of their own, which the default comparison searches
+ * before looking at the keys. A lookup touches a handful of nodes instead of a
+ * node per level of a binary tree, and the default comparison is inlined
+ * rather than called through a function pointer.
+ *
+ * The API mirrors map.h. Unlike map, entries move between nodes as the tree
+ * is modified, so value pointers are only valid until the next insert or
+ * remove operation.
+ */
+
+#ifndef LF_BTREE_H
+#define LF_BTREE_H
+
+#ifndef LF_HEADERONLY
+#include "allocator.h"
+#include "common.h"
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** @brief B-tree ordered map. */
+struct lf(btree) {
+	/** @cond */
+	struct lfi(btree_node) *root;
+
+	void *hold_value;
+
+	size_t size;
+	size_t value_size;
+
+	/* NULL for the default comparison. */
+	int (*cmp)(const void *, const void *, size_t, size_t);
+
+	struct lf(allocator) allocator;
+	/** @endcond */
+};
+
+/** @brief Iteration handle to retrieve btree entries one by one. */
+struct lf(btree_it) {
+	/** @cond */
+	struct lf(btree) *t;
+	struct lfi(btree_node) *n;
+	size_t i;
+	/** @endcond */
+};
+
+/** @cond */
+struct lfi(btree_key) {
+	size_t keylen;
+
+	union {
+		const void *ptr;
+		char bytes[LF_HASHMAP_INLINE_KEY_SIZE];
+	} key;
+};
+
+struct lfi(btree_node) {
+	struct lfi(btree_node) *p;
+
+	/* Number of keys. */
+	unsigned short len;
+	bool leaf;
+
+	/* First 8 bytes of the keys as big-endian integers, so that most
+	 * comparisons of the default ordering are integer comparisons. */
+	uint64_t prefixes[2 * LF_BTREE_DEGREE - 1];
+
+	struct lfi(btree_key) keys[2 * LF_BTREE_DEGREE - 1];
+
+	/* Followed by the values, and by the children and their subtree sizes
+	 * if the node is internal. */
+};
+/** @endcond */
+
+
+/**
+ * @brief Creates a new btree.
+ *
+ * Comparator is as in map_init(). Defaults to comparing the keys
+ * lexicographically by their bytes if `NULL`.
+ *
+ * Returns non-zero if a memory allocation failure occurs.
+ */
+int lf(btree_init)(struct lf(btree) *btree,
+		   size_t value_size,
+		   int (*comparator)(const void *key1,
+				     const void *key2,
+				     size_t keylen1,
+				     size_t keylen2)) lfi_wur;
+
+/** @brief Identical to btree_init(), but raises an error if memory allocation
+ * fails. */
+void lf(btree_xinit)(struct lf(btree) *btree,
+		     size_t value_size,
+		     int (*comparator)(const void *key1,
+				       const void *key2,
+				       size_t keylen1,
+				       size_t keylen2));
+
+/**
+ * @brief Identical to btree_init(), but takes the memory of the nodes and the
+ * keys from the `allocator`.
+ *
+ * The allocator is copied into the btree. Defaults to allocator_libc if
+ * `NULL`.
+ *
+ * @see allocator.h
+ */
+int lf(btree_init_with)(struct lf(btree) *btree,
+			size_t value_size,
+			int (*comparator)(const void *key1,
+					  const void *key2,
+					  size_t keylen1,
+					  size_t keylen2),
+			const struct lf(allocator) *allocator) lfi_wur;
+
+/** @brief Identical to btree_init_with(), but raises an error if memory
+ * allocation fails. */
+void lf(btree_xinit_with)(struct lf(btree) *btree,
+			  size_t value_size,
+			  int (*comparator)(const void *key1,
+					    const void *key2,
+					    size_t keylen1,
+					    size_t keylen2),
+			  const struct lf(allocator) *allocator);
+
+/** @brief Clears the memory allocated by the btree. */
+void lf(btree_destroy)(struct lf(btree) *btree);
+
+/**
+ * @brief Returns a pointer to the value matching the key, returns `NULL` if
+ * the key is not found.
+ *
+ * The `key` parameter must be null-terminated. Returned pointer will be a
+ * sentinel if the btree's `value_size` is zero, and it should not be
+ * dereferenced.
+ */
+void *lf(btree_get)(struct lf(btree) *btree, const void *key);
+
+/** @brief Identical to btree_get(), but accepts a non-null-terminated key. */
+void *lf(btree_get2)(struct lf(btree) *btree, const void *key, size_t keylen);
+
+/**
+ * @brief Inserts a key-value pair into the btree.
+ *
+ * @warning The key must not already exist in the btree. It is only checked if
+ * the library is not compiled with `NDEBUG`.
+ *
+ * The `key` parameter must be null-terminated. Returns `NULL` if a memory
+ * allocation failure occurs.
+ */
+void *lf(btree_insert)(struct lf(btree) *btree,
+		       const void *key,
+		       const void *value) lfi_wur;
+
+/** @brief Identical to btree_insert(), but raises an error if memory
+ * allocation fails. */
+void *lf(btree_xinsert)(struct lf(btree) *btree,
+			const void *key,
+			const void *value);
+
+/** @brief Identical to btree_insert(), but accepts a non-null-terminated
+ * key. */
+void *lf(btree_insert2)(struct lf(btree) *btree,
+			const void *key,
+			size_t keylen,
+			const void *value) lfi_wur;
+
+/** @brief Identical to btree_insert2(), but raises an error if memory
+ * allocation fails. */
+void *lf(btree_xinsert2)(struct lf(btree) *btree,
+			 const void *key,
+			 size_t keylen,
+			 const void *value);
+
+/**
+ * @brief Removes a key-value pair from the btree and returns a pointer to the
+ * value, returns `NULL` if the key is not found.
+ *
+ * @attention The returned value pointer points to internal memory that is only
+ * valid until the next remove operation. The user must copy the underlying
+ * data if they wish to retain it.
+ */
+const void *lf(btree_remove)(struct lf(btree) *btree, const void *key);
+
+/** @brief Identical to btree_remove(), but accepts a non-null-terminated
+ * key. */
+const void *lf(btree_remove2)(struct lf(btree) *btree,
+			      const void *key,
+			      size_t keylen);
+
+/**
+ * @brief Retrieves the btree entry at a specific sorted index.
+ *
+ * Raises an error if the index is larger than btree size. The entry is
+ * invalidated by the next insert or remove operation.
+ */
+struct lf(entry) lf(btree_select)(struct lf(btree) *btree, ptrdiff_t index);
+
+/**
+ * @brief Determines the 0-based index of a specific key in the sorted btree.
+ *
+ * Returns -1 casted to size_t if the key is not found.
+ */
+size_t lf(btree_rank)(const struct lf(btree) *btree, const void *key);
+
+/** @brief Identical to btree_rank(), but accepts a non-null-terminated key. */
+size_t lf(btree_rank2)(const struct lf(btree) *btree,
+		       const void *key,
+		       size_t keylen);
+
+/** @brief Returns the total number of elements currently stored in the
+ * btree. */
+size_t lf(btree_size)(const struct lf(btree) *btree);
+
+/**
+ * @brief Creates a forward iteration handle for the btree.
+ *
+ * Initializes `it` to iterate over all entries in ascending key order.
+ *
+ * @attention The iterator is invalidated by any insert or remove operation
+ * on the btree. Do not modify the btree while iterating.
+ */
+void lf(btree_iter)(struct lf(btree) *btree, struct lf(btree_it) *it);
+
+/**
+ * @brief Creates an iteration handle starting from the entry at a specific
+ * sorted index.
+ *
+ * See btree_iter().
+ */
+void lf(btree_iter_from)(struct lf(btree) *btree,
+			 struct lf(btree_it) *it,
+			 ptrdiff_t index);
+
+/**
+ * @brief Retrieves the next entry from an iteration handle.
+ *
+ * Returns entries in ascending key order. When all entries have been
+ * retrieved, returns a sentinel entry. Use entry_is_valid() to check wheter
+ * or not the entry is sentinel.
+ *
+ * @see common.h
+ */
+struct lf(entry) lf(btree_iter_next)(struct lf(btree_it) *it);
+
+/** @brief Identical to btree_iter_next, but in reverse direction. */
+struct lf(entry) lf(btree_iter_prev)(struct lf(btree_it) *it);
+
+
+#endif
+#ifdef LF_IMPLEMENTATION
+#ifndef LF_UTIL_H
+
+#ifndef LF_HEADERONLY
+#include "../include/allocator.h"
+#include "../include/common.h"
+#include "../include/config.h"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>  // IWYU pragma: export
+#include <string.h>
+
+
+/** @brief Assertion macro that prints formatted error message if failed. */
+#if (defined(__unix__) || defined(__APPLE__) || defined(__linux__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+
+#include <stdio.h>  // IWYU pragma: begin_exports
+#include <signal.h>  // IWYU pragma: end_exports
+
+/** @cond */
+#define lf_assert_stringify_detail(a) #a
+#define lf_assert_stringify(a) lf_assert_stringify_detail(a)
+/** @endcond */
+
+#define lf_assert(c, ...) do { \
+		if (!(c)) { \
+			fprintf(stderr, "["  __FILE__ ":" \
+				lf_assert_stringify(__LINE__) "] " \
+				"Assertion failed for: " \
+				lf_assert_stringify(c) \
+				"\n> " __VA_ARGS__); \
+			fputc('\n', stderr); \
+			raise(SIGINT); \
+		} \
+	} while(0)
+
+#else
+
+#include <assert.h>  // IWYU pragma: export
+
+#define lf_assert(c, ...) do { assert(c); abort(); } while (0)
+
+#endif
+
+/** @brief Identical to lf_assert(), but only checked if `NDEBUG` is not
+ * defined. Used for the checks too costly for the release builds. */
+#ifdef NDEBUG
+#define lf_debug_assert(c, ...) ((void) 0)
+#else
+#define lf_debug_assert(c, ...) lf_assert(c, __VA_ARGS__)
+#endif
+
+/** @brief Counterpart of the assert(), expects the condition to be false. */
+#define lf_unwrap(c) lf_assert(!(c), "discarded result indicate error")
+
+/** @brief Hints the processor to fetch the cache line of the address. */
+#if defined(__GNUC__) || defined(__clang__)
+#define lf_prefetch(addr) __builtin_prefetch(addr)
+#else
+#define lf_prefetch(addr) ((void) (addr))
+#endif
+
+/** @brief Hints the processor that the thread is spinning on a lock. */
+#if defined(__SSE2__)
+#include <emmintrin.h>  // IWYU pragma: export
+#define lf_cpu_relax() _mm_pause()
+#else
+#define lf_cpu_relax() ((void) 0)
+#endif
+
+/** @brief Unreachable assertion. */
+#define lf_unreachable do { lf_assert(0, "unreachable"); abort(); } while (0)
+
+
+/* Circullar indexing, negative indexes starts from the end. */
+inline lfi_fdecl(size_t, circular_index)(ptrdiff_t index, size_t size)
+{
+	lf_assert(-(ptrdiff_t) size <= index && index < (ptrdiff_t) size, "overflow");
+
+	if (index < 0)
+		index += size;
+
+	return index;
+}
+
+/* Allocation through the allocator of a container. */
+#define lf_alloc(a, size) ((a)->alloc((a)->ctx, (size)))
+#define lf_realloc(a, ptr, old_size, size) \
+	((a)->realloc((a)->ctx, (ptr), (old_size), (size)))
+
+/* Releases the allocation, if not NULL, as free(). */
+inline lfi_fdecl(void, free)(const struct lf(allocator) *a,
+			     void *ptr,
+			     size_t size)
+{
+	if (ptr != NULL)
+		a->free(a->ctx, ptr, size);
+}
+
+/* First 8 bytes of the key, zero padded, as a big-endian integer. Prefixes
+ * compare as the keys do when ordered by their bytes, unless they are
+ * equal. */
+inline lfi_fdecl(uint64_t, key_prefix)(const void *key, size_t keylen)
+{
+	unsigned char bytes[8] = { 0 };
+	uint64_t prefix = 0;
+
+	memcpy(bytes, key, keylen < 8 ? keylen : 8);
+
+	for (int i = 0; i < 8; i++)
+		prefix = prefix << 8 | bytes[i];
+
+	return prefix;
+}
+
+#define lfi_sentinel_entry ((struct lf(entry)) { .key = NULL, })
+
+
+#endif
+#ifndef LF_HEADERONLY
+#include "util.h"
+#include "../include/allocator.h"
+#include "../include/config.h"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#if (LF_ARENA_INITIAL_BLOCK_SIZE) <= 0 || \
+	(LF_ARENA_MAX_BLOCK_SIZE) < (LF_ARENA_INITIAL_BLOCK_SIZE)
+#error "LF_ARENA_MAX_BLOCK_SIZE must not be less than LF_ARENA_INITIAL_BLOCK_SIZE"
+#endif
+
+/* Allocations are rounded up to keep the next one aligned. Empty ones take
+ * a unit too, so that no two allocations share an address. */
+#define lf_arena_align(size) \
+	((size) == 0 ? _Alignof(max_align_t) : \
+	 ((size) + _Alignof(max_align_t) - 1) / _Alignof(max_align_t) * \
+	 _Alignof(max_align_t))
+
+
+lfi_fdecl(void *, libc_alloc)(void *ctx, size_t size)
+{
+	(void) ctx;
+
+	return malloc(size);
+}
+
+lfi_fdecl(void *, libc_realloc)(void *ctx,
+				void *ptr,
+				size_t old_size,
+				size_t size)
+{
+	(void) ctx;
+	(void) old_size;
+
+	return realloc(ptr, size);
+}
+
+lfi_fdecl(void, libc_free)(void *ctx, void *ptr, size_t size)
+{
+	(void) ctx;
+	(void) size;
+
+	free(ptr);
+}
+
+const struct lf(allocator) lf(allocator_libc) = {
+	.alloc = lfi(libc_alloc),
+	.realloc = lfi(libc_realloc),
+	.free = lfi(libc_free),
+	.ctx = NULL,
+};
+
+
+/* Starts a new block with room for at least size bytes. The remaining space
+ * of the current block is abandoned. */
+lfi_fdecl(int, arena_grow)(struct lf(arena) *a, size_t size)
+{
+	size_t block_size = a->block_size > size ? a->block_size : size;
+
+	if (block_size > SIZE_MAX - sizeof(struct lfi(arena_block)))
+		return 1;
+
+	struct lfi(arena_block) *b =
+		malloc(sizeof(struct lfi(arena_block)) + block_size);
+
+	if (b == NULL)
+		return 1;
+
+	b->next = a->blocks;
+	b->size = block_size;
+
+	a->blocks = b;
+	a->top = (char *) b->data;
+	a->end = a->top + block_size;
+	a->last = NULL;
+
+	if (a->block_size < LF_ARENA_MAX_BLOCK_SIZE / 2)
+		a->block_size *= 2;
+	else
+		a->block_size = LF_ARENA_MAX_BLOCK_SIZE;
+
+	return 0;
+}
+
+lfi_fdecl(void *, arena_allocator_alloc)(void *ctx, size_t size)
+{
+	return lf(arena_alloc)(ctx, size);
+}
+
+lfi_fdecl(void *, arena_allocator_realloc)(void *ctx,
+					   void *ptr,
+					   size_t old_size,
+					   size_t size)
+{
+	struct lf(arena) *a = ctx;
+
+	if (ptr == a->last && size <= (size_t) (a->end - a->last)) {
+		a->top = a->last + lf_arena_align(size);
+
+		return ptr;
+	} else if (size <= old_size) {
+		return ptr;
+	}
+
+	void *new_ptr = lf(arena_alloc)(a, size);
+
+	if (new_ptr != NULL)
+		memcpy(new_ptr, ptr, old_size);
+
+	return new_ptr;
+}
+
+lfi_fdecl(void, arena_allocator_free)(void *ctx, void *ptr, size_t size)
+{
+	struct lf(arena) *a = ctx;
+
+	(void) size;
+
+	if (ptr == a->last) {
+		a->top = a->last;
+		a->last = NULL;
+	}
+}
+
+
+int lf(arena_init)(struct lf(arena) *a)
+{
+	a->blocks = NULL;
+	a->block_size = LF_ARENA_INITIAL_BLOCK_SIZE;
+
+	return lfi(arena_grow)(a, 0);
+}
+
+void lf(arena_xinit)(struct lf(arena) *a)
+{
+	lf_unwrap(lf(arena_init)(a));
+}
+
+void lf(arena_destroy)(struct lf(arena) *a)
+{
+	struct lfi(arena_block) *b = a->blocks;
+
+	while (b != NULL) {
+		struct lfi(arena_block) *next = b->next;
+
+		free(b);
+		b = next;
+	}
+}
+
+void lf(arena_reset)(struct lf(arena) *a)
+{
+	struct lfi(arena_block) *b = a->blocks->next;
+
+	while (b != NULL) {
+		struct lfi(arena_block) *next = b->next;
+
+		free(b);
+		b = next;
+	}
+
+	a->blocks->next = NULL;
+	a->top = (char *) a->blocks->data;
+	a->end = a->top + a->blocks->size;
+	a->last = NULL;
+}
+
+void *lf(arena_alloc)(struct lf(arena) *a, size_t size)
+{
+	if (size > SIZE_MAX - _Alignof(max_align_t))
+		return NULL;
+
+	size = lf_arena_align(size);
+
+	if (size > (size_t) (a->end - a->top) && lfi(arena_grow)(a, size))
+		return NULL;
+
+	a->last = a->top;
+	a->top += size;
+
+	return a->last;
+}
+
+void *lf(arena_xalloc)(struct lf(arena) *a, size_t size)
+{
+	void *alloc_res = lf(arena_alloc)(a, size);
+
+	lf_assert(alloc_res != NULL, "alloc returned NULL");
+
+	return alloc_res;
+}
+
+struct lf(allocator) lf(arena_allocator)(struct lf(arena) *a)
+{
+	return (struct lf(allocator)) {
+		.alloc = lfi(arena_allocator_alloc),
+		.realloc = lfi(arena_allocator_realloc),
+		.free = lfi(arena_allocator_free),
+		.ctx = a,
+	};
+}
+#ifndef LF_HEADERONLY
+#include "util.h"
+#include "../include/btree.h"
+#include "../include/config.h"
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#if (LF_BTREE_DEGREE) < 2 || (LF_BTREE_DEGREE) > 128
+#error "LF_BTREE_DEGREE must be between 2 and 128"
+#endif
+
+/* Minimum degree, nodes other than the root hold T - 1 to MAX_KEYS keys. */
+#define LF_BTREE_T LF_BTREE_DEGREE
+#define LF_BTREE_MAX_KEYS (2 * LF_BTREE_DEGREE - 1)
+
+#define lf_btree_align(i) \
+	(((i) + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t))
+
+/* Values are aligned to sizeof(size_t)-byte boundary in the nodes. */
+#define lf_btree_stride(t) lf_btree_align((t)->value_size)
+
+#define lf_btree_values(n) \
+	((char *) (n) + lf_btree_align(sizeof(struct lfi(btree_node))))
+
+#define lf_btree_value_at(t, n, i) \
+	(lf_btree_values(n) + (i) * lf_btree_stride(t))
+
+#define lf_btree_children(t, n) \
+	((struct lfi(btree_node) **) lf_btree_value_at(t, n, LF_BTREE_MAX_KEYS))
+
+#define lf_btree_counts(t, n) \
+	((size_t *) &lf_btree_children(t, n)[LF_BTREE_MAX_KEYS + 1])
+
+#define lf_btree_node_alloc_size(t, leaf) \
+	(lf_btree_align(sizeof(struct lfi(btree_node))) + \
+	 LF_BTREE_MAX_KEYS * lf_btree_stride(t) + \
+	 ((leaf) ? 0 : (LF_BTREE_MAX_KEYS + 1) * \
+		       (sizeof(struct lfi(btree_node) *) + sizeof(size_t))))
+
+#define lf_btree_key_is_inline(keylen) \
+	((keylen) <= LF_HASHMAP_INLINE_KEY_SIZE)
+
+#define lf_btree_key_ptr(k) \
+	(lf_btree_key_is_inline((k)->keylen) ? \
+	 (const void *) (k)->key.bytes : (k)->key.ptr)
+
+
+/* Compares the key i of the node to the given one, the default comparison is
+ * done inline. */
+inline lfi_fdecl(int, btree_cmp)(const struct lf(btree) *t,
+				 const struct lfi(btree_node) *n,
+				 size_t i,
+				 const void *key,
+				 size_t keylen,
+				 uint64_t prefix)
+{
+	const struct lfi(btree_key) *k = &n->keys[i];
+	const void *k1 = lf_btree_key_ptr(k);
+
+	if (t->cmp != NULL)
+		return t->cmp(k1, key, k->keylen, keylen);
+
+	if (n->prefixes[i] != prefix)
+		return n->prefixes[i] < prefix ? -1 : 1;
+
+	int res = memcmp(k1, key, k->keylen < keylen ? k->keylen : keylen);
+
+	if (res == 0)
+		return (k->keylen > keylen) - (k->keylen < keylen);
+
+	return res;
+}
+
+/* Index of the first key of the node not less than the given key. found is
+ * set to whether the key is equal to it. */
+lfi_fdecl(size_t, btree_search)(const struct lf(btree) *t,
+				const struct lfi(btree_node) *n,
+				const void *key,
+				size_t keylen,
+				uint64_t prefix,
+				bool *found)
+{
+	size_t lo = 0, hi = n->len;
+
+	/* The default ordering counts the smaller prefixes without branches,
+	 * and only compares the keys sharing the prefix. */
+	if (t->cmp == NULL) {
+		for (size_t i = 0; i < n->len; i++)
+			lo += n->prefixes[i] < prefix;
+
+		while (lo < hi && n->prefixes[lo] == prefix) {
+			int cmp = lfi(btree_cmp)(t, n, lo, key, keylen, prefix);
+
+			if (cmp >= 0) {
+				*found = cmp == 0;
+
+				return lo;
+			}
+
+			lo++;
+		}
+
+		*found = false;
+
+		return lo;
+	}
+
+	/* The last key hi is moved to is the one at the returned index. */
+	*found = false;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = lfi(btree_cmp)(t, n, mid, key, keylen, prefix);
+
+		if (cmp < 0) {
+			lo = mid + 1;
+		} else {
+			*found = cmp == 0;
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+lfi_fdecl(struct lfi(btree_node) *, btree_new_node)(struct lf(btree) *t,
+						    bool leaf)
+{
+	struct lfi(btree_node) *n =
+		lf_alloc(&t->allocator, lf_btree_node_alloc_size(t, leaf));
+
+	if (n == NULL)
+		return NULL;
+
+	n->p = NULL;
+	n->len = 0;
+	n->leaf = leaf;
+
+	return n;
+}
+
+lfi_fdecl(void, btree_free_node)(struct lf(btree) *t, struct lfi(btree_node) *n)
+{
+	lfi(free)(&t->allocator, n, lf_btree_node_alloc_size(t, n->leaf));
+}
+
+lfi_fdecl(void, btree_free_key)(struct lf(btree) *t,
+				const struct lfi(btree_key) *k)
+{
+	if (!lf_btree_key_is_inline(k->keylen))
+		lfi(free)(&t->allocator, (void *) k->key.ptr, k->keylen);
+}
+
+/* Number of entries in the subtree rooted at n. */
+lfi_fdecl(size_t, btree_node_size)(const struct lf(btree) *t,
+				   struct lfi(btree_node) *n)
+{
+	size_t size = n->len;
+
+	if (!n->leaf) {
+		for (size_t i = 0; i <= n->len; i++)
+			size += lf_btree_counts(t, n)[i];
+	}
+
+	return size;
+}
+
+/* Index of the child in its parent. */
+lfi_fdecl(size_t, btree_child_index)(const struct lf(btree) *t,
+				     struct lfi(btree_node) *n)
+{
+	struct lfi(btree_node) **children = lf_btree_children(t, n->p);
+	size_t i = 0;
+
+	while (children[i] != n)
+		i++;
+
+	return i;
+}
+
+/* Moves the entries [from, from + count) of src to dst at index to. The
+ * ranges may overlap. */
+lfi_fdecl(void, btree_move_entries)(struct lf(btree) *t,
+				    struct lfi(btree_node) *dst,
+				    size_t to,
+				    struct lfi(btree_node) *src,
+				    size_t from,
+				    size_t count)
+{
+	memmove(&dst->prefixes[to], &src->prefixes[from],
+		count * sizeof(uint64_t));
+	memmove(&dst->keys[to], &src->keys[from],
+		count * sizeof(struct lfi(btree_key)));
+	memmove(lf_btree_value_at(t, dst, to), lf_btree_value_at(t, src, from),
+		count * lf_btree_stride(t));
+}
+
+/* Moves the children [from, from + count) of src, and their subtree sizes, to
+ * dst at index to. */
+lfi_fdecl(void, btree_move_children)(struct lf(btree) *t,
+				     struct lfi(btree_node) *dst,
+				     size_t to,
+				     struct lfi(btree_node) *src,
+				     size_t from,
+				     size_t count)
+{
+	struct lfi(btree_node) **children = lf_btree_children(t, dst);
+
+	memmove(&children[to], &lf_btree_children(t, src)[from],
+		count * sizeof(*children));
+	memmove(&lf_btree_counts(t, dst)[to], &lf_btree_counts(t, src)[from],
+		count * sizeof(size_t));
+
+	if (dst != src) {
+		for (size_t i = to; i < to + count; i++)
+			children[i]->p = dst;
+	}
+}
+
+/* Splits the full child i of x, moving its median key up into x. */
+lfi_fdecl(int, btree_split_child)(struct lf(btree) *t,
+				  struct lfi(btree_node) *x,
+				  size_t i)
+{
+	struct lfi(btree_node) *y = lf_btree_children(t, x)[i];
+	struct lfi(btree_node) *z = lfi(btree_new_node)(t, y->leaf);
+
+	if (z == NULL)
+		return 1;
+
+	z->p = x;
+	z->len = LF_BTREE_T - 1;
+	lfi(btree_move_entries)(t, z, 0, y, LF_BTREE_T, LF_BTREE_T - 1);
+
+	if (!y->leaf)
+		lfi(btree_move_children)(t, z, 0, y, LF_BTREE_T, LF_BTREE_T);
+
+	y->len = LF_BTREE_T - 1;
+
+	lfi(btree_move_children)(t, x, i + 2, x, i + 1, x->len - i);
+	lfi(btree_move_entries)(t, x, i + 1, x, i, x->len - i);
+	lfi(btree_move_entries)(t, x, i, y, LF_BTREE_T - 1, 1);
+	x->len++;
+
+	lf_btree_children(t, x)[i + 1] = z;
+	lf_btree_counts(t, x)[i] = lfi(btree_node_size)(t, y);
+	lf_btree_counts(t, x)[i + 1] = lfi(btree_node_size)(t, z);
+
+	return 0;
+}
+
+/* Merges the child i + 1 of x and the key i into the child i. */
+lfi_fdecl(void, btree_merge)(struct lf(btree) *t,
+			     struct lfi(btree_node) *x,
+			     size_t i)
+{
+	struct lfi(btree_node) *y = lf_btree_children(t, x)[i];
+	struct lfi(btree_node) *z = lf_btree_children(t, x)[i + 1];
+	size_t *counts = lf_btree_counts(t, x);
+
+	lfi(btree_move_entries)(t, y, y->len, x, i, 1);
+	lfi(btree_move_entries)(t, y, y->len + 1, z, 0, z->len);
+
+	if (!y->leaf)
+		lfi(btree_move_children)(t, y, y->len + 1, z, 0, z->len + 1);
+
+	y->len += z->len + 1;
+	counts[i] += counts[i + 1] + 1;
+
+	lfi(btree_move_entries)(t, x, i, x, i + 1, x->len - i - 1);
+	lfi(btree_move_children)(t, x, i + 1, x, i + 2, x->len - i - 1);
+	x->len--;
+
+	lfi(btree_free_node)(t, z);
+}
+
+/* Moves the last key of the child i - 1 of x up, and the key i - 1 of x down
+ * to the child i. */
+lfi_fdecl(void, btree_rotate_right)(struct lf(btree) *t,
+				    struct lfi(btree_node) *x,
+				    size_t i)
+{
+	struct lfi(btree_node) *left = lf_btree_children(t, x)[i - 1];
+	struct lfi(btree_node) *c = lf_btree_children(t, x)[i];
+	size_t moved = 1;
+
+	lfi(btree_move_entries)(t, c, 1, c, 0, c->len);
+	lfi(btree_move_entries)(t, c, 0, x, i - 1, 1);
+
+	if (!c->leaf) {
+		lfi(btree_move_children)(t, c, 1, c, 0, c->len + 1);
+		lfi(btree_move_children)(t, c, 0, left, left->len, 1);
+		moved += lf_btree_counts(t, c)[0];
+	}
+
+	lfi(btree_move_entries)(t, x, i - 1, left, left->len - 1, 1);
+	left->len--;
+	c->len++;
+
+	lf_btree_counts(t, x)[i - 1] -= moved;
+	lf_btree_counts(t, x)[i] += moved;
+}
+
+/* Moves the first key of the child i + 1 of x up, and the key i of x down to
+ * the child i. */
+lfi_fdecl(void, btree_rotate_left)(struct lf(btree) *t,
+				   struct lfi(btree_node) *x,
+				   size_t i)
+{
+	struct lfi(btree_node) *c = lf_btree_children(t, x)[i];
+	struct lfi(btree_node) *right = lf_btree_children(t, x)[i + 1];
+	size_t moved = 1;
+
+	lfi(btree_move_entries)(t, c, c->len, x, i, 1);
+	lfi(btree_move_entries)(t, x, i, right, 0, 1);
+	lfi(btree_move_entries)(t, right, 0, right, 1, right->len - 1);
+
+	if (!c->leaf) {
+		lfi(btree_move_children)(t, c, c->len + 1, right, 0, 1);
+		lfi(btree_move_children)(t, right, 0, right, 1, right->len);
+		moved += lf_btree_counts(t, c)[c->len + 1];
+	}
+
+	right->len--;
+	c->len++;
+
+	lf_btree_counts(t, x)[i] += moved;
+	lf_btree_counts(t, x)[i + 1] -= moved;
+}
+
+/* Removes the key from the subtree rooted at x, which must contain it. The
+ * key and the value are moved to out and out_value. x holds at least T keys,
+ * unless it is the root. */
+lfi_fdecl(void, btree_delete)(struct lf(btree) *t,
+			      struct lfi(btree_node) *x,
+			      const void *key,
+			      size_t keylen,
+			      struct lfi(btree_key) *out,
+			      uint64_t *out_prefix,
+			      void *out_value)
+{
+	uint64_t prefix = lfi(key_prefix)(key, keylen);
+
+	for (;;) {
+		bool found;
+		size_t i = lfi(btree_search)(t, x, key, keylen, prefix,
+					     &found);
+
+		if (found && x->leaf) {
+			*out = x->keys[i];
+			*out_prefix = x->prefixes[i];
+			memcpy(out_value, lf_btree_value_at(t, x, i),
+			       t->value_size);
+			lfi(btree_move_entries)(t, x, i, x, i + 1,
+						x->len - i - 1);
+			x->len--;
+
+			return;
+		}
+
+		struct lfi(btree_node) **children = lf_btree_children(t, x);
+		size_t *counts = lf_btree_counts(t, x);
+
+		if (found) {
+			struct lfi(btree_node) *y = children[i];
+			struct lfi(btree_node) *z = children[i + 1];
+			struct lfi(btree_key) k;
+
+			if (y->len < LF_BTREE_T && z->len < LF_BTREE_T) {
+				/* The key moves down into the merged child. */
+				lfi(btree_merge)(t, x, i);
+				counts[i]--;
+				x = y;
+
+				continue;
+			}
+
+			*out = x->keys[i];
+			*out_prefix = x->prefixes[i];
+			memcpy(out_value, lf_btree_value_at(t, x, i),
+			       t->value_size);
+
+			/* The key is replaced by its predecessor or
+			 * successor, taken from the child that can lose a
+			 * key. */
+			struct lfi(btree_node) *c, *n;
+
+			if (y->len >= LF_BTREE_T) {
+				c = n = y;
+
+				while (!n->leaf)
+					n = lf_btree_children(t, n)[n->len];
+
+				k = n->keys[n->len - 1];
+				counts[i]--;
+			} else {
+				c = n = z;
+
+				while (!n->leaf)
+					n = lf_btree_children(t, n)[0];
+
+				k = n->keys[0];
+				counts[i + 1]--;
+			}
+
+			lfi(btree_delete)(t, c, lf_btree_key_ptr(&k), k.keylen,
+					  &x->keys[i], &x->prefixes[i],
+					  lf_btree_value_at(t, x, i));
+
+			return;
+		}
+
+		/* The child is filled up before descending, so that it
+		 * can lose a key. */
+		if (children[i]->len < LF_BTREE_T) {
+			if (i > 0 && children[i - 1]->len >= LF_BTREE_T) {
+				lfi(btree_rotate_right)(t, x, i);
+			} else if (i < x->len &&
+				   children[i + 1]->len >= LF_BTREE_T) {
+				lfi(btree_rotate_left)(t, x, i);
+			} else {
+				if (i == x->len)
+					i--;
+
+				lfi(btree_merge)(t, x, i);
+			}
+		}
+
+		counts[i]--;
+		x = children[i];
+	}
+}
+
+/* Removes the counts added on the path from the root down to n. */
+lfi_fdecl(void, btree_uncount)(struct lf(btree) *t, struct lfi(btree_node) *n)
+{
+	for (; n->p != NULL; n = n->p)
+		lf_btree_counts(t, n->p)[lfi(btree_child_index)(t, n)]--;
+}
+
+lfi_fdecl(struct lfi(btree_node) *, btree_get2_node)(const struct lf(btree) *t,
+						     const void *key,
+						     size_t keylen,
+						     size_t *i)
+{
+	struct lfi(btree_node) *n = t->root;
+	uint64_t prefix = lfi(key_prefix)(key, keylen);
+
+	while (n != NULL) {
+		bool found;
+
+		*i = lfi(btree_search)(t, n, key, keylen, prefix, &found);
+
+		if (found)
+			return n;
+
+		n = n->leaf ? NULL : lf_btree_children(t, n)[*i];
+	}
+
+	return NULL;
+}
+
+lfi_fdecl(struct lfi(btree_node) *, btree_select_node)(struct lf(btree) *t,
+						       ptrdiff_t i_,
+						       size_t *i)
+{
+	size_t rank = lfi(circular_index)(i_, t->size);
+	struct lfi(btree_node) *n = t->root;
+
+	while (!n->leaf) {
+		size_t *counts = lf_btree_counts(t, n);
+		size_t j = 0;
+
+		while (rank > counts[j]) {
+			rank -= counts[j] + 1;
+			j++;
+		}
+
+		if (rank == counts[j]) {
+			*i = j;
+
+			return n;
+		}
+
+		n = lf_btree_children(t, n)[j];
+	}
+
+	*i = rank;
+
+	return n;
+}
+
+/* Moves the position to the in-order successor, n is NULL past the last
+ * entry. */
+lfi_fdecl(void, btree_successor)(struct lf(btree) *t,
+				 struct lfi(btree_node) **n,
+				 size_t *i)
+{
+	struct lfi(btree_node) *x = *n;
+
+	if (!x->leaf) {
+		x = lf_btree_children(t, x)[*i + 1];
+
+		while (!x->leaf)
+			x = lf_btree_children(t, x)[0];
+
+		*n = x;
+		*i = 0;
+	} else if (*i + 1 < x->len) {
+		(*i)++;
+	} else {
+		while (x->p != NULL) {
+			size_t j = lfi(btree_child_index)(t, x);
+
+			x = x->p;
+
+			if (j < x->len) {
+				*n = x;
+				*i = j;
+
+				return;
+			}
+		}
+
+		*n = NULL;
+	}
+}
+
+/* Moves the position to the in-order predecessor, n is NULL before the first
+ * entry. */
+lfi_fdecl(void, btree_predecessor)(struct lf(btree) *t,
+				   struct lfi(btree_node) **n,
+				   size_t *i)
+{
+	struct lfi(btree_node) *x = *n;
+
+	if (!x->leaf) {
+		x = lf_btree_children(t, x)[*i];
+
+		while (!x->leaf)
+			x = lf_btree_children(t, x)[x->len];
+
+		*n = x;
+		*i = x->len - 1;
+	} else if (*i > 0) {
+		(*i)--;
+	} else {
+		while (x->p != NULL) {
+			size_t j = lfi(btree_child_index)(t, x);
+
+			x = x->p;
+
+			if (j > 0) {
+				*n = x;
+				*i = j - 1;
+
+				return;
+			}
+		}
+
+		*n = NULL;
+	}
+}
+
+lfi_fdecl(struct lf(entry), btree_entry_of)(struct lf(btree) *t,
+					    struct lfi(btree_node) *n,
+					    size_t i)
+{
+	if (n == NULL)
+		return lfi_sentinel_entry;
+
+	return (struct lf(entry)) {
+		.key = lf_btree_key_ptr(&n->keys[i]),
+		.keylen = n->keys[i].keylen,
+		.value = lf_btree_value_at(t, n, i),
+	};
+}
+
+lfi_fdecl(void, btree_destroy_recursive)(struct lf(btree) *t,
+					 struct lfi(btree_node) *n)
+{
+	if (!n->leaf) {
+		for (size_t i = 0; i <= n->len; i++)
+			lfi(btree_destroy_recursive)(t,
+						     lf_btree_children(t, n)[i]);
+	}
+
+	for (size_t i = 0; i < n->len; i++)
+		lfi(btree_free_key)(t, &n->keys[i]);
+
+	lfi(btree_free_node)(t, n);
+}
+
+
+int lf(btree_init)(struct lf(btree) *t,
+		   size_t value_size,
+		   int (*cmp)(const void *, const void *, size_t, size_t))
+{
+	return lf(btree_init_with)(t, value_size, cmp, NULL);
+}
+
+void lf(btree_xinit)(struct lf(btree) *t,
+		     size_t value_size,
+		     int (*cmp)(const void *, const void *, size_t, size_t))
+{
+	lf_unwrap(lf(btree_init)(t, value_size, cmp));
+}
+
+int lf(btree_init_with)(struct lf(btree) *t,
+			size_t value_size,
+			int (*cmp)(const void *, const void *, size_t, size_t),
+			const struct lf(allocator) *allocator)
+{
+	t->allocator = allocator == NULL ? lf(allocator_libc) : *allocator;
+	t->root = NULL;
+	t->size = 0;
+	t->value_size = value_size;
+	t->cmp = cmp;
+
+	if (t->value_size)
+		t->hold_value = lf_alloc(&t->allocator, value_size);
+	else
+		t->hold_value = (void *) 1;
+
+	return t->hold_value == NULL ? 1 : 0;
+}
+
+void lf(btree_xinit_with)(struct lf(btree) *t,
+			  size_t value_size,
+			  int (*cmp)(const void *, const void *, size_t, size_t),
+			  const struct lf(allocator) *allocator)
+{
+	lf_unwrap(lf(btree_init_with)(t, value_size, cmp, allocator));
+}
+
+void lf(btree_destroy)(struct lf(btree) *t)
+{
+	if (t->root != NULL)
+		lfi(btree_destroy_recursive)(t, t->root);
+
+	if (t->value_size)
+		lfi(free)(&t->allocator, t->hold_value, t->value_size);
+}
+
+void *lf(btree_get)(struct lf(btree) *t, const void *key)
+{
+	return lf(btree_get2)(t, key, strlen(key));
+}
+
+void *lf(btree_get2)(struct lf(btree) *t, const void *key, size_t keylen)
+{
+	size_t i;
+	struct lfi(btree_node) *n = lfi(btree_get2_node)(t, key, keylen, &i);
+
+	return n != NULL ? lf_btree_value_at(t, n, i) : NULL;
+}
+
+void *lf(btree_insert)(struct lf(btree) *t, const void *key, const void *value)
+{
+	return lf(btree_insert2)(t, key, strlen(key), value);
+}
+
+void *lf(btree_xinsert)(struct lf(btree) *t,
+			const void *key,
+			const void *value)
+{
+	void *insert_res = lf(btree_insert)(t, key, value);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+void *lf(btree_insert2)(struct lf(btree) *t,
+			const void *key,
+			size_t keylen,
+			const void *value)
+{
+	struct lfi(btree_key) k = { .keylen = keylen };
+	uint64_t prefix = lfi(key_prefix)(key, keylen);
+
+	lf_debug_assert(lf(btree_get2)(t, key, keylen) == NULL,
+			"btree contains the element");
+
+	if (lf_btree_key_is_inline(keylen)) {
+		memcpy(k.key.bytes, key, keylen);
+	} else {
+		void *new_key = lf_alloc(&t->allocator, keylen);
+
+		if (new_key == NULL)
+			return NULL;
+
+		memcpy(new_key, key, keylen);
+		k.key.ptr = new_key;
+	}
+
+	if (t->root == NULL) {
+		t->root = lfi(btree_new_node)(t, true);
+
+		if (t->root == NULL)
+			goto fail;
+	} else if (t->root->len == LF_BTREE_MAX_KEYS) {
+		struct lfi(btree_node) *s = lfi(btree_new_node)(t, false);
+
+		if (s == NULL)
+			goto fail;
+
+		lf_btree_children(t, s)[0] = t->root;
+		lf_btree_counts(t, s)[0] = t->size;
+		t->root->p = s;
+
+		if (lfi(btree_split_child)(t, s, 0)) {
+			t->root->p = NULL;
+			lfi(btree_free_node)(t, s);
+
+			goto fail;
+		}
+
+		t->root = s;
+	}
+
+	/* Full nodes are split on the way down, so that the leaf has room for
+	 * the key. */
+	struct lfi(btree_node) *n = t->root;
+	bool found;
+	size_t i;
+
+	while (!n->leaf) {
+		i = lfi(btree_search)(t, n, key, keylen, prefix, &found);
+
+		struct lfi(btree_node) *c = lf_btree_children(t, n)[i];
+
+		if (c->len == LF_BTREE_MAX_KEYS) {
+			if (lfi(btree_split_child)(t, n, i)) {
+				lfi(btree_uncount)(t, n);
+
+				goto fail;
+			}
+
+			if (lfi(btree_cmp)(t, n, i, key, keylen, prefix) < 0)
+				i++;
+		}
+
+		lf_btree_counts(t, n)[i]++;
+		n = lf_btree_children(t, n)[i];
+	}
+
+	i = lfi(btree_search)(t, n, key, keylen, prefix, &found);
+
+	lfi(btree_move_entries)(t, n, i + 1, n, i, n->len - i);
+	n->prefixes[i] = prefix;
+	n->keys[i] = k;
+	n->len++;
+	t->size++;
+
+	void *v = lf_btree_value_at(t, n, i);
+
+	if (t->value_size && value != NULL)
+		memcpy(v, value, t->value_size);
+
+	return v;
+
+fail:
+	lfi(btree_free_key)(t, &k);
+
+	return NULL;
+}
+
+void *lf(btree_xinsert2)(struct lf(btree) *t,
+			 const void *key,
+			 size_t keylen,
+			 const void *value)
+{
+	void *insert_res = lf(btree_insert2)(t, key, keylen, value);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+const void *lf(btree_remove)(struct lf(btree) *t, const void *key)
+{
+	return lf(btree_remove2)(t, key, strlen(key));
+}
+
+const void *lf(btree_remove2)(struct lf(btree) *t,
+			      const void *key,
+			      size_t keylen)
+{
+	size_t i;
+	struct lfi(btree_key) k;
+	uint64_t prefix;
+
+	if (lfi(btree_get2_node)(t, key, keylen, &i) == NULL)
+		return NULL;
+
+	lfi(btree_delete)(t, t->root, key, keylen, &k, &prefix,
+			  t->hold_value);
+	lfi(btree_free_key)(t, &k);
+	t->size--;
+
+	struct lfi(btree_node) *root = t->root;
+
+	if (root->len == 0) {
+		t->root = root->leaf ? NULL : lf_btree_children(t, root)[0];
+
+		if (t->root != NULL)
+			t->root->p = NULL;
+
+		lfi(btree_free_node)(t, root);
+	}
+
+	return t->hold_value;
+}
+
+struct lf(entry) lf(btree_select)(struct lf(btree) *t, ptrdiff_t index)
+{
+	size_t i;
+	struct lfi(btree_node) *n = lfi(btree_select_node)(t, index, &i);
+
+	return lfi(btree_entry_of)(t, n, i);
+}
+
+size_t lf(btree_rank)(const struct lf(btree) *t, const void *key)
+{
+	return lf(btree_rank2)(t, key, strlen(key));
+}
+
+size_t lf(btree_rank2)(const struct lf(btree) *t,
+		       const void *key,
+		       size_t keylen)
+{
+	struct lfi(btree_node) *n = t->root;
+	uint64_t prefix = lfi(key_prefix)(key, keylen);
+	size_t rank = 0;
+
+	while (n != NULL) {
+		bool found;
+		size_t i = lfi(btree_search)(t, n, key, keylen, prefix,
+					     &found);
+
+		rank += i;
+
+		if (!n->leaf) {
+			size_t *counts = lf_btree_counts(t, n);
+
+			for (size_t j = 0; j < i; j++)
+				rank += counts[j];
+
+			if (found)
+				return rank + counts[i];
+
+			n = lf_btree_children(t, n)[i];
+		} else {
+			return found ? rank : (size_t) -1;
+		}
+	}
+
+	return -1;
+}
+
+size_t lf(btree_size)(const struct lf(btree) *t)
+{
+	return t->size;
+}
+
+void lf(btree_iter)(struct lf(btree) *t, struct lf(btree_it) *it)
+{
+	it->t = t;
+	it->n = NULL;
+
+	if (t->size)
+		it->n = lfi(btree_select_node)(t, 0, &it->i);
+}
+
+void lf(btree_iter_from)(struct lf(btree) *t,
+			 struct lf(btree_it) *it,
+			 ptrdiff_t index)
+{
+	it->t = t;
+	it->n = lfi(btree_select_node)(t, index, &it->i);
+}
+
+struct lf(entry) lf(btree_iter_next)(struct lf(btree_it) *it)
+{
+	struct lf(entry) e = lfi(btree_entry_of)(it->t, it->n, it->i);
+
+	if (it->n != NULL)
+		lfi(btree_successor)(it->t, &it->n, &it->i);
+
+	return e;
+}
+
+struct lf(entry) lf(btree_iter_prev)(struct lf(btree_it) *it)
+{
+	struct lf(entry) e = lfi(btree_entry_of)(it->t, it->n, it->i);
+
+	if (it->n != NULL)
+		lfi(btree_predecessor)(it->t, &it->n, &it->i);
+
+	return e;
+}
+#ifndef LF_HEADERONLY
+#include "util.h"
+#include "../include/config.h"
+#include "../include/dict.h"
+#include "../include/hashmap.h"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Index slots hold the position of an entry plus one, zero is empty. Slots of
+ * the removed entries are kept as tombstones until the index is rebuilt. */
+#define LF_DICT_INDEX_EMPTY 0
+
+/* Returned by dict_find() if the key is not found. */
+#define LF_DICT_NO_ENTRY SIZE_MAX
+
+#if LF_DICT_INITIAL_CAP < 8 || \
+	(LF_DICT_INITIAL_CAP & (LF_DICT_INITIAL_CAP - 1)) != 0
+#error "LF_DICT_INITIAL_CAP must be a power of two, not less than 8"
+#endif
+
+/* Number of entries a dict can hold with the given number of index slots.
+ * Removed entries also count until the entries are compacted. */
+#define lf_dict_usable(cap) ((cap) / 4 * 3)
+
+/* Width of an index slot in bytes, wide enough for lf_dict_usable(cap). */
+#define lf_dict_index_width(cap) \
+	((cap) <= UINT8_MAX + 1 ? 1 : (cap) <= UINT16_MAX + 1 ? 2 : \
+	 (cap) <= UINT32_MAX ? 4 : 8)
+
+/* Values are aligned to sizeof(size_t)-byte boundary in the entries. */
+#define lf_dict_stride(d) \
+	(sizeof(struct lfi(dict_entry)) + \
+	 ((d)->value_size + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t))
+
+#define lf_dict_entry_at(entries, i) \
+	((struct lfi(dict_entry) *) &((char *) entries)[(i) * lf_dict_stride(d)])
+
+#define lf_dict_entry_is_removed(e) ((e)->keylen == SIZE_MAX)
+
+#define lf_dict_key_is_inline(keylen) \
+	((keylen) <= LF_HASHMAP_INLINE_KEY_SIZE)
+
+#define lf_dict_entry_key(e) \
+	(lf_dict_key_is_inline((e)->keylen) ? \
+	 (const void *) (e)->key.bytes : (e)->key.ptr)
+
+
+/* Get the position of a key in the entries, or LF_DICT_NO_ENTRY. If the last
+ * argument is not NULL, the empty index slot ending the probe sequence is
+ * stored in it. */
+lfi_fdecl(size_t, dict_find)(struct lf(dict) *,
+			     uint64_t,
+			     const void *, size_t,
+			     size_t *);
+
+/* Rebuilds the index table from the entries. */
+lfi_fdecl(void, dict_reindex)(struct lf(dict) *);
+
+/* Moves the entries to the front of the array in place, dropping the removed
+ * ones, and rebuilds the index table. */
+lfi_fdecl(void, dict_compact)(struct lf(dict) *);
+
+/* Moves the entries to a new block with the given number of index slots,
+ * dropping the removed ones. */
+lfi_fdecl(int, dict_resize)(struct lf(dict) *, size_t);
+
+
+inline lfi_fdecl(size_t, dict_index_get)(struct lf(dict) *d, size_t i)
+{
+	switch (lf_dict_index_width(d->cap)) {
+	case 1:
+		return ((uint8_t *) d->index)[i];
+	case 2:
+		return ((uint16_t *) d->index)[i];
+	case 4:
+		return ((uint32_t *) d->index)[i];
+	default:
+		return ((uint64_t *) d->index)[i];
+	}
+}
+
+inline lfi_fdecl(void, dict_index_set)(struct lf(dict) *d,
+				       size_t i,
+				       size_t ix)
+{
+	switch (lf_dict_index_width(d->cap)) {
+	case 1:
+		((uint8_t *) d->index)[i] = ix;
+		break;
+	case 2:
+		((uint16_t *) d->index)[i] = ix;
+		break;
+	case 4:
+		((uint32_t *) d->index)[i] = ix;
+		break;
+	default:
+		((uint64_t *) d->index)[i] = ix;
+	}
+}
+
+/* Allocates the index table and the entries in a single block. One more entry
+ * than usable is allocated, used as a scratch entry. */
+lfi_fdecl(int, dict_alloc)(struct lf(dict) *d, size_t cap)
+{
+	/* The index table of at least 8 slots keeps the entries aligned. */
+	size_t index_size = cap * lf_dict_index_width(cap);
+	char *block = malloc(index_size +
+			     (lf_dict_usable(cap) + 1) * lf_dict_stride(d));
+
+	if (block == NULL)
+		return 1;
+
+	memset(block, LF_DICT_INDEX_EMPTY, index_size);
+
+	d->index = block;
+	d->entries = (struct lfi(dict_entry) *) &block[index_size];
+	d->cap = cap;
+
+	return 0;
+}
+
+int lf(dict_init)(struct lf(dict) *d,
+		  size_t value_size,
+		  uint64_t (*hash)(const void *, size_t))
+{
+	d->len = 0;
+	d->used = 0;
+	d->value_size = value_size;
+	d->hash = hash == NULL ? lf(hashmap_default_hash) : hash;
+
+	return lfi(dict_alloc)(d, LF_DICT_INITIAL_CAP);
+}
+
+void lf(dict_destroy)(struct lf(dict) *d)
+{
+	for (size_t i = 0; i < d->len; i++) {
+		struct lfi(dict_entry) *e = lf_dict_entry_at(d->entries, i);
+
+		if (!lf_dict_entry_is_removed(e) &&
+		    !lf_dict_key_is_inline(e->keylen))
+			free((void *) e->key.ptr);
+	}
+
+	free(d->index);
+}
+
+void *lf(dict_get)(struct lf(dict) *d, const void *key)
+{
+	return lf(dict_get2)(d, key, strlen(key));
+}
+
+void *lf(dict_get2)(struct lf(dict) *d, const void *key, size_t keylen)
+{
+	size_t i = lfi(dict_find)(d, d->hash(key, keylen), key, keylen, NULL);
+
+	if (i == LF_DICT_NO_ENTRY)
+		return NULL;
+
+	return lf_dict_entry_at(d->entries, i)->value;
+}
+
+void *lf(dict_insert)(struct lf(dict) *d, const void *key, const void *value)
+{
+	return lf(dict_insert2)(d, key, strlen(key), value);
+}
+
+void *lf(dict_insert2)(struct lf(dict) *d,
+		       const void *key,
+		       size_t keylen,
+		       const void *value)
+{
+	uint64_t hash = d->hash(key, keylen);
+	size_t slot;
+
+	lf_debug_assert(lfi(dict_find)(d, hash, key, keylen, &slot) ==
+			LF_DICT_NO_ENTRY, "dict contains the element");
+
+	void *new_key = NULL;
+
+	if (!lf_dict_key_is_inline(keylen)) {
+		new_key = malloc(keylen);
+
+		if (new_key == NULL)
+			return NULL;
+
+		memcpy(new_key, key, keylen);
+	}
+
+	/* If the removed entries make up the most of the array, they are
+	 * dropped without growing. */
+	if (d->len == lf_dict_usable(d->cap)) {
+		if (d->used * 2 < d->len) {
+			lfi(dict_compact)(d);
+		} else if (lfi(dict_resize)(d, d->cap * 2)) {
+			free(new_key);
+
+			return NULL;
+		}
+	}
+
+	/* Finds the empty slot ending the probe sequence. */
+	size_t mask = d->cap - 1;
+
+	for (slot = hash & mask;
+	     lfi(dict_index_get)(d, slot) != LF_DICT_INDEX_EMPTY;
+	     slot = (slot + 1) & mask)
+		;
+
+	struct lfi(dict_entry) *e = lf_dict_entry_at(d->entries, d->len);
+
+	e->hash = hash;
+	e->keylen = keylen;
+
+	if (new_key != NULL)
+		e->key.ptr = new_key;
+	else
+		memcpy(e->key.bytes, key, keylen);
+
+	if (d->value_size && value != NULL)
+		memcpy(e->value, value, d->value_size);
+
+	lfi(dict_index_set)(d, slot, ++d->len);
+	d->used++;
+
+	return e->value;
+}
+
+const void *lf(dict_remove)(struct lf(dict) *d, const void *key)
+{
+	return lf(dict_remove2)(d, key, strlen(key));
+}
+
+const void *lf(dict_remove2)(struct lf(dict) *d,
+			     const void *key,
+			     size_t keylen)
+{
+	size_t i = lfi(dict_find)(d, d->hash(key, keylen), key, keylen, NULL);
+
+	if (i == LF_DICT_NO_ENTRY)
+		return NULL;
+
+	struct lfi(dict_entry) *e = lf_dict_entry_at(d->entries, i);
+	struct lfi(dict_entry) *hold =
+		lf_dict_entry_at(d->entries, lf_dict_usable(d->cap));
+
+	/* Entry may be overwritten by compaction. */
+	memcpy(hold->value, e->value, d->value_size);
+
+	if (!lf_dict_key_is_inline(e->keylen))
+		free((void *) e->key.ptr);
+
+	e->keylen = SIZE_MAX;
+	d->used--;
+
+	/* Keeps iteration proportional to the number of entries. */
+	if (d->used * 2 < d->len - d->used)
+		lfi(dict_compact)(d);
+
+	return hold->value;
+}
+
+void lf(dict_iter)(struct lf(dict) *d, struct lf(dict_it) *it)
+{
+	it->d = d;
+	it->i = 0;
+}
+
+struct lf(entry) lf(dict_iter_next)(struct lf(dict_it) *it)
+{
+	struct lf(dict) *d = it->d;
+
+	while (it->i < d->len) {
+		struct lfi(dict_entry) *e = lf_dict_entry_at(d->entries, it->i++);
+
+		if (!lf_dict_entry_is_removed(e))
+			return (struct lf(entry)) {
+				.key = lf_dict_entry_key(e),
+				.keylen = e->keylen,
+				.value = e->value
+			};
+	}
+
+	return lfi_sentinel_entry;
+}
+
+void lf(dict_xinit)(struct lf(dict) *d,
+		    size_t value_size,
+		    uint64_t (*hash)(const void *, size_t))
+{
+	lf_unwrap(lf(dict_init)(d, value_size, hash));
+}
+
+void *lf(dict_xinsert)(struct lf(dict) *d, const void *key, const void *value)
+{
+	void *insert_res = lf(dict_insert)(d, key, value);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+void *lf(dict_xinsert2)(struct lf(dict) *d,
+			const void *key,
+			size_t keylen,
+			const void *value)
+{
+	void *insert_res = lf(dict_insert2)(d, key, keylen, value);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+
+lfi_fdecl(size_t, dict_find)(struct lf(dict) *d,
+			     uint64_t hash,
+			     const void *key,
+			     size_t keylen,
+			     size_t *slot)
+{
+	size_t mask = d->cap - 1;
+
+	for (size_t i = hash & mask;; i = (i + 1) & mask) {
+		size_t ix = lfi(dict_index_get)(d, i);
+
+		if (ix == LF_DICT_INDEX_EMPTY) {
+			if (slot != NULL)
+				*slot = i;
+
+			return LF_DICT_NO_ENTRY;
+		}
+
+		struct lfi(dict_entry) *e = lf_dict_entry_at(d->entries, ix - 1);
+
+		/* Removed entries never match, as their keylen is SIZE_MAX. */
+		if (e->hash == hash && e->keylen == keylen &&
+		    memcmp(lf_dict_entry_key(e), key, keylen) == 0)
+			return ix - 1;
+	}
+}
+
+lfi_fdecl(void, dict_reindex)(struct lf(dict) *d)
+{
+	size_t mask = d->cap - 1;
+
+	memset(d->index, LF_DICT_INDEX_EMPTY,
+	       d->cap * lf_dict_index_width(d->cap));
+
+	for (size_t i = 0; i < d->len; i++) {
+		size_t slot = lf_dict_entry_at(d->entries, i)->hash & mask;
+
+		while (lfi(dict_index_get)(d, slot) != LF_DICT_INDEX_EMPTY)
+			slot = (slot + 1) & mask;
+
+		lfi(dict_index_set)(d, slot, i + 1);
+	}
+}
+
+lfi_fdecl(void, dict_compact)(struct lf(dict) *d)
+{
+	size_t len = 0;
+
+	for (size_t i = 0; i < d->len; i++) {
+		struct lfi(dict_entry) *e = lf_dict_entry_at(d->entries, i);
+
+		if (lf_dict_entry_is_removed(e))
+			continue;
+
+		if (i != len)
+			memcpy(lf_dict_entry_at(d->entries, len), e,
+			       lf_dict_stride(d));
+
+		len++;
+	}
+
+	d->len = len;
+
+	lfi(dict_reindex)(d);
+}
+
+lfi_fdecl(int, dict_resize)(struct lf(dict) *d, size_t cap)
+{
+	struct lf(dict) old = *d;
+
+	if (lfi(dict_alloc)(d, cap))
+		return 1;
+
+	d->len = 0;
+
+	for (size_t i = 0; i < old.len; i++) {
+		struct lfi(dict_entry) *e = lf_dict_entry_at(old.entries, i);
+
+		if (!lf_dict_entry_is_removed(e))
+			memcpy(lf_dict_entry_at(d->entries, d->len++), e,
+			       lf_dict_stride(d));
+	}
+
+	lfi(dict_reindex)(d);
+
+	free(old.index);
+
+	return 0;
+}
+#ifndef LF_HEADERONLY
+/* mmap() for the hashmap snapshots, sched_yield() for the chashmap locks. */
+#define _POSIX_C_SOURCE 200809L
+
+#include "util.h"
+#include "../include/config.h"
+#include "../include/hashmap.h"
+#include "../include/chashmap.h"
+#include "hashmap_ctrl.h"
+#endif
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <stdio.h>
+
+/* Header-only users get the mapping, and the chashmap locks yield the
+ * processor while waiting, only if they enable POSIX. */
+#if defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 200112L
+#define LF_HASHMAP_MMAP
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define lf_chashmap_yield() sched_yield()
+#else
+#define lf_chashmap_yield() ((void) 0)
+#endif
+
+
+/* Bitmask of all the slots of a group, see hashmap_ctrl.h. */
+#define LF_HASHMAP_GROUP_MASK ((uint32_t) 0xffff)
+
+/* Number of keys hashed and prefetched together by hashmap_get_many(). */
+#define LF_HASHMAP_PREFETCH_BATCH 32
+
+/* Returned by hashmap_find() if the key is not found. */
+#define LF_HASHMAP_NO_SLOT SIZE_MAX
+
+#if LF_HASHMAP_INITIAL_CAP < LF_HASHMAP_GROUP_WIDTH || \
+	(LF_HASHMAP_INITIAL_CAP & (LF_HASHMAP_INITIAL_CAP - 1)) != 0
+#error "LF_HASHMAP_INITIAL_CAP must be a power of two, not less than 16"
+#endif
+
+/* Values are aligned to sizeof(size_t)-byte boundary in the entries. */
+#define lf_hashmap_stride(m) \
+	(sizeof(struct lfi(hashmap_entry)) + \
+	 ((m)->value_size + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t))
+
+/* Size of the allocation holding a table of the given capacity. */
+#define lf_hashmap_table_size(m, cap) \
+	((cap) + ((cap) + 1) * lf_hashmap_stride(m))
+
+#define lf_hashmap_entry_at(entries, i) \
+	((struct lfi(hashmap_entry) *) &((char *) entries) \
+	 [(i) * lf_hashmap_stride(m)])
+
+#define lf_hashmap_key_is_inline(keylen) \
+	((keylen) <= LF_HASHMAP_INLINE_KEY_SIZE)
+
+/* NULL if the key of a mapped file lies out of its key section. */
+#define lf_hashmap_entry_key(e) \
+	(lf_hashmap_key_is_inline((e)->keylen) ? \
+	 (const void *) (e)->key.bytes : \
+	 m->keys != NULL ? lfi(hashmap_mapped_key)(m, e) : \
+	 (e)->key.ptr)
+
+/* Counters of the operations, see hashmap_stats(). */
+#ifdef LF_HASHMAP_COUNTERS
+#define lf_hashmap_count(m, counter, n) ((m)->counters.counter += (n))
+
+/* Takes the counts made through a view of the hashmap, such as the old table
+ * during incremental rehashing. */
+#define lf_hashmap_count_merge(m, view) ((m)->counters = (view)->counters)
+#else
+#define lf_hashmap_count(m, counter, n) ((void) 0)
+#define lf_hashmap_count_merge(m, view) ((void) 0)
+#endif
+
+/* Snapshot files start with this magic, followed by an integer telling the
+ * byte order of the writer. */
+#define LF_HASHMAP_FILE_MAGIC "libfun\0hashmap1"
+#define LF_HASHMAP_FILE_BYTE_ORDER UINT64_C(0x0102030405060708)
+
+/* Sections of the snapshot files are aligned to cache lines. */
+#define lf_hashmap_file_align(off) (((off) + 63) / 64 * 64)
+
+/* Header of the snapshot files. */
+struct lfi(hashmap_file_header) {
+	char magic[16];
+	uint64_t byte_order;
+
+	/* Hash of a fixed string, to check the hash function. */
+	uint64_t hash_check;
+
+	uint64_t inline_key_size;
+	uint64_t stride;
+	uint64_t value_size;
+	uint64_t flags;
+	uint64_t cap;
+	uint64_t used;
+
+	uint64_t ctrl_offset;
+	uint64_t entries_offset;
+	uint64_t keys_offset;
+	uint64_t keys_size;
+};
+
+
+/* Linear probe sequence over the control groups. The first group is entered
+ * at the home slot of the hash, and the slots of it preceding the home slot
+ * are visited last, after wrapping around the table. */
+struct lfi(hashmap_probe) {
+	/* First slot of the current group. */
+	size_t base;
+
+	/* Slots of the current group that are part of the sequence. */
+	uint32_t valid;
+
+	/* Slots of the home group preceding the home slot. */
+	uint32_t wrap;
+
+	size_t visit;
+};
+
+
+/* Inserts a key that is not in the hashmap. */
+lfi_fdecl(void *, hashmap_insert_new)(struct lf(hashmap) *,
+				      uint64_t,
+				      const void *, size_t,
+				      const void *,
+				      size_t);
+
+/* Moves the entries to a bucket with the given capacity, using the hashes
+ * stored in the entries. */
+lfi_fdecl(int, hashmap_rehash)(struct lf(hashmap) *, size_t);
+
+/* Allocates a bucket with the given capacity, and keeps the current one as
+ * the old table, whose entries are migrated by the following insert and remove
+ * operations. */
+lfi_fdecl(int, hashmap_rehash_incremental)(struct lf(hashmap) *, size_t);
+
+/* Get the slot index of a key, or LF_HASHMAP_NO_SLOT. If the last argument
+ * is not NULL, the first free slot seen in the probe sequence is stored in
+ * it. */
+lfi_fdecl(size_t, hashmap_find)(struct lf(hashmap) *,
+				uint64_t,
+				const void *, size_t,
+				size_t *);
+
+/* Claims a slot for a new entry with the given hash, the caller fills the
+ * entry. The last argument is a free slot in the probe sequence of the hash
+ * if already known, or LF_HASHMAP_NO_SLOT. */
+lfi_fdecl(size_t, hashmap_claim)(struct lf(hashmap) *, uint64_t, size_t);
+
+/* Empties the slot of a removed entry. */
+lfi_fdecl(void, hashmap_release)(struct lf(hashmap) *, size_t);
+
+/* Get an entry from the table, or from the old table during incremental
+ * rehashing. */
+lfi_fdecl(struct lfi(hashmap_entry) *, hashmap_get_entry)(struct lf(hashmap) *,
+							  uint64_t,
+							  const void *,
+							  size_t);
+
+/* Moves the entries in the next given number of slots of the old table to
+ * the table, in incremental rehashing. */
+lfi_fdecl(void, hashmap_migrate)(struct lf(hashmap) *, size_t);
+
+/* hashmap_get_or_insert2() and hashmap_remove2() with the hash of the key
+ * already computed. */
+lfi_fdecl(void *, hashmap_get_or_insert_hashed)(struct lf(hashmap) *,
+						uint64_t,
+						const void *, size_t,
+						const void *,
+						bool *);
+
+lfi_fdecl(const void *, hashmap_remove_hashed)(struct lf(hashmap) *,
+					       uint64_t,
+					       const void *, size_t);
+
+
+/* Keys of a mapped file are checked as they are read, rather than when the
+ * file is opened, so that opening does not read the entries. */
+inline lfi_fdecl(const void *, hashmap_mapped_key)(
+	const struct lf(hashmap) *m,
+	const struct lfi(hashmap_entry) *e)
+{
+	if (e->keylen > m->keys_size ||
+	    e->key.offset > m->keys_size - e->keylen)
+		return NULL;
+
+	return &m->keys[e->key.offset];
+}
+
+inline lfi_fdecl(void, hashmap_probe_start)(struct lf(hashmap) *m,
+					    uint64_t hash,
+					    struct lfi(hashmap_probe) *p)
+{
+	size_t home = hash & (m->cap - 1);
+	unsigned offset = home % LF_HASHMAP_GROUP_WIDTH;
+
+	p->base = home - offset;
+	p->valid = (LF_HASHMAP_GROUP_MASK << offset) & LF_HASHMAP_GROUP_MASK;
+	p->wrap = ~p->valid & LF_HASHMAP_GROUP_MASK;
+	p->visit = 0;
+}
+
+/* Advances to the next group, returns false if all slots are visited. */
+inline lfi_fdecl(bool, hashmap_probe_next)(struct lf(hashmap) *m,
+					   struct lfi(hashmap_probe) *p)
+{
+	size_t groups = m->cap / LF_HASHMAP_GROUP_WIDTH;
+
+	if (++p->visit > groups)
+		return false;
+
+	p->base = (p->base + LF_HASHMAP_GROUP_WIDTH) & (m->cap - 1);
+	p->valid = p->visit == groups ? p->wrap : LF_HASHMAP_GROUP_MASK;
+
+	return p->valid != 0;
+}
+
+/* Maximum number of used and deleted slots of a table of the given capacity.
+ * At least one slot is kept empty, so that the probe sequences end. */
+lfi_fdecl(size_t, hashmap_grow_at)(struct lf(hashmap) *m, size_t cap)
+{
+	size_t n = (size_t) ((double) cap * m->max_load);
+
+	return n < cap ? n : cap - 1;
+}
+
+/* Smallest capacity holding n entries, zero if it overflows. */
+lfi_fdecl(size_t, hashmap_cap_for)(struct lf(hashmap) *m, size_t n)
+{
+	size_t cap = LF_HASHMAP_GROUP_WIDTH;
+
+	while (lfi(hashmap_grow_at)(m, cap) < n) {
+		if (cap > SIZE_MAX / 4)
+			return 0;
+
+		cap *= 2;
+	}
+
+	return cap;
+}
+
+/* Allocates the control bytes and the entries of the given capacity in a
+ * single block. One more entry than the capacity is allocated, used as a
+ * scratch entry. */
+lfi_fdecl(int, hashmap_alloc)(struct lf(hashmap) *m, size_t cap)
+{
+	unsigned char *ctrl = lf_alloc(&m->allocator,
+				       lf_hashmap_table_size(m, cap));
+
+	if (ctrl == NULL)
+		return 1;
+
+	memset(ctrl, LF_HASHMAP_CTRL_EMPTY, cap);
+
+	m->ctrl = ctrl;
+	m->entries = (struct lfi(hashmap_entry) *) &ctrl[cap];
+	m->cap = cap;
+	m->deleted = 0;
+	m->grow_at = lfi(hashmap_grow_at)(m, cap);
+
+	return 0;
+}
+
+/* The old table during incremental rehashing, viewed as a hashmap. Entries
+ * are removed from it by marking their slots deleted, as migration walks its
+ * slots in order. */
+inline lfi_fdecl(struct lf(hashmap), hashmap_old)(struct lf(hashmap) *m)
+{
+	struct lf(hashmap) old = *m;
+
+	old.ctrl = m->old_ctrl;
+	old.entries = (struct lfi(hashmap_entry) *) &m->old_ctrl[m->old_cap];
+	old.cap = m->old_cap;
+	old.flags &= ~LF_HASHMAP_ROBIN_HOOD;
+
+	return old;
+}
+
+/* Distance of the entry in slot i from its home slot. */
+inline lfi_fdecl(size_t, hashmap_distance)(struct lf(hashmap) *m, size_t i)
+{
+	return (i - lf_hashmap_entry_at(m->entries, i)->hash) & (m->cap - 1);
+}
+
+lfi_fdecl(void, hashmap_move)(struct lf(hashmap) *m, size_t to, size_t from)
+{
+	m->ctrl[to] = m->ctrl[from];
+	memcpy(lf_hashmap_entry_at(m->entries, to),
+	       lf_hashmap_entry_at(m->entries, from),
+	       lf_hashmap_stride(m));
+}
+
+/* Robin Hood insertion. The new entry takes the first slot whose entry is
+ * closer to its home slot than the new one would be, and the rest of the
+ * cluster is shifted forward by one slot. */
+lfi_fdecl(size_t, hashmap_claim_robin_hood)(struct lf(hashmap) *m,
+					    uint64_t hash)
+{
+	size_t mask = m->cap - 1;
+	size_t i = hash & mask;
+
+	for (size_t dist = 0; lf_hashmap_ctrl_is_full(m->ctrl[i]); dist++) {
+		if (lfi(hashmap_distance)(m, i) < dist)
+			break;
+
+		i = (i + 1) & mask;
+	}
+
+	size_t j = i;
+
+	while (lf_hashmap_ctrl_is_full(m->ctrl[j]))
+		j = (j + 1) & mask;
+
+	for (; j != i; j = (j - 1) & mask)
+		lfi(hashmap_move)(m, j, (j - 1) & mask);
+
+	m->ctrl[i] = lf_hashmap_tag(hash);
+
+	return i;
+}
+
+/* Backward-shift deletion. The entries following the removed one are moved
+ * back by one slot until an empty slot or an entry at its home slot. */
+lfi_fdecl(void, hashmap_release_robin_hood)(struct lf(hashmap) *m, size_t i)
+{
+	size_t mask = m->cap - 1;
+	size_t j = (i + 1) & mask;
+
+	while (lf_hashmap_ctrl_is_full(m->ctrl[j]) &&
+	       lfi(hashmap_distance)(m, j) != 0) {
+		lfi(hashmap_move)(m, i, j);
+
+		i = j;
+		j = (j + 1) & mask;
+	}
+
+	m->ctrl[i] = LF_HASHMAP_CTRL_EMPTY;
+}
+
+
+/* Unaligned native-endian load of a 64-bit word. */
+inline lfi_fdecl(uint64_t, hashmap_load64)(const unsigned char *p)
+{
+	uint64_t w;
+
+	memcpy(&w, p, sizeof(w));
+
+	return w;
+}
+
+/* MurmurHash3 finalizer. */
+inline lfi_fdecl(uint64_t, hashmap_fmix64)(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccd;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53;
+	h ^= h >> 33;
+
+	return h;
+}
+
+
+uint64_t lf(hashmap_default_hash)(const void *key_, size_t keylen)
+{
+	const unsigned char *key = key_;
+	uint64_t hash = 0x9e3779b97f4a7c15 ^ keylen;
+
+	for (; keylen >= 8; key += 8, keylen -= 8) {
+		/* The word multiply is off the dependency chain, only the
+		 * rotation and a multiply are carried between words. */
+		hash ^= lfi(hashmap_load64)(key) * 0xbf58476d1ce4e5b9;
+		hash = ((hash << 31) | (hash >> 33)) * 0x94d049bb133111eb;
+	}
+
+	if (keylen) {
+		uint64_t tail = 0;
+
+		memcpy(&tail, key, keylen);
+
+		hash ^= tail * 0xbf58476d1ce4e5b9;
+		hash = ((hash << 31) | (hash >> 33)) * 0x94d049bb133111eb;
+	}
+
+	return lfi(hashmap_fmix64)(hash);
+}
+
+/* https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function */
+uint64_t lf(hashmap_fnv_hash)(const void *key_, size_t keylen)
+{
+	const unsigned char *key = key_;
+	uint64_t hash = 0xcbf29ce484222325;
+
+	for (size_t i = 0; i < keylen; i++) {
+		hash *= 0x100000001b3;
+		hash ^= key[i];
+	}
+
+	return hash;
+}
+
+int lf(hashmap_init)(struct lf(hashmap) *m,
+		     size_t value_size,
+		     uint64_t (*hash)(const void *, size_t),
+		     int flags)
+{
+	return lf(hashmap_init_with)(m, value_size, hash, flags, NULL);
+}
+
+int lf(hashmap_init_with)(struct lf(hashmap) *m,
+			  size_t value_size,
+			  uint64_t (*hash)(const void *, size_t),
+			  int flags,
+			  const struct lf(allocator) *allocator)
+{
+	m->allocator = allocator == NULL ? lf(allocator_libc) : *allocator;
+	m->used = 0;
+	m->flags = flags;
+	m->hash = hash == NULL ? lf(hashmap_default_hash) : hash;
+	m->value_size = value_size;
+	m->max_load = LF_HASHMAP_MAX_LOAD;
+	m->old_ctrl = NULL;
+	m->mapping = NULL;
+	m->keys = NULL;
+
+#ifdef LF_HASHMAP_COUNTERS
+	memset(&m->counters, 0, sizeof(m->counters));
+#endif
+
+	return lfi(hashmap_alloc)(m, LF_HASHMAP_INITIAL_CAP);
+}
+
+void lf(hashmap_destroy)(struct lf(hashmap) *m)
+{
+	struct lf(hashmap_it) it;
+	struct lf(entry) e;
+
+	if (m->mapping != NULL) {
+#ifdef LF_HASHMAP_MMAP
+		munmap(m->mapping, m->mapping_size);
+#else
+		free(m->mapping);
+#endif
+		return;
+	}
+
+	lf(hashmap_iter)(m, &it);
+
+	while (lf(entry_is_valid)(e = lf(hashmap_iter_next)(&it))) {
+		if (!lf_hashmap_key_is_inline(e.keylen))
+			lfi(free)(&m->allocator, (void *) e.key, e.keylen);
+	}
+
+	lfi(free)(&m->allocator, m->old_ctrl,
+		  lf_hashmap_table_size(m, m->old_cap));
+	lfi(free)(&m->allocator, m->ctrl, lf_hashmap_table_size(m, m->cap));
+}
+
+int lf(hashmap_reserve)(struct lf(hashmap) *m, size_t n)
+{
+	if (n <= m->grow_at)
+		return 0;
+
+	size_t cap = lfi(hashmap_cap_for)(m, n);
+
+	if (cap == 0)
+		return 1;
+
+	/* Entries of the old table are moved along with the rest. */
+	if (m->old_ctrl != NULL)
+		lfi(hashmap_migrate)(m, SIZE_MAX);
+
+	return lfi(hashmap_rehash)(m, cap);
+}
+
+void lf(hashmap_clear)(struct lf(hashmap) *m)
+{
+	struct lf(hashmap_it) it;
+	struct lf(entry) e;
+
+	lf_assert(m->mapping == NULL, "hashmap is read-only");
+
+	lf(hashmap_iter)(m, &it);
+
+	while (lf(entry_is_valid)(e = lf(hashmap_iter_next)(&it))) {
+		if (!lf_hashmap_key_is_inline(e.keylen))
+			lfi(free)(&m->allocator, (void *) e.key, e.keylen);
+	}
+
+	lfi(free)(&m->allocator, m->old_ctrl,
+		  lf_hashmap_table_size(m, m->old_cap));
+	m->old_ctrl = NULL;
+
+	memset(m->ctrl, LF_HASHMAP_CTRL_EMPTY, m->cap);
+	m->used = 0;
+	m->deleted = 0;
+}
+
+int lf(hashmap_shrink_to_fit)(struct lf(hashmap) *m)
+{
+	size_t cap = lfi(hashmap_cap_for)(m, m->used);
+
+	if (cap == m->cap && m->deleted == 0 && m->old_ctrl == NULL)
+		return 0;
+
+	if (m->old_ctrl != NULL)
+		lfi(hashmap_migrate)(m, SIZE_MAX);
+
+	return lfi(hashmap_rehash)(m, cap);
+}
+
+void lf(hashmap_set_max_load)(struct lf(hashmap) *m, double max_load)
+{
+	lf_assert(max_load > 0 && max_load <= 1, "max_load out of range");
+
+	m->max_load = max_load;
+	m->grow_at = lfi(hashmap_grow_at)(m, m->cap);
+}
+
+void *lf(hashmap_get)(struct lf(hashmap) *m, const void *key)
+{
+	return lf(hashmap_get2)(m, key, strlen(key));
+}
+
+void *lf(hashmap_get2)(struct lf(hashmap) *m, const void *key, size_t keylen)
+{
+	struct lfi(hashmap_entry) *e =
+		lfi(hashmap_get_entry)(m, m->hash(key, keylen), key, keylen);
+
+	return e ? e->value : NULL;
+}
+
+size_t lf(hashmap_get_many)(struct lf(hashmap) *m,
+			    size_t n,
+			    const void *const *keys,
+			    const size_t *keylens,
+			    void **values)
+{
+	uint64_t hashes[LF_HASHMAP_PREFETCH_BATCH];
+	size_t found = 0;
+
+	for (size_t batch = 0; batch < n; batch += LF_HASHMAP_PREFETCH_BATCH) {
+		size_t len = n - batch < LF_HASHMAP_PREFETCH_BATCH ?
+			n - batch : LF_HASHMAP_PREFETCH_BATCH;
+
+		/* Start loading the home slots of the whole batch before
+		 * waiting on any of them. */
+		for (size_t k = 0; k < len; k++) {
+			size_t home;
+
+			hashes[k] = m->hash(keys[batch + k], keylens[batch + k]);
+			home = hashes[k] & (m->cap - 1);
+
+			lf_prefetch(&m->ctrl[home]);
+			lf_prefetch(lf_hashmap_entry_at(m->entries, home));
+		}
+
+		for (size_t k = 0; k < len; k++) {
+			struct lfi(hashmap_entry) *e = lfi(hashmap_get_entry)(
+				m, hashes[k], keys[batch + k], keylens[batch + k]);
+
+			if (e != NULL) {
+				values[batch + k] = e->value;
+				found++;
+			} else {
+				values[batch + k] = NULL;
+			}
+		}
+	}
+
+	return found;
+}
+
+const void *lf(hashmap_remove)(struct lf(hashmap) *m, const void *key)
+{
+	return lf(hashmap_remove2)(m, key, strlen(key));
+}
+
+const void *lf(hashmap_remove2)(struct lf(hashmap) *m,
+				const void *key,
+				size_t keylen)
+{
+	return lfi(hashmap_remove_hashed)(m, m->hash(key, keylen), key, keylen);
+}
+
+void *lf(hashmap_insert)(struct lf(hashmap) *m, const void *key, const void *value)
+{
+	return lf(hashmap_insert2)(m, key, strlen(key), value);
+}
+
+void *lf(hashmap_insert2)(struct lf(hashmap) *m,
+			  const void *key,
+			  size_t keylen,
+			  const void *value)
+{
+	uint64_t hash = m->hash(key, keylen);
+
+	lf_debug_assert(!lfi(hashmap_get_entry)(m, hash, key, keylen),
+			"hashmap contains the element");
+
+	return lfi(hashmap_insert_new)(m, hash, key, keylen, value,
+				       LF_HASHMAP_NO_SLOT);
+}
+
+void *lf(hashmap_get_or_insert)(struct lf(hashmap) *m,
+				const void *key,
+				const void *value,
+				bool *inserted)
+{
+	return lf(hashmap_get_or_insert2)(m, key, strlen(key), value, inserted);
+}
+
+void *lf(hashmap_get_or_insert2)(struct lf(hashmap) *m,
+				 const void *key,
+				 size_t keylen,
+				 const void *value,
+				 bool *inserted)
+{
+	return lfi(hashmap_get_or_insert_hashed)(m, m->hash(key, keylen),
+						 key, keylen, value, inserted);
+}
+
+void *lf(hashmap_upsert)(struct lf(hashmap) *m,
+			 const void *key,
+			 const void *value,
+			 bool *inserted)
+{
+	return lf(hashmap_upsert2)(m, key, strlen(key), value, inserted);
+}
+
+void *lf(hashmap_upsert2)(struct lf(hashmap) *m,
+			  const void *key,
+			  size_t keylen,
+			  const void *value,
+			  bool *inserted)
+{
+	bool inserted_;
+	void *v = lf(hashmap_get_or_insert2)(m, key, keylen, value, &inserted_);
+
+	if (v != NULL && !inserted_ && m->value_size && value != NULL)
+		memcpy(v, value, m->value_size);
+
+	if (inserted != NULL)
+		*inserted = inserted_;
+
+	return v;
+}
+
+/* Writes n zero bytes, returns non-zero on failure. */
+lfi_fdecl(int, hashmap_file_pad)(FILE *f, size_t n)
+{
+	static const char pad[64];
+
+	return n != 0 && fwrite(pad, n, 1, f) != 1;
+}
+
+int lf(hashmap_save)(struct lf(hashmap) *m, const char *path)
+{
+	size_t stride = lf_hashmap_stride(m);
+	struct lfi(hashmap_file_header) h = {
+		.magic = LF_HASHMAP_FILE_MAGIC,
+		.byte_order = LF_HASHMAP_FILE_BYTE_ORDER,
+		.hash_check = m->hash(LF_HASHMAP_FILE_MAGIC,
+				      sizeof(LF_HASHMAP_FILE_MAGIC)),
+		.inline_key_size = LF_HASHMAP_INLINE_KEY_SIZE,
+		.stride = stride,
+		.value_size = m->value_size,
+		.flags = m->flags & LF_HASHMAP_ROBIN_HOOD,
+	};
+
+	if (m->old_ctrl != NULL)
+		lfi(hashmap_migrate)(m, SIZE_MAX);
+
+	h.cap = m->cap;
+	h.used = m->used;
+	h.ctrl_offset = lf_hashmap_file_align(sizeof(h));
+	h.entries_offset = lf_hashmap_file_align(h.ctrl_offset + m->cap);
+	h.keys_offset = h.entries_offset + m->cap * stride;
+
+	struct lfi(hashmap_entry) *buf = calloc(1, stride);
+	FILE *f = fopen(path, "wb");
+	int err = buf == NULL || f == NULL;
+
+	if (!err)
+		err = fwrite(&h, sizeof(h), 1, f) != 1 ||
+		      lfi(hashmap_file_pad)(f, h.ctrl_offset - sizeof(h)) ||
+		      fwrite(m->ctrl, m->cap, 1, f) != 1 ||
+		      lfi(hashmap_file_pad)(f, h.entries_offset -
+					       h.ctrl_offset - m->cap);
+
+	/* Long keys are written after the entries, in the order of their
+	 * slots. */
+	for (size_t i = 0; !err && i < m->cap; i++) {
+		struct lfi(hashmap_entry) *e = lf_hashmap_entry_at(m->entries, i);
+
+		if (lf_hashmap_ctrl_is_full(m->ctrl[i])) {
+			memcpy(buf, e, stride);
+
+			if (!lf_hashmap_key_is_inline(e->keylen)) {
+				buf->key.offset = h.keys_size;
+				h.keys_size += e->keylen;
+			}
+		} else {
+			memset(buf, 0, stride);
+		}
+
+		err = fwrite(buf, stride, 1, f) != 1;
+	}
+
+	for (size_t i = 0; !err && i < m->cap; i++) {
+		struct lfi(hashmap_entry) *e = lf_hashmap_entry_at(m->entries, i);
+
+		const void *key;
+
+		/* A damaged key of a mapped file fails the save. */
+		if (lf_hashmap_ctrl_is_full(m->ctrl[i]) &&
+		    !lf_hashmap_key_is_inline(e->keylen))
+			err = (key = lf_hashmap_entry_key(e)) == NULL ||
+				fwrite(key, e->keylen, 1, f) != 1;
+	}
+
+	/* The size of the key section is known after it is written. */
+	if (!err)
+		err = fseek(f, 0, SEEK_SET) != 0 ||
+		      fwrite(&h, sizeof(h), 1, f) != 1;
+
+	if (f != NULL && fclose(f) != 0)
+		err = 1;
+
+	free(buf);
+
+	return err;
+}
+
+/* Checks the header of a snapshot file of the given size. The sections must
+ * lie in the file without wrapping around, so the counts are checked by
+ * division, as the header may hold any values. The entries are not read, the
+ * keys are checked by hashmap_mapped_key() as they are looked up. */
+lfi_fdecl(bool, hashmap_file_check)(const struct lfi(hashmap_file_header) *h,
+				    size_t size,
+				    uint64_t (*hash)(const void *, size_t))
+{
+	return size >= sizeof(*h) &&
+		memcmp(h->magic, LF_HASHMAP_FILE_MAGIC,
+		       sizeof(h->magic)) == 0 &&
+		h->byte_order == LF_HASHMAP_FILE_BYTE_ORDER &&
+		h->hash_check == hash(LF_HASHMAP_FILE_MAGIC,
+				      sizeof(LF_HASHMAP_FILE_MAGIC)) &&
+		h->inline_key_size == LF_HASHMAP_INLINE_KEY_SIZE &&
+		h->value_size <= size &&
+		h->stride == lf_hashmap_stride(&(struct lf(hashmap)) {
+			.value_size = h->value_size }) &&
+		(h->flags & ~(uint64_t) LF_HASHMAP_ROBIN_HOOD) == 0 &&
+		h->cap >= LF_HASHMAP_GROUP_WIDTH &&
+		(h->cap & (h->cap - 1)) == 0 && h->used <= h->cap &&
+		h->ctrl_offset >= sizeof(*h) && h->ctrl_offset <= size &&
+		h->cap <= size - h->ctrl_offset &&
+		h->entries_offset >= h->ctrl_offset + h->cap &&
+		h->entries_offset <= size &&
+		h->entries_offset % sizeof(size_t) == 0 &&
+		h->cap <= (size - h->entries_offset) / h->stride &&
+		h->keys_offset >= h->entries_offset + h->cap * h->stride &&
+		h->keys_offset <= size && h->keys_size <= size - h->keys_offset;
+}
+
+int lf(hashmap_open_mapped)(struct lf(hashmap) *m,
+			    const char *path,
+			    uint64_t (*hash)(const void *, size_t))
+{
+	void *mapping = NULL;
+	size_t size = 0;
+
+#ifdef LF_HASHMAP_MMAP
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+
+	if (fd < 0)
+		return 1;
+
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		size = st.st_size;
+		mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+
+		if (mapping == MAP_FAILED)
+			mapping = NULL;
+	}
+
+	close(fd);
+#else
+	FILE *f = fopen(path, "rb");
+
+	if (f == NULL)
+		return 1;
+
+	if (fseek(f, 0, SEEK_END) == 0) {
+		long end = ftell(f);
+
+		/* Aligned as a mapping would be, for the entries. */
+		if (end > 0 && fseek(f, 0, SEEK_SET) == 0) {
+			size = end;
+			mapping = aligned_alloc(64, lf_hashmap_file_align(size));
+		}
+
+		if (mapping != NULL && fread(mapping, size, 1, f) != 1) {
+			free(mapping);
+			mapping = NULL;
+		}
+	}
+
+	fclose(f);
+#endif
+
+	if (mapping == NULL)
+		return 1;
+
+	const struct lfi(hashmap_file_header) *h = mapping;
+
+	if (hash == NULL)
+		hash = lf(hashmap_default_hash);
+
+	if (!lfi(hashmap_file_check)(h, size, hash)) {
+#ifdef LF_HASHMAP_MMAP
+		munmap(mapping, size);
+#else
+		free(mapping);
+#endif
+		return 1;
+	}
+
+	m->ctrl = (unsigned char *) mapping + h->ctrl_offset;
+	m->entries = (struct lfi(hashmap_entry) *)
+		((char *) mapping + h->entries_offset);
+	m->cap = h->cap;
+	m->used = h->used;
+	m->deleted = 0;
+	m->value_size = h->value_size;
+	m->hash = hash;
+	m->flags = h->flags;
+	m->allocator = lf(allocator_libc);
+	m->max_load = LF_HASHMAP_MAX_LOAD;
+	m->grow_at = lfi(hashmap_grow_at)(m, m->cap);
+	m->old_ctrl = NULL;
+	m->mapping = mapping;
+	m->mapping_size = size;
+	m->keys = (const char *) mapping + h->keys_offset;
+	m->keys_size = h->keys_size;
+
+#ifdef LF_HASHMAP_COUNTERS
+	memset(&m->counters, 0, sizeof(m->counters));
+#endif
+
+	return 0;
+}
+
+/* Adds the slots of a table to the statistics. */
+lfi_fdecl(void, hashmap_stats_table)(struct lf(hashmap) *m,
+				     struct lf(hashmap_stats) *stats,
+				     size_t *probe_total)
+{
+	for (size_t i = 0; i < m->cap; i++) {
+		if (m->ctrl[i] == LF_HASHMAP_CTRL_EMPTY) {
+			stats->empty++;
+
+			continue;
+		} else if (m->ctrl[i] == LF_HASHMAP_CTRL_DELETED) {
+			stats->tombstones++;
+
+			continue;
+		}
+
+		struct lfi(hashmap_entry) *e = lf_hashmap_entry_at(m->entries, i);
+		size_t home = e->hash & (m->cap - 1);
+		size_t probe = (home % LF_HASHMAP_GROUP_WIDTH +
+				((i - home) & (m->cap - 1))) /
+			       LF_HASHMAP_GROUP_WIDTH + 1;
+		size_t bucket = probe - 1;
+
+		if (bucket >= LF_HASHMAP_STATS_HISTOGRAM_SIZE)
+			bucket = LF_HASHMAP_STATS_HISTOGRAM_SIZE - 1;
+
+		stats->live++;
+		stats->probe_histogram[bucket]++;
+		*probe_total += probe;
+
+		if (probe > stats->max_probe)
+			stats->max_probe = probe;
+
+		if (!lf_hashmap_key_is_inline(e->keylen) && m->mapping == NULL)
+			stats->memory += e->keylen;
+	}
+}
+
+void lf(hashmap_stats)(struct lf(hashmap) *m, struct lf(hashmap_stats) *stats)
+{
+	size_t probe_total = 0;
+
+	memset(stats, 0, sizeof(*stats));
+
+	stats->size = m->used;
+	stats->capacity = m->cap;
+
+	lfi(hashmap_stats_table)(m, stats, &probe_total);
+
+	if (m->old_ctrl != NULL) {
+		struct lf(hashmap) old = lfi(hashmap_old)(m);
+
+		stats->old_capacity = old.cap;
+		lfi(hashmap_stats_table)(&old, stats, &probe_total);
+		stats->memory += lf_hashmap_table_size(m, old.cap);
+	}
+
+	if (stats->live)
+		stats->avg_probe = (double) probe_total / stats->live;
+
+	if (m->mapping != NULL)
+		stats->memory += m->mapping_size;
+	else
+		stats->memory += lf_hashmap_table_size(m, m->cap);
+
+#ifdef LF_HASHMAP_COUNTERS
+	stats->lookups = m->counters.lookups;
+	stats->misses = m->counters.misses;
+	stats->probes = m->counters.probes;
+	stats->rehashes = m->counters.rehashes;
+#endif
+}
+
+void lf(hashmap_iter)(struct lf(hashmap) *m, struct lf(hashmap_it) *it)
+{
+	it->m = m;
+	it->i = 0;
+}
+
+struct lf(entry) lf(hashmap_iter_next)(struct lf(hashmap_it) *it)
+{
+	struct lf(hashmap) *m = it->m;
+
+	/* The old table is iterated after the table during incremental
+	 * rehashing. */
+	size_t end = m->cap + (m->old_ctrl != NULL ? m->old_cap : 0);
+
+	while (it->i < end) {
+		size_t i = it->i++;
+		unsigned char *ctrl = m->ctrl;
+		struct lfi(hashmap_entry) *entries = m->entries;
+
+		if (i >= m->cap) {
+			i -= m->cap;
+			ctrl = m->old_ctrl;
+			entries = (struct lfi(hashmap_entry) *) &ctrl[m->old_cap];
+		}
+
+		if (lf_hashmap_ctrl_is_full(ctrl[i])) {
+			struct lfi(hashmap_entry) *e =
+				lf_hashmap_entry_at(entries, i);
+			const void *key = lf_hashmap_entry_key(e);
+
+			/* Skips the damaged keys of a mapped file. */
+			if (key == NULL)
+				continue;
+
+			return (struct lf(entry)) {
+				.key = key,
+				.keylen = e->keylen,
+				.value = e->value
+			};
+		}
+	}
+
+	return lfi_sentinel_entry;
+}
+
+void lf(hashmap_xinit)(struct lf(hashmap) *m,
+		       size_t value_size,
+		       uint64_t (*hash)(const void *, size_t),
+		       int flags)
+{
+	lf_unwrap(lf(hashmap_init)(m, value_size, hash, flags));
+}
+
+void lf(hashmap_xinit_with)(struct lf(hashmap) *m,
+			    size_t value_size,
+			    uint64_t (*hash)(const void *, size_t),
+			    int flags,
+			    const struct lf(allocator) *allocator)
+{
+	lf_unwrap(lf(hashmap_init_with)(m, value_size, hash, flags, allocator));
+}
+
+void lf(hashmap_xreserve)(struct lf(hashmap) *m, size_t n)
+{
+	lf_unwrap(lf(hashmap_reserve)(m, n));
+}
+
+void *lf(hashmap_xinsert)(struct lf(hashmap) *m,
+			  const void *key,
+			  const void *value)
+{
+	void *insert_res = lf(hashmap_insert)(m, key, value);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+void *lf(hashmap_xinsert2)(struct lf(hashmap) *m,
+			   const void *key,
+			   size_t keylen,
+			   const void *value)
+{
+	void *insert_res = lf(hashmap_insert2)(m, key, keylen, value);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+void *lf(hashmap_xget_or_insert)(struct lf(hashmap) *m,
+				 const void *key,
+				 const void *value,
+				 bool *inserted)
+{
+	void *insert_res = lf(hashmap_get_or_insert)(m, key, value, inserted);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+void *lf(hashmap_xget_or_insert2)(struct lf(hashmap) *m,
+				  const void *key,
+				  size_t keylen,
+				  const void *value,
+				  bool *inserted)
+{
+	void *insert_res = lf(hashmap_get_or_insert2)(m, key, keylen, value,
+						      inserted);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+void *lf(hashmap_xupsert)(struct lf(hashmap) *m,
+			  const void *key,
+			  const void *value,
+			  bool *inserted)
+{
+	void *insert_res = lf(hashmap_upsert)(m, key, value, inserted);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+void *lf(hashmap_xupsert2)(struct lf(hashmap) *m,
+			   const void *key,
+			   size_t keylen,
+			   const void *value,
+			   bool *inserted)
+{
+	void *insert_res = lf(hashmap_upsert2)(m, key, keylen, value, inserted);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+/* Concurrent hashmap. It lives beside the hashmap to reuse its internals with
+ * the hashes computed once. */
+
+#define LF_CHASHMAP_WRITER (UINT_MAX / 2 + 1)
+
+/* Spins before yielding the processor while waiting on a lock. */
+#define LF_CHASHMAP_SPIN 64
+
+#if LF_CHASHMAP_STRIPES < 1 || \
+	(LF_CHASHMAP_STRIPES & (LF_CHASHMAP_STRIPES - 1)) != 0
+#error "LF_CHASHMAP_STRIPES must be a power of two"
+#endif
+
+/* Stripes are picked by the bits above the ones picking the slots. */
+#define lf_chashmap_stripe(c, hash) \
+	(&(c)->stripes[((hash) >> 32) & (LF_CHASHMAP_STRIPES - 1)])
+
+inline lfi_fdecl(void, chashmap_wait)(unsigned *spins)
+{
+	if (++*spins < LF_CHASHMAP_SPIN) {
+		lf_cpu_relax();
+	} else {
+		*spins = 0;
+		lf_chashmap_yield();
+	}
+}
+
+inline lfi_fdecl(void, chashmap_read_lock)(atomic_uint *lock)
+{
+	unsigned spins = 0;
+
+	for (;;) {
+		while (atomic_load_explicit(lock, memory_order_relaxed) &
+		       LF_CHASHMAP_WRITER)
+			lfi(chashmap_wait)(&spins);
+
+		if (!(atomic_fetch_add_explicit(lock, 1, memory_order_acquire) &
+		      LF_CHASHMAP_WRITER))
+			return;
+
+		/* A writer took the lock in between. */
+		atomic_fetch_sub_explicit(lock, 1, memory_order_relaxed);
+	}
+}
+
+inline lfi_fdecl(void, chashmap_read_unlock)(atomic_uint *lock)
+{
+	atomic_fetch_sub_explicit(lock, 1, memory_order_release);
+}
+
+inline lfi_fdecl(void, chashmap_write_lock)(atomic_uint *lock)
+{
+	unsigned spins = 0;
+
+	/* The writer bit keeps the new readers out, then the current ones are
+	 * waited on. */
+	for (;;) {
+		while (atomic_load_explicit(lock, memory_order_relaxed) &
+		       LF_CHASHMAP_WRITER)
+			lfi(chashmap_wait)(&spins);
+
+		if (!(atomic_fetch_or_explicit(lock, LF_CHASHMAP_WRITER,
+					       memory_order_acquire) &
+		      LF_CHASHMAP_WRITER))
+			break;
+	}
+
+	while (atomic_load_explicit(lock, memory_order_acquire) !=
+	       LF_CHASHMAP_WRITER)
+		lfi(chashmap_wait)(&spins);
+}
+
+inline lfi_fdecl(void, chashmap_write_unlock)(atomic_uint *lock)
+{
+	atomic_fetch_and_explicit(lock, ~LF_CHASHMAP_WRITER,
+				  memory_order_release);
+}
+
+int lf(chashmap_init)(struct lf(chashmap) *c,
+		      size_t value_size,
+		      uint64_t (*hash)(const void *, size_t),
+		      int flags)
+{
+	c->value_size = value_size;
+	c->hash = hash == NULL ? lf(hashmap_default_hash) : hash;
+	c->stripes = aligned_alloc(_Alignof(struct lfi(chashmap_stripe)),
+				   LF_CHASHMAP_STRIPES *
+				   sizeof(struct lfi(chashmap_stripe)));
+
+	if (c->stripes == NULL)
+		return 1;
+
+	for (size_t i = 0; i < LF_CHASHMAP_STRIPES; i++) {
+		struct lfi(chashmap_stripe) *s = &c->stripes[i];
+
+		atomic_init(&s->lock, 0);
+
+		if (lf(hashmap_init)(&s->m, value_size, c->hash, flags)) {
+			while (i--)
+				lf(hashmap_destroy)(&c->stripes[i].m);
+
+			free(c->stripes);
+
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+void lf(chashmap_destroy)(struct lf(chashmap) *c)
+{
+	for (size_t i = 0; i < LF_CHASHMAP_STRIPES; i++)
+		lf(hashmap_destroy)(&c->stripes[i].m);
+
+	free(c->stripes);
+}
+
+bool lf(chashmap_get)(struct lf(chashmap) *c, const void *key, void *value)
+{
+	return lf(chashmap_get2)(c, key, strlen(key), value);
+}
+
+bool lf(chashmap_get2)(struct lf(chashmap) *c,
+		       const void *key,
+		       size_t keylen,
+		       void *value)
+{
+	uint64_t hash = c->hash(key, keylen);
+	struct lfi(chashmap_stripe) *s = lf_chashmap_stripe(c, hash);
+
+	lfi(chashmap_read_lock)(&s->lock);
+
+	struct lfi(hashmap_entry) *e =
+		lfi(hashmap_get_entry)(&s->m, hash, key, keylen);
+
+	if (e != NULL && value != NULL && c->value_size)
+		memcpy(value, e->value, c->value_size);
+
+	lfi(chashmap_read_unlock)(&s->lock);
+
+	return e != NULL;
+}
+
+int lf(chashmap_upsert)(struct lf(chashmap) *c,
+			const void *key,
+			const void *value,
+			bool *inserted)
+{
+	return lf(chashmap_upsert2)(c, key, strlen(key), value, inserted);
+}
+
+int lf(chashmap_upsert2)(struct lf(chashmap) *c,
+			 const void *key,
+			 size_t keylen,
+			 const void *value,
+			 bool *inserted)
+{
+	uint64_t hash = c->hash(key, keylen);
+	struct lfi(chashmap_stripe) *s = lf_chashmap_stripe(c, hash);
+	bool inserted_;
+
+	lfi(chashmap_write_lock)(&s->lock);
+
+	void *v = lfi(hashmap_get_or_insert_hashed)(&s->m, hash, key, keylen,
+						    value, &inserted_);
+
+	if (v != NULL && !inserted_ && c->value_size && value != NULL)
+		memcpy(v, value, c->value_size);
+
+	lfi(chashmap_write_unlock)(&s->lock);
+
+	if (inserted != NULL)
+		*inserted = inserted_;
+
+	return v == NULL;
+}
+
+bool lf(chashmap_remove)(struct lf(chashmap) *c, const void *key, void *value)
+{
+	return lf(chashmap_remove2)(c, key, strlen(key), value);
+}
+
+bool lf(chashmap_remove2)(struct lf(chashmap) *c,
+			  const void *key,
+			  size_t keylen,
+			  void *value)
+{
+	uint64_t hash = c->hash(key, keylen);
+	struct lfi(chashmap_stripe) *s = lf_chashmap_stripe(c, hash);
+
+	lfi(chashmap_write_lock)(&s->lock);
+
+	const void *v = lfi(hashmap_remove_hashed)(&s->m, hash, key, keylen);
+
+	if (v != NULL && value != NULL && c->value_size)
+		memcpy(value, v, c->value_size);
+
+	lfi(chashmap_write_unlock)(&s->lock);
+
+	return v != NULL;
+}
+
+size_t lf(chashmap_size)(struct lf(chashmap) *c)
+{
+	size_t size = 0;
+
+	for (size_t i = 0; i < LF_CHASHMAP_STRIPES; i++) {
+		struct lfi(chashmap_stripe) *s = &c->stripes[i];
+
+		lfi(chashmap_read_lock)(&s->lock);
+		size += s->m.used;
+		lfi(chashmap_read_unlock)(&s->lock);
+	}
+
+	return size;
+}
+
+void lf(chashmap_xinit)(struct lf(chashmap) *c,
+			size_t value_size,
+			uint64_t (*hash)(const void *, size_t),
+			int flags)
+{
+	lf_unwrap(lf(chashmap_init)(c, value_size, hash, flags));
+}
+
+void lf(chashmap_xupsert)(struct lf(chashmap) *c,
+			  const void *key,
+			  const void *value,
+			  bool *inserted)
+{
+	lf_unwrap(lf(chashmap_upsert)(c, key, value, inserted));
+}
+
+void lf(chashmap_xupsert2)(struct lf(chashmap) *c,
+			   const void *key,
+			   size_t keylen,
+			   const void *value,
+			   bool *inserted)
+{
+	lf_unwrap(lf(chashmap_upsert2)(c, key, keylen, value, inserted));
+}
+
+
+lfi_fdecl(size_t, hashmap_find)(struct lf(hashmap) *m,
+				uint64_t hash,
+				const void *key,
+				size_t keylen,
+				size_t *free_slot)
+{
+	unsigned char tag = lf_hashmap_tag(hash);
+
+	struct lfi(hashmap_probe) p;
+
+	if (free_slot != NULL)
+		*free_slot = LF_HASHMAP_NO_SLOT;
+
+	lfi(hashmap_probe_start)(m, hash, &p);
+
+	do {
+		const unsigned char *group = &m->ctrl[p.base];
+		uint32_t match = lfi(hashmap_group_match)(group, tag) & p.valid;
+
+		lf_hashmap_count(m, probes, 1);
+
+		while (match) {
+			size_t i = p.base + lfi(hashmap_ctz)(match);
+			struct lfi(hashmap_entry) *e =
+				lf_hashmap_entry_at(m->entries, i);
+
+			const void *k;
+
+			if (e->hash == hash && e->keylen == keylen &&
+			    (k = lf_hashmap_entry_key(e)) != NULL &&
+			    memcmp(k, key, keylen) == 0)
+				return i;
+
+			match &= match - 1;
+		}
+
+		if (free_slot != NULL && *free_slot == LF_HASHMAP_NO_SLOT) {
+			uint32_t free_slots =
+				lfi(hashmap_group_match_free)(group) & p.valid;
+
+			if (free_slots)
+				*free_slot = p.base + lfi(hashmap_ctz)(free_slots);
+		}
+
+		if (lfi(hashmap_group_match)(group, LF_HASHMAP_CTRL_EMPTY) &
+		    p.valid)
+			return LF_HASHMAP_NO_SLOT;
+	} while (lfi(hashmap_probe_next)(m, &p));
+
+	/* Hashmap filled up with tombstones */
+	return LF_HASHMAP_NO_SLOT;
+}
+
+lfi_fdecl(size_t, hashmap_claim)(struct lf(hashmap) *m,
+				 uint64_t hash,
+				 size_t i)
+{
+	if (m->flags & LF_HASHMAP_ROBIN_HOOD)
+		return lfi(hashmap_claim_robin_hood)(m, hash);
+
+	if (i == LF_HASHMAP_NO_SLOT) {
+		struct lfi(hashmap_probe) p;
+
+		lfi(hashmap_probe_start)(m, hash, &p);
+
+		do {
+			uint32_t free_slots = lfi(hashmap_group_match_free)(
+				&m->ctrl[p.base]) & p.valid;
+
+			if (free_slots) {
+				i = p.base + lfi(hashmap_ctz)(free_slots);
+				break;
+			}
+		} while (lfi(hashmap_probe_next)(m, &p));
+	}
+
+	lf_assert(i != LF_HASHMAP_NO_SLOT, "hashmap is full");
+
+	if (m->ctrl[i] == LF_HASHMAP_CTRL_DELETED)
+		m->deleted--;
+
+	m->ctrl[i] = lf_hashmap_tag(hash);
+
+	return i;
+}
+
+lfi_fdecl(void, hashmap_release)(struct lf(hashmap) *m, size_t i)
+{
+	if (m->flags & LF_HASHMAP_ROBIN_HOOD) {
+		lfi(hashmap_release_robin_hood)(m, i);
+	} else if (m->ctrl[(i + 1) & (m->cap - 1)] == LF_HASHMAP_CTRL_EMPTY) {
+		/* No probe sequence passes through a slot followed by an
+		 * empty one, so it can be emptied rather than marked
+		 * deleted. */
+		m->ctrl[i] = LF_HASHMAP_CTRL_EMPTY;
+	} else {
+		m->ctrl[i] = LF_HASHMAP_CTRL_DELETED;
+		m->deleted++;
+	}
+}
+
+lfi_fdecl(struct lfi(hashmap_entry) *, hashmap_get_entry)(struct lf(hashmap) *m,
+							  uint64_t hash,
+							  const void *key,
+							  size_t keylen)
+{
+	size_t i = lfi(hashmap_find)(m, hash, key, keylen, NULL);
+
+	lf_hashmap_count(m, lookups, 1);
+
+	if (i != LF_HASHMAP_NO_SLOT)
+		return lf_hashmap_entry_at(m->entries, i);
+
+	if (m->old_ctrl != NULL) {
+		struct lf(hashmap) old = lfi(hashmap_old)(m);
+
+		i = lfi(hashmap_find)(&old, hash, key, keylen, NULL);
+		lf_hashmap_count_merge(m, &old);
+
+		if (i != LF_HASHMAP_NO_SLOT)
+			return lf_hashmap_entry_at(old.entries, i);
+	}
+
+	lf_hashmap_count(m, misses, 1);
+
+	return NULL;
+}
+
+lfi_fdecl(void, hashmap_migrate)(struct lf(hashmap) *m, size_t slots)
+{
+	struct lf(hashmap) old = lfi(hashmap_old)(m);
+
+	for (; slots && m->migrated < old.cap; slots--, m->migrated++) {
+		size_t i = m->migrated;
+
+		if (!lf_hashmap_ctrl_is_full(old.ctrl[i]))
+			continue;
+
+		struct lfi(hashmap_entry) *e = lf_hashmap_entry_at(old.entries, i);
+		size_t j = lfi(hashmap_claim)(m, e->hash, LF_HASHMAP_NO_SLOT);
+
+		memcpy(lf_hashmap_entry_at(m->entries, j), e, lf_hashmap_stride(m));
+
+		/* Lookups in the old table still probe past this slot. */
+		old.ctrl[i] = LF_HASHMAP_CTRL_DELETED;
+	}
+
+	if (m->migrated == old.cap) {
+		lfi(free)(&m->allocator, m->old_ctrl,
+			  lf_hashmap_table_size(m, old.cap));
+		m->old_ctrl = NULL;
+	}
+}
+
+lfi_fdecl(int, hashmap_rehash)(struct lf(hashmap) *m, size_t cap)
+{
+	struct lf(hashmap) old = *m;
+
+	lf_assert(m->mapping == NULL, "hashmap is read-only");
+
+	if (lfi(hashmap_alloc)(m, cap))
+		return 1;
+
+	lf_hashmap_count(m, rehashes, 1);
+
+	for (size_t i = 0; i < old.cap; i++) {
+		if (!lf_hashmap_ctrl_is_full(old.ctrl[i]))
+			continue;
+
+		struct lfi(hashmap_entry) *e = lf_hashmap_entry_at(old.entries, i);
+		size_t j = lfi(hashmap_claim)(m, e->hash, LF_HASHMAP_NO_SLOT);
+
+		memcpy(lf_hashmap_entry_at(m->entries, j), e, lf_hashmap_stride(m));
+	}
+
+	lfi(free)(&m->allocator, old.ctrl, lf_hashmap_table_size(m, old.cap));
+
+	return 0;
+}
+
+lfi_fdecl(int, hashmap_rehash_incremental)(struct lf(hashmap) *m, size_t cap)
+{
+	/* Only one old table is kept. */
+	if (m->old_ctrl != NULL)
+		lfi(hashmap_migrate)(m, SIZE_MAX);
+
+	unsigned char *ctrl = m->ctrl;
+	size_t old_cap = m->cap;
+
+	if (lfi(hashmap_alloc)(m, cap))
+		return 1;
+
+	lf_hashmap_count(m, rehashes, 1);
+
+	m->old_ctrl = ctrl;
+	m->old_cap = old_cap;
+	m->migrated = 0;
+
+	return 0;
+}
+
+lfi_fdecl(void *, hashmap_insert_new)(struct lf(hashmap) *m,
+				      uint64_t hash,
+				      const void *key,
+				      size_t keylen,
+				      const void *value,
+				      size_t free_slot)
+{
+	void *new_key = NULL;
+
+	lf_assert(m->mapping == NULL, "hashmap is read-only");
+
+	if (!lf_hashmap_key_is_inline(keylen)) {
+		new_key = lf_alloc(&m->allocator, keylen);
+
+		if (new_key == NULL)
+			return NULL;
+
+		memcpy(new_key, key, keylen);
+	}
+
+	/* Migration may take the free slot. */
+	if (m->old_ctrl != NULL) {
+		lfi(hashmap_migrate)(m, LF_HASHMAP_MIGRATE_STEP);
+		free_slot = LF_HASHMAP_NO_SLOT;
+	}
+
+	/* Deleted slots lengthen the probe sequences as much as the used ones.
+	 * If they make up the most of the load, the table is rebuilt with the
+	 * same capacity to drop them. */
+	if (m->used + m->deleted >= m->grow_at) {
+		size_t cap = m->cap;
+		int err;
+
+		if (m->used * 2 >= m->grow_at) {
+			cap = lfi(hashmap_cap_for)(m, m->used * 2);
+
+			if (cap == 0) {
+				lfi(free)(&m->allocator, new_key, keylen);
+
+				return NULL;
+			}
+		}
+
+		if (m->flags & LF_HASHMAP_INCREMENTAL)
+			err = lfi(hashmap_rehash_incremental)(m, cap);
+		else
+			err = lfi(hashmap_rehash)(m, cap);
+
+		if (err) {
+			lfi(free)(&m->allocator, new_key, keylen);
+
+			return NULL;
+		}
+
+		free_slot = LF_HASHMAP_NO_SLOT;
+	}
+
+	size_t i = lfi(hashmap_claim)(m, hash, free_slot);
+	struct lfi(hashmap_entry) *e = lf_hashmap_entry_at(m->entries, i);
+
+	e->hash = hash;
+	e->keylen = keylen;
+
+	if (new_key != NULL)
+		e->key.ptr = new_key;
+	else
+		memcpy(e->key.bytes, key, keylen);
+
+	if (m->value_size && value != NULL)
+		memcpy(e->value, value, m->value_size);
+
+	m->used++;
+
+	return e->value;
+}
+
+lfi_fdecl(void *, hashmap_get_or_insert_hashed)(struct lf(hashmap) *m,
+						uint64_t hash,
+						const void *key,
+						size_t keylen,
+						const void *value,
+						bool *inserted)
+{
+	size_t free_slot;
+	size_t i = lfi(hashmap_find)(m, hash, key, keylen, &free_slot);
+	struct lfi(hashmap_entry) *e = NULL;
+
+	if (i != LF_HASHMAP_NO_SLOT) {
+		e = lf_hashmap_entry_at(m->entries, i);
+	} else if (m->old_ctrl != NULL) {
+		struct lf(hashmap) old = lfi(hashmap_old)(m);
+
+		i = lfi(hashmap_find)(&old, hash, key, keylen, NULL);
+		lf_hashmap_count_merge(m, &old);
+
+		if (i != LF_HASHMAP_NO_SLOT)
+			e = lf_hashmap_entry_at(old.entries, i);
+	}
+
+	lf_hashmap_count(m, lookups, 1);
+	lf_hashmap_count(m, misses, e == NULL);
+
+	if (inserted != NULL)
+		*inserted = e == NULL;
+
+	if (e != NULL)
+		return e->value;
+
+	return lfi(hashmap_insert_new)(m, hash, key, keylen, value, free_slot);
+}
+
+lfi_fdecl(const void *, hashmap_remove_hashed)(struct lf(hashmap) *m,
+					       uint64_t hash,
+					       const void *key,
+					       size_t keylen)
+{
+	lf_assert(m->mapping == NULL, "hashmap is read-only");
+
+	if (m->old_ctrl != NULL)
+		lfi(hashmap_migrate)(m, LF_HASHMAP_MIGRATE_STEP);
+
+	struct lf(hashmap) old, *t = m;
+	size_t i = lfi(hashmap_find)(m, hash, key, keylen, NULL);
+
+	if (i == LF_HASHMAP_NO_SLOT && m->old_ctrl != NULL) {
+		old = lfi(hashmap_old)(m);
+		t = &old;
+		i = lfi(hashmap_find)(t, hash, key, keylen, NULL);
+		lf_hashmap_count_merge(m, &old);
+	}
+
+	lf_hashmap_count(m, lookups, 1);
+	lf_hashmap_count(m, misses, i == LF_HASHMAP_NO_SLOT);
+
+	if (i == LF_HASHMAP_NO_SLOT)
+		return NULL;
+
+	struct lfi(hashmap_entry) *e = lf_hashmap_entry_at(t->entries, i);
+	struct lfi(hashmap_entry) *hold = lf_hashmap_entry_at(m->entries, m->cap);
+
+	/* Slot may be overwritten by the following entries. */
+	memcpy(hold->value, e->value, m->value_size);
+
+	if (!lf_hashmap_key_is_inline(e->keylen))
+		lfi(free)(&m->allocator, (void *) e->key.ptr, e->keylen);
+
+	lfi(hashmap_release)(t, i);
+	m->used--;
+
+	return hold->value;
+}
+#ifndef LF_HEADERONLY
+#include "util.h"
+#include "../include/config.h"
+#include "../include/intmap.h"
+#include "hashmap_ctrl.h"
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* The tables are probed by the table functions of hashmap_ctrl.h, as in the
+ * typed hashmaps. */
+/* Returned by intmap_find() if the key is not found. */
+#define LF_INTMAP_NO_SLOT SIZE_MAX
+
+#define lf_intmap_entry_at(m, i) (&(m)->entries[(i) * (m)->stride])
+
+#define lf_intmap_value_at(m, i) (lf_intmap_entry_at(m, i) + (m)->value_offset)
+
+
+/* Finalizer of MurmurHash3, every input bit affects every output bit. */
+inline lfi_fdecl(uint64_t, intmap_mix)(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= UINT64_C(0xff51afd7ed558ccd);
+	k ^= k >> 33;
+	k *= UINT64_C(0xc4ceb9fe1a85ec53);
+	k ^= k >> 33;
+
+	return k;
+}
+
+/* Values follow the keys, aligned to sizeof(size_t), unless they fit in the
+ * alignment of the key. */
+inline lfi_fdecl(void, intmap_layout)(size_t key_size,
+				      size_t value_size,
+				      size_t *value_offset,
+				      size_t *stride)
+{
+	size_t align = value_size <= key_size ? key_size : sizeof(size_t);
+
+	if (align < key_size)
+		align = key_size;
+
+	*value_offset = (key_size + align - 1) / align * align;
+	*stride = (*value_offset + value_size + align - 1) / align * align;
+}
+
+
+/* Defines the functions of an integer keyed map. The implementations of
+ * u64map and u32map only differ in their key types. */
+#define lf_intmap_define(name, key_t) \
+\
+/* The entry functions given to the table functions. */ \
+inline lfi_fdecl(bool, name##_eq)(const void *entry, const void *key) \
+{ \
+	return *(const key_t *) entry == *(const key_t *) key; \
+} \
+\
+inline lfi_fdecl(uint64_t, name##_hash)(const void *entry) \
+{ \
+	return lfi(intmap_mix)(*(const key_t *) entry); \
+} \
+\
+lfi_fdecl(int, name##_alloc)(struct lf(name) *m, size_t cap) \
+{ \
+	/* The control bytes keep the entries aligned, as cap is a multiple \
+	 * of the group width. One more entry than the capacity is allocated, \
+	 * used as a scratch entry. */ \
+	unsigned char *ctrl = malloc(cap + (cap + 1) * m->stride); \
+\
+	if (ctrl == NULL) \
+		return 1; \
+\
+	memset(ctrl, LF_HASHMAP_CTRL_EMPTY, cap); \
+\
+	m->ctrl = ctrl; \
+	m->entries = (char *) &ctrl[cap]; \
+	m->cap = cap; \
+	m->deleted = 0; \
+\
+	return 0; \
+} \
+\
+lfi_fdecl(size_t, name##_find)(struct lf(name) *m, key_t key, uint64_t hash) \
+{ \
+	return lfi(group_table_find)(m->ctrl, m->entries, m->cap, m->stride, \
+				     hash, &key, lfi(name##_eq)); \
+} \
+\
+lfi_fdecl(int, name##_rehash)(struct lf(name) *m, size_t cap) \
+{ \
+	struct lf(name) old = *m; \
+\
+	if (lfi(name##_alloc)(m, cap)) \
+		return 1; \
+\
+	lfi(group_table_move)(old.ctrl, old.entries, old.cap, m->ctrl, \
+			      m->entries, m->cap, m->stride, \
+			      lfi(name##_hash)); \
+	free(old.ctrl); \
+\
+	return 0; \
+} \
+\
+lfi_fdecl(void *, name##_insert_new)(struct lf(name) *m, \
+				     key_t key, \
+				     uint64_t hash, \
+				     const void *value) \
+{ \
+	size_t cap = lfi(group_table_grow)(m->cap, m->used, m->deleted); \
+\
+	if (cap != 0 && lfi(name##_rehash)(m, cap)) \
+		return NULL; \
+\
+	size_t i = lfi(group_table_claim)(m->ctrl, m->cap, hash, &m->deleted); \
+\
+	*(key_t *) lf_intmap_entry_at(m, i) = key; \
+\
+	if (m->value_size && value != NULL) \
+		memcpy(lf_intmap_value_at(m, i), value, m->value_size); \
+\
+	m->used++; \
+\
+	return lf_intmap_value_at(m, i); \
+} \
+\
+int lf(name##_init)(struct lf(name) *m, size_t value_size) \
+{ \
+	m->used = 0; \
+	m->value_size = value_size; \
+\
+	lfi(intmap_layout)(sizeof(key_t), value_size, \
+			   &m->value_offset, &m->stride); \
+\
+	return lfi(name##_alloc)(m, LF_HASHMAP_INITIAL_CAP); \
+} \
+\
+void lf(name##_destroy)(struct lf(name) *m) \
+{ \
+	free(m->ctrl); \
+} \
+\
+void *lf(name##_get)(struct lf(name) *m, key_t key) \
+{ \
+	size_t i = lfi(name##_find)(m, key, lfi(intmap_mix)(key)); \
+\
+	return i == LF_INTMAP_NO_SLOT ? NULL : lf_intmap_value_at(m, i); \
+} \
+\
+void *lf(name##_insert)(struct lf(name) *m, key_t key, const void *value) \
+{ \
+	uint64_t hash = lfi(intmap_mix)(key); \
+\
+	lf_debug_assert(lfi(name##_find)(m, key, hash) == LF_INTMAP_NO_SLOT, \
+			"map contains the element"); \
+\
+	return lfi(name##_insert_new)(m, key, hash, value); \
+} \
+\
+void *lf(name##_get_or_insert)(struct lf(name) *m, \
+			       key_t key, \
+			       const void *value, \
+			       bool *inserted) \
+{ \
+	uint64_t hash = lfi(intmap_mix)(key); \
+	size_t i = lfi(name##_find)(m, key, hash); \
+\
+	if (inserted != NULL) \
+		*inserted = i == LF_INTMAP_NO_SLOT; \
+\
+	if (i != LF_INTMAP_NO_SLOT) \
+		return lf_intmap_value_at(m, i); \
+\
+	return lfi(name##_insert_new)(m, key, hash, value); \
+} \
+\
+void *lf(name##_upsert)(struct lf(name) *m, \
+			key_t key, \
+			const void *value, \
+			bool *inserted) \
+{ \
+	bool inserted_; \
+	void *v = lf(name##_get_or_insert)(m, key, value, &inserted_); \
+\
+	if (v != NULL && !inserted_ && m->value_size && value != NULL) \
+		memcpy(v, value, m->value_size); \
+\
+	if (inserted != NULL) \
+		*inserted = inserted_; \
+\
+	return v; \
+} \
+\
+const void *lf(name##_remove)(struct lf(name) *m, key_t key) \
+{ \
+	size_t i = lfi(name##_find)(m, key, lfi(intmap_mix)(key)); \
+\
+	if (i == LF_INTMAP_NO_SLOT) \
+		return NULL; \
+\
+	void *hold = lf_intmap_value_at(m, m->cap); \
+\
+	/* Slot may be overwritten by the following entries. */ \
+	memcpy(hold, lf_intmap_value_at(m, i), m->value_size); \
+\
+	lfi(group_table_release)(m->ctrl, i, &m->deleted); \
+	m->used--; \
+\
+	return hold; \
+} \
+\
+int lf(name##_reserve)(struct lf(name) *m, size_t n) \
+{ \
+	size_t cap = lfi(group_table_cap_for)(n); \
+\
+	if (cap == 0) \
+		return 1; \
+\
+	return cap > m->cap ? lfi(name##_rehash)(m, cap) : 0; \
+} \
+\
+void lf(name##_clear)(struct lf(name) *m) \
+{ \
+	memset(m->ctrl, LF_HASHMAP_CTRL_EMPTY, m->cap); \
+	m->used = 0; \
+	m->deleted = 0; \
+} \
+\
+void lf(name##_iter)(struct lf(name) *m, struct lf(name##_it) *it) \
+{ \
+	it->m = m; \
+	it->i = 0; \
+} \
+\
+struct lf(entry) lf(name##_iter_next)(struct lf(name##_it) *it) \
+{ \
+	struct lf(name) *m = it->m; \
+\
+	while (it->i < m->cap) { \
+		size_t i = it->i++; \
+\
+		if (lf_hashmap_ctrl_is_full(m->ctrl[i])) \
+			return (struct lf(entry)) { \
+				.key = lf_intmap_entry_at(m, i), \
+				.keylen = sizeof(key_t), \
+				.value = lf_intmap_value_at(m, i) \
+			}; \
+	} \
+\
+	return lfi_sentinel_entry; \
+} \
+\
+void lf(name##_xinit)(struct lf(name) *m, size_t value_size) \
+{ \
+	lf_unwrap(lf(name##_init)(m, value_size)); \
+} \
+\
+void *lf(name##_xinsert)(struct lf(name) *m, key_t key, const void *value) \
+{ \
+	void *insert_res = lf(name##_insert)(m, key, value); \
+\
+	lf_assert(insert_res != NULL, "insert returned NULL"); \
+\
+	return insert_res; \
+} \
+\
+void *lf(name##_xget_or_insert)(struct lf(name) *m, \
+				key_t key, \
+				const void *value, \
+				bool *inserted) \
+{ \
+	void *insert_res = lf(name##_get_or_insert)(m, key, value, inserted); \
+\
+	lf_assert(insert_res != NULL, "insert returned NULL"); \
+\
+	return insert_res; \
+} \
+\
+void *lf(name##_xupsert)(struct lf(name) *m, \
+			 key_t key, \
+			 const void *value, \
+			 bool *inserted) \
+{ \
+	void *insert_res = lf(name##_upsert)(m, key, value, inserted); \
+\
+	lf_assert(insert_res != NULL, "insert returned NULL"); \
+\
+	return insert_res; \
+} \
+\
+void lf(name##_xreserve)(struct lf(name) *m, size_t n) \
+{ \
+	lf_unwrap(lf(name##_reserve)(m, n)); \
+}
+
+
+lf_intmap_define(u64map, uint64_t)
+
+lf_intmap_define(u32map, uint32_t)
+#ifndef LF_HEADERONLY
+#include "util.h"
+#include "../include/config.h"
+#include "../include/map.h"
+#endif
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define lf_map_align(i) ((i + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t))
+
+#define lf_map_node_size(n) ((n) == NULL ? 0 : (n)->size)
+
+#define lf_map_node_color(n) ((n) == NULL ? 0 : (n)->color)
+
+#define lf_map_node_value(n) (&(n)->kv[lf_map_align((n)->keylen)])
+
+#if (LF_MAP_POOL_MAX_NODE_SIZE) % 16 != 0 || \
+	(LF_MAP_MAX_SLAB_SIZE) < (LF_MAP_POOL_MAX_NODE_SIZE) * 16
+#error "LF_MAP_POOL_MAX_NODE_SIZE must be a multiple of 16, and at most \
+LF_MAP_MAX_SLAB_SIZE / 16"
+#endif
+
+/* Pooled nodes are rounded up to a multiple of the granule, each multiple is
+ * a size class with its own free list. */
+#define LF_MAP_POOL_GRANULE 16
+
+#define lf_map_pool_class(size) (((size) - 1) / LF_MAP_POOL_GRANULE)
+
+
+/* Slabs are linked to be released along with the map. */
+struct lfi(map_slab) {
+	struct lfi(map_slab) *next;
+	size_t size;
+	max_align_t data[];
+};
+
+/* Slabs holding nodes of more than one map, after a split or a join. Shares
+ * refer to the shares of the maps they were made from, and are released with
+ * them once no map refers to them. */
+struct lfi(map_share) {
+	atomic_size_t refs;
+
+	struct lfi(map_slab) *slabs;
+	struct lfi(map_share) *parents[2];
+
+	/* Links the shares being released. */
+	struct lfi(map_share) *next;
+};
+
+/* Subtree with the number of black nodes on its paths, including its root. */
+struct lfi(map_tree) {
+	struct lfi(map_node) *root;
+	size_t bh;
+};
+
+
+/* Size of the allocation holding the node. */
+inline lfi_fdecl(size_t, map_node_alloc_size)(size_t keylen, size_t value_size)
+{
+	size_t size = lf_map_align(sizeof(struct lfi(map_node)));
+
+	if (value_size > 0)
+		size += lf_map_align(keylen) + value_size;
+	else
+		size += keylen;
+
+	return size;
+}
+
+/* Starts a new slab. The remaining space of the current slab is abandoned. */
+lfi_fdecl(int, map_pool_grow)(struct lf(map) *m)
+{
+	struct lfi(map_slab) *slab =
+		lf_alloc(&m->allocator,
+			 sizeof(struct lfi(map_slab)) + m->slab_size);
+
+	if (slab == NULL)
+		return 1;
+
+	slab->next = m->slabs;
+	slab->size = m->slab_size;
+
+	m->slabs = slab;
+	m->slab_top = (char *) slab->data;
+	m->slab_left = m->slab_size;
+
+	if (m->slab_size < LF_MAP_MAX_SLAB_SIZE / 2)
+		m->slab_size *= 2;
+	else
+		m->slab_size = LF_MAP_MAX_SLAB_SIZE;
+
+	return 0;
+}
+
+/* Allocates a node from its free list, or from the current slab. */
+lfi_fdecl(void *, map_pool_alloc)(struct lf(map) *m, size_t size)
+{
+	if (size > LF_MAP_POOL_MAX_NODE_SIZE) {
+		void *n = lf_alloc(&m->allocator, size);
+
+		if (n != NULL)
+			m->large_nodes++;
+
+		return n;
+	}
+
+	size_t c = lf_map_pool_class(size);
+	void *n = m->free_nodes[c];
+
+	if (n != NULL) {
+		m->free_nodes[c] = *(void **) n;
+
+		return n;
+	}
+
+	size = (c + 1) * LF_MAP_POOL_GRANULE;
+
+	if (size > m->slab_left && lfi(map_pool_grow)(m))
+		return NULL;
+
+	n = m->slab_top;
+	m->slab_top += size;
+	m->slab_left -= size;
+
+	return n;
+}
+
+/* Pushes the node to the free list of its size class. */
+lfi_fdecl(void, map_pool_free)(struct lf(map) *m, void *n, size_t size)
+{
+	if (size > LF_MAP_POOL_MAX_NODE_SIZE) {
+		lfi(free)(&m->allocator, n, size);
+		m->large_nodes--;
+
+		return;
+	}
+
+	size_t c = lf_map_pool_class(size);
+
+	*(void **) n = m->free_nodes[c];
+	m->free_nodes[c] = n;
+}
+
+lfi_fdecl(void, map_free_slabs)(struct lf(map) *m, struct lfi(map_slab) *slab)
+{
+	while (slab != NULL) {
+		struct lfi(map_slab) *next = slab->next;
+
+		lfi(free)(&m->allocator, slab,
+			  sizeof(struct lfi(map_slab)) + slab->size);
+		slab = next;
+	}
+}
+
+/* Drops a reference to the share, releasing the shares no longer referred
+ * to. */
+lfi_fdecl(void, map_share_release)(struct lf(map) *m,
+				   struct lfi(map_share) *share)
+{
+	if (share == NULL || atomic_fetch_sub(&share->refs, 1) != 1)
+		return;
+
+	share->next = NULL;
+
+	while (share != NULL) {
+		struct lfi(map_share) *next = share->next;
+
+		for (int i = 0; i < 2; i++) {
+			struct lfi(map_share) *parent = share->parents[i];
+
+			if (parent != NULL &&
+			    atomic_fetch_sub(&parent->refs, 1) == 1) {
+				parent->next = next;
+				next = parent;
+			}
+		}
+
+		lfi(map_free_slabs)(m, share->slabs);
+		lfi(free)(&m->allocator, share, sizeof(*share));
+
+		share = next;
+	}
+}
+
+lfi_fdecl(struct lfi(map_share) *, map_share_new)(struct lf(map) *m,
+						  struct lfi(map_slab) *slabs,
+						  struct lfi(map_share) *p1,
+						  struct lfi(map_share) *p2)
+{
+	struct lfi(map_share) *share = lf_alloc(&m->allocator, sizeof(*share));
+
+	if (share == NULL)
+		return NULL;
+
+	atomic_init(&share->refs, 1);
+	share->slabs = slabs;
+	share->parents[0] = p1;
+	share->parents[1] = p2;
+
+	return share;
+}
+
+/* Moves the slabs of `m` to a share, and lets `other` refer to it. `other`
+ * must not have a pool of its own. */
+lfi_fdecl(int, map_pool_share)(struct lf(map) *m, struct lf(map) *other)
+{
+	if (m->slabs != NULL) {
+		struct lfi(map_share) *share =
+			lfi(map_share_new)(m, m->slabs, m->share, NULL);
+
+		if (share == NULL)
+			return 1;
+
+		m->slabs = NULL;
+		m->share = share;
+	}
+
+	if (m->share != NULL)
+		atomic_fetch_add(&m->share->refs, 1);
+
+	other->share = m->share;
+
+	return 0;
+}
+
+/* Moves the pool of `other` to `m`, leaving `other` with an empty pool.
+ * Nodes of either map can then be freed to `m`. */
+lfi_fdecl(int, map_pool_absorb)(struct lf(map) *m, struct lf(map) *other)
+{
+	struct lfi(map_share) *share = m->share;
+
+	if (share == NULL) {
+		share = other->share;
+	} else if (other->share != NULL && other->share != share) {
+		share = lfi(map_share_new)(m, NULL, m->share, other->share);
+
+		if (share == NULL)
+			return 1;
+	} else if (other->share != NULL) {
+		/* Both refer to it, the reference of `other` is dropped. */
+		atomic_fetch_sub(&share->refs, 1);
+	}
+
+	m->share = share;
+	other->share = NULL;
+
+	if (other->slabs != NULL) {
+		struct lfi(map_slab) *tail = other->slabs;
+
+		while (tail->next != NULL)
+			tail = tail->next;
+
+		tail->next = m->slabs;
+		m->slabs = other->slabs;
+	}
+
+	for (size_t c = 0; c < LF_MAP_POOL_MAX_NODE_SIZE / 16; c++) {
+		void *n = other->free_nodes[c];
+
+		if (n == NULL)
+			continue;
+
+		while (*(void **) n != NULL)
+			n = *(void **) n;
+
+		*(void **) n = m->free_nodes[c];
+		m->free_nodes[c] = other->free_nodes[c];
+		other->free_nodes[c] = NULL;
+	}
+
+	if (m->slab_size < other->slab_size)
+		m->slab_size = other->slab_size;
+
+	m->large_nodes += other->large_nodes;
+
+	other->slabs = NULL;
+	other->slab_top = NULL;
+	other->slab_left = 0;
+	other->large_nodes = 0;
+
+	return 0;
+}
+
+/* Allocates a new node. */
+lfi_fdecl(struct lfi(map_node) *, map_new_node)(struct lf(map) *m,
+						const void *key,
+						size_t keylen,
+						const void *value)
+{
+	size_t value_size = m->value_size;
+	struct lfi(map_node) *n =
+		lfi(map_pool_alloc)(m, lfi(map_node_alloc_size)(keylen,
+								 value_size));
+
+	if (n == NULL)
+		return NULL;
+
+	memcpy(n->kv, key, keylen);
+
+	n->keylen = keylen;
+	n->p = n->left = n->right = NULL;
+	n->size = 1;
+	n->prefix = lfi(key_prefix)(key, keylen);
+	n->color = 1;
+
+	if (value_size > 0 && value != NULL)
+		memcpy(lf_map_node_value(n), value, value_size);
+
+	return n;
+}
+
+lfi_fdecl(void, map_left_rotate)(struct lf(map) *m, struct lfi(map_node) *x)
+{
+	struct lfi(map_node) *y = x->right;
+	x->right = y->left;
+
+	if (y->left != NULL)
+		y->left->p = x;
+
+	y->p = x->p;
+	if (x->p == NULL)
+		m->root = y;
+	else if (x == x->p->left)
+		x->p->left = y;
+	else
+		x->p->right = y;
+
+	y->left = x;
+	x->p = y;
+
+	y->size = x->size;
+	x->size = lf_map_node_size(x->left) + lf_map_node_size(x->right) + 1;
+}
+
+lfi_fdecl(void, map_right_rotate)(struct lf(map) *m, struct lfi(map_node) *x)
+{
+	struct lfi(map_node) *y = x->left;
+	x->left = y->right;
+
+	if (y->right != NULL)
+		y->right->p = x;
+
+	y->p = x->p;
+	if (x->p == NULL)
+		m->root = y;
+	else if (x == x->p->right)
+		x->p->right = y;
+	else
+		x->p->left = y;
+
+	y->right = x;
+	x->p = y;
+
+	y->size = x->size;
+	x->size = lf_map_node_size(x->left) + lf_map_node_size(x->right) + 1;
+}
+
+lfi_fdecl(void, map_delete_fixup)(struct lf(map) *m,
+				  struct lfi(map_node) *x,
+				  struct lfi(map_node) *x_parent)
+{
+	while (x != m->root && lf_map_node_color(x) == 0) {
+		if (x == x_parent->left) {
+			struct lfi(map_node) *w = x_parent->right;
+
+			if (lf_map_node_color(w) == 1) {
+				/* case 1 */
+				w->color = 0;
+				x_parent->color = 1;
+				lfi(map_left_rotate)(m, x_parent);
+				w = x_parent->right;
+			}
+
+			if (lf_map_node_color(w->left) == 0 &&
+				lf_map_node_color(w->right) == 0) {
+				/* case 2 */
+				w->color = 1;
+				x = x_parent;
+				x_parent = x->p;
+			} else {
+				if (lf_map_node_color(w->right) == 0) {
+					/* case 3 */
+					if (w->left) w->left->color = 0;
+					w->color = 1;
+					lfi(map_right_rotate)(m, w);
+					w = x_parent->right;
+				}
+
+				/* case 4 */
+				w->color = x_parent->color;
+				x_parent->color = 0;
+				if (w->right)
+					w->right->color = 0;
+				lfi(map_left_rotate)(m, x_parent);
+				x = m->root;
+			}
+		} else {
+			struct lfi(map_node) *w = x_parent->left;
+
+			if (lf_map_node_color(w) == 1) {
+				/* case 1 */
+				w->color = 0;
+				x_parent->color = 1;
+				lfi(map_right_rotate)(m, x_parent);
+				w = x_parent->left;
+			}
+
+			if (lf_map_node_color(w->right) == 0 &&
+				lf_map_node_color(w->left) == 0) {
+				/* case 2 */
+				w->color = 1;
+				x = x_parent;
+				x_parent = x->p;
+			} else {
+				if (lf_map_node_color(w->left) == 0) {
+					/* case 3 */
+					if (w->right)
+						w->right->color = 0;
+					w->color = 1;
+					lfi(map_left_rotate)(m, w);
+					w = x_parent->left;
+				}
+
+				/* case 4 */
+				w->color = x_parent->color;
+				x_parent->color = 0;
+				if (w->left)
+					w->left->color = 0;
+				lfi(map_right_rotate)(m, x_parent);
+				x = m->root;
+			}
+		}
+	}
+
+	if (x != NULL)
+		x->color = 0;
+}
+
+/* Returns true if the root is turned black, which adds a black node to every
+ * path. */
+lfi_fdecl(bool, map_insert_fixup)(struct lf(map) *m, struct lfi(map_node) *z)
+{
+	while (z->p != NULL && z->p->color == 1) {
+		if (z->p == z->p->p->left) {
+			struct lfi(map_node) *y = z->p->p->right;  // Uncle
+
+			if (y != NULL && y->color == 1) {
+				/* case 1 */
+				z->p->color = 0;
+				y->color = 0;
+				z->p->p->color = 1;
+				z = z->p->p;
+			} else {
+				if (z == z->p->right) {
+					/* case 2 */
+					z = z->p;
+					lfi(map_left_rotate)(m, z);
+				}
+
+				/* case 3 */
+				z->p->color = 0;
+				z->p->p->color = 1;
+				lfi(map_right_rotate)(m, z->p->p);
+			}
+		} else {
+			struct lfi(map_node) *y = z->p->p->left;  // Uncle
+
+			if (y != NULL && y->color == 1) {
+				z->p->color = 0;
+				y->color = 0;
+				z->p->p->color = 1;
+				z = z->p->p;
+			} else {
+				if (z == z->p->left) {
+					z = z->p;
+					lfi(map_right_rotate)(m, z);
+				}
+
+				z->p->color = 0;
+				z->p->p->color = 1;
+				lfi(map_left_rotate)(m, z->p->p);
+			}
+		}
+	}
+
+	/* case 0 */
+	bool grown = m->root->color == 1;
+
+	m->root->color = 0;
+
+	return grown;
+}
+
+lfi_fdecl(void, map_transplant)(struct lf(map) *m,
+			    struct lfi(map_node) *u,
+			    struct lfi(map_node) *v)
+{
+	if (u->p == NULL)
+		m->root = v;
+	else if (u == u->p->left)
+		u->p->left = v;
+	else
+		u->p->right = v;
+
+	if (v != NULL)
+		v->p = u->p;
+}
+
+/* Default comparator used if no comparatasion function is given to the
+ * map_init(). */
+lfi_fdecl(int, map_default_comparator)(const void *key1, const void *key2,
+				       size_t keylen1, size_t keylen2)
+{
+	int res = memcmp(key1, key2, keylen1 < keylen2 ? keylen1 : keylen2);
+
+	if (res == 0) {
+		if (keylen1 == keylen2)
+			return 0;
+		else if (keylen1 < keylen2)
+			return -1;
+		else
+			return 1;
+	}
+
+	return res;
+}
+
+/* Compares the key of the node to the given one. The default comparison is
+ * decided by the prefixes unless they are equal, without calling through the
+ * pointer. */
+inline lfi_fdecl(int, map_cmp)(const struct lf(map) *m,
+			       const struct lfi(map_node) *n,
+			       const void *key,
+			       size_t keylen,
+			       uint64_t prefix)
+{
+	if (m->cmp != lfi(map_default_comparator))
+		return m->cmp(n->kv, key, n->keylen, keylen);
+
+	if (n->prefix != prefix)
+		return n->prefix < prefix ? -1 : 1;
+
+	return lfi(map_default_comparator)(n->kv, key, n->keylen, keylen);
+}
+
+/* Takes the node out of the tree, without freeing it. */
+lfi_fdecl(void, map_unlink)(struct lf(map) *m, struct lfi(map_node) *z)
+{
+	struct lfi(map_node) *y = z;
+
+	char orig_color = y->color;
+
+	struct lfi(map_node) *x, *x_parent = NULL;
+
+	if (z->left == NULL) {
+		/* case 1 */
+		x = z->right;
+		x_parent = z->p;
+		lfi(map_transplant)(m, z, z->right);
+	} else if (z->right == NULL) {
+		/* case 2 */
+		x = z->left;
+		x_parent = z->p;
+		lfi(map_transplant)(m, z, z->left);
+	} else {
+		/* case 3 */
+		y = z->right;
+
+		while (y->left)
+			y = y->left;
+
+		orig_color = y->color;
+		x = y->right;
+
+		if (y->p == z) {
+			x_parent = y;
+			if (x != NULL)
+				x->p = y;
+		} else {
+			x_parent = y->p;
+			lfi(map_transplant)(m, y, y->right);
+			y->right = z->right;
+			y->right->p = y;
+		}
+
+		lfi(map_transplant)(m, z, y);
+		y->left = z->left;
+		y->left->p = y;
+		y->color = z->color;
+
+		y->size = z->size;
+	}
+
+	struct lfi(map_node) *cur = x_parent;
+	while (cur != NULL) {
+		cur->size--;
+		cur = cur->p;
+	}
+
+	if (orig_color == 0)
+		lfi(map_delete_fixup)(m, x, x_parent);
+}
+
+/* Releases the nodes not allocated from the slabs. */
+lfi_fdecl(void, map_destroy_recursive)(struct lf(map) *m,
+				       struct lfi(map_node) *n)
+{
+	if (n != NULL) {
+		lfi(map_destroy_recursive)(m, n->left);
+		lfi(map_destroy_recursive)(m, n->right);
+
+		size_t size = lfi(map_node_alloc_size)(n->keylen,
+						       m->value_size);
+
+		if (size > LF_MAP_POOL_MAX_NODE_SIZE)
+			lfi(free)(&m->allocator, n, size);
+	}
+}
+
+/* Returns the nodes of a partially built tree to the pool. */
+lfi_fdecl(void, map_release_recursive)(struct lf(map) *m,
+				       struct lfi(map_node) *n)
+{
+	if (n != NULL) {
+		lfi(map_release_recursive)(m, n->left);
+		lfi(map_release_recursive)(m, n->right);
+
+		lfi(map_pool_free)(m, n, lfi(map_node_alloc_size)(n->keylen,
+								  m->value_size));
+	}
+}
+
+/* Builds the subtree of the entries in [lo, hi) rooted at their middle entry.
+ * Subtree sizes differ by at most one, so every leaf is on the last two
+ * levels. Nodes on the deepest level of the whole tree are red and the rest
+ * are black, which gives every path the same number of black nodes. Sets
+ * `*err` and returns the part built so far if an allocation fails. */
+lfi_fdecl(struct lfi(map_node) *, map_build)(struct lf(map) *m,
+					     const void *const *keys,
+					     const size_t *keylens,
+					     const char *values,
+					     size_t lo,
+					     size_t hi,
+					     size_t depth,
+					     size_t red_depth,
+					     bool *err)
+{
+	if (lo == hi)
+		return NULL;
+
+	size_t mid = lo + (hi - lo) / 2;
+	size_t keylen = keylens != NULL ? keylens[mid] : strlen(keys[mid]);
+	const void *value = values != NULL ? &values[mid * m->value_size] : NULL;
+
+	struct lfi(map_node) *n = lfi(map_new_node)(m, keys[mid], keylen, value);
+
+	if (n == NULL) {
+		*err = true;
+
+		return NULL;
+	}
+
+	n->left = lfi(map_build)(m, keys, keylens, values, lo, mid,
+				 depth + 1, red_depth, err);
+	n->right = lfi(map_build)(m, keys, keylens, values, mid + 1, hi,
+				  depth + 1, red_depth, err);
+
+	if (n->left != NULL)
+		n->left->p = n;
+	if (n->right != NULL)
+		n->right->p = n;
+
+	n->size = hi - lo;
+	n->color = depth == red_depth && depth > 0;
+
+	return n;
+}
+
+lfi_fdecl(size_t, map_black_height)(struct lfi(map_node) *n)
+{
+	size_t bh = 0;
+
+	for (; n != NULL; n = n->left)
+		bh += !n->color;
+
+	return bh;
+}
+
+/* Makes the child of a node with `bh` black nodes on its paths a tree of its
+ * own. Roots of trees are black. */
+lfi_fdecl(struct lfi(map_tree), map_detach)(struct lfi(map_node) *parent,
+					    size_t bh,
+					    struct lfi(map_node) *n)
+{
+	struct lfi(map_tree) t = { n, bh - !parent->color };
+
+	if (n != NULL) {
+		n->p = NULL;
+
+		if (n->color) {
+			n->color = 0;
+			t.bh++;
+		}
+	}
+
+	return t;
+}
+
+/* Joins the trees with `x` in between, all keys of `l` are less than the key
+ * of `x` and all keys of `r` are greater. The root of the shorter tree
+ * replaces a black node of the same black height on the near spine of the
+ * taller one, under the red `x`, and the insert fixup restores the colors. */
+lfi_fdecl(struct lfi(map_tree), map_join3)(struct lfi(map_tree) l,
+					   struct lfi(map_node) *x,
+					   struct lfi(map_tree) r)
+{
+	x->left = l.root;
+	x->right = r.root;
+	x->size = lf_map_node_size(l.root) + lf_map_node_size(r.root) + 1;
+
+	if (l.bh == r.bh) {
+		x->p = NULL;
+		x->color = 0;
+
+		if (l.root != NULL)
+			l.root->p = x;
+		if (r.root != NULL)
+			r.root->p = x;
+
+		return (struct lfi(map_tree)) { x, l.bh + 1 };
+	}
+
+	bool taller_left = l.bh > r.bh;
+	struct lfi(map_tree) tall = taller_left ? l : r;
+	struct lfi(map_tree) short_ = taller_left ? r : l;
+
+	struct lfi(map_node) *cur = tall.root;
+	struct lfi(map_node) *p = NULL;
+	size_t bh = tall.bh;
+	size_t add = lf_map_node_size(short_.root) + 1;
+
+	while (bh > short_.bh || lf_map_node_color(cur) == 1) {
+		bh -= !cur->color;
+		cur->size += add;
+		p = cur;
+		cur = taller_left ? cur->right : cur->left;
+	}
+
+	if (taller_left) {
+		x->left = cur;
+		p->right = x;
+	} else {
+		x->right = cur;
+		p->left = x;
+	}
+
+	if (cur != NULL)
+		cur->p = x;
+	if (short_.root != NULL)
+		short_.root->p = x;
+
+	x->p = p;
+	x->color = 1;
+	x->size = lf_map_node_size(x->left) + lf_map_node_size(x->right) + 1;
+
+	struct lf(map) t = { .root = tall.root };
+	bool grown = lfi(map_insert_fixup)(&t, x);
+
+	return (struct lfi(map_tree)) { t.root, tall.bh + grown };
+}
+
+/* Splits the tree into the keys less than the key, and the rest. If `eq` is
+ * not NULL, the node matching the key is detached to `*eq` rather than
+ * going to the right. */
+lfi_fdecl(void, map_split_tree)(const struct lf(map) *m,
+				struct lfi(map_tree) t,
+				const void *key,
+				size_t keylen,
+				uint64_t prefix,
+				struct lfi(map_tree) *l,
+				struct lfi(map_tree) *r,
+				struct lfi(map_node) **eq)
+{
+	struct lfi(map_node) *n = t.root;
+
+	if (n == NULL) {
+		*l = *r = t;
+
+		return;
+	}
+
+	struct lfi(map_tree) left = lfi(map_detach)(n, t.bh, n->left);
+	struct lfi(map_tree) right = lfi(map_detach)(n, t.bh, n->right);
+	struct lfi(map_tree) part;
+
+	int cmp = lfi(map_cmp)(m, n, key, keylen, prefix);
+
+	if (cmp == 0 && eq != NULL) {
+		*eq = n;
+		*l = left;
+		*r = right;
+	} else if (cmp >= 0) {
+		lfi(map_split_tree)(m, left, key, keylen, prefix, l, &part,
+				    eq);
+		*r = lfi(map_join3)(part, n, right);
+	} else {
+		lfi(map_split_tree)(m, right, key, keylen, prefix, &part, r,
+				    eq);
+		*l = lfi(map_join3)(left, n, part);
+	}
+}
+
+/* Merges the trees, freeing the nodes of `b` whose keys are in `a`. */
+lfi_fdecl(struct lfi(map_tree), map_union_tree)(struct lf(map) *m,
+						struct lfi(map_tree) a,
+						struct lfi(map_tree) b)
+{
+	struct lfi(map_node) *n = a.root;
+
+	if (n == NULL)
+		return b;
+	if (b.root == NULL)
+		return a;
+
+	struct lfi(map_tree) al = lfi(map_detach)(n, a.bh, n->left);
+	struct lfi(map_tree) ar = lfi(map_detach)(n, a.bh, n->right);
+	struct lfi(map_tree) bl, br;
+	struct lfi(map_node) *dup = NULL;
+
+	lfi(map_split_tree)(m, b, n->kv, n->keylen, n->prefix, &bl, &br, &dup);
+
+	if (dup != NULL)
+		lfi(map_pool_free)(m, dup, lfi(map_node_alloc_size)(dup->keylen,
+								    m->value_size));
+
+	struct lfi(map_tree) l = lfi(map_union_tree)(m, al, bl);
+	struct lfi(map_tree) r = lfi(map_union_tree)(m, ar, br);
+
+	return lfi(map_join3)(l, n, r);
+}
+
+lfi_fdecl(bool, map_compatible)(const struct lf(map) *m,
+				const struct lf(map) *other)
+{
+	return m->value_size == other->value_size && m->cmp == other->cmp &&
+	       m->allocator.alloc == other->allocator.alloc &&
+	       m->allocator.realloc == other->allocator.realloc &&
+	       m->allocator.free == other->allocator.free &&
+	       m->allocator.ctx == other->allocator.ctx;
+}
+
+lfi_fdecl(struct lfi(map_node) *, map_get2_node)(struct lf(map) *m,
+						 const void *key,
+						 size_t keylen)
+{
+	struct lfi(map_node) *cur = m->root;
+
+	uint64_t prefix = lfi(key_prefix)(key, keylen);
+
+	while (cur != NULL) {
+		int cmp = lfi(map_cmp)(m, cur, key, keylen, prefix);
+
+		if (cmp < 0)
+			cur = cur->right;
+		else if (cmp > 0)
+			cur = cur->left;
+		else
+			return cur;
+	}
+
+	return NULL;
+}
+
+lfi_fdecl(struct lfi(map_node) *, map_select_node)(struct lf(map) *m,
+						   ptrdiff_t i_)
+{
+	size_t i = lfi(circular_index)(i_, lf(map_size)(m));
+
+	struct lfi(map_node) *cur = m->root;
+
+	while (true) {
+		if (lf_map_node_size(cur->left) == i)
+			break;
+
+		if (lf_map_node_size(cur->left) > i) {
+			cur = cur->left;
+		} else {
+			i -= lf_map_node_size(cur->left) + 1;
+			cur = cur->right;
+		}
+	}
+
+	return cur;
+}
+
+/* Returns the leftmost node in the subtree rooted at n. */
+lfi_fdecl(struct lfi(map_node) *, map_leftmost)(struct lfi(map_node) *n)
+{
+	if (n == NULL)
+		return NULL;
+
+	while (n->left)
+		n = n->left;
+
+	return n;
+}
+
+/* Returns the rightmost node in the subtree rooted at n. */
+lfi_fdecl(struct lfi(map_node) *, map_rightmost)(struct lfi(map_node) *n)
+{
+	if (n == NULL)
+		return NULL;
+
+	while (n->right)
+		n = n->right;
+
+	return n;
+}
+
+/* Returns the in-order successor of n, or NULL if n is the maximum. */
+lfi_fdecl(struct lfi(map_node) *, map_successor)(struct lfi(map_node) *n)
+{
+	if (n->right)
+		return lfi(map_leftmost)(n->right);
+
+	struct lfi(map_node) *y = n->p;
+
+	while (y != NULL && n == y->right) {
+		n = y;
+		y = y->p;
+	}
+
+	return y;
+}
+
+/* Returns the in-order predecessor of n, or NULL if n is the minimum. */
+lfi_fdecl(struct lfi(map_node) *, map_predecessor)(struct lfi(map_node) *n)
+{
+	if (n->left)
+		return lfi(map_rightmost)(n->left);
+
+	struct lfi(map_node) *y = n->p;
+
+	while (y != NULL && n == y->left) {
+		n = y;
+		y = y->p;
+	}
+
+	return y;
+}
+
+/* Returns the first node with a key not less than the key, or greater than
+ * the key if `upper`. Sets `*pred` to the node preceding it and `*rank` to its
+ * rank, unless they are NULL. */
+lfi_fdecl(struct lfi(map_node) *, map_bound)(const struct lf(map) *m,
+					     const void *key,
+					     size_t keylen,
+					     bool upper,
+					     struct lfi(map_node) **pred,
+					     size_t *rank)
+{
+	struct lfi(map_node) *cur = m->root;
+	struct lfi(map_node) *bound = NULL;
+	struct lfi(map_node) *before = NULL;
+
+	uint64_t prefix = lfi(key_prefix)(key, keylen);
+	size_t r = 0;
+
+	while (cur != NULL) {
+		int cmp = lfi(map_cmp)(m, cur, key, keylen, prefix);
+
+		if (cmp < 0 || (upper && cmp == 0)) {
+			r += lf_map_node_size(cur->left) + 1;
+			before = cur;
+
+			cur = cur->right;
+		} else {
+			bound = cur;
+
+			cur = cur->left;
+		}
+	}
+
+	if (pred != NULL)
+		*pred = before;
+	if (rank != NULL)
+		*rank = r;
+
+	return bound;
+}
+
+/* Constructs a map_entry from a node, or the exhaustion sentinel if NULL. */
+lfi_fdecl(struct lf(entry), map_entry_of)(struct lfi(map_node) *n)
+{
+	if (n == NULL)
+		return lfi_sentinel_entry;
+
+	return (struct lf(entry)) {
+		.key = n->kv,
+		.keylen = n->keylen,
+		.value = lf_map_node_value(n),
+	};
+}
+
+
+int lf(map_init)(struct lf(map) *m,
+		 size_t value_size,
+		 int (*cmp)(const void *, const void *, size_t, size_t))
+{
+	return lf(map_init_with)(m, value_size, cmp, NULL);
+}
+
+int lf(map_init_with)(struct lf(map) *m,
+		      size_t value_size,
+		      int (*cmp)(const void *, const void *, size_t, size_t),
+		      const struct lf(allocator) *allocator)
+{
+	m->allocator = allocator == NULL ? lf(allocator_libc) : *allocator;
+	m->slabs = NULL;
+	m->share = NULL;
+	m->slab_top = NULL;
+	m->slab_left = 0;
+	m->slab_size = LF_MAP_POOL_MAX_NODE_SIZE * 16;
+	m->large_nodes = 0;
+	memset(m->free_nodes, 0, sizeof(m->free_nodes));
+	m->root = NULL;
+	m->value_size = value_size;
+	m->cmp = cmp == NULL ? lfi(map_default_comparator) : cmp;
+
+	if (m->value_size)
+		m->hold_value = lf_alloc(&m->allocator, value_size);
+	else
+		m->hold_value = (void *) 1;
+
+	return m->hold_value == NULL ? 1 : 0;
+}
+
+void lf(map_xinit)(struct lf(map) *m,
+		   size_t value_size,
+		   int (*cmp)(const void *, const void *, size_t, size_t))
+{
+	lf_unwrap(lf(map_init)(m, value_size, cmp));
+}
+
+void lf(map_xinit_with)(struct lf(map) *m,
+			size_t value_size,
+			int (*cmp)(const void *, const void *, size_t, size_t),
+			const struct lf(allocator) *allocator)
+{
+	lf_unwrap(lf(map_init_with)(m, value_size, cmp, allocator));
+}
+
+void lf(map_destroy)(struct lf(map) *m)
+{
+	/* Only the large nodes are released one by one. */
+	if (m->large_nodes)
+		lfi(map_destroy_recursive)(m, m->root);
+
+	lfi(map_free_slabs)(m, m->slabs);
+	lfi(map_share_release)(m, m->share);
+
+	if (m->value_size)
+		lfi(free)(&m->allocator, m->hold_value, m->value_size);
+}
+
+void *lf(map_get)(struct lf(map) *m, const void *key)
+{
+	return lf(map_get2)(m, key, strlen(key));
+}
+
+void *lf(map_get2)(struct lf(map) *m, const void *key, size_t keylen)
+{
+	struct lfi(map_node) *n = lfi(map_get2_node)(m, key, keylen);
+
+	return n != NULL ? lf_map_node_value(n) : NULL;
+}
+
+void *lf(map_insert)(struct lf(map) *m, const void *key, const void *value)
+{
+	return lf(map_insert2)(m, key, strlen(key), value);
+}
+
+void *lf(map_xinsert)(struct lf(map) *m, const void *key, const void *value)
+{
+	void *insert_res = lf(map_insert)(m, key, value);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+void *lf(map_insert2)(struct lf(map) *m,
+		      const void *key,
+		      size_t keylen,
+		      const void *value)
+{
+	struct lfi(map_node) *n =
+		lfi(map_new_node)(m, key, keylen, value);
+
+	if (n == NULL)
+		return NULL;
+
+	if (m->root == NULL) {
+		m->root = n;
+	} else {
+		struct lfi(map_node) *cur = m->root;
+
+		struct lfi(map_node) *p;
+		int cmp = 0;
+
+		while (cur != NULL) {
+			p = cur;
+			cur->size++;
+
+			cmp = lfi(map_cmp)(m, cur, key, keylen, n->prefix);
+
+			lf_assert(cmp != 0, "map already contains the element");
+
+			if (cmp < 0)
+				cur = cur->right;
+			else if (cmp > 0)
+				cur = cur->left;
+		}
+
+		if (cmp < 0)
+			p->right = n;
+		else if (cmp > 0)
+			p->left = n;
+
+		n->p = p;
+	}
+
+	lfi(map_insert_fixup)(m, n);
+
+	return lf_map_node_value(n);
+}
+
+void *lf(map_xinsert2)(struct lf(map) *m,
+		       const void *key,
+		       size_t keylen,
+		       const void *value)
+{
+	void *insert_res = lf(map_insert2)(m, key, keylen, value);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+int lf(map_build_sorted)(struct lf(map) *m,
+			 const void *const *keys,
+			 const void *values,
+			 size_t n)
+{
+	return lf(map_build_sorted2)(m, keys, NULL, values, n);
+}
+
+int lf(map_build_sorted2)(struct lf(map) *m,
+			  const void *const *keys,
+			  const size_t *keylens,
+			  const void *values,
+			  size_t n)
+{
+	lf_assert(m->root == NULL, "map is not empty");
+
+#ifndef NDEBUG
+	for (size_t i = 1; i < n; i++) {
+		size_t keylen1 = keylens != NULL ? keylens[i - 1] :
+			strlen(keys[i - 1]);
+		size_t keylen2 = keylens != NULL ? keylens[i] : strlen(keys[i]);
+
+		lf_debug_assert(m->cmp(keys[i - 1], keys[i],
+				       keylen1, keylen2) < 0,
+				"keys are not sorted");
+	}
+#endif
+
+	if (n == 0)
+		return 0;
+
+	/* Depth of the deepest level, floor(log2(n)). */
+	size_t red_depth = 0;
+
+	while (n >> red_depth > 1)
+		red_depth++;
+
+	bool err = false;
+	struct lfi(map_node) *root = lfi(map_build)(m, keys, keylens, values,
+						    0, n, 0, red_depth, &err);
+
+	if (err) {
+		lfi(map_release_recursive)(m, root);
+
+		return 1;
+	}
+
+	m->root = root;
+
+	return 0;
+}
+
+void lf(map_xbuild_sorted)(struct lf(map) *m,
+			   const void *const *keys,
+			   const void *values,
+			   size_t n)
+{
+	lf_unwrap(lf(map_build_sorted)(m, keys, values, n));
+}
+
+void lf(map_xbuild_sorted2)(struct lf(map) *m,
+			    const void *const *keys,
+			    const size_t *keylens,
+			    const void *values,
+			    size_t n)
+{
+	lf_unwrap(lf(map_build_sorted2)(m, keys, keylens, values, n));
+}
+
+const void *lf(map_remove)(struct lf(map) *m, const void *key)
+{
+	return lf(map_remove2)(m, key, strlen(key));
+}
+
+const void *lf(map_remove2)(struct lf(map) *m, const void *key, size_t keylen)
+{
+	struct lfi(map_node) *z = lfi(map_get2_node)(m, key, keylen);
+
+	if (z == NULL)
+		return NULL;
+
+	if (m->value_size)
+		memcpy(m->hold_value, lf_map_node_value(z), m->value_size);
+
+	lfi(map_unlink)(m, z);
+
+	lfi(map_pool_free)(m, z, lfi(map_node_alloc_size)(z->keylen,
+							   m->value_size));
+
+	return m->hold_value;
+}
+
+int lf(map_split)(struct lf(map) *m, const void *key, struct lf(map) *right)
+{
+	return lf(map_split2)(m, key, strlen(key), right);
+}
+
+int lf(map_split2)(struct lf(map) *m,
+		   const void *key,
+		   size_t keylen,
+		   struct lf(map) *right)
+{
+	if (lf(map_init_with)(right, m->value_size, m->cmp, &m->allocator))
+		return 1;
+
+	if (lfi(map_pool_share)(m, right)) {
+		lf(map_destroy)(right);
+
+		return 1;
+	}
+
+	/* Large nodes are not counted one by one, the count is only an upper
+	 * bound from now on. */
+	right->large_nodes = m->large_nodes;
+
+	struct lfi(map_tree) t = { m->root, lfi(map_black_height)(m->root) };
+	struct lfi(map_tree) l, r;
+
+	lfi(map_split_tree)(m, t, key, keylen, lfi(key_prefix)(key, keylen),
+			    &l, &r, NULL);
+
+	m->root = l.root;
+	right->root = r.root;
+
+	return 0;
+}
+
+int lf(map_join)(struct lf(map) *m, struct lf(map) *other)
+{
+	lf_assert(lfi(map_compatible)(m, other), "maps are not compatible");
+
+	if (lfi(map_pool_absorb)(m, other))
+		return 1;
+
+	struct lfi(map_node) *x = other->root;
+
+	if (x == NULL)
+		return 0;
+
+	while (x->left != NULL)
+		x = x->left;
+
+#ifndef NDEBUG
+	struct lfi(map_node) *max = m->root;
+
+	while (max != NULL && max->right != NULL)
+		max = max->right;
+
+	lf_debug_assert(max == NULL ||
+			m->cmp(max->kv, x->kv, max->keylen, x->keylen) < 0,
+			"key ranges of the maps overlap");
+#endif
+
+	lfi(map_unlink)(other, x);
+
+	struct lfi(map_tree) l = { m->root, lfi(map_black_height)(m->root) };
+	struct lfi(map_tree) r = {
+		other->root, lfi(map_black_height)(other->root)
+	};
+
+	m->root = lfi(map_join3)(l, x, r).root;
+	other->root = NULL;
+
+	return 0;
+}
+
+int lf(map_union)(struct lf(map) *m, struct lf(map) *other)
+{
+	lf_assert(lfi(map_compatible)(m, other), "maps are not compatible");
+
+	if (lfi(map_pool_absorb)(m, other))
+		return 1;
+
+	struct lfi(map_tree) a = { m->root, lfi(map_black_height)(m->root) };
+	struct lfi(map_tree) b = {
+		other->root, lfi(map_black_height)(other->root)
+	};
+
+	m->root = lfi(map_union_tree)(m, a, b).root;
+	other->root = NULL;
+
+	return 0;
+}
+
+void lf(map_xsplit)(struct lf(map) *m, const void *key, struct lf(map) *right)
+{
+	lf_unwrap(lf(map_split)(m, key, right));
+}
+
+void lf(map_xsplit2)(struct lf(map) *m,
+		     const void *key,
+		     size_t keylen,
+		     struct lf(map) *right)
+{
+	lf_unwrap(lf(map_split2)(m, key, keylen, right));
+}
+
+void lf(map_xjoin)(struct lf(map) *m, struct lf(map) *other)
+{
+	lf_unwrap(lf(map_join)(m, other));
+}
+
+void lf(map_xunion)(struct lf(map) *m, struct lf(map) *other)
+{
+	lf_unwrap(lf(map_union)(m, other));
+}
+
+struct lf(entry) lf(map_select)(struct lf(map) *m, ptrdiff_t i)
+{
+	return lfi(map_entry_of)(lfi(map_select_node)(m, i));
+}
+
+size_t lf(map_size)(const struct lf(map) *m)
+{
+	return lf_map_node_size(m->root);
+}
+
+size_t lf(map_rank)(const struct lf(map) *m, const void *key)
+{
+	return lf(map_rank2)(m, key, strlen(key));
+}
+
+size_t lf(map_rank2)(const struct lf(map) *m, const void *key, size_t keylen)
+{
+	struct lfi(map_node) *cur = m->root;
+
+	uint64_t prefix = lfi(key_prefix)(key, keylen);
+	size_t rank = 0;
+
+	while (cur != NULL) {
+		int cmp = lfi(map_cmp)(m, cur, key, keylen, prefix);
+
+		if (cmp < 0) {
+			rank += lf_map_node_size(cur->left) + 1;
+
+			cur = cur->right;
+		} else if (cmp > 0) {
+			cur = cur->left;
+		} else {
+			rank += lf_map_node_size(cur->left);
+
+			return rank;
+		}
+	}
+
+	return -1;
+}
+
+void lf(map_iter)(struct lf(map) *m, struct lf(map_it) *it)
+{
+	lf(map_iter_from)(m, it, 0);
+}
+
+void lf(map_iter_from)(struct lf(map) *m,
+		       struct lf(map_it) *it,
+		       ptrdiff_t i)
+{
+	it->m = m;
+	it->n = lfi(map_select_node)(m, i);
+	it->end = NULL;
+	it->rend = NULL;
+}
+
+void lf(map_lower_bound)(struct lf(map) *m,
+			 struct lf(map_it) *it,
+			 const void *key)
+{
+	lf(map_lower_bound2)(m, it, key, strlen(key));
+}
+
+void lf(map_lower_bound2)(struct lf(map) *m,
+			  struct lf(map_it) *it,
+			  const void *key,
+			  size_t keylen)
+{
+	it->m = m;
+	it->n = lfi(map_bound)(m, key, keylen, false, NULL, NULL);
+	it->end = NULL;
+	it->rend = NULL;
+}
+
+void lf(map_upper_bound)(struct lf(map) *m,
+			 struct lf(map_it) *it,
+			 const void *key)
+{
+	lf(map_upper_bound2)(m, it, key, strlen(key));
+}
+
+void lf(map_upper_bound2)(struct lf(map) *m,
+			  struct lf(map_it) *it,
+			  const void *key,
+			  size_t keylen)
+{
+	it->m = m;
+	it->n = lfi(map_bound)(m, key, keylen, true, NULL, NULL);
+	it->end = NULL;
+	it->rend = NULL;
+}
+
+void lf(map_iter_range)(struct lf(map) *m,
+			struct lf(map_it) *it,
+			const void *lo,
+			const void *hi)
+{
+	lf(map_iter_range2)(m, it, lo, strlen(lo), hi, strlen(hi));
+}
+
+void lf(map_iter_range2)(struct lf(map) *m,
+			 struct lf(map_it) *it,
+			 const void *lo,
+			 size_t lolen,
+			 const void *hi,
+			 size_t hilen)
+{
+	lf_debug_assert(m->cmp(lo, hi, lolen, hilen) <= 0,
+			"range bounds are not in order");
+
+	it->m = m;
+	it->n = lfi(map_bound)(m, lo, lolen, false, &it->rend, NULL);
+	it->end = lfi(map_bound)(m, hi, hilen, false, NULL, NULL);
+}
+
+size_t lf(map_count_range)(const struct lf(map) *m,
+			   const void *lo,
+			   const void *hi)
+{
+	return lf(map_count_range2)(m, lo, strlen(lo), hi, strlen(hi));
+}
+
+size_t lf(map_count_range2)(const struct lf(map) *m,
+			    const void *lo,
+			    size_t lolen,
+			    const void *hi,
+			    size_t hilen)
+{
+	size_t lo_rank, hi_rank;
+
+	lfi(map_bound)(m, lo, lolen, false, NULL, &lo_rank);
+	lfi(map_bound)(m, hi, hilen, false, NULL, &hi_rank);
+
+	return hi_rank > lo_rank ? hi_rank - lo_rank : 0;
+}
+
+/* The bounds of a range are the nodes just outside of it, which end the
+ * iteration in either direction. */
+struct lf(entry) lf(map_iter_next)(struct lf(map_it) *it)
+{
+	struct lfi(map_node) *cur = it->n;
+
+	if (cur == NULL || cur == it->end || cur == it->rend) {
+		it->n = NULL;
+
+		return lfi_sentinel_entry;
+	}
+
+	it->n = lfi(map_successor)(cur);
+
+	return lfi(map_entry_of)(cur);
+}
+
+struct lf(entry) lf(map_iter_prev)(struct lf(map_it) *it)
+{
+	struct lfi(map_node) *cur = it->n;
+
+	if (cur == NULL || cur == it->end || cur == it->rend) {
+		it->n = NULL;
+
+		return lfi_sentinel_entry;
+	}
+
+	it->n = lfi(map_predecessor)(cur);
+
+	return lfi(map_entry_of)(cur);
+}
+#ifndef LF_HEADERONLY
+#include "util.h"
+#include "../include/config.h"
+#include "../include/stack.h"
+#endif
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+int lf(stack_init)(struct lf(stack) *s, size_t item_size)
+{
+	return lf(stack_init_with)(s, item_size, NULL);
+}
+
+void lf(stack_xinit)(struct lf(stack) *s, size_t item_size)
+{
+	lf_unwrap(lf(stack_init)(s, item_size));
+}
+
+int lf(stack_init_with)(struct lf(stack) *s,
+			size_t item_size,
+			const struct lf(allocator) *allocator)
+{
+	s->allocator = allocator == NULL ? lf(allocator_libc) : *allocator;
+	s->cap = LF_STACK_INITIAL_CAP;
+	s->len = 0;
+	s->item_size = item_size;
+	s->data = lf_alloc(&s->allocator, item_size * LF_STACK_INITIAL_CAP);
+
+	return s->data == NULL ? 1 : 0;
+}
+
+void lf(stack_xinit_with)(struct lf(stack) *s,
+			  size_t item_size,
+			  const struct lf(allocator) *allocator)
+{
+	lf_unwrap(lf(stack_init_with)(s, item_size, allocator));
+}
+
+void lf(stack_destroy)(struct lf(stack) *s)
+{
+	lfi(free)(&s->allocator, s->data, s->cap * s->item_size);
+}
+
+const void *lf(stack_pop)(struct lf(stack) *s)
+{
+	lf_assert(s->len, "stack underflow");
+
+	void *item = lf(stack_at)(s, s->len - 1);
+
+	s->len--;
+
+	return item;
+}
+
+void *lf(stack_push)(struct lf(stack) *s, const void *item)
+{
+	if (s->len == s->cap) {
+		void *new_data = lf_realloc(&s->allocator, s->data,
+					    s->cap * s->item_size,
+					    s->cap * 2 * s->item_size);
+
+		if (new_data == NULL)
+			return NULL;
+
+		s->data = new_data;
+		s->cap *= 2;
+	}
+
+	void *item_on_stack = &s->data[s->len * s->item_size];
+
+	if (item != NULL)
+		memcpy(item_on_stack, item, s->item_size);
+
+	s->len++;
+
+	return item_on_stack;
+}
+
+void *lf(stack_xpush)(struct lf(stack) *s, const void *item)
+{
+	void *push_res = lf(stack_push)(s, item);
+
+	lf_assert(push_res != NULL, "insert returned NULL");
+
+	return push_res;
+}
+
+void *lf(stack_top)(struct lf(stack) *s)
+{
+	lf_assert(s->len, "stack underflow");
+
+	return lf(stack_at)(s, s->len - 1);
+}
+
+void *lf(stack_at)(struct lf(stack) *s, ptrdiff_t index)
+{
+	return &s->data[lfi(circular_index)(index, s->len) * s->item_size];
+}
+
+size_t lf(stack_len)(const struct lf(stack) *s)
+{
+	return s->len;
+}
+#endif
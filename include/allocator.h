@@ -0,0 +1,129 @@
+/**
+ * @file allocator.h
+ * @brief Pluggable memory allocators.
+ *
+ * stack, hashmap, map and btree take their memory from the allocator given to
+ * their `*_init_with` functions, so they can be placed in arenas, pools or any
+ * other memory than the libc heap. Their `*_init` functions use allocator_libc.
+ *
+ * arena is a bump allocator. Its allocations are carved from large blocks and
+ * never released one by one; destroying the arena releases its blocks at
+ * once. A container allocated in an arena does not need to be destroyed, so a
+ * request-scoped map is torn down without visiting its nodes or keys.
+ */
+
+#ifndef LF_ALLOCATOR_H
+#define LF_ALLOCATOR_H
+
+#ifndef LF_HEADERONLY
+#include "common.h"
+#endif
+
+#include <stddef.h>
+
+
+/**
+ * @brief Memory allocator.
+ *
+ * Allocations must be aligned for any type, as with malloc(). The sizes of
+ * the allocations are passed back on realloc and free, so allocators do not
+ * need to track them.
+ */
+struct lf(allocator) {
+	/** Allocates `size` bytes, returns `NULL` on failure. */
+	void *(*alloc)(void *ctx, size_t size);
+
+	/** Resizes the allocation of `old_size` bytes at `ptr` to `size` bytes,
+	 * as realloc(). Returns `NULL` on failure, leaving the allocation
+	 * intact. */
+	void *(*realloc)(void *ctx, void *ptr, size_t old_size, size_t size);
+
+	/** Releases the allocation of `size` bytes at `ptr`, never `NULL`. */
+	void (*free)(void *ctx, void *ptr, size_t size);
+
+	/** Passed to the functions above. */
+	void *ctx;
+};
+
+/** @brief Allocator using malloc(), realloc() and free(). */
+extern const struct lf(allocator) lf(allocator_libc);
+
+/** @brief Bump allocator, allocations are released with the arena. */
+struct lf(arena) {
+	/** @cond */
+	struct lfi(arena_block) *blocks;
+
+	/* Free space of the current block. */
+	char *top;
+	char *end;
+
+	/* Start of the latest allocation, which can be resized or released in
+	 * place. NULL if none. */
+	char *last;
+
+	/* Size of the next block. */
+	size_t block_size;
+	/** @endcond */
+};
+
+/** @cond */
+struct lfi(arena_block) {
+	struct lfi(arena_block) *next;
+	size_t size;
+	max_align_t data[];
+};
+/** @endcond */
+
+
+/**
+ * @brief Creates a new arena.
+ *
+ * Allocates the first block of `LF_ARENA_INITIAL_BLOCK_SIZE` bytes. Each
+ * following block is twice the size of the previous one, up to
+ * `LF_ARENA_MAX_BLOCK_SIZE`, or as large as the allocation it is made for.
+ *
+ * Returns non-zero if a memory allocation failure occurs.
+ */
+int lf(arena_init)(struct lf(arena) *arena) lfi_wur;
+
+/** @brief Identical to arena_init(), but raises an error if memory allocation
+ * fails. */
+void lf(arena_xinit)(struct lf(arena) *arena);
+
+/**
+ * @brief Releases the blocks of the arena, and all allocations made from it.
+ *
+ * Takes time proportional to the number of blocks, not the number of
+ * allocations.
+ */
+void lf(arena_destroy)(struct lf(arena) *arena);
+
+/**
+ * @brief Releases all allocations made from the arena, keeping its latest
+ * block for the following allocations.
+ */
+void lf(arena_reset)(struct lf(arena) *arena);
+
+/**
+ * @brief Allocates `size` bytes from the arena.
+ *
+ * Returns `NULL` if a memory allocation failure occurs.
+ */
+void *lf(arena_alloc)(struct lf(arena) *arena, size_t size) lfi_wur;
+
+/** @brief Identical to arena_alloc(), but raises an error if memory
+ * allocation fails. */
+void *lf(arena_xalloc)(struct lf(arena) *arena, size_t size);
+
+/**
+ * @brief Returns an allocator allocating from the arena.
+ *
+ * Releasing an allocation only reclaims its memory if it is the latest one,
+ * likewise resizing is done in place only for the latest allocation.
+ *
+ * @warning The arena must outlive the containers using the allocator.
+ */
+struct lf(allocator) lf(arena_allocator)(struct lf(arena) *arena);
+
+
+#endif
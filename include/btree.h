@@ -0,0 +1,262 @@
+/**
+ * @file btree.h
+ * @brief Ordered map on a B-tree.
+ *
+ * btree is an order-statistics B-tree. Each node holds up to
+ * `2 * LF_BTREE_DEGREE - 1` keys in a contiguous array, short keys stored in
+ * place as in hashmap.h, and internal nodes keep the subtree size of each
+ * child for select and rank. The first bytes of the keys are also kept as
+ * integers in an array of their own, which the default comparison searches
+ * before looking at the keys. A lookup touches a handful of nodes instead of a
+ * node per level of a binary tree, and the default comparison is inlined
+ * rather than called through a function pointer.
+ *
+ * The API mirrors map.h. Unlike map, entries move between nodes as the tree
+ * is modified, so value pointers are only valid until the next insert or
+ * remove operation.
+ */
+
+#ifndef LF_BTREE_H
+#define LF_BTREE_H
+
+#ifndef LF_HEADERONLY
+#include "allocator.h"
+#include "common.h"
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** @brief B-tree ordered map. */
+struct lf(btree) {
+	/** @cond */
+	struct lfi(btree_node) *root;
+
+	void *hold_value;
+
+	size_t size;
+	size_t value_size;
+
+	/* NULL for the default comparison. */
+	int (*cmp)(const void *, const void *, size_t, size_t);
+
+	struct lf(allocator) allocator;
+	/** @endcond */
+};
+
+/** @brief Iteration handle to retrieve btree entries one by one. */
+struct lf(btree_it) {
+	/** @cond */
+	struct lf(btree) *t;
+	struct lfi(btree_node) *n;
+	size_t i;
+	/** @endcond */
+};
+
+/** @cond */
+struct lfi(btree_key) {
+	size_t keylen;
+
+	union {
+		const void *ptr;
+		char bytes[LF_HASHMAP_INLINE_KEY_SIZE];
+	} key;
+};
+
+struct lfi(btree_node) {
+	struct lfi(btree_node) *p;
+
+	/* Number of keys. */
+	unsigned short len;
+	bool leaf;
+
+	/* First 8 bytes of the keys as big-endian integers, so that most
+	 * comparisons of the default ordering are integer comparisons. */
+	uint64_t prefixes[2 * LF_BTREE_DEGREE - 1];
+
+	struct lfi(btree_key) keys[2 * LF_BTREE_DEGREE - 1];
+
+	/* Followed by the values, and by the children and their subtree sizes
+	 * if the node is internal. */
+};
+/** @endcond */
+
+
+/**
+ * @brief Creates a new btree.
+ *
+ * Comparator is as in map_init(). Defaults to comparing the keys
+ * lexicographically by their bytes if `NULL`.
+ *
+ * Returns non-zero if a memory allocation failure occurs.
+ */
+int lf(btree_init)(struct lf(btree) *btree,
+		   size_t value_size,
+		   int (*comparator)(const void *key1,
+				     const void *key2,
+				     size_t keylen1,
+				     size_t keylen2)) lfi_wur;
+
+/** @brief Identical to btree_init(), but raises an error if memory allocation
+ * fails. */
+void lf(btree_xinit)(struct lf(btree) *btree,
+		     size_t value_size,
+		     int (*comparator)(const void *key1,
+				       const void *key2,
+				       size_t keylen1,
+				       size_t keylen2));
+
+/**
+ * @brief Identical to btree_init(), but takes the memory of the nodes and the
+ * keys from the `allocator`.
+ *
+ * The allocator is copied into the btree. Defaults to allocator_libc if
+ * `NULL`.
+ *
+ * @see allocator.h
+ */
+int lf(btree_init_with)(struct lf(btree) *btree,
+			size_t value_size,
+			int (*comparator)(const void *key1,
+					  const void *key2,
+					  size_t keylen1,
+					  size_t keylen2),
+			const struct lf(allocator) *allocator) lfi_wur;
+
+/** @brief Identical to btree_init_with(), but raises an error if memory
+ * allocation fails. */
+void lf(btree_xinit_with)(struct lf(btree) *btree,
+			  size_t value_size,
+			  int (*comparator)(const void *key1,
+					    const void *key2,
+					    size_t keylen1,
+					    size_t keylen2),
+			  const struct lf(allocator) *allocator);
+
+/** @brief Clears the memory allocated by the btree. */
+void lf(btree_destroy)(struct lf(btree) *btree);
+
+/**
+ * @brief Returns a pointer to the value matching the key, returns `NULL` if
+ * the key is not found.
+ *
+ * The `key` parameter must be null-terminated. Returned pointer will be a
+ * sentinel if the btree's `value_size` is zero, and it should not be
+ * dereferenced.
+ */
+void *lf(btree_get)(struct lf(btree) *btree, const void *key);
+
+/** @brief Identical to btree_get(), but accepts a non-null-terminated key. */
+void *lf(btree_get2)(struct lf(btree) *btree, const void *key, size_t keylen);
+
+/**
+ * @brief Inserts a key-value pair into the btree.
+ *
+ * @warning The key must not already exist in the btree. It is only checked if
+ * the library is not compiled with `NDEBUG`.
+ *
+ * The `key` parameter must be null-terminated. Returns `NULL` if a memory
+ * allocation failure occurs.
+ */
+void *lf(btree_insert)(struct lf(btree) *btree,
+		       const void *key,
+		       const void *value) lfi_wur;
+
+/** @brief Identical to btree_insert(), but raises an error if memory
+ * allocation fails. */
+void *lf(btree_xinsert)(struct lf(btree) *btree,
+			const void *key,
+			const void *value);
+
+/** @brief Identical to btree_insert(), but accepts a non-null-terminated
+ * key. */
+void *lf(btree_insert2)(struct lf(btree) *btree,
+			const void *key,
+			size_t keylen,
+			const void *value) lfi_wur;
+
+/** @brief Identical to btree_insert2(), but raises an error if memory
+ * allocation fails. */
+void *lf(btree_xinsert2)(struct lf(btree) *btree,
+			 const void *key,
+			 size_t keylen,
+			 const void *value);
+
+/**
+ * @brief Removes a key-value pair from the btree and returns a pointer to the
+ * value, returns `NULL` if the key is not found.
+ *
+ * @attention The returned value pointer points to internal memory that is only
+ * valid until the next remove operation. The user must copy the underlying
+ * data if they wish to retain it.
+ */
+const void *lf(btree_remove)(struct lf(btree) *btree, const void *key);
+
+/** @brief Identical to btree_remove(), but accepts a non-null-terminated
+ * key. */
+const void *lf(btree_remove2)(struct lf(btree) *btree,
+			      const void *key,
+			      size_t keylen);
+
+/**
+ * @brief Retrieves the btree entry at a specific sorted index.
+ *
+ * Raises an error if the index is larger than btree size. The entry is
+ * invalidated by the next insert or remove operation.
+ */
+struct lf(entry) lf(btree_select)(struct lf(btree) *btree, ptrdiff_t index);
+
+/**
+ * @brief Determines the 0-based index of a specific key in the sorted btree.
+ *
+ * Returns -1 casted to size_t if the key is not found.
+ */
+size_t lf(btree_rank)(const struct lf(btree) *btree, const void *key);
+
+/** @brief Identical to btree_rank(), but accepts a non-null-terminated key. */
+size_t lf(btree_rank2)(const struct lf(btree) *btree,
+		       const void *key,
+		       size_t keylen);
+
+/** @brief Returns the total number of elements currently stored in the
+ * btree. */
+size_t lf(btree_size)(const struct lf(btree) *btree);
+
+/**
+ * @brief Creates a forward iteration handle for the btree.
+ *
+ * Initializes `it` to iterate over all entries in ascending key order.
+ *
+ * @attention The iterator is invalidated by any insert or remove operation
+ * on the btree. Do not modify the btree while iterating.
+ */
+void lf(btree_iter)(struct lf(btree) *btree, struct lf(btree_it) *it);
+
+/**
+ * @brief Creates an iteration handle starting from the entry at a specific
+ * sorted index.
+ *
+ * See btree_iter().
+ */
+void lf(btree_iter_from)(struct lf(btree) *btree,
+			 struct lf(btree_it) *it,
+			 ptrdiff_t index);
+
+/**
+ * @brief Retrieves the next entry from an iteration handle.
+ *
+ * Returns entries in ascending key order. When all entries have been
+ * retrieved, returns a sentinel entry. Use entry_is_valid() to check wheter
+ * or not the entry is sentinel.
+ *
+ * @see common.h
+ */
+struct lf(entry) lf(btree_iter_next)(struct lf(btree_it) *it);
+
+/** @brief Identical to btree_iter_next, but in reverse direction. */
+struct lf(entry) lf(btree_iter_prev)(struct lf(btree_it) *it);
+
+
+#endif
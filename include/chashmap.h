@@ -0,0 +1,162 @@
+/**
+ * @file chashmap.h
+ * @brief Concurrent hashmap.
+ *
+ * chashmap splits its keys over `LF_CHASHMAP_STRIPES` hashmaps by their hash,
+ * each guarded by its own reader-writer spinlock. Lookups of a stripe run in
+ * parallel, and writes only block the operations on the same stripe. A
+ * stripe grows on its own, under its write lock, so that a resize never
+ * stalls the whole map.
+ *
+ * The hash of a key is computed once, and picks both the stripe and the slot
+ * in it. Entries are stored as in hashmap.h.
+ *
+ * Values are copied in and out under the lock, as a pointer to a value would
+ * not outlive a concurrent write to its stripe. Lookups take the lock shared
+ * rather than validating a sequence counter, since a concurrent writer may
+ * free the keys a lookup compares against.
+ */
+
+#ifndef LF_CHASHMAP_H
+#define LF_CHASHMAP_H
+
+#ifndef LF_HEADERONLY
+#include "common.h"
+#include "hashmap.h"
+#endif
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** @brief Concurrent hashmap. */
+struct lf(chashmap) {
+	/** @cond */
+	struct lfi(chashmap_stripe) *stripes;
+	size_t value_size;
+	uint64_t (*hash)(const void *, size_t);
+	/** @endcond */
+};
+
+/** @cond */
+struct lfi(chashmap_stripe) {
+	/* Writer bit and the number of readers. Stripes are aligned to cache
+	 * lines, so that their locks do not share lines. */
+	_Alignas(64) atomic_uint lock;
+
+	struct lf(hashmap) m;
+};
+/** @endcond */
+
+
+/**
+ * @brief Creates a new concurrent hashmap.
+ *
+ * `value_size`, `hash` and `flags` are as in hashmap_init(), and apply to each
+ * stripe.
+ *
+ * Returns non-zero if a memory allocation failure occurs.
+ */
+int lf(chashmap_init)(struct lf(chashmap) *chashmap,
+		      size_t value_size,
+		      uint64_t (*hash)(const void *key, size_t keylen),
+		      int flags) lfi_wur;
+
+/** @brief Identical to chashmap_init(), but raises an error if memory
+ * allocation fails. */
+void lf(chashmap_xinit)(struct lf(chashmap) *chashmap,
+			size_t value_size,
+			uint64_t (*hash)(const void *key, size_t keylen),
+			int flags);
+
+/**
+ * @brief Clears the memory allocated by the concurrent hashmap.
+ *
+ * @warning Must not run concurrently with any other operation.
+ */
+void lf(chashmap_destroy)(struct lf(chashmap) *chashmap);
+
+/**
+ * @brief Looks up the key, returns true if it is found.
+ *
+ * Copies the value matching the key to `value`, unless `value` is `NULL`. The
+ * `key` parameter must be null-terminated.
+ */
+bool lf(chashmap_get)(struct lf(chashmap) *chashmap,
+		      const void *key,
+		      void *value);
+
+/** @brief Identical to chashmap_get(), but accepts a non-null-terminated
+ * key. */
+bool lf(chashmap_get2)(struct lf(chashmap) *chashmap,
+		       const void *key,
+		       size_t keylen,
+		       void *value);
+
+/**
+ * @brief Inserts a key-value pair into the concurrent hashmap, or overwrites
+ * the value if the key exists.
+ *
+ * `*inserted` is set to whether the key is inserted, `inserted` may be `NULL`.
+ *
+ * The `key` parameter must be null-terminated. Returns non-zero if a memory
+ * allocation failure occurs.
+ */
+int lf(chashmap_upsert)(struct lf(chashmap) *chashmap,
+			const void *key,
+			const void *value,
+			bool *inserted) lfi_wur;
+
+/** @brief Identical to chashmap_upsert(), but raises an error if memory
+ * allocation fails. */
+void lf(chashmap_xupsert)(struct lf(chashmap) *chashmap,
+			  const void *key,
+			  const void *value,
+			  bool *inserted);
+
+/** @brief Identical to chashmap_upsert(), but accepts a non-null-terminated
+ * key. */
+int lf(chashmap_upsert2)(struct lf(chashmap) *chashmap,
+			 const void *key,
+			 size_t keylen,
+			 const void *value,
+			 bool *inserted) lfi_wur;
+
+/** @brief Identical to chashmap_upsert2(), but raises an error if memory
+ * allocation fails. */
+void lf(chashmap_xupsert2)(struct lf(chashmap) *chashmap,
+			   const void *key,
+			   size_t keylen,
+			   const void *value,
+			   bool *inserted);
+
+/**
+ * @brief Removes the key-value pair from the concurrent hashmap, returns true
+ * if the key is found.
+ *
+ * Copies the removed value to `value`, unless `value` is `NULL`. The `key`
+ * parameter must be null-terminated.
+ */
+bool lf(chashmap_remove)(struct lf(chashmap) *chashmap,
+			 const void *key,
+			 void *value);
+
+/** @brief Identical to chashmap_remove(), but accepts a non-null-terminated
+ * key. */
+bool lf(chashmap_remove2)(struct lf(chashmap) *chashmap,
+			  const void *key,
+			  size_t keylen,
+			  void *value);
+
+/**
+ * @brief Returns the number of entries in the concurrent hashmap.
+ *
+ * Stripes are counted one at a time, the result may be stale under
+ * concurrent writes.
+ */
+size_t lf(chashmap_size)(struct lf(chashmap) *chashmap);
+
+
+#endif
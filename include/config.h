@@ -4,10 +4,104 @@
  */
 
 #ifndef LF_HASHMAP_INITIAL_CAP
-/** @brief Initial capacity of the hashmap. */
+/** @brief Initial capacity of the hashmap. Must be a power of two, not less
+ * than 16. */
 #define LF_HASHMAP_INITIAL_CAP 64
 #endif
 
+#ifndef LF_HASHMAP_MAX_LOAD
+/** @brief Default maximum load factor of the hashmap, see
+ * hashmap_set_max_load(). */
+#define LF_HASHMAP_MAX_LOAD 0.75
+#endif
+
+#ifndef LF_HASHMAP_INLINE_KEY_SIZE
+/**
+ * @brief Keys up to this size are stored inside the hashmap and dict entries,
+ * and the btree nodes, without a separate allocation.
+ *
+ * Changes the layout of the hashmap, the library and its users must be
+ * compiled with the same value.
+ */
+#define LF_HASHMAP_INLINE_KEY_SIZE 16
+#endif
+
+#ifndef LF_HASHMAP_STATS_HISTOGRAM_SIZE
+/** @brief Number of buckets in the probe length histogram of
+ * hashmap_stats(). */
+#define LF_HASHMAP_STATS_HISTOGRAM_SIZE 8
+#endif
+
+#ifdef LF_DOXYGEN
+/**
+ * @brief If defined, hashmaps count their lookups, misses, probes and
+ * rehashes, reported by hashmap_stats().
+ *
+ * Not defined by default. Changes the layout of the hashmap, the library and
+ * its users must be compiled with the same value. The counters are not
+ * updated atomically, and must not be enabled for a chashmap read by multiple
+ * threads.
+ */
+#define LF_HASHMAP_COUNTERS
+#endif
+
+#ifndef LF_HASHMAP_MIGRATE_STEP
+/** @brief Number of old table slots migrated by each insert or remove
+ * operation during incremental rehashing of a hashmap. */
+#define LF_HASHMAP_MIGRATE_STEP 32
+#endif
+
+#ifndef LF_CHASHMAP_STRIPES
+/** @brief Number of stripes, each with its own lock, of the concurrent
+ * hashmap. Must be a power of two. */
+#define LF_CHASHMAP_STRIPES 64
+#endif
+
+#ifndef LF_DICT_INITIAL_CAP
+/** @brief Initial number of index slots of the dict. Must be a power of two,
+ * not less than 8. */
+#define LF_DICT_INITIAL_CAP 8
+#endif
+
+#ifndef LF_ARENA_INITIAL_BLOCK_SIZE
+/** @brief Size of the first block of the arena, in bytes. */
+#define LF_ARENA_INITIAL_BLOCK_SIZE 4096
+#endif
+
+#ifndef LF_ARENA_MAX_BLOCK_SIZE
+/** @brief Maximum size of the arena blocks, in bytes. Larger allocations get
+ * blocks of their own size. */
+#define LF_ARENA_MAX_BLOCK_SIZE (1 << 20)
+#endif
+
+#ifndef LF_MAP_POOL_MAX_NODE_SIZE
+/**
+ * @brief Map nodes up to this size, in bytes, are allocated from the slabs of
+ * the map. Must be a multiple of 16.
+ *
+ * Changes the layout of the map, the library and its users must be compiled
+ * with the same value.
+ */
+#define LF_MAP_POOL_MAX_NODE_SIZE 256
+#endif
+
+#ifndef LF_MAP_MAX_SLAB_SIZE
+/** @brief Maximum size of the map slabs, in bytes. Each slab is twice the
+ * size of the previous one, up to this size. */
+#define LF_MAP_MAX_SLAB_SIZE (1 << 20)
+#endif
+
+#ifndef LF_BTREE_DEGREE
+/**
+ * @brief Minimum degree of the btree, nodes hold up to `2 * LF_BTREE_DEGREE -
+ * 1` keys. Must be between 2 and 128.
+ *
+ * Changes the layout of the btree, the library and its users must be
+ * compiled with the same value.
+ */
+#define LF_BTREE_DEGREE 8
+#endif
+
 #ifndef LF_STACK_INITIAL_CAP
 /** @brief Initial capacity of the stack. */
 #define LF_STACK_INITIAL_CAP 64
@@ -44,5 +138,12 @@
 #define lfi(name) lf(_libfun_internal_ ## name)
 
 #define lfi_fdecl(ret_ty, name) static ret_ty lfi(name)
+
+/* Internal functions called by the code that the macros of the headers
+ * expand in the user's code, such as LF_TYPED_MAP(). These are the only
+ * internal symbols exported by the library. They are declared in the @cond
+ * sections of the headers and are not part of the API, so they may change in
+ * any release. All other internal functions are static. */
+#define lfi_export_fdecl(ret_ty, name) ret_ty lfi(name)
 #endif
 /** @endcond */
@@ -0,0 +1,177 @@
+/**
+ * @file dict.h
+ * @brief Insertion-ordered hashmap with dense entry storage.
+ *
+ * dict keeps its entries in a dense array, in insertion order, and finds them
+ * through a sparse index table of open addressed slots. Each index slot only
+ * holds the position of an entry in the array, so it takes 1, 2, 4 or 8 bytes
+ * depending on the capacity, and small dicts have small index tables.
+ *
+ * Iteration walks the dense array, touching only the entries rather than
+ * every slot of the table. Removed entries leave holes in the array until
+ * they outnumber the remaining entries, when the array is compacted in place.
+ *
+ * Prefer hashmap.h for lookup-heavy workloads, and dict for the maps that are
+ * iterated often or whose iteration order matters.
+ */
+
+#ifndef LF_DICT_H
+#define LF_DICT_H
+
+#ifndef LF_HEADERONLY
+#include "common.h"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** @brief Insertion-ordered hashmap. */
+struct lf(dict) {
+	/** @cond */
+	void *index;
+	struct lfi(dict_entry) *entries;
+
+	/* Number of index slots, entries can hold three quarters of it. */
+	size_t cap;
+
+	/* Number of entries in the array, including the removed ones. */
+	size_t len;
+	size_t used;
+	size_t value_size;
+	uint64_t (*hash)(const void *, size_t);
+	/** @endcond */
+};
+
+/** @brief Iteration handle to retrieve dict entries in insertion order. */
+struct lf(dict_it) {
+	/** @cond */
+	struct lf(dict) *d;
+	size_t i;
+	/** @endcond */
+};
+
+/** @cond */
+struct lfi(dict_entry) {
+	uint64_t hash;
+
+	/* SIZE_MAX if the entry is removed. */
+	size_t keylen;
+
+	union {
+		const void *ptr;
+		char bytes[LF_HASHMAP_INLINE_KEY_SIZE];
+	} key;
+
+	char value[];
+};
+/** @endcond */
+
+
+/**
+ * @brief Creates a new dict.
+ *
+ * Allocates the necessary memory for the dict. The `value_size` parameter
+ * specifies the maximum size of the `value`s the user will add.
+ *
+ * Hash is a function pointer used to hash keys. Defaults to
+ * hashmap_default_hash() if `NULL`.
+ *
+ * Returns non-zero if a memory allocation failure occurs.
+ */
+int lf(dict_init)(struct lf(dict) *dict,
+		  size_t value_size,
+		  uint64_t (*hash)(const void *key, size_t keylen)) lfi_wur;
+
+/** @brief Identical to dict_init(), but raises an error if memory allocation
+ * fails. */
+void lf(dict_xinit)(struct lf(dict) *dict,
+		    size_t value_size,
+		    uint64_t (*hash)(const void *key, size_t keylen));
+
+/** @brief Clears the memory allocated by the dict. */
+void lf(dict_destroy)(struct lf(dict) *dict);
+
+/**
+ * @brief Returns a pointer to the value matching the key, returns `NULL` if
+ * the key is not found.
+ *
+ * The `key` parameter must be null-terminated. Returned pointer will be a
+ * sentinel if the dict's `value_size` is zero, and it should not be
+ * dereferenced.
+ */
+void *lf(dict_get)(struct lf(dict) *dict, const void *key);
+
+/** @brief Identical to dict_get(), but accepts a non-null-terminated key. */
+void *lf(dict_get2)(struct lf(dict) *dict, const void *key, size_t keylen);
+
+/**
+ * @brief Appends a key-value pair to the dict.
+ *
+ * @warning The `key` must not already exist in the dict. It is only checked if
+ * the library is not compiled with `NDEBUG`.
+ *
+ * The `key` parameter must be null-terminated. Returns `NULL` if a memory
+ * allocation failure occurs.
+ */
+void *lf(dict_insert)(struct lf(dict) *dict,
+		      const void *key,
+		      const void *value) lfi_wur;
+
+/** @brief Identical to dict_insert(), but raises an error if memory
+ * allocation fails. */
+void *lf(dict_xinsert)(struct lf(dict) *dict,
+		       const void *key,
+		       const void *value);
+
+/** @brief Identical to dict_insert(), but accepts a non-null-terminated
+ * key. */
+void *lf(dict_insert2)(struct lf(dict) *dict,
+		       const void *key,
+		       size_t keylen,
+		       const void *value) lfi_wur;
+
+/** @brief Identical to dict_insert2(), but raises an error if memory
+ * allocation fails. */
+void *lf(dict_xinsert2)(struct lf(dict) *dict,
+			const void *key,
+			size_t keylen,
+			const void *value);
+
+/**
+ * @brief Removes the key-value pair from the dict, returns a pointer to the
+ * value.
+ *
+ * @attention The returned value pointer is valid until the next dict
+ * operation. If the user wants to continue using the value, they must copy
+ * underlying data.
+ *
+ * The `key` parameter must be `null-terminated`.
+ */
+const void *lf(dict_remove)(struct lf(dict) *dict, const void *key);
+
+/** @brief Identical to dict_remove(), but accepts a non-null-terminated
+ * key. */
+const void *lf(dict_remove2)(struct lf(dict) *dict,
+			     const void *key,
+			     size_t keylen);
+
+/** @brief Creates an iteration handle to retrieve the entries in the dict
+ * one by one, in insertion order. */
+void lf(dict_iter)(struct lf(dict) *dict, struct lf(dict_it) *it);
+
+/**
+ * @brief Retrieves the next entry from the iteration handle.
+ *
+ * If all entries have been retrieved, it returns a sentinel entry. Use
+ * entry_is_valid() to check wheter or not the returned entry is sentinel.
+ *
+ * @attention Short keys are stored inside the dict, the key of the returned
+ * entry is valid until the next insert or remove operation.
+ *
+ * @see common.h
+ */
+struct lf(entry) lf(dict_iter_next)(struct lf(dict_it) *it);
+
+
+#endif
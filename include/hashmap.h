@@ -2,31 +2,149 @@
  * @file hashmap.h
  * @brief Basic hashmap.
  *
- * hashmap uses the FNV hash function and open addressing method. It stores
- * data as key-value pairs, allowing variable-length keys while storing
+ * hashmap uses open addressing method with a pluggable hash function. It
+ * stores data as key-value pairs, allowing variable-length keys while storing
  * fixed-length values.
+ *
+ * Slot states live in a separate control array, one byte per slot, holding a
+ * 7-bit tag of the key hash. Lookups scan the control bytes a group of slots
+ * at a time (using SSE2 if available), and only touch the entries whose tag
+ * matches.
  */
 
 #ifndef LF_HASHMAP_H
 #define LF_HASHMAP_H
 
 #ifndef LF_HEADERONLY
+#include "allocator.h"
 #include "common.h"
 #endif
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 
 /** @brief hashmap. */
 struct lf(hashmap) {
 	/** @cond */
 	struct lfi(hashmap_entry) *entries;
+	unsigned char *ctrl;
 	size_t cap;
 	size_t used;
+	size_t deleted;
 	size_t value_size;
+	uint64_t (*hash)(const void *, size_t);
+	int flags;
+	struct lf(allocator) allocator;
+
+	/* The table grows when an insert would make the number of used and
+	 * deleted slots exceed grow_at. */
+	double max_load;
+	size_t grow_at;
+
+	/* Old table during incremental rehashing, NULL if none. */
+	unsigned char *old_ctrl;
+	size_t old_cap;
+	size_t migrated;
+
+	/* File mapping of a hashmap opened by hashmap_open_mapped(), NULL if
+	 * none. The keys stored out of the entries are at the given offsets of
+	 * the key section of keys_size bytes. */
+	void *mapping;
+	size_t mapping_size;
+	const char *keys;
+	size_t keys_size;
+
+#ifdef LF_HASHMAP_COUNTERS
+	struct {
+		uint64_t lookups;
+		uint64_t misses;
+		uint64_t probes;
+		uint64_t rehashes;
+	} counters;
+#endif
 	/** @endcond */
 };
 
+/**
+ * @brief Statistics of a hashmap, see hashmap_stats().
+ *
+ * The probe length of an entry is the number of groups of slots a lookup of
+ * its key scans, one if the entry is in the group of its home slot.
+ */
+struct lf(hashmap_stats) {
+	/** Number of entries. */
+	size_t size;
+
+	/** Number of slots. */
+	size_t capacity;
+
+	/** Number of slots of the old table during incremental rehashing, zero
+	 * otherwise. */
+	size_t old_capacity;
+
+	/** Number of slots holding an entry, in both tables. */
+	size_t live;
+
+	/** Number of slots of the removed entries not reused yet. */
+	size_t tombstones;
+
+	/** Number of empty slots. */
+	size_t empty;
+
+	/** Average probe length of the entries. */
+	double avg_probe;
+
+	/** Maximum probe length of the entries. */
+	size_t max_probe;
+
+	/** Number of entries by their probe length, the last bucket also counts
+	 * the longer ones. */
+	size_t probe_histogram[LF_HASHMAP_STATS_HISTOGRAM_SIZE];
+
+	/** Bytes allocated by the hashmap, including the keys stored out of the
+	 * entries, or the size of the mapping if the hashmap is mapped. */
+	size_t memory;
+
+	/** @name Counters
+	 * Zero unless the library is compiled with `LF_HASHMAP_COUNTERS`. */
+	/** @{ */
+	/** Number of lookups, including the ones made by inserts and
+	 * removals. */
+	uint64_t lookups;
+
+	/** Number of lookups not finding their key. */
+	uint64_t misses;
+
+	/** Number of groups scanned by the lookups. */
+	uint64_t probes;
+
+	/** Number of times the table is rebuilt. */
+	uint64_t rehashes;
+	/** @} */
+};
+
+/** @brief Flags changing the behavior of the hashmap, see hashmap_init(). */
+enum lf(hashmap_flags) {
+	/**
+	 * Robin Hood probing. An entry is never placed farther from its home
+	 * slot than the entries it passes over, which bounds the variance of
+	 * the probe lengths. Removals shift the following entries back instead
+	 * of leaving tombstones, so the probe lengths do not grow with churn.
+	 */
+	LF_HASHMAP_ROBIN_HOOD = 1 << 0,
+
+	/**
+	 * Incremental rehashing. When the hashmap grows, the old table is kept
+	 * beside the new one, and each insert or remove operation moves the
+	 * entries of a bounded number of old slots (`LF_HASHMAP_MIGRATE_STEP`)
+	 * to the new table. This spreads the cost of a rehash over the
+	 * following operations, instead of stalling a single insert.
+	 */
+	LF_HASHMAP_INCREMENTAL = 1 << 1,
+};
+
 /** @brief Iteration handle to retrieve hashmap entries one by one. */
 struct lf(hashmap_it) {
 	/** @cond */
@@ -37,8 +155,17 @@ struct lf(hashmap_it) {
 
 /** @cond */
 struct lfi(hashmap_entry) {
-	const void *key;
+	uint64_t hash;
 	size_t keylen;
+
+	/* Keys up to LF_HASHMAP_INLINE_KEY_SIZE bytes are stored in the entry,
+	 * longer keys are copied to the heap. */
+	union {
+		const void *ptr;
+		uint64_t offset;
+		char bytes[LF_HASHMAP_INLINE_KEY_SIZE];
+	} key;
+
 	char value[];
 };
 /** @endcond */
@@ -50,17 +177,90 @@ struct lfi(hashmap_entry) {
  * Allocates the necessary memory for the hashmap. The `value_size` parameter
  * specifies the maximum size of the `value`s the user will add.
  *
+ * Hash is a function pointer used to hash keys. Defaults to
+ * hashmap_default_hash() if `NULL`. `flags` is a bitwise OR of
+ * `lf(hashmap_flags)`, or zero.
+ *
  * Returns non-zero if a memory allocation failure occurs.
  */
-int lf(hashmap_init)(struct lf(hashmap) *hashmap, size_t value_size) lfi_wur;
+int lf(hashmap_init)(struct lf(hashmap) *hashmap,
+		     size_t value_size,
+		     uint64_t (*hash)(const void *key, size_t keylen),
+		     int flags) lfi_wur;
 
 /** @brief Identical to hashmap_init(), but raises an error if memory allocation
  * fails. */
-void lf(hashmap_xinit)(struct lf(hashmap) *hashmap, size_t value_size);
+void lf(hashmap_xinit)(struct lf(hashmap) *hashmap,
+		       size_t value_size,
+		       uint64_t (*hash)(const void *key, size_t keylen),
+		       int flags);
+
+/**
+ * @brief Identical to hashmap_init(), but takes the memory of the table and
+ * the keys from the `allocator`.
+ *
+ * The allocator is copied into the hashmap. Defaults to allocator_libc if
+ * `NULL`.
+ *
+ * @see allocator.h
+ */
+int lf(hashmap_init_with)(struct lf(hashmap) *hashmap,
+			  size_t value_size,
+			  uint64_t (*hash)(const void *key, size_t keylen),
+			  int flags,
+			  const struct lf(allocator) *allocator) lfi_wur;
+
+/** @brief Identical to hashmap_init_with(), but raises an error if memory
+ * allocation fails. */
+void lf(hashmap_xinit_with)(struct lf(hashmap) *hashmap,
+			    size_t value_size,
+			    uint64_t (*hash)(const void *key, size_t keylen),
+			    int flags,
+			    const struct lf(allocator) *allocator);
 
 /** @brief Clears the memory allocated by the hashmap. */
 void lf(hashmap_destroy)(struct lf(hashmap) *hashmap);
 
+/**
+ * @brief Grows the hashmap so that it holds `n` entries without rehashing.
+ *
+ * Does nothing if the current capacity is already sufficient. Returns non-zero
+ * if a memory allocation failure occurs, leaving the hashmap unchanged.
+ */
+int lf(hashmap_reserve)(struct lf(hashmap) *hashmap, size_t n) lfi_wur;
+
+/** @brief Identical to hashmap_reserve(), but raises an error if memory
+ * allocation fails. */
+void lf(hashmap_xreserve)(struct lf(hashmap) *hashmap, size_t n);
+
+/**
+ * @brief Removes all entries from the hashmap.
+ *
+ * The capacity of the hashmap is kept, so that refilling it up to its earlier
+ * size does not allocate, apart from the keys longer than
+ * `LF_HASHMAP_INLINE_KEY_SIZE`.
+ */
+void lf(hashmap_clear)(struct lf(hashmap) *hashmap);
+
+/**
+ * @brief Shrinks the capacity of the hashmap to the smallest one holding its
+ * entries.
+ *
+ * Deleted slots are dropped as well. Returns non-zero if a memory allocation
+ * failure occurs, leaving the hashmap unchanged.
+ */
+int lf(hashmap_shrink_to_fit)(struct lf(hashmap) *hashmap) lfi_wur;
+
+/**
+ * @brief Sets the maximum load factor of the hashmap.
+ *
+ * The hashmap grows when the ratio of its used slots to its capacity would
+ * exceed `max_load`, which must be in (0, 1]. Defaults to
+ * `LF_HASHMAP_MAX_LOAD`. Lower values trade memory for shorter probe
+ * sequences. The new factor takes effect on the next insert.
+ */
+void lf(hashmap_set_max_load)(struct lf(hashmap) *hashmap, double max_load);
+
 /**
  * @brief Returns a pointer to the value matching the key, returns `NULL` if
  * the key is not found.
@@ -76,10 +276,28 @@ void *lf(hashmap_get2)(struct lf(hashmap) *hashmap,
 		       const void *key,
 		       size_t keylen);
 
+/**
+ * @brief Looks up a batch of keys, returns the number of keys found.
+ *
+ * Stores the pointer to the value matching `keys[i]`, whose length is
+ * `keylens[i]`, to `values[i]`, or `NULL` if the key is not found.
+ *
+ * The keys are hashed and their slots are prefetched in batches before
+ * being probed, so the cache misses of the keys overlap rather than each
+ * lookup waiting for the previous one.
+ */
+size_t lf(hashmap_get_many)(struct lf(hashmap) *hashmap,
+			    size_t n,
+			    const void *const *keys,
+			    const size_t *keylens,
+			    void **values);
+
 /**
  * @brief Inserts a key-value pair into the hashmap.
  *
- * @warning The `key` must not already exist in the hashmap.
+ * @warning The `key` must not already exist in the hashmap. It is only
+ * checked if the library is not compiled with `NDEBUG`, use
+ * hashmap_get_or_insert() if the key may exist.
  *
  * The `key` parameter must be null-terminated. Returns `NULL` if a memory
  * allocation failure occurs.
@@ -108,6 +326,80 @@ void *lf(hashmap_xinsert2)(struct lf(hashmap) *hashmap,
 			   size_t keylen,
 			   const void *value);
 
+/**
+ * @brief Returns a pointer to the value matching the key, inserts the key if
+ * it is not found.
+ *
+ * The key is hashed and looked up once. If the key is inserted, `value` is
+ * copied to the new entry and `*inserted` is set to true, otherwise the
+ * existing value is kept. `inserted` may be `NULL`.
+ *
+ * The `key` parameter must be null-terminated. Returns `NULL` if a memory
+ * allocation failure occurs.
+ */
+void *lf(hashmap_get_or_insert)(struct lf(hashmap) *hashmap,
+				const void *key,
+				const void *value,
+				bool *inserted) lfi_wur;
+
+/** @brief Identical to hashmap_get_or_insert(), but raises an error if memory
+ * allocation fails. */
+void *lf(hashmap_xget_or_insert)(struct lf(hashmap) *hashmap,
+				 const void *key,
+				 const void *value,
+				 bool *inserted);
+
+/** @brief Identical to hashmap_get_or_insert(), but accepts a
+ * non-null-terminated key. */
+void *lf(hashmap_get_or_insert2)(struct lf(hashmap) *hashmap,
+				 const void *key,
+				 size_t keylen,
+				 const void *value,
+				 bool *inserted) lfi_wur;
+
+/** @brief Identical to hashmap_get_or_insert2(), but raises an error if memory
+ * allocation fails. */
+void *lf(hashmap_xget_or_insert2)(struct lf(hashmap) *hashmap,
+				  const void *key,
+				  size_t keylen,
+				  const void *value,
+				  bool *inserted);
+
+/**
+ * @brief Inserts a key-value pair into the hashmap, or overwrites the value
+ * if the key exists.
+ *
+ * Identical to hashmap_get_or_insert(), but `value` is also copied over the
+ * existing value. Returns a pointer to the value.
+ */
+void *lf(hashmap_upsert)(struct lf(hashmap) *hashmap,
+			 const void *key,
+			 const void *value,
+			 bool *inserted) lfi_wur;
+
+/** @brief Identical to hashmap_upsert(), but raises an error if memory
+ * allocation fails. */
+void *lf(hashmap_xupsert)(struct lf(hashmap) *hashmap,
+			  const void *key,
+			  const void *value,
+			  bool *inserted);
+
+/** @brief Identical to hashmap_upsert(), but accepts a non-null-terminated
+ * key. */
+void *lf(hashmap_upsert2)(struct lf(hashmap) *hashmap,
+			  const void *key,
+			  size_t keylen,
+			  const void *value,
+			  bool *inserted) lfi_wur;
+
+/** @brief Identical to hashmap_upsert2(), but raises an error if memory
+ * allocation fails. */
+void *lf(hashmap_xupsert2)(struct lf(hashmap) *hashmap,
+			   const void *key,
+			   size_t keylen,
+			   const void *value,
+			   bool *inserted);
+
 /**
  * @brief Removes the key-value pair from the hashmap, returns a pointer to the
  * value.
@@ -126,6 +418,71 @@ const void *lf(hashmap_remove2)(struct lf(hashmap) *hashmap,
 				const void *key,
 				size_t keylen);
 
+/**
+ * @brief The default hash function of the hashmap.
+ *
+ * Consumes keys a 64-bit word at a time, and finalizes the hash so that
+ * sequential integer keys spread over the whole table.
+ */
+uint64_t lf(hashmap_default_hash)(const void *key, size_t keylen);
+
+/**
+ * @brief 64-bit FNV hash function.
+ *
+ * Hashes a byte at a time. It is kept for the compatibility with the hashes
+ * computed by the earlier versions of the hashmap.
+ */
+uint64_t lf(hashmap_fnv_hash)(const void *key, size_t keylen);
+
+/**
+ * @brief Collects the statistics of the hashmap.
+ *
+ * Walks all slots of the hashmap, taking time proportional to its capacity.
+ *
+ * @see struct hashmap_stats
+ */
+void lf(hashmap_stats)(struct lf(hashmap) *hashmap,
+		       struct lf(hashmap_stats) *stats);
+
+/**
+ * @brief Writes the hashmap to a file, to be opened by hashmap_open_mapped().
+ *
+ * The file holds the table as it is in memory, except that the keys stored
+ * out of the entries are moved to a section of their own and referred to by
+ * their offsets, so that the file can be mapped at any address. An incremental
+ * rehash in progress is finished first.
+ *
+ * Returns non-zero if an I/O error or a memory allocation failure occurs.
+ */
+int lf(hashmap_save)(struct lf(hashmap) *hashmap, const char *path) lfi_wur;
+
+/**
+ * @brief Opens a file written by hashmap_save() as a read-only hashmap.
+ *
+ * The file is memory mapped on POSIX systems, and lookups and iteration read
+ * the table directly from the mapping. Opening takes constant time and the
+ * pages are shared by the processes mapping the same file. Elsewhere the file
+ * is read into memory.
+ *
+ * Opening checks the header, and each key stored out of the entries is checked
+ * as it is read, so that a damaged file is not read out of bounds. The entries
+ * whose keys lie out of the file are not found by the lookups and are skipped
+ * by the iteration.
+ *
+ * `hash` must be the hash function the hashmap is saved with, `NULL` for
+ * hashmap_default_hash(). The hashmap must not be modified, and the values it
+ * returns must not be written. hashmap_destroy() unmaps the file.
+ *
+ * Returns non-zero if the file cannot be read, if it is not written by
+ * hashmap_save() with the same hash function and the same
+ * `LF_HASHMAP_INLINE_KEY_SIZE`, or if it is truncated or its sections lie out
+ * of the file.
+ */
+int lf(hashmap_open_mapped)(struct lf(hashmap) *hashmap,
+			    const char *path,
+			    uint64_t (*hash)(const void *key, size_t keylen))
+	lfi_wur;
+
 /** @brief Creates an iteration handle to retrieve the entries in the hashmap
  * one by one. */
 void lf(hashmap_iter)(struct lf(hashmap) *hashmap, struct lf(hashmap_it) *it);
@@ -136,6 +493,9 @@ void lf(hashmap_iter)(struct lf(hashmap) *hashmap, struct lf(hashmap_it) *it);
  * If all entries have been retrieved, it returns a sentinel entry. Use
  * entry_is_valid() to check wheter or not the returned entry is sentinel.
  *
+ * @attention Short keys are stored inside the hashmap, the key of the
+ * returned entry is valid until the next insert or remove operation.
+ *
  * @see common.h
  */
 struct lf(entry) lf(hashmap_iter_next)(struct lf(hashmap_it) *it);
@@ -0,0 +1,261 @@
+/**
+ * @file intmap.h
+ * @brief Hashmaps with integer keys.
+ *
+ * u64map and u32map are hashmaps keyed by `uint64_t` and `uint32_t`
+ * integers, storing fixed-length values. Keys are stored inline in the
+ * entries, next to the values, so inserting does not allocate per key, and an
+ * entry carries no key metadata beyond the key itself. Keys are hashed with
+ * an integer mixer, and compared as integers.
+ *
+ * The table uses the same control byte layout as hashmap.h. Values are
+ * aligned to `sizeof(size_t)`-byte boundary, except in u32map if the
+ * `value_size` is not larger than 4, where the values are 4-byte aligned and
+ * the entries take 8 bytes.
+ */
+
+#ifndef LF_INTMAP_H
+#define LF_INTMAP_H
+
+#ifndef LF_HEADERONLY
+#include "common.h"
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** @brief Hashmap with `uint64_t` keys. */
+struct lf(u64map) {
+	/** @cond */
+	unsigned char *ctrl;
+	char *entries;
+	size_t cap;
+	size_t used;
+	size_t deleted;
+	size_t value_size;
+	size_t value_offset;
+	size_t stride;
+	/** @endcond */
+};
+
+/** @brief Hashmap with `uint32_t` keys. */
+struct lf(u32map) {
+	/** @cond */
+	unsigned char *ctrl;
+	char *entries;
+	size_t cap;
+	size_t used;
+	size_t deleted;
+	size_t value_size;
+	size_t value_offset;
+	size_t stride;
+	/** @endcond */
+};
+
+/** @brief Iteration handle to retrieve u64map entries one by one. */
+struct lf(u64map_it) {
+	/** @cond */
+	struct lf(u64map) *m;
+	size_t i;
+	/** @endcond */
+};
+
+/** @brief Iteration handle to retrieve u32map entries one by one. */
+struct lf(u32map_it) {
+	/** @cond */
+	struct lf(u32map) *m;
+	size_t i;
+	/** @endcond */
+};
+
+
+/**
+ * @brief Creates a new u64map.
+ *
+ * Allocates the necessary memory for the map. The `value_size` parameter
+ * specifies the maximum size of the `value`s the user will add.
+ *
+ * Returns non-zero if a memory allocation failure occurs.
+ */
+int lf(u64map_init)(struct lf(u64map) *map, size_t value_size) lfi_wur;
+
+/** @brief Identical to u64map_init(), but raises an error if memory
+ * allocation fails. */
+void lf(u64map_xinit)(struct lf(u64map) *map, size_t value_size);
+
+/** @brief Clears the memory allocated by the u64map. */
+void lf(u64map_destroy)(struct lf(u64map) *map);
+
+/**
+ * @brief Returns a pointer to the value matching the key, returns `NULL` if
+ * the key is not found.
+ *
+ * Returned pointer will be a sentinel if the map's `value_size` is zero, and
+ * it should not be dereferenced.
+ */
+void *lf(u64map_get)(struct lf(u64map) *map, uint64_t key);
+
+/**
+ * @brief Inserts a key-value pair into the u64map.
+ *
+ * @warning The `key` must not already exist in the map. It is only checked if
+ * the library is not compiled with `NDEBUG`, use u64map_get_or_insert() if
+ * the key may exist.
+ *
+ * Returns `NULL` if a memory allocation failure occurs.
+ */
+void *lf(u64map_insert)(struct lf(u64map) *map,
+			uint64_t key,
+			const void *value) lfi_wur;
+
+/** @brief Identical to u64map_insert(), but raises an error if memory
+ * allocation fails. */
+void *lf(u64map_xinsert)(struct lf(u64map) *map,
+			 uint64_t key,
+			 const void *value);
+
+/**
+ * @brief Returns a pointer to the value matching the key, inserts the key if
+ * it is not found.
+ *
+ * If the key is inserted, `value` is copied to the new entry and `*inserted`
+ * is set to true, otherwise the existing value is kept. `inserted` may be
+ * `NULL`. Returns `NULL` if a memory allocation failure occurs.
+ */
+void *lf(u64map_get_or_insert)(struct lf(u64map) *map,
+			       uint64_t key,
+			       const void *value,
+			       bool *inserted) lfi_wur;
+
+/** @brief Identical to u64map_get_or_insert(), but raises an error if memory
+ * allocation fails. */
+void *lf(u64map_xget_or_insert)(struct lf(u64map) *map,
+				uint64_t key,
+				const void *value,
+				bool *inserted);
+
+/**
+ * @brief Inserts a key-value pair into the u64map, or overwrites the value if
+ * the key exists.
+ *
+ * Identical to u64map_get_or_insert(), but `value` is also copied over the
+ * existing value.
+ */
+void *lf(u64map_upsert)(struct lf(u64map) *map,
+			uint64_t key,
+			const void *value,
+			bool *inserted) lfi_wur;
+
+/** @brief Identical to u64map_upsert(), but raises an error if memory
+ * allocation fails. */
+void *lf(u64map_xupsert)(struct lf(u64map) *map,
+			 uint64_t key,
+			 const void *value,
+			 bool *inserted);
+
+/**
+ * @brief Removes the key-value pair from the u64map, returns a pointer to the
+ * value, or `NULL` if the key is not found.
+ *
+ * @attention The returned value pointer is valid until the next map
+ * operation.
+ */
+const void *lf(u64map_remove)(struct lf(u64map) *map, uint64_t key);
+
+/**
+ * @brief Grows the u64map so that it holds `n` entries without rehashing.
+ *
+ * Returns non-zero if a memory allocation failure occurs, leaving the map
+ * unchanged.
+ */
+int lf(u64map_reserve)(struct lf(u64map) *map, size_t n) lfi_wur;
+
+/** @brief Identical to u64map_reserve(), but raises an error if memory
+ * allocation fails. */
+void lf(u64map_xreserve)(struct lf(u64map) *map, size_t n);
+
+/** @brief Removes all entries from the u64map, keeping its capacity. */
+void lf(u64map_clear)(struct lf(u64map) *map);
+
+/** @brief Creates an iteration handle to retrieve the entries in the u64map
+ * one by one. */
+void lf(u64map_iter)(struct lf(u64map) *map, struct lf(u64map_it) *it);
+
+/**
+ * @brief Retrieves the next entry from the iteration handle.
+ *
+ * The key of the entry points to the `uint64_t` key in the map. If all
+ * entries have been retrieved, it returns a sentinel entry.
+ *
+ * @see common.h
+ */
+struct lf(entry) lf(u64map_iter_next)(struct lf(u64map_it) *it);
+
+/** @brief Identical to u64map_init(), but with `uint32_t` keys. */
+int lf(u32map_init)(struct lf(u32map) *map, size_t value_size) lfi_wur;
+
+/** @brief Identical to u64map_xinit(), but with `uint32_t` keys. */
+void lf(u32map_xinit)(struct lf(u32map) *map, size_t value_size);
+
+/** @brief Identical to u64map_destroy(), but with `uint32_t` keys. */
+void lf(u32map_destroy)(struct lf(u32map) *map);
+
+/** @brief Identical to u64map_get(), but with `uint32_t` keys. */
+void *lf(u32map_get)(struct lf(u32map) *map, uint32_t key);
+
+/** @brief Identical to u64map_insert(), but with `uint32_t` keys. */
+void *lf(u32map_insert)(struct lf(u32map) *map,
+			uint32_t key,
+			const void *value) lfi_wur;
+
+/** @brief Identical to u64map_xinsert(), but with `uint32_t` keys. */
+void *lf(u32map_xinsert)(struct lf(u32map) *map,
+			 uint32_t key,
+			 const void *value);
+
+/** @brief Identical to u64map_get_or_insert(), but with `uint32_t` keys. */
+void *lf(u32map_get_or_insert)(struct lf(u32map) *map,
+			       uint32_t key,
+			       const void *value,
+			       bool *inserted) lfi_wur;
+
+/** @brief Identical to u64map_xget_or_insert(), but with `uint32_t` keys. */
+void *lf(u32map_xget_or_insert)(struct lf(u32map) *map,
+				uint32_t key,
+				const void *value,
+				bool *inserted);
+
+/** @brief Identical to u64map_upsert(), but with `uint32_t` keys. */
+void *lf(u32map_upsert)(struct lf(u32map) *map,
+			uint32_t key,
+			const void *value,
+			bool *inserted) lfi_wur;
+
+/** @brief Identical to u64map_xupsert(), but with `uint32_t` keys. */
+void *lf(u32map_xupsert)(struct lf(u32map) *map,
+			 uint32_t key,
+			 const void *value,
+			 bool *inserted);
+
+/** @brief Identical to u64map_remove(), but with `uint32_t` keys. */
+const void *lf(u32map_remove)(struct lf(u32map) *map, uint32_t key);
+
+/** @brief Identical to u64map_reserve(), but with `uint32_t` keys. */
+int lf(u32map_reserve)(struct lf(u32map) *map, size_t n) lfi_wur;
+
+/** @brief Identical to u64map_xreserve(), but with `uint32_t` keys. */
+void lf(u32map_xreserve)(struct lf(u32map) *map, size_t n);
+
+/** @brief Identical to u64map_clear(), but with `uint32_t` keys. */
+void lf(u32map_clear)(struct lf(u32map) *map);
+
+/** @brief Identical to u64map_iter(), but with `uint32_t` keys. */
+void lf(u32map_iter)(struct lf(u32map) *map, struct lf(u32map_it) *it);
+
+/** @brief Identical to u64map_iter_next(), but with `uint32_t` keys. */
+struct lf(entry) lf(u32map_iter_next)(struct lf(u32map_it) *it);
+
+
+#endif
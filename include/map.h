@@ -3,16 +3,30 @@
  * @brief Basic map.
  *
  * map is an order-statistics tree implemented augmenting Red-Black tree.
+ *
+ * Nodes are carved from slabs owned by the map, and the nodes of removed
+ * entries are kept in a free list per size class for the following inserts.
+ * Nodes allocated together stay close in memory, and destroying the map
+ * releases whole slabs rather than every node. Nodes larger than
+ * `LF_MAP_POOL_MAX_NODE_SIZE` are allocated one by one.
+ *
+ * Maps can be split at a key and joined back in logarithmic time, moving the
+ * nodes rather than copying them. A map split from another one keeps holding
+ * nodes from its slabs, the slabs are released once both of the maps are
+ * destroyed.
  */
 
 #ifndef LF_MAP_H
 #define LF_MAP_H
 
 #ifndef LF_HEADERONLY
+#include "allocator.h"
 #include "common.h"
 #endif
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 
 /** @brief map. */
@@ -25,6 +39,17 @@ struct lf(map) {
 	size_t value_size;
 
 	int (*cmp)(const void *, const void *, size_t, size_t);
+
+	struct lf(allocator) allocator;
+
+	/* Node pool. Slabs holding nodes of other maps are in the share. */
+	struct lfi(map_slab) *slabs;
+	struct lfi(map_share) *share;
+	char *slab_top;
+	size_t slab_left;
+	size_t slab_size;
+	void *free_nodes[LF_MAP_POOL_MAX_NODE_SIZE / 16];
+	size_t large_nodes;
 	/** @endcond */
 };
 
@@ -33,6 +58,10 @@ struct lf(map_it) {
 	/** @cond */
 	struct lf(map) *m;
 	struct lfi(map_node) *n;
+
+	/* Nodes just past the range in each direction, NULL if unbounded. */
+	struct lfi(map_node) *end;
+	struct lfi(map_node) *rend;
 	/** @endcond */
 };
 
@@ -48,12 +77,32 @@ struct lfi(map_node) {
 	 * this node. */
 	size_t size;
 
+	/* First bytes of the key, compared before the key itself when the
+	 * keys are ordered by their bytes. */
+	uint64_t prefix;
+
 	/* 1 if red, 0 if black. */
 	char color;
 
-	/* Key and value. */
-	char kv[];
+	/* Key and value, the value is aligned to sizeof(size_t)-byte
+	 * boundary. */
+	_Alignas(size_t) char kv[];
 };
+
+/* Exported for the maps of typed_map.h, which search the tree on their own,
+ * see lfi_export_fdecl(). Nodes have no key, and hold a value of the map's
+ * value size. */
+lfi_export_fdecl(struct lfi(map_node) *, map_alloc_node)(struct lf(map) *map);
+
+/* Links the allocated node as a child of `parent`, or as the root if
+ * `parent` is NULL, and rebalances the tree. */
+lfi_export_fdecl(void, map_attach)(struct lf(map) *map,
+				   struct lfi(map_node) *parent,
+				   struct lfi(map_node) *node,
+				   bool left);
+
+lfi_export_fdecl(void, map_delete_node)(struct lf(map) *map,
+					struct lfi(map_node) *node);
 /** @endcond */
 
 
@@ -83,6 +132,32 @@ void lf(map_xinit)(struct lf(map) *map,
 				     size_t keylen1,
 				     size_t keylen2));
 
+/**
+ * @brief Identical to map_init(), but takes the memory of the nodes from the
+ * `allocator`.
+ *
+ * The allocator is copied into the map. Defaults to allocator_libc if `NULL`.
+ *
+ * @see allocator.h
+ */
+int lf(map_init_with)(struct lf(map) *map,
+		      size_t value_size,
+		      int (*comparator)(const void *key1,
+					const void *key2,
+					size_t keylen1,
+					size_t keylen2),
+		      const struct lf(allocator) *allocator) lfi_wur;
+
+/** @brief Identical to map_init_with(), but raises an error if memory
+ * allocation fails. */
+void lf(map_xinit_with)(struct lf(map) *map,
+			size_t value_size,
+			int (*comparator)(const void *key1,
+					  const void *key2,
+					  size_t keylen1,
+					  size_t keylen2),
+			const struct lf(allocator) *allocator);
+
 /** @brief Clears the memory allocated by the map. */
 void lf(map_destroy)(struct lf(map) *map);
 
@@ -125,6 +200,90 @@ void *lf(map_xinsert2)(struct lf(map) *map,
 		      size_t keylen,
 		      const void *value);
 
+/**
+ * @brief Identical to map_insert(), but searches the position of the key from
+ * the entry of an iteration handle instead of from the root.
+ *
+ * If the key falls right before or right after the entry of the handle, it is
+ * inserted with at most two comparisons. A `NULL` handle, or one whose entries
+ * are all retrieved, hints at the end of the map, so keys larger than the
+ * largest one are appended with a single comparison. Otherwise the key is
+ * inserted as by map_insert().
+ *
+ * The handle, unless `NULL`, is moved to the inserted entry as if it was
+ * created by map_lower_bound(), so sorted keys are inserted one after the other
+ * with the same handle.
+ */
+void *lf(map_insert_hint)(struct lf(map) *map,
+			  struct lf(map_it) *hint,
+			  const void *key,
+			  const void *value) lfi_wur;
+
+/** @brief Identical to map_insert_hint(), but raises an error if memory
+ * allocation fails. */
+void *lf(map_xinsert_hint)(struct lf(map) *map,
+			   struct lf(map_it) *hint,
+			   const void *key,
+			   const void *value);
+
+/** @brief Identical to map_insert_hint(), but accepts a non-null-terminated
+ * key. */
+void *lf(map_insert_hint2)(struct lf(map) *map,
+			   struct lf(map_it) *hint,
+			   const void *key,
+			   size_t keylen,
+			   const void *value) lfi_wur;
+
+/** @brief Identical to map_insert_hint2(), but raises an error if memory
+ * allocation fails. */
+void *lf(map_xinsert_hint2)(struct lf(map) *map,
+			    struct lf(map_it) *hint,
+			    const void *key,
+			    size_t keylen,
+			    const void *value);
+
+/**
+ * @brief Fills an empty map with `n` entries from sorted arrays.
+ *
+ * `keys` must be null-terminated and in strictly ascending order of the map's
+ * comparator, which is only checked if the library is not compiled with
+ * `NDEBUG`. `values` holds `n` consecutive values of the map's `value_size`,
+ * the values are left uninitialized if it is `NULL`.
+ *
+ * The tree is built balanced in linear time, without the searches and
+ * rebalancing of inserting the entries one by one.
+ *
+ * Returns non-zero if a memory allocation failure occurs, the map is left
+ * empty.
+ */
+int lf(map_build_sorted)(struct lf(map) *map,
+			 const void *const *keys,
+			 const void *values,
+			 size_t n) lfi_wur;
+
+/** @brief Identical to map_build_sorted(), but raises an error if memory
+ * allocation fails. */
+void lf(map_xbuild_sorted)(struct lf(map) *map,
+			   const void *const *keys,
+			   const void *values,
+			   size_t n);
+
+/** @brief Identical to map_build_sorted(), but accepts non-null-terminated
+ * keys of lengths `keylens`. */
+int lf(map_build_sorted2)(struct lf(map) *map,
+			  const void *const *keys,
+			  const size_t *keylens,
+			  const void *values,
+			  size_t n) lfi_wur;
+
+/** @brief Identical to map_build_sorted2(), but raises an error if memory
+ * allocation fails. */
+void lf(map_xbuild_sorted2)(struct lf(map) *map,
+			    const void *const *keys,
+			    const size_t *keylens,
+			    const void *values,
+			    size_t n);
+
 /**
  * @brief Removes a key-value pair from the map and returns a pointer to the value.
  *
@@ -137,6 +296,74 @@ const void *lf(map_remove)(struct lf(map) *map, const void *key);
 /** @brief Identical to map_remove(), but accepts a non-null-terminated key. */
 const void *lf(map_remove2)(struct lf(map) *map, const void *key, size_t keylen);
 
+/**
+ * @brief Moves the entries with keys not less than `key` to `right`.
+ *
+ * `right` is initialized with the value size, comparator and allocator of the
+ * map, and must be destroyed by the user. Takes logarithmic time, as the
+ * nodes are moved rather than copied. The `key` parameter must be
+ * null-terminated.
+ *
+ * Returns non-zero if a memory allocation failure occurs, the map is left
+ * unchanged.
+ */
+int lf(map_split)(struct lf(map) *map,
+		  const void *key,
+		  struct lf(map) *right) lfi_wur;
+
+/** @brief Identical to map_split(), but raises an error if memory allocation
+ * fails. */
+void lf(map_xsplit)(struct lf(map) *map,
+		    const void *key,
+		    struct lf(map) *right);
+
+/** @brief Identical to map_split(), but accepts a non-null-terminated key. */
+int lf(map_split2)(struct lf(map) *map,
+		   const void *key,
+		   size_t keylen,
+		   struct lf(map) *right) lfi_wur;
+
+/** @brief Identical to map_split2(), but raises an error if memory allocation
+ * fails. */
+void lf(map_xsplit2)(struct lf(map) *map,
+		     const void *key,
+		     size_t keylen,
+		     struct lf(map) *right);
+
+/**
+ * @brief Moves all entries of `other` to the map, leaving `other` empty.
+ *
+ * All keys of the map must be less than the keys of `other`, which is only
+ * checked if the library is not compiled with `NDEBUG`. Both maps must have
+ * the same value size, comparator and allocator. Takes logarithmic time in
+ * the sizes of the maps. `other` can still be used, and must be destroyed by
+ * the user.
+ *
+ * Returns non-zero if a memory allocation failure occurs, the maps are left
+ * unchanged.
+ */
+int lf(map_join)(struct lf(map) *map, struct lf(map) *other) lfi_wur;
+
+/** @brief Identical to map_join(), but raises an error if memory allocation
+ * fails. */
+void lf(map_xjoin)(struct lf(map) *map, struct lf(map) *other);
+
+/**
+ * @brief Moves all entries of `other` to the map, leaving `other` empty.
+ *
+ * Keys may be in both maps, in which case the value in the map is kept. The
+ * maps are as in map_join(). Takes O(m log(n / m + 1)) time, where m is the
+ * size of the smaller map and n of the larger one.
+ *
+ * Returns non-zero if a memory allocation failure occurs, the maps are left
+ * unchanged.
+ */
+int lf(map_union)(struct lf(map) *map, struct lf(map) *other) lfi_wur;
+
+/** @brief Identical to map_union(), but raises an error if memory allocation
+ * fails. */
+void lf(map_xunion)(struct lf(map) *map, struct lf(map) *other);
+
 /**
  * @brief Retrieves the map entry at a specific sorted index.
  *
@@ -178,6 +405,82 @@ void lf(map_iter_from)(struct lf(map) *map,
 		       struct lf(map_it) *it,
 		       ptrdiff_t index);
 
+/**
+ * @brief Creates an iteration handle starting from the first entry whose key
+ * is not less than `key`.
+ *
+ * The handle retrieves the sentinel entry if there is no such entry. The
+ * `key` parameter must be null-terminated. See map_iter().
+ */
+void lf(map_lower_bound)(struct lf(map) *map,
+			 struct lf(map_it) *it,
+			 const void *key);
+
+/** @brief Identical to map_lower_bound(), but accepts a non-null-terminated
+ * key. */
+void lf(map_lower_bound2)(struct lf(map) *map,
+			  struct lf(map_it) *it,
+			  const void *key,
+			  size_t keylen);
+
+/**
+ * @brief Creates an iteration handle starting from the first entry whose key
+ * is greater than `key`.
+ *
+ * See map_lower_bound().
+ */
+void lf(map_upper_bound)(struct lf(map) *map,
+			 struct lf(map_it) *it,
+			 const void *key);
+
+/** @brief Identical to map_upper_bound(), but accepts a non-null-terminated
+ * key. */
+void lf(map_upper_bound2)(struct lf(map) *map,
+			  struct lf(map_it) *it,
+			  const void *key,
+			  size_t keylen);
+
+/**
+ * @brief Creates an iteration handle over the entries with keys in
+ * [`lo`, `hi`).
+ *
+ * Iteration starts from the first entry of the range. Both map_iter_next()
+ * and map_iter_prev() return the sentinel entry once they leave the range.
+ * `lo` must not be greater than `hi`, which is only checked if the library is
+ * not compiled with `NDEBUG`. The keys must be null-terminated.
+ */
+void lf(map_iter_range)(struct lf(map) *map,
+			struct lf(map_it) *it,
+			const void *lo,
+			const void *hi);
+
+/** @brief Identical to map_iter_range(), but accepts non-null-terminated
+ * keys. */
+void lf(map_iter_range2)(struct lf(map) *map,
+			 struct lf(map_it) *it,
+			 const void *lo,
+			 size_t lolen,
+			 const void *hi,
+			 size_t hilen);
+
+/**
+ * @brief Returns the number of entries with keys in [`lo`, `hi`).
+ *
+ * Counted from the subtree sizes in logarithmic time, without visiting the
+ * entries. The keys must be null-terminated.
+ */
+size_t lf(map_count_range)(const struct lf(map) *map,
+			   const void *lo,
+			   const void *hi);
+
+/** @brief Identical to map_count_range(), but accepts non-null-terminated
+ * keys. */
+size_t lf(map_count_range2)(const struct lf(map) *map,
+			    const void *lo,
+			    size_t lolen,
+			    const void *hi,
+			    size_t hilen);
+
 /**
  * @brief Retrieves the next entry from an iteration handle.
  *
@@ -0,0 +1,347 @@
+/**
+ * @file pmap.h
+ * @brief Persistent ordered map for lock-free readers.
+ *
+ * pmap is an order-statistics tree whose nodes are never modified once
+ * published. An update copies the nodes on its path, O(log n) of them, and
+ * publishes the new root atomically, so that readers see either the old or the
+ * new version of the map and never a partial update. The tree is balanced by
+ * subtree weights, which are the subtree sizes kept for select and rank, as
+ * the rotations of a Red-Black tree rely on parent pointers that shared
+ * subtrees cannot have.
+ *
+ * Each reading thread gets a reader from pmap_reader_new(), and reads a
+ * snapshot between pmap_read_begin() and pmap_read_end(). Readers only write
+ * to their own reader, so reads scale with the number of threads. Nodes
+ * replaced by an update are retired, and freed by a following update once no
+ * reader has started before they were replaced.
+ *
+ * There may be a single writer at a time, updates must be serialized by the
+ * user. Reads may run concurrently with each other and with the writer.
+ */
+
+#ifndef LF_PMAP_H
+#define LF_PMAP_H
+
+#ifndef LF_HEADERONLY
+#include "allocator.h"
+#include "common.h"
+#endif
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** @cond */
+/* Subtrees hold at least a quarter of the entries of their parent, which
+ * bounds the height of a tree of 2^64 entries below log(2^64) / log(4/3). */
+#define LF_PMAP_MAX_HEIGHT 160
+/** @endcond */
+
+
+/** @brief Persistent map. */
+struct lf(pmap) {
+	/** @cond */
+	_Atomic(struct lfi(pmap_node) *) root;
+
+	/* Readers announce the epoch they started in, and nodes are retired
+	 * in the epoch they were replaced in. */
+	atomic_size_t epoch;
+	_Atomic(struct lf(pmap_reader) *) readers;
+
+	/* Retired nodes in the order of their epochs, writer only. */
+	struct lfi(pmap_node) *retired;
+	struct lfi(pmap_node) *retired_tail;
+
+	/* Nodes of the ongoing update, and the ones it replaces. */
+	size_t gen;
+	struct lfi(pmap_node) *fresh;
+	struct lfi(pmap_node) *replaced;
+
+	size_t value_size;
+
+	/* NULL for the default comparison. */
+	int (*cmp)(const void *, const void *, size_t, size_t);
+
+	struct lf(allocator) allocator;
+	/** @endcond */
+};
+
+/** @brief Reading thread of a pmap. */
+struct lf(pmap_reader) {
+	/** @cond */
+	/* Zero if not reading. Readers are aligned to cache lines, so that
+	 * their epochs do not share lines. */
+	_Alignas(64) atomic_size_t epoch;
+
+	atomic_bool used;
+
+	struct lf(pmap_reader) *next;
+	struct lf(pmap) *m;
+	/** @endcond */
+};
+
+/** @brief Version of a pmap, unchanged by the following updates. */
+struct lf(pmap_snapshot) {
+	/** @cond */
+	const struct lf(pmap) *m;
+	const struct lfi(pmap_node) *root;
+	/** @endcond */
+};
+
+/** @brief Iteration handle to retrieve snapshot entries one by one. */
+struct lf(pmap_it) {
+	/** @cond */
+	const struct lf(pmap) *m;
+	const struct lfi(pmap_node) *stack[LF_PMAP_MAX_HEIGHT];
+	size_t top;
+	/** @endcond */
+};
+
+/** @cond */
+struct lfi(pmap_node) {
+	struct lfi(pmap_node) *left;
+	struct lfi(pmap_node) *right;
+
+	/* Number of nodes in the subtree rooted at this node, including this
+	 * node. */
+	size_t size;
+	size_t keylen;
+
+	/* First bytes of the key, as in map. */
+	uint64_t prefix;
+
+	/* Update that allocated the node, which may modify it until it is
+	 * published. */
+	size_t gen;
+
+	/* Links the node in the list of the update or of the retired nodes,
+	 * with the epoch it is retired in. Not read by the readers. */
+	struct lfi(pmap_node) *next;
+	size_t retired_epoch;
+
+	/* Key and value, the value is aligned to sizeof(size_t)-byte
+	 * boundary. */
+	_Alignas(size_t) char kv[];
+};
+/** @endcond */
+
+
+/**
+ * @brief Creates a new persistent map.
+ *
+ * Comparator is as in map_init(). Defaults to comparing the keys
+ * lexicographically by their bytes if `NULL`.
+ *
+ * Returns non-zero if a memory allocation failure occurs.
+ */
+int lf(pmap_init)(struct lf(pmap) *pmap,
+		  size_t value_size,
+		  int (*comparator)(const void *key1,
+				    const void *key2,
+				    size_t keylen1,
+				    size_t keylen2)) lfi_wur;
+
+/** @brief Identical to pmap_init(), but raises an error if memory allocation
+ * fails. */
+void lf(pmap_xinit)(struct lf(pmap) *pmap,
+		    size_t value_size,
+		    int (*comparator)(const void *key1,
+				      const void *key2,
+				      size_t keylen1,
+				      size_t keylen2));
+
+/**
+ * @brief Identical to pmap_init(), but takes the memory of the nodes from the
+ * `allocator`.
+ *
+ * The allocator is copied into the pmap. Defaults to allocator_libc if `NULL`.
+ * It is called by the writer only, readers are allocated from the libc heap.
+ *
+ * @see allocator.h
+ */
+int lf(pmap_init_with)(struct lf(pmap) *pmap,
+		       size_t value_size,
+		       int (*comparator)(const void *key1,
+					 const void *key2,
+					 size_t keylen1,
+					 size_t keylen2),
+		       const struct lf(allocator) *allocator) lfi_wur;
+
+/** @brief Identical to pmap_init_with(), but raises an error if memory
+ * allocation fails. */
+void lf(pmap_xinit_with)(struct lf(pmap) *pmap,
+			 size_t value_size,
+			 int (*comparator)(const void *key1,
+					   const void *key2,
+					   size_t keylen1,
+					   size_t keylen2),
+			 const struct lf(allocator) *allocator);
+
+/**
+ * @brief Clears the memory allocated by the pmap, including its readers.
+ *
+ * @warning Must not run concurrently with any other operation.
+ */
+void lf(pmap_destroy)(struct lf(pmap) *pmap);
+
+/**
+ * @brief Inserts a key-value pair into the pmap, or replaces the value if the
+ * key exists, and publishes the new version.
+ *
+ * `*inserted` is set to whether the key is inserted, `inserted` may be `NULL`.
+ * The `key` parameter must be null-terminated. Writer only.
+ *
+ * Returns non-zero if a memory allocation failure occurs, the pmap is left
+ * unchanged.
+ */
+int lf(pmap_upsert)(struct lf(pmap) *pmap,
+		    const void *key,
+		    const void *value,
+		    bool *inserted) lfi_wur;
+
+/** @brief Identical to pmap_upsert(), but raises an error if memory
+ * allocation fails. */
+void lf(pmap_xupsert)(struct lf(pmap) *pmap,
+		      const void *key,
+		      const void *value,
+		      bool *inserted);
+
+/** @brief Identical to pmap_upsert(), but accepts a non-null-terminated
+ * key. */
+int lf(pmap_upsert2)(struct lf(pmap) *pmap,
+		     const void *key,
+		     size_t keylen,
+		     const void *value,
+		     bool *inserted) lfi_wur;
+
+/** @brief Identical to pmap_upsert2(), but raises an error if memory
+ * allocation fails. */
+void lf(pmap_xupsert2)(struct lf(pmap) *pmap,
+		       const void *key,
+		       size_t keylen,
+		       const void *value,
+		       bool *inserted);
+
+/**
+ * @brief Removes the key from the pmap and publishes the new version.
+ *
+ * `*removed` is set to whether the key is found, `removed` may be `NULL`. The
+ * `key` parameter must be null-terminated. Writer only.
+ *
+ * Returns non-zero if a memory allocation failure occurs, the pmap is left
+ * unchanged.
+ */
+int lf(pmap_remove)(struct lf(pmap) *pmap,
+		    const void *key,
+		    bool *removed) lfi_wur;
+
+/** @brief Identical to pmap_remove(), but raises an error if memory
+ * allocation fails. */
+void lf(pmap_xremove)(struct lf(pmap) *pmap, const void *key, bool *removed);
+
+/** @brief Identical to pmap_remove(), but accepts a non-null-terminated
+ * key. */
+int lf(pmap_remove2)(struct lf(pmap) *pmap,
+		     const void *key,
+		     size_t keylen,
+		     bool *removed) lfi_wur;
+
+/** @brief Identical to pmap_remove2(), but raises an error if memory
+ * allocation fails. */
+void lf(pmap_xremove2)(struct lf(pmap) *pmap,
+		       const void *key,
+		       size_t keylen,
+		       bool *removed);
+
+/**
+ * @brief Returns the current version of the pmap, for the writer.
+ *
+ * The snapshot is valid until the next update. Readers take snapshots with
+ * pmap_read_begin().
+ */
+struct lf(pmap_snapshot) lf(pmap_current)(struct lf(pmap) *pmap);
+
+/**
+ * @brief Creates a reader of the pmap, returns `NULL` if a memory allocation
+ * failure occurs.
+ *
+ * Readers are reused after pmap_reader_release(), and freed along with the
+ * pmap. A reader is used by a single thread at a time. May run concurrently
+ * with the other operations.
+ */
+struct lf(pmap_reader) *lf(pmap_reader_new)(struct lf(pmap) *pmap) lfi_wur;
+
+/** @brief Releases the reader for reuse. The reader must not be reading. */
+void lf(pmap_reader_release)(struct lf(pmap_reader) *reader);
+
+/**
+ * @brief Starts reading, and returns the current version of the pmap.
+ *
+ * The snapshot, and the pointers retrieved from it, are valid until
+ * pmap_read_end(). Nodes retired meanwhile are not freed, reads should be
+ * kept short.
+ */
+struct lf(pmap_snapshot) lf(pmap_read_begin)(struct lf(pmap_reader) *reader);
+
+/** @brief Ends reading, invalidating the snapshot. */
+void lf(pmap_read_end)(struct lf(pmap_reader) *reader);
+
+/**
+ * @brief Returns a pointer to the value matching the key in the snapshot,
+ * returns `NULL` if the key is not found.
+ *
+ * The value must not be modified. The `key` parameter must be null-terminated.
+ * Returned pointer will be a sentinel if the pmap's `value_size` is zero, and
+ * it should not be dereferenced.
+ */
+const void *lf(pmap_get)(struct lf(pmap_snapshot) snapshot, const void *key);
+
+/** @brief Identical to pmap_get(), but accepts a non-null-terminated key. */
+const void *lf(pmap_get2)(struct lf(pmap_snapshot) snapshot,
+			  const void *key,
+			  size_t keylen);
+
+/** @brief Returns the number of entries in the snapshot. */
+size_t lf(pmap_size)(struct lf(pmap_snapshot) snapshot);
+
+/**
+ * @brief Retrieves the snapshot entry at a specific sorted index.
+ *
+ * Raises an error if the index is larger than snapshot size. The entry must
+ * not be modified.
+ */
+struct lf(entry) lf(pmap_select)(struct lf(pmap_snapshot) snapshot,
+				 ptrdiff_t index);
+
+/**
+ * @brief Determines the 0-based index of a specific key in the sorted
+ * snapshot.
+ *
+ * Returns -1 casted to size_t if the key is not found.
+ */
+size_t lf(pmap_rank)(struct lf(pmap_snapshot) snapshot, const void *key);
+
+/** @brief Identical to pmap_rank(), but accepts a non-null-terminated key. */
+size_t lf(pmap_rank2)(struct lf(pmap_snapshot) snapshot,
+		      const void *key,
+		      size_t keylen);
+
+/** @brief Creates a forward iteration handle for the snapshot. */
+void lf(pmap_iter)(struct lf(pmap_snapshot) snapshot, struct lf(pmap_it) *it);
+
+/**
+ * @brief Retrieves the next entry from an iteration handle.
+ *
+ * Returns entries in ascending key order. When all entries have been
+ * retrieved, returns a sentinel entry. Use entry_is_valid() to check wheter
+ * or not the entry is sentinel.
+ *
+ * @see common.h
+ */
+struct lf(entry) lf(pmap_iter_next)(struct lf(pmap_it) *it);
+
+
+#endif
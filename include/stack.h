@@ -18,6 +18,7 @@
 #define LF_STACK_H
 
 #ifndef LF_HEADERONLY
+#include "allocator.h"
 #include "common.h"
 #endif
 
@@ -31,6 +32,7 @@ struct lf(stack) {
     size_t cap;
     size_t len;
     size_t item_size;
+    struct lf(allocator) allocator;
     /** @endcond */
 };
 
@@ -49,6 +51,25 @@ int lf(stack_init)(struct lf(stack) *stack, size_t item_size) lfi_wur;
  * fails. */
 void lf(stack_xinit)(struct lf(stack) *stack, size_t value_size);
 
+/**
+ * @brief Identical to stack_init(), but takes the memory of the stack from the
+ * `allocator`.
+ *
+ * The allocator is copied into the stack. Defaults to allocator_libc if
+ * `NULL`.
+ *
+ * @see allocator.h
+ */
+int lf(stack_init_with)(struct lf(stack) *stack,
+			size_t item_size,
+			const struct lf(allocator) *allocator) lfi_wur;
+
+/** @brief Identical to stack_init_with(), but raises an error if memory
+ * allocation fails. */
+void lf(stack_xinit_with)(struct lf(stack) *stack,
+			  size_t item_size,
+			  const struct lf(allocator) *allocator);
+
 /** @brief Clears the memory allocated by the stack. */
 void lf(stack_destroy)(struct lf(stack) *stack);
 
@@ -0,0 +1,298 @@
+/**
+ * @file typed_hashmap.h
+ * @brief Hashmaps specialized for a key and a value type.
+ *
+ * LF_TYPED_HASHMAP() instantiates a hashmap for concrete key and value types,
+ * with its hash and equality functions known at compile time. Keys and values
+ * are stored by value in the entries, so that the compiler inlines the hash
+ * and the comparison, indexes the entries with a constant stride, and copies
+ * values by assignment.
+ *
+ * The table uses the same control byte layout as hashmap.h, and probes it a
+ * group of 16 slots at a time (using SSE2 if available).
+ *
+ * Example:
+ * @code
+ * static uint64_t hash_id(uint64_t id) { return id * 0x9e3779b97f4a7c15u; }
+ * static bool eq_id(uint64_t a, uint64_t b) { return a == b; }
+ *
+ * LF_TYPED_HASHMAP(id_map, uint64_t, struct point, hash_id, eq_id)
+ *
+ * struct fid_map m;
+ * fid_map_init(&m);
+ * fid_map_upsert(&m, 42, (struct point) { 1, 2 }, NULL);
+ * struct point *p = fid_map_get(&m, 42);
+ * @endcode
+ */
+
+#ifndef LF_TYPED_HASHMAP_H
+#define LF_TYPED_HASHMAP_H
+
+#ifndef LF_HEADERONLY
+#include "common.h"
+#include "../src/hashmap_ctrl.h"
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/**
+ * @brief Instantiates a hashmap named `name` from `key_t` to `value_t`.
+ *
+ * `hash_fn` is called as `uint64_t hash_fn(key_t key)`, and `eq_fn` as
+ * `bool eq_fn(key_t a, key_t b)`; both may be functions or function-like
+ * macros. The high bits of the hash are used as the tags in the control bytes,
+ * and the low bits pick the slots, so the hash must mix all of its bits.
+ *
+ * The following are defined, where `lf(x)` is `x` with the library prefix:
+ * - `struct lf(name)`, the hashmap.
+ * - `struct lf(name_entry)`, an entry with `key` and `value` fields.
+ * - `struct lf(name_it)`, an iteration handle.
+ * - `int lf(name_init)(m)` creates a hashmap, returns non-zero if a memory
+ *   allocation failure occurs.
+ * - `void lf(name_destroy)(m)` clears the memory allocated by the hashmap.
+ * - `value_t *lf(name_get)(m, key)` returns a pointer to the value matching
+ *   the key, or `NULL`.
+ * - `value_t *lf(name_insert)(m, key, value)` inserts a key that must not
+ *   already exist in the hashmap, without looking it up.
+ * - `value_t *lf(name_get_or_insert)(m, key, value, bool *inserted)` and
+ *   `value_t *lf(name_upsert)(m, key, value, bool *inserted)` are as in
+ *   hashmap.h.
+ * - `bool lf(name_remove)(m, key, value_t *value)` removes the key, copying
+ *   its value to `value` unless it is `NULL`, and returns whether the key is
+ *   found.
+ * - `int lf(name_reserve)(m, n)` grows the hashmap to hold `n` entries
+ *   without rehashing.
+ * - `void lf(name_clear)(m)` removes all entries, keeping the capacity.
+ * - `size_t lf(name_size)(m)` returns the number of entries.
+ * - `void lf(name_iter)(m, it)` and `struct lf(name_entry)
+ *   *lf(name_iter_next)(it)`, which returns `NULL` after the last entry.
+ *
+ * Inserting functions return `NULL` if a memory allocation failure occurs.
+ * The returned pointers are valid until the next insert or remove
+ * operation. All functions are `static inline`, the macro is meant to be used
+ * once per map type in a source file or in a header.
+ */
+#define LF_TYPED_HASHMAP(name, key_t, value_t, hash_fn, eq_fn) \
+\
+struct lf(name##_entry) { \
+	key_t key; \
+	value_t value; \
+}; \
+\
+struct lf(name) { \
+	unsigned char *ctrl; \
+	struct lf(name##_entry) *entries; \
+	size_t cap; \
+	size_t used; \
+	size_t deleted; \
+}; \
+\
+struct lf(name##_it) { \
+	struct lf(name) *m; \
+	size_t i; \
+}; \
+\
+/* The entry functions given to the table functions of hashmap_ctrl.h. */ \
+inline lfi_fdecl(bool, name##_eq)(const void *entry, const void *key) \
+{ \
+	return eq_fn(((const struct lf(name##_entry) *) entry)->key, \
+		     *(const key_t *) key); \
+} \
+\
+inline lfi_fdecl(uint64_t, name##_hash)(const void *entry) \
+{ \
+	return hash_fn(((const struct lf(name##_entry) *) entry)->key); \
+} \
+\
+inline lfi_fdecl(int, name##_alloc)(struct lf(name) *m, size_t cap) \
+{ \
+	size_t align = _Alignof(struct lf(name##_entry)); \
+	size_t off = (cap + align - 1) / align * align; \
+	unsigned char *ctrl = \
+		malloc(off + cap * sizeof(struct lf(name##_entry))); \
+\
+	if (ctrl == NULL) \
+		return 1; \
+\
+	memset(ctrl, LF_HASHMAP_CTRL_EMPTY, cap); \
+\
+	m->ctrl = ctrl; \
+	m->entries = (struct lf(name##_entry) *) &ctrl[off]; \
+	m->cap = cap; \
+	m->deleted = 0; \
+\
+	return 0; \
+} \
+\
+inline lfi_fdecl(size_t, name##_find)(struct lf(name) *m, \
+				      key_t key, \
+				      uint64_t hash) \
+{ \
+	return lfi(group_table_find)(m->ctrl, (const char *) m->entries, \
+				     m->cap, sizeof(*m->entries), hash, \
+				     &key, lfi(name##_eq)); \
+} \
+\
+inline lfi_fdecl(int, name##_rehash)(struct lf(name) *m, size_t cap) \
+{ \
+	struct lf(name) old = *m; \
+\
+	if (lfi(name##_alloc)(m, cap)) \
+		return 1; \
+\
+	lfi(group_table_move)(old.ctrl, (const char *) old.entries, old.cap, \
+			      m->ctrl, (char *) m->entries, m->cap, \
+			      sizeof(*m->entries), lfi(name##_hash)); \
+	free(old.ctrl); \
+\
+	return 0; \
+} \
+\
+static inline int lf(name##_init)(struct lf(name) *m) \
+{ \
+	m->used = 0; \
+\
+	return lfi(name##_alloc)(m, LF_HASHMAP_INITIAL_CAP); \
+} \
+\
+static inline void lf(name##_destroy)(struct lf(name) *m) \
+{ \
+	free(m->ctrl); \
+} \
+\
+static inline value_t *lf(name##_get)(struct lf(name) *m, key_t key) \
+{ \
+	size_t i = lfi(name##_find)(m, key, hash_fn(key)); \
+\
+	return i == SIZE_MAX ? NULL : &m->entries[i].value; \
+} \
+\
+inline lfi_fdecl(value_t *, name##_insert_new)(struct lf(name) *m, \
+					       key_t key, \
+					       value_t value, \
+					       uint64_t hash) \
+{ \
+	size_t cap = lfi(group_table_grow)(m->cap, m->used, m->deleted); \
+\
+	if (cap != 0 && lfi(name##_rehash)(m, cap)) \
+		return NULL; \
+\
+	struct lf(name##_entry) *e = \
+		&m->entries[lfi(group_table_claim)(m->ctrl, m->cap, hash, \
+						   &m->deleted)]; \
+\
+	e->key = key; \
+	e->value = value; \
+	m->used++; \
+\
+	return &e->value; \
+} \
+\
+static inline value_t *lf(name##_insert)(struct lf(name) *m, \
+					 key_t key, \
+					 value_t value) \
+{ \
+	return lfi(name##_insert_new)(m, key, value, hash_fn(key)); \
+} \
+\
+static inline value_t *lf(name##_get_or_insert)(struct lf(name) *m, \
+						key_t key, \
+						value_t value, \
+						bool *inserted) \
+{ \
+	uint64_t hash = hash_fn(key); \
+	size_t i = lfi(name##_find)(m, key, hash); \
+\
+	if (inserted != NULL) \
+		*inserted = i == SIZE_MAX; \
+\
+	if (i != SIZE_MAX) \
+		return &m->entries[i].value; \
+\
+	return lfi(name##_insert_new)(m, key, value, hash); \
+} \
+\
+static inline value_t *lf(name##_upsert)(struct lf(name) *m, \
+					 key_t key, \
+					 value_t value, \
+					 bool *inserted) \
+{ \
+	bool inserted_; \
+	value_t *v = lf(name##_get_or_insert)(m, key, value, &inserted_); \
+\
+	if (v != NULL && !inserted_) \
+		*v = value; \
+\
+	if (inserted != NULL) \
+		*inserted = inserted_; \
+\
+	return v; \
+} \
+\
+static inline bool lf(name##_remove)(struct lf(name) *m, \
+				     key_t key, \
+				     value_t *value) \
+{ \
+	size_t i = lfi(name##_find)(m, key, hash_fn(key)); \
+\
+	if (i == SIZE_MAX) \
+		return false; \
+\
+	if (value != NULL) \
+		*value = m->entries[i].value; \
+\
+	lfi(group_table_release)(m->ctrl, i, &m->deleted); \
+	m->used--; \
+\
+	return true; \
+} \
+\
+static inline int lf(name##_reserve)(struct lf(name) *m, size_t n) \
+{ \
+	size_t cap = lfi(group_table_cap_for)(n); \
+\
+	if (cap == 0) \
+		return 1; \
+\
+	return cap > m->cap ? lfi(name##_rehash)(m, cap) : 0; \
+} \
+\
+static inline void lf(name##_clear)(struct lf(name) *m) \
+{ \
+	memset(m->ctrl, LF_HASHMAP_CTRL_EMPTY, m->cap); \
+	m->used = 0; \
+	m->deleted = 0; \
+} \
+\
+static inline size_t lf(name##_size)(struct lf(name) *m) \
+{ \
+	return m->used; \
+} \
+\
+static inline void lf(name##_iter)(struct lf(name) *m, \
+				   struct lf(name##_it) *it) \
+{ \
+	it->m = m; \
+	it->i = 0; \
+} \
+\
+static inline struct lf(name##_entry) *lf(name##_iter_next)( \
+	struct lf(name##_it) *it) \
+{ \
+	while (it->i < it->m->cap) { \
+		size_t i = it->i++; \
+\
+		if (lf_hashmap_ctrl_is_full(it->m->ctrl[i])) \
+			return &it->m->entries[i]; \
+	} \
+\
+	return NULL; \
+}
+
+
+#endif
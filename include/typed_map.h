@@ -0,0 +1,337 @@
+/**
+ * @file typed_map.h
+ * @brief Ordered maps specialized for a key and a value type.
+ *
+ * LF_TYPED_MAP() instantiates an ordered map for concrete key and value types,
+ * with its ordering known at compile time. The tree is the order-statistics
+ * Red-Black tree of map.h, and it is rebalanced by the same code, but the
+ * searches are generated for the key type. Their comparisons are inlined
+ * instead of called through the comparator pointer. Rank and lower bound
+ * searches take a single comparison per level, which the compiler turns into
+ * conditional moves for integer keys.
+ *
+ * Keys and values are stored by value in the nodes, which are allocated from
+ * the pool of the underlying map.
+ *
+ * Example:
+ * @code
+ * #define less_id(a, b) ((a) < (b))
+ *
+ * LF_TYPED_MAP(id_tree, uint64_t, struct point, less_id)
+ *
+ * struct fid_tree t;
+ * fid_tree_init(&t);
+ * fid_tree_upsert(&t, 42, (struct point) { 1, 2 }, NULL);
+ * struct point *p = fid_tree_get(&t, 42);
+ * size_t i = fid_tree_rank(&t, 42);
+ * @endcode
+ */
+
+#ifndef LF_TYPED_MAP_H
+#define LF_TYPED_MAP_H
+
+#ifndef LF_HEADERONLY
+#include "allocator.h"
+#include "common.h"
+#include "map.h"
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/**
+ * @brief Instantiates an ordered map named `name` from `key_t` to `value_t`.
+ *
+ * `less_fn` is called as `bool less_fn(key_t a, key_t b)`, and must return
+ * whether `a` is ordered before `b`; it may be a function or a function-like
+ * macro. Two keys are equal if neither is less than the other. Entries must
+ * not be aligned to more than `size_t`.
+ *
+ * The following are defined, where `lf(x)` is `x` with the library prefix:
+ * - `struct lf(name)`, the map.
+ * - `struct lf(name_entry)`, an entry with `key` and `value` fields.
+ * - `struct lf(name_it)`, an iteration handle.
+ * - `int lf(name_init)(m)` creates a map, and `int lf(name_init_with)(m,
+ *   allocator)` one allocating from the allocator, as in map_init_with().
+ *   Return non-zero if a memory allocation failure occurs.
+ * - `void lf(name_destroy)(m)` clears the memory allocated by the map.
+ * - `value_t *lf(name_get)(m, key)` returns a pointer to the value matching
+ *   the key, or `NULL`.
+ * - `value_t *lf(name_insert)(m, key, value)` inserts a key that must not
+ *   already exist in the map, and aborts if it does, as map_insert().
+ * - `value_t *lf(name_get_or_insert)(m, key, value, bool *inserted)` and
+ *   `value_t *lf(name_upsert)(m, key, value, bool *inserted)` are as in
+ *   hashmap.h.
+ * - `bool lf(name_remove)(m, key, value_t *value)` removes the key, copying
+ *   its value to `value` unless it is `NULL`, and returns whether the key is
+ *   found.
+ * - `struct lf(name_entry) *lf(name_select)(m, index)` returns the entry at
+ *   the sorted index, as in map_select().
+ * - `size_t lf(name_rank)(m, key)` returns the sorted index of the key, or -1
+ *   casted to size_t if the key is not found.
+ * - `size_t lf(name_size)(m)` returns the number of entries.
+ * - `void lf(name_iter)(m, it)` and `void lf(name_lower_bound)(m, it, key)`
+ *   start an iteration from the smallest key, or from the first key not less
+ *   than `key`. `struct lf(name_entry) *lf(name_iter_next)(it)` and
+ *   `lf(name_iter_prev)(it)` return the entries in ascending or descending
+ *   order, and `NULL` after the last one.
+ *
+ * Inserting functions return `NULL` if a memory allocation failure occurs.
+ * Entries stay in place until they are removed. All functions are `static
+ * inline`, the macro is meant to be used once per map type in a source file or
+ * in a header.
+ */
+#define LF_TYPED_MAP(name, key_t, value_t, less_fn) \
+\
+struct lf(name##_entry) { \
+	key_t key; \
+	value_t value; \
+}; \
+\
+_Static_assert(_Alignof(struct lf(name##_entry)) <= _Alignof(size_t), \
+	       "entries of " #name " must not be aligned to more than size_t"); \
+\
+struct lf(name) { \
+	struct lf(map) m; \
+}; \
+\
+struct lf(name##_it) { \
+	struct lf(map_it) it; \
+}; \
+\
+inline lfi_fdecl(struct lf(name##_entry) *, name##_entry_of)( \
+	struct lfi(map_node) *n) \
+{ \
+	return n == NULL ? NULL : (struct lf(name##_entry) *) (void *) n->kv; \
+} \
+\
+/* First node whose key is not less than the key, or NULL. Sets `*rank` to \
+ * its index unless `rank` is NULL. */ \
+inline lfi_fdecl(struct lfi(map_node) *, name##_lower_bound_node)( \
+	const struct lf(name) *t, \
+	key_t key, \
+	size_t *rank) \
+{ \
+	struct lfi(map_node) *cur = t->m.root; \
+	struct lfi(map_node) *bound = NULL; \
+	size_t r = 0; \
+\
+	while (cur != NULL) { \
+		bool less = less_fn(lfi(name##_entry_of)(cur)->key, key); \
+\
+		if (less) \
+			r += (cur->left != NULL ? cur->left->size : 0) + 1; \
+		else \
+			bound = cur; \
+\
+		cur = less ? cur->right : cur->left; \
+	} \
+\
+	if (rank != NULL) \
+		*rank = r; \
+\
+	return bound; \
+} \
+\
+inline lfi_fdecl(struct lfi(map_node) *, name##_find)( \
+	const struct lf(name) *t, \
+	key_t key) \
+{ \
+	struct lfi(map_node) *cur = t->m.root; \
+\
+	while (cur != NULL) { \
+		key_t k = lfi(name##_entry_of)(cur)->key; \
+\
+		if (less_fn(key, k)) \
+			cur = cur->left; \
+		else if (less_fn(k, key)) \
+			cur = cur->right; \
+		else \
+			break; \
+	} \
+\
+	return cur; \
+} \
+\
+static inline int lf(name##_init_with)(struct lf(name) *t, \
+				       const struct lf(allocator) *allocator) \
+{ \
+	return lf(map_init_with)(&t->m, sizeof(struct lf(name##_entry)), NULL, \
+				 allocator); \
+} \
+\
+static inline int lf(name##_init)(struct lf(name) *t) \
+{ \
+	return lf(name##_init_with)(t, NULL); \
+} \
+\
+static inline void lf(name##_destroy)(struct lf(name) *t) \
+{ \
+	lf(map_destroy)(&t->m); \
+} \
+\
+static inline value_t *lf(name##_get)(struct lf(name) *t, key_t key) \
+{ \
+	struct lfi(map_node) *n = lfi(name##_find)(t, key); \
+\
+	return n == NULL ? NULL : &lfi(name##_entry_of)(n)->value; \
+} \
+\
+static inline value_t *lf(name##_get_or_insert)(struct lf(name) *t, \
+						key_t key, \
+						value_t value, \
+						bool *inserted) \
+{ \
+	struct lfi(map_node) *cur = t->m.root; \
+	struct lfi(map_node) *p = NULL; \
+	struct lfi(map_node) *last_right = NULL; \
+	bool left = false; \
+\
+	/* The key is equal to the last key it is not less than. */ \
+	while (cur != NULL) { \
+		p = cur; \
+		left = less_fn(key, lfi(name##_entry_of)(cur)->key); \
+		last_right = left ? last_right : cur; \
+		cur = left ? cur->left : cur->right; \
+	} \
+\
+	if (inserted != NULL) \
+		*inserted = false; \
+\
+	if (last_right != NULL && \
+	    !less_fn(lfi(name##_entry_of)(last_right)->key, key)) \
+		return &lfi(name##_entry_of)(last_right)->value; \
+\
+	struct lfi(map_node) *n = lfi(map_alloc_node)(&t->m); \
+\
+	if (n == NULL) \
+		return NULL; \
+\
+	struct lf(name##_entry) *e = lfi(name##_entry_of)(n); \
+\
+	e->key = key; \
+	e->value = value; \
+\
+	lfi(map_attach)(&t->m, p, n, left); \
+\
+	if (inserted != NULL) \
+		*inserted = true; \
+\
+	return &e->value; \
+} \
+\
+static inline value_t *lf(name##_insert)(struct lf(name) *t, \
+					 key_t key, \
+					 value_t value) \
+{ \
+	bool inserted; \
+	value_t *v = lf(name##_get_or_insert)(t, key, value, &inserted); \
+\
+	/* As map_insert(), which asserts on the duplicates. */ \
+	if (v != NULL && !inserted) { \
+		fputs("map already contains the element\n", stderr); \
+		abort(); \
+	} \
+\
+	return v; \
+} \
+\
+static inline value_t *lf(name##_upsert)(struct lf(name) *t, \
+					 key_t key, \
+					 value_t value, \
+					 bool *inserted) \
+{ \
+	bool inserted_; \
+	value_t *v = lf(name##_get_or_insert)(t, key, value, &inserted_); \
+\
+	if (v != NULL && !inserted_) \
+		*v = value; \
+\
+	if (inserted != NULL) \
+		*inserted = inserted_; \
+\
+	return v; \
+} \
+\
+static inline bool lf(name##_remove)(struct lf(name) *t, \
+				     key_t key, \
+				     value_t *value) \
+{ \
+	struct lfi(map_node) *n = lfi(name##_find)(t, key); \
+\
+	if (n == NULL) \
+		return false; \
+\
+	if (value != NULL) \
+		*value = lfi(name##_entry_of)(n)->value; \
+\
+	lfi(map_delete_node)(&t->m, n); \
+\
+	return true; \
+} \
+\
+static inline struct lf(name##_entry) *lf(name##_select)(struct lf(name) *t, \
+							 ptrdiff_t index) \
+{ \
+	return lf(map_select)(&t->m, index).value; \
+} \
+\
+static inline size_t lf(name##_rank)(const struct lf(name) *t, key_t key) \
+{ \
+	size_t rank; \
+	struct lfi(map_node) *n = \
+		lfi(name##_lower_bound_node)(t, key, &rank); \
+\
+	if (n == NULL || less_fn(key, lfi(name##_entry_of)(n)->key)) \
+		return -1; \
+\
+	return rank; \
+} \
+\
+static inline size_t lf(name##_size)(const struct lf(name) *t) \
+{ \
+	return lf(map_size)(&t->m); \
+} \
+\
+static inline void lf(name##_lower_bound)(struct lf(name) *t, \
+					  struct lf(name##_it) *it, \
+					  key_t key) \
+{ \
+	it->it.m = &t->m; \
+	it->it.n = lfi(name##_lower_bound_node)(t, key, NULL); \
+	it->it.end = NULL; \
+	it->it.rend = NULL; \
+} \
+\
+static inline void lf(name##_iter)(struct lf(name) *t, \
+				   struct lf(name##_it) *it) \
+{ \
+	struct lfi(map_node) *n = t->m.root; \
+\
+	while (n != NULL && n->left != NULL) \
+		n = n->left; \
+\
+	it->it.m = &t->m; \
+	it->it.n = n; \
+	it->it.end = NULL; \
+	it->it.rend = NULL; \
+} \
+\
+static inline struct lf(name##_entry) *lf(name##_iter_next)( \
+	struct lf(name##_it) *it) \
+{ \
+	return lf(map_iter_next)(&it->it).value; \
+} \
+\
+static inline struct lf(name##_entry) *lf(name##_iter_prev)( \
+	struct lf(name##_it) *it) \
+{ \
+	return lf(map_iter_prev)(&it->it).value; \
+}
+
+
+#endif
@@ -4,6 +4,9 @@ LIBFUN_MODE ?= release
 # Symbol prefix (for functions and types).
 LIBFUN_PREFIX ?= f
 
+# Extra preprocessor flags, e.g. overrides of the macros in config.h.
+LIBFUN_CPPFLAGS ?=
+
 # The directory containing libfun repository
 LIBFUN_DIR ?= .
 
@@ -22,9 +25,9 @@ LIBFUN_H ?= $(libfun_DIST_DIR)/libfun.h
 
 # Variables below this line are private.
 # -----------------------------------------------------------------------------
-libfun_CFLAGS_COMMON := -std=c11 -Wall -Wextra -pedantic -fPIC -DLIBFUN_PREFIX=$(LIBFUN_PREFIX)
+libfun_CFLAGS_COMMON := -std=c11 -Wall -Wextra -pedantic -fPIC -DLIBFUN_PREFIX=$(LIBFUN_PREFIX) $(LIBFUN_CPPFLAGS)
 
-libfun_CFLAGS_release := $(libfun_CFLAGS_COMMON) -O3 -flto
+libfun_CFLAGS_release := $(libfun_CFLAGS_COMMON) -O3 -flto -DNDEBUG
 libfun_CFLAGS_debug := $(libfun_CFLAGS_COMMON) -O0 -g3
 libfun_CFLAGS_test := $(libfun_CFLAGS_COMMON) -O0 -g3 --coverage
 
@@ -34,7 +37,7 @@ ifeq ($(libfun_CFLAGS),)
 $(error "WARNING: unknown mode $(LIBFUN_MODE).")
 endif
 
-libfun_HEADERS_TOPOLOGICAL_ORDERED = config.h common.h stack.h hashmap.h map.h
+libfun_HEADERS_TOPOLOGICAL_ORDERED = config.h common.h allocator.h stack.h hashmap.h ../src/hashmap_ctrl.h typed_hashmap.h intmap.h chashmap.h dict.h map.h typed_map.h pmap.h btree.h
 
 libfun_SRC_DIR := $(LIBFUN_DIR)/src
 
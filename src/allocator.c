@@ -0,0 +1,207 @@
+#ifndef LF_HEADERONLY
+#include "util.h"
+#include "../include/allocator.h"
+#include "../include/config.h"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#if (LF_ARENA_INITIAL_BLOCK_SIZE) <= 0 || \
+	(LF_ARENA_MAX_BLOCK_SIZE) < (LF_ARENA_INITIAL_BLOCK_SIZE)
+#error "LF_ARENA_MAX_BLOCK_SIZE must not be less than LF_ARENA_INITIAL_BLOCK_SIZE"
+#endif
+
+/* Allocations are rounded up to keep the next one aligned. Empty ones take
+ * a unit too, so that no two allocations share an address. */
+#define lf_arena_align(size) \
+	((size) == 0 ? _Alignof(max_align_t) : \
+	 ((size) + _Alignof(max_align_t) - 1) / _Alignof(max_align_t) * \
+	 _Alignof(max_align_t))
+
+
+lfi_fdecl(void *, libc_alloc)(void *ctx, size_t size)
+{
+	(void) ctx;
+
+	return malloc(size);
+}
+
+lfi_fdecl(void *, libc_realloc)(void *ctx,
+				void *ptr,
+				size_t old_size,
+				size_t size)
+{
+	(void) ctx;
+	(void) old_size;
+
+	return realloc(ptr, size);
+}
+
+lfi_fdecl(void, libc_free)(void *ctx, void *ptr, size_t size)
+{
+	(void) ctx;
+	(void) size;
+
+	free(ptr);
+}
+
+const struct lf(allocator) lf(allocator_libc) = {
+	.alloc = lfi(libc_alloc),
+	.realloc = lfi(libc_realloc),
+	.free = lfi(libc_free),
+	.ctx = NULL,
+};
+
+
+/* Starts a new block with room for at least size bytes. The remaining space
+ * of the current block is abandoned. */
+lfi_fdecl(int, arena_grow)(struct lf(arena) *a, size_t size)
+{
+	size_t block_size = a->block_size > size ? a->block_size : size;
+
+	if (block_size > SIZE_MAX - sizeof(struct lfi(arena_block)))
+		return 1;
+
+	struct lfi(arena_block) *b =
+		malloc(sizeof(struct lfi(arena_block)) + block_size);
+
+	if (b == NULL)
+		return 1;
+
+	b->next = a->blocks;
+	b->size = block_size;
+
+	a->blocks = b;
+	a->top = (char *) b->data;
+	a->end = a->top + block_size;
+	a->last = NULL;
+
+	if (a->block_size < LF_ARENA_MAX_BLOCK_SIZE / 2)
+		a->block_size *= 2;
+	else
+		a->block_size = LF_ARENA_MAX_BLOCK_SIZE;
+
+	return 0;
+}
+
+lfi_fdecl(void *, arena_allocator_alloc)(void *ctx, size_t size)
+{
+	return lf(arena_alloc)(ctx, size);
+}
+
+lfi_fdecl(void *, arena_allocator_realloc)(void *ctx,
+					   void *ptr,
+					   size_t old_size,
+					   size_t size)
+{
+	struct lf(arena) *a = ctx;
+
+	if (ptr == a->last && size <= (size_t) (a->end - a->last)) {
+		a->top = a->last + lf_arena_align(size);
+
+		return ptr;
+	} else if (size <= old_size) {
+		return ptr;
+	}
+
+	void *new_ptr = lf(arena_alloc)(a, size);
+
+	if (new_ptr != NULL)
+		memcpy(new_ptr, ptr, old_size);
+
+	return new_ptr;
+}
+
+lfi_fdecl(void, arena_allocator_free)(void *ctx, void *ptr, size_t size)
+{
+	struct lf(arena) *a = ctx;
+
+	(void) size;
+
+	if (ptr == a->last) {
+		a->top = a->last;
+		a->last = NULL;
+	}
+}
+
+
+int lf(arena_init)(struct lf(arena) *a)
+{
+	a->blocks = NULL;
+	a->block_size = LF_ARENA_INITIAL_BLOCK_SIZE;
+
+	return lfi(arena_grow)(a, 0);
+}
+
+void lf(arena_xinit)(struct lf(arena) *a)
+{
+	lf_unwrap(lf(arena_init)(a));
+}
+
+void lf(arena_destroy)(struct lf(arena) *a)
+{
+	struct lfi(arena_block) *b = a->blocks;
+
+	while (b != NULL) {
+		struct lfi(arena_block) *next = b->next;
+
+		free(b);
+		b = next;
+	}
+}
+
+void lf(arena_reset)(struct lf(arena) *a)
+{
+	struct lfi(arena_block) *b = a->blocks->next;
+
+	while (b != NULL) {
+		struct lfi(arena_block) *next = b->next;
+
+		free(b);
+		b = next;
+	}
+
+	a->blocks->next = NULL;
+	a->top = (char *) a->blocks->data;
+	a->end = a->top + a->blocks->size;
+	a->last = NULL;
+}
+
+void *lf(arena_alloc)(struct lf(arena) *a, size_t size)
+{
+	if (size > SIZE_MAX - _Alignof(max_align_t))
+		return NULL;
+
+	size = lf_arena_align(size);
+
+	if (size > (size_t) (a->end - a->top) && lfi(arena_grow)(a, size))
+		return NULL;
+
+	a->last = a->top;
+	a->top += size;
+
+	return a->last;
+}
+
+void *lf(arena_xalloc)(struct lf(arena) *a, size_t size)
+{
+	void *alloc_res = lf(arena_alloc)(a, size);
+
+	lf_assert(alloc_res != NULL, "alloc returned NULL");
+
+	return alloc_res;
+}
+
+struct lf(allocator) lf(arena_allocator)(struct lf(arena) *a)
+{
+	return (struct lf(allocator)) {
+		.alloc = lfi(arena_allocator_alloc),
+		.realloc = lfi(arena_allocator_realloc),
+		.free = lfi(arena_allocator_free),
+		.ctx = a,
+	};
+}
@@ -0,0 +1,907 @@
+#ifndef LF_HEADERONLY
+#include "util.h"
+#include "../include/btree.h"
+#include "../include/config.h"
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#if (LF_BTREE_DEGREE) < 2 || (LF_BTREE_DEGREE) > 128
+#error "LF_BTREE_DEGREE must be between 2 and 128"
+#endif
+
+/* Minimum degree, nodes other than the root hold T - 1 to MAX_KEYS keys. */
+#define LF_BTREE_T LF_BTREE_DEGREE
+#define LF_BTREE_MAX_KEYS (2 * LF_BTREE_DEGREE - 1)
+
+#define lf_btree_align(i) \
+	(((i) + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t))
+
+/* Values are aligned to sizeof(size_t)-byte boundary in the nodes. */
+#define lf_btree_stride(t) lf_btree_align((t)->value_size)
+
+#define lf_btree_values(n) \
+	((char *) (n) + lf_btree_align(sizeof(struct lfi(btree_node))))
+
+#define lf_btree_value_at(t, n, i) \
+	(lf_btree_values(n) + (i) * lf_btree_stride(t))
+
+#define lf_btree_children(t, n) \
+	((struct lfi(btree_node) **) lf_btree_value_at(t, n, LF_BTREE_MAX_KEYS))
+
+#define lf_btree_counts(t, n) \
+	((size_t *) &lf_btree_children(t, n)[LF_BTREE_MAX_KEYS + 1])
+
+#define lf_btree_node_alloc_size(t, leaf) \
+	(lf_btree_align(sizeof(struct lfi(btree_node))) + \
+	 LF_BTREE_MAX_KEYS * lf_btree_stride(t) + \
+	 ((leaf) ? 0 : (LF_BTREE_MAX_KEYS + 1) * \
+		       (sizeof(struct lfi(btree_node) *) + sizeof(size_t))))
+
+#define lf_btree_key_is_inline(keylen) \
+	((keylen) <= LF_HASHMAP_INLINE_KEY_SIZE)
+
+#define lf_btree_key_ptr(k) \
+	(lf_btree_key_is_inline((k)->keylen) ? \
+	 (const void *) (k)->key.bytes : (k)->key.ptr)
+
+
+/* Compares the key i of the node to the given one, the default comparison is
+ * done inline. */
+inline lfi_fdecl(int, btree_cmp)(const struct lf(btree) *t,
+				 const struct lfi(btree_node) *n,
+				 size_t i,
+				 const void *key,
+				 size_t keylen,
+				 uint64_t prefix)
+{
+	const struct lfi(btree_key) *k = &n->keys[i];
+	const void *k1 = lf_btree_key_ptr(k);
+
+	if (t->cmp != NULL)
+		return t->cmp(k1, key, k->keylen, keylen);
+
+	if (n->prefixes[i] != prefix)
+		return n->prefixes[i] < prefix ? -1 : 1;
+
+	int res = memcmp(k1, key, k->keylen < keylen ? k->keylen : keylen);
+
+	if (res == 0)
+		return (k->keylen > keylen) - (k->keylen < keylen);
+
+	return res;
+}
+
+/* Index of the first key of the node not less than the given key. found is
+ * set to whether the key is equal to it. */
+lfi_fdecl(size_t, btree_search)(const struct lf(btree) *t,
+				const struct lfi(btree_node) *n,
+				const void *key,
+				size_t keylen,
+				uint64_t prefix,
+				bool *found)
+{
+	size_t lo = 0, hi = n->len;
+
+	/* The default ordering counts the smaller prefixes without branches,
+	 * and only compares the keys sharing the prefix. */
+	if (t->cmp == NULL) {
+		for (size_t i = 0; i < n->len; i++)
+			lo += n->prefixes[i] < prefix;
+
+		while (lo < hi && n->prefixes[lo] == prefix) {
+			int cmp = lfi(btree_cmp)(t, n, lo, key, keylen, prefix);
+
+			if (cmp >= 0) {
+				*found = cmp == 0;
+
+				return lo;
+			}
+
+			lo++;
+		}
+
+		*found = false;
+
+		return lo;
+	}
+
+	/* The last key hi is moved to is the one at the returned index. */
+	*found = false;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = lfi(btree_cmp)(t, n, mid, key, keylen, prefix);
+
+		if (cmp < 0) {
+			lo = mid + 1;
+		} else {
+			*found = cmp == 0;
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+lfi_fdecl(struct lfi(btree_node) *, btree_new_node)(struct lf(btree) *t,
+						    bool leaf)
+{
+	struct lfi(btree_node) *n =
+		lf_alloc(&t->allocator, lf_btree_node_alloc_size(t, leaf));
+
+	if (n == NULL)
+		return NULL;
+
+	n->p = NULL;
+	n->len = 0;
+	n->leaf = leaf;
+
+	return n;
+}
+
+lfi_fdecl(void, btree_free_node)(struct lf(btree) *t, struct lfi(btree_node) *n)
+{
+	lfi(free)(&t->allocator, n, lf_btree_node_alloc_size(t, n->leaf));
+}
+
+lfi_fdecl(void, btree_free_key)(struct lf(btree) *t,
+				const struct lfi(btree_key) *k)
+{
+	if (!lf_btree_key_is_inline(k->keylen))
+		lfi(free)(&t->allocator, (void *) k->key.ptr, k->keylen);
+}
+
+/* Number of entries in the subtree rooted at n. */
+lfi_fdecl(size_t, btree_node_size)(const struct lf(btree) *t,
+				   struct lfi(btree_node) *n)
+{
+	size_t size = n->len;
+
+	if (!n->leaf) {
+		for (size_t i = 0; i <= n->len; i++)
+			size += lf_btree_counts(t, n)[i];
+	}
+
+	return size;
+}
+
+/* Index of the child in its parent. */
+lfi_fdecl(size_t, btree_child_index)(const struct lf(btree) *t,
+				     struct lfi(btree_node) *n)
+{
+	struct lfi(btree_node) **children = lf_btree_children(t, n->p);
+	size_t i = 0;
+
+	while (children[i] != n)
+		i++;
+
+	return i;
+}
+
+/* Moves the entries [from, from + count) of src to dst at index to. The
+ * ranges may overlap. */
+lfi_fdecl(void, btree_move_entries)(struct lf(btree) *t,
+				    struct lfi(btree_node) *dst,
+				    size_t to,
+				    struct lfi(btree_node) *src,
+				    size_t from,
+				    size_t count)
+{
+	memmove(&dst->prefixes[to], &src->prefixes[from],
+		count * sizeof(uint64_t));
+	memmove(&dst->keys[to], &src->keys[from],
+		count * sizeof(struct lfi(btree_key)));
+	memmove(lf_btree_value_at(t, dst, to), lf_btree_value_at(t, src, from),
+		count * lf_btree_stride(t));
+}
+
+/* Moves the children [from, from + count) of src, and their subtree sizes, to
+ * dst at index to. */
+lfi_fdecl(void, btree_move_children)(struct lf(btree) *t,
+				     struct lfi(btree_node) *dst,
+				     size_t to,
+				     struct lfi(btree_node) *src,
+				     size_t from,
+				     size_t count)
+{
+	struct lfi(btree_node) **children = lf_btree_children(t, dst);
+
+	memmove(&children[to], &lf_btree_children(t, src)[from],
+		count * sizeof(*children));
+	memmove(&lf_btree_counts(t, dst)[to], &lf_btree_counts(t, src)[from],
+		count * sizeof(size_t));
+
+	if (dst != src) {
+		for (size_t i = to; i < to + count; i++)
+			children[i]->p = dst;
+	}
+}
+
+/* Splits the full child i of x, moving its median key up into x. */
+lfi_fdecl(int, btree_split_child)(struct lf(btree) *t,
+				  struct lfi(btree_node) *x,
+				  size_t i)
+{
+	struct lfi(btree_node) *y = lf_btree_children(t, x)[i];
+	struct lfi(btree_node) *z = lfi(btree_new_node)(t, y->leaf);
+
+	if (z == NULL)
+		return 1;
+
+	z->p = x;
+	z->len = LF_BTREE_T - 1;
+	lfi(btree_move_entries)(t, z, 0, y, LF_BTREE_T, LF_BTREE_T - 1);
+
+	if (!y->leaf)
+		lfi(btree_move_children)(t, z, 0, y, LF_BTREE_T, LF_BTREE_T);
+
+	y->len = LF_BTREE_T - 1;
+
+	lfi(btree_move_children)(t, x, i + 2, x, i + 1, x->len - i);
+	lfi(btree_move_entries)(t, x, i + 1, x, i, x->len - i);
+	lfi(btree_move_entries)(t, x, i, y, LF_BTREE_T - 1, 1);
+	x->len++;
+
+	lf_btree_children(t, x)[i + 1] = z;
+	lf_btree_counts(t, x)[i] = lfi(btree_node_size)(t, y);
+	lf_btree_counts(t, x)[i + 1] = lfi(btree_node_size)(t, z);
+
+	return 0;
+}
+
+/* Merges the child i + 1 of x and the key i into the child i. */
+lfi_fdecl(void, btree_merge)(struct lf(btree) *t,
+			     struct lfi(btree_node) *x,
+			     size_t i)
+{
+	struct lfi(btree_node) *y = lf_btree_children(t, x)[i];
+	struct lfi(btree_node) *z = lf_btree_children(t, x)[i + 1];
+	size_t *counts = lf_btree_counts(t, x);
+
+	lfi(btree_move_entries)(t, y, y->len, x, i, 1);
+	lfi(btree_move_entries)(t, y, y->len + 1, z, 0, z->len);
+
+	if (!y->leaf)
+		lfi(btree_move_children)(t, y, y->len + 1, z, 0, z->len + 1);
+
+	y->len += z->len + 1;
+	counts[i] += counts[i + 1] + 1;
+
+	lfi(btree_move_entries)(t, x, i, x, i + 1, x->len - i - 1);
+	lfi(btree_move_children)(t, x, i + 1, x, i + 2, x->len - i - 1);
+	x->len--;
+
+	lfi(btree_free_node)(t, z);
+}
+
+/* Moves the last key of the child i - 1 of x up, and the key i - 1 of x down
+ * to the child i. */
+lfi_fdecl(void, btree_rotate_right)(struct lf(btree) *t,
+				    struct lfi(btree_node) *x,
+				    size_t i)
+{
+	struct lfi(btree_node) *left = lf_btree_children(t, x)[i - 1];
+	struct lfi(btree_node) *c = lf_btree_children(t, x)[i];
+	size_t moved = 1;
+
+	lfi(btree_move_entries)(t, c, 1, c, 0, c->len);
+	lfi(btree_move_entries)(t, c, 0, x, i - 1, 1);
+
+	if (!c->leaf) {
+		lfi(btree_move_children)(t, c, 1, c, 0, c->len + 1);
+		lfi(btree_move_children)(t, c, 0, left, left->len, 1);
+		moved += lf_btree_counts(t, c)[0];
+	}
+
+	lfi(btree_move_entries)(t, x, i - 1, left, left->len - 1, 1);
+	left->len--;
+	c->len++;
+
+	lf_btree_counts(t, x)[i - 1] -= moved;
+	lf_btree_counts(t, x)[i] += moved;
+}
+
+/* Moves the first key of the child i + 1 of x up, and the key i of x down to
+ * the child i. */
+lfi_fdecl(void, btree_rotate_left)(struct lf(btree) *t,
+				   struct lfi(btree_node) *x,
+				   size_t i)
+{
+	struct lfi(btree_node) *c = lf_btree_children(t, x)[i];
+	struct lfi(btree_node) *right = lf_btree_children(t, x)[i + 1];
+	size_t moved = 1;
+
+	lfi(btree_move_entries)(t, c, c->len, x, i, 1);
+	lfi(btree_move_entries)(t, x, i, right, 0, 1);
+	lfi(btree_move_entries)(t, right, 0, right, 1, right->len - 1);
+
+	if (!c->leaf) {
+		lfi(btree_move_children)(t, c, c->len + 1, right, 0, 1);
+		lfi(btree_move_children)(t, right, 0, right, 1, right->len);
+		moved += lf_btree_counts(t, c)[c->len + 1];
+	}
+
+	right->len--;
+	c->len++;
+
+	lf_btree_counts(t, x)[i] += moved;
+	lf_btree_counts(t, x)[i + 1] -= moved;
+}
+
+/* Removes the key from the subtree rooted at x, which must contain it. The
+ * key and the value are moved to out and out_value. x holds at least T keys,
+ * unless it is the root. */
+lfi_fdecl(void, btree_delete)(struct lf(btree) *t,
+			      struct lfi(btree_node) *x,
+			      const void *key,
+			      size_t keylen,
+			      struct lfi(btree_key) *out,
+			      uint64_t *out_prefix,
+			      void *out_value)
+{
+	uint64_t prefix = lfi(key_prefix)(key, keylen);
+
+	for (;;) {
+		bool found;
+		size_t i = lfi(btree_search)(t, x, key, keylen, prefix,
+					     &found);
+
+		if (found && x->leaf) {
+			*out = x->keys[i];
+			*out_prefix = x->prefixes[i];
+			memcpy(out_value, lf_btree_value_at(t, x, i),
+			       t->value_size);
+			lfi(btree_move_entries)(t, x, i, x, i + 1,
+						x->len - i - 1);
+			x->len--;
+
+			return;
+		}
+
+		struct lfi(btree_node) **children = lf_btree_children(t, x);
+		size_t *counts = lf_btree_counts(t, x);
+
+		if (found) {
+			struct lfi(btree_node) *y = children[i];
+			struct lfi(btree_node) *z = children[i + 1];
+			struct lfi(btree_key) k;
+
+			if (y->len < LF_BTREE_T && z->len < LF_BTREE_T) {
+				/* The key moves down into the merged child. */
+				lfi(btree_merge)(t, x, i);
+				counts[i]--;
+				x = y;
+
+				continue;
+			}
+
+			*out = x->keys[i];
+			*out_prefix = x->prefixes[i];
+			memcpy(out_value, lf_btree_value_at(t, x, i),
+			       t->value_size);
+
+			/* The key is replaced by its predecessor or
+			 * successor, taken from the child that can lose a
+			 * key. */
+			struct lfi(btree_node) *c, *n;
+
+			if (y->len >= LF_BTREE_T) {
+				c = n = y;
+
+				while (!n->leaf)
+					n = lf_btree_children(t, n)[n->len];
+
+				k = n->keys[n->len - 1];
+				counts[i]--;
+			} else {
+				c = n = z;
+
+				while (!n->leaf)
+					n = lf_btree_children(t, n)[0];
+
+				k = n->keys[0];
+				counts[i + 1]--;
+			}
+
+			lfi(btree_delete)(t, c, lf_btree_key_ptr(&k), k.keylen,
+					  &x->keys[i], &x->prefixes[i],
+					  lf_btree_value_at(t, x, i));
+
+			return;
+		}
+
+		/* The child is filled up before descending, so that it
+		 * can lose a key. */
+		if (children[i]->len < LF_BTREE_T) {
+			if (i > 0 && children[i - 1]->len >= LF_BTREE_T) {
+				lfi(btree_rotate_right)(t, x, i);
+			} else if (i < x->len &&
+				   children[i + 1]->len >= LF_BTREE_T) {
+				lfi(btree_rotate_left)(t, x, i);
+			} else {
+				if (i == x->len)
+					i--;
+
+				lfi(btree_merge)(t, x, i);
+			}
+		}
+
+		counts[i]--;
+		x = children[i];
+	}
+}
+
+/* Removes the counts added on the path from the root down to n. */
+lfi_fdecl(void, btree_uncount)(struct lf(btree) *t, struct lfi(btree_node) *n)
+{
+	for (; n->p != NULL; n = n->p)
+		lf_btree_counts(t, n->p)[lfi(btree_child_index)(t, n)]--;
+}
+
+lfi_fdecl(struct lfi(btree_node) *, btree_get2_node)(const struct lf(btree) *t,
+						     const void *key,
+						     size_t keylen,
+						     size_t *i)
+{
+	struct lfi(btree_node) *n = t->root;
+	uint64_t prefix = lfi(key_prefix)(key, keylen);
+
+	while (n != NULL) {
+		bool found;
+
+		*i = lfi(btree_search)(t, n, key, keylen, prefix, &found);
+
+		if (found)
+			return n;
+
+		n = n->leaf ? NULL : lf_btree_children(t, n)[*i];
+	}
+
+	return NULL;
+}
+
+lfi_fdecl(struct lfi(btree_node) *, btree_select_node)(struct lf(btree) *t,
+						       ptrdiff_t i_,
+						       size_t *i)
+{
+	size_t rank = lfi(circular_index)(i_, t->size);
+	struct lfi(btree_node) *n = t->root;
+
+	while (!n->leaf) {
+		size_t *counts = lf_btree_counts(t, n);
+		size_t j = 0;
+
+		while (rank > counts[j]) {
+			rank -= counts[j] + 1;
+			j++;
+		}
+
+		if (rank == counts[j]) {
+			*i = j;
+
+			return n;
+		}
+
+		n = lf_btree_children(t, n)[j];
+	}
+
+	*i = rank;
+
+	return n;
+}
+
+/* Moves the position to the in-order successor, n is NULL past the last
+ * entry. */
+lfi_fdecl(void, btree_successor)(struct lf(btree) *t,
+				 struct lfi(btree_node) **n,
+				 size_t *i)
+{
+	struct lfi(btree_node) *x = *n;
+
+	if (!x->leaf) {
+		x = lf_btree_children(t, x)[*i + 1];
+
+		while (!x->leaf)
+			x = lf_btree_children(t, x)[0];
+
+		*n = x;
+		*i = 0;
+	} else if (*i + 1 < x->len) {
+		(*i)++;
+	} else {
+		while (x->p != NULL) {
+			size_t j = lfi(btree_child_index)(t, x);
+
+			x = x->p;
+
+			if (j < x->len) {
+				*n = x;
+				*i = j;
+
+				return;
+			}
+		}
+
+		*n = NULL;
+	}
+}
+
+/* Moves the position to the in-order predecessor, n is NULL before the first
+ * entry. */
+lfi_fdecl(void, btree_predecessor)(struct lf(btree) *t,
+				   struct lfi(btree_node) **n,
+				   size_t *i)
+{
+	struct lfi(btree_node) *x = *n;
+
+	if (!x->leaf) {
+		x = lf_btree_children(t, x)[*i];
+
+		while (!x->leaf)
+			x = lf_btree_children(t, x)[x->len];
+
+		*n = x;
+		*i = x->len - 1;
+	} else if (*i > 0) {
+		(*i)--;
+	} else {
+		while (x->p != NULL) {
+			size_t j = lfi(btree_child_index)(t, x);
+
+			x = x->p;
+
+			if (j > 0) {
+				*n = x;
+				*i = j - 1;
+
+				return;
+			}
+		}
+
+		*n = NULL;
+	}
+}
+
+lfi_fdecl(struct lf(entry), btree_entry_of)(struct lf(btree) *t,
+					    struct lfi(btree_node) *n,
+					    size_t i)
+{
+	if (n == NULL)
+		return lfi_sentinel_entry;
+
+	return (struct lf(entry)) {
+		.key = lf_btree_key_ptr(&n->keys[i]),
+		.keylen = n->keys[i].keylen,
+		.value = lf_btree_value_at(t, n, i),
+	};
+}
+
+lfi_fdecl(void, btree_destroy_recursive)(struct lf(btree) *t,
+					 struct lfi(btree_node) *n)
+{
+	if (!n->leaf) {
+		for (size_t i = 0; i <= n->len; i++)
+			lfi(btree_destroy_recursive)(t,
+						     lf_btree_children(t, n)[i]);
+	}
+
+	for (size_t i = 0; i < n->len; i++)
+		lfi(btree_free_key)(t, &n->keys[i]);
+
+	lfi(btree_free_node)(t, n);
+}
+
+
+int lf(btree_init)(struct lf(btree) *t,
+		   size_t value_size,
+		   int (*cmp)(const void *, const void *, size_t, size_t))
+{
+	return lf(btree_init_with)(t, value_size, cmp, NULL);
+}
+
+void lf(btree_xinit)(struct lf(btree) *t,
+		     size_t value_size,
+		     int (*cmp)(const void *, const void *, size_t, size_t))
+{
+	lf_unwrap(lf(btree_init)(t, value_size, cmp));
+}
+
+int lf(btree_init_with)(struct lf(btree) *t,
+			size_t value_size,
+			int (*cmp)(const void *, const void *, size_t, size_t),
+			const struct lf(allocator) *allocator)
+{
+	t->allocator = allocator == NULL ? lf(allocator_libc) : *allocator;
+	t->root = NULL;
+	t->size = 0;
+	t->value_size = value_size;
+	t->cmp = cmp;
+
+	if (t->value_size)
+		t->hold_value = lf_alloc(&t->allocator, value_size);
+	else
+		t->hold_value = (void *) 1;
+
+	return t->hold_value == NULL ? 1 : 0;
+}
+
+void lf(btree_xinit_with)(struct lf(btree) *t,
+			  size_t value_size,
+			  int (*cmp)(const void *, const void *, size_t, size_t),
+			  const struct lf(allocator) *allocator)
+{
+	lf_unwrap(lf(btree_init_with)(t, value_size, cmp, allocator));
+}
+
+void lf(btree_destroy)(struct lf(btree) *t)
+{
+	if (t->root != NULL)
+		lfi(btree_destroy_recursive)(t, t->root);
+
+	if (t->value_size)
+		lfi(free)(&t->allocator, t->hold_value, t->value_size);
+}
+
+void *lf(btree_get)(struct lf(btree) *t, const void *key)
+{
+	return lf(btree_get2)(t, key, strlen(key));
+}
+
+void *lf(btree_get2)(struct lf(btree) *t, const void *key, size_t keylen)
+{
+	size_t i;
+	struct lfi(btree_node) *n = lfi(btree_get2_node)(t, key, keylen, &i);
+
+	return n != NULL ? lf_btree_value_at(t, n, i) : NULL;
+}
+
+void *lf(btree_insert)(struct lf(btree) *t, const void *key, const void *value)
+{
+	return lf(btree_insert2)(t, key, strlen(key), value);
+}
+
+void *lf(btree_xinsert)(struct lf(btree) *t,
+			const void *key,
+			const void *value)
+{
+	void *insert_res = lf(btree_insert)(t, key, value);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+void *lf(btree_insert2)(struct lf(btree) *t,
+			const void *key,
+			size_t keylen,
+			const void *value)
+{
+	struct lfi(btree_key) k = { .keylen = keylen };
+	uint64_t prefix = lfi(key_prefix)(key, keylen);
+
+	lf_debug_assert(lf(btree_get2)(t, key, keylen) == NULL,
+			"btree contains the element");
+
+	if (lf_btree_key_is_inline(keylen)) {
+		memcpy(k.key.bytes, key, keylen);
+	} else {
+		void *new_key = lf_alloc(&t->allocator, keylen);
+
+		if (new_key == NULL)
+			return NULL;
+
+		memcpy(new_key, key, keylen);
+		k.key.ptr = new_key;
+	}
+
+	if (t->root == NULL) {
+		t->root = lfi(btree_new_node)(t, true);
+
+		if (t->root == NULL)
+			goto fail;
+	} else if (t->root->len == LF_BTREE_MAX_KEYS) {
+		struct lfi(btree_node) *s = lfi(btree_new_node)(t, false);
+
+		if (s == NULL)
+			goto fail;
+
+		lf_btree_children(t, s)[0] = t->root;
+		lf_btree_counts(t, s)[0] = t->size;
+		t->root->p = s;
+
+		if (lfi(btree_split_child)(t, s, 0)) {
+			t->root->p = NULL;
+			lfi(btree_free_node)(t, s);
+
+			goto fail;
+		}
+
+		t->root = s;
+	}
+
+	/* Full nodes are split on the way down, so that the leaf has room for
+	 * the key. */
+	struct lfi(btree_node) *n = t->root;
+	bool found;
+	size_t i;
+
+	while (!n->leaf) {
+		i = lfi(btree_search)(t, n, key, keylen, prefix, &found);
+
+		struct lfi(btree_node) *c = lf_btree_children(t, n)[i];
+
+		if (c->len == LF_BTREE_MAX_KEYS) {
+			if (lfi(btree_split_child)(t, n, i)) {
+				lfi(btree_uncount)(t, n);
+
+				goto fail;
+			}
+
+			if (lfi(btree_cmp)(t, n, i, key, keylen, prefix) < 0)
+				i++;
+		}
+
+		lf_btree_counts(t, n)[i]++;
+		n = lf_btree_children(t, n)[i];
+	}
+
+	i = lfi(btree_search)(t, n, key, keylen, prefix, &found);
+
+	lfi(btree_move_entries)(t, n, i + 1, n, i, n->len - i);
+	n->prefixes[i] = prefix;
+	n->keys[i] = k;
+	n->len++;
+	t->size++;
+
+	void *v = lf_btree_value_at(t, n, i);
+
+	if (t->value_size && value != NULL)
+		memcpy(v, value, t->value_size);
+
+	return v;
+
+fail:
+	lfi(btree_free_key)(t, &k);
+
+	return NULL;
+}
+
+void *lf(btree_xinsert2)(struct lf(btree) *t,
+			 const void *key,
+			 size_t keylen,
+			 const void *value)
+{
+	void *insert_res = lf(btree_insert2)(t, key, keylen, value);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+const void *lf(btree_remove)(struct lf(btree) *t, const void *key)
+{
+	return lf(btree_remove2)(t, key, strlen(key));
+}
+
+const void *lf(btree_remove2)(struct lf(btree) *t,
+			      const void *key,
+			      size_t keylen)
+{
+	size_t i;
+	struct lfi(btree_key) k;
+	uint64_t prefix;
+
+	if (lfi(btree_get2_node)(t, key, keylen, &i) == NULL)
+		return NULL;
+
+	lfi(btree_delete)(t, t->root, key, keylen, &k, &prefix,
+			  t->hold_value);
+	lfi(btree_free_key)(t, &k);
+	t->size--;
+
+	struct lfi(btree_node) *root = t->root;
+
+	if (root->len == 0) {
+		t->root = root->leaf ? NULL : lf_btree_children(t, root)[0];
+
+		if (t->root != NULL)
+			t->root->p = NULL;
+
+		lfi(btree_free_node)(t, root);
+	}
+
+	return t->hold_value;
+}
+
+struct lf(entry) lf(btree_select)(struct lf(btree) *t, ptrdiff_t index)
+{
+	size_t i;
+	struct lfi(btree_node) *n = lfi(btree_select_node)(t, index, &i);
+
+	return lfi(btree_entry_of)(t, n, i);
+}
+
+size_t lf(btree_rank)(const struct lf(btree) *t, const void *key)
+{
+	return lf(btree_rank2)(t, key, strlen(key));
+}
+
+size_t lf(btree_rank2)(const struct lf(btree) *t,
+		       const void *key,
+		       size_t keylen)
+{
+	struct lfi(btree_node) *n = t->root;
+	uint64_t prefix = lfi(key_prefix)(key, keylen);
+	size_t rank = 0;
+
+	while (n != NULL) {
+		bool found;
+		size_t i = lfi(btree_search)(t, n, key, keylen, prefix,
+					     &found);
+
+		rank += i;
+
+		if (!n->leaf) {
+			size_t *counts = lf_btree_counts(t, n);
+
+			for (size_t j = 0; j < i; j++)
+				rank += counts[j];
+
+			if (found)
+				return rank + counts[i];
+
+			n = lf_btree_children(t, n)[i];
+		} else {
+			return found ? rank : (size_t) -1;
+		}
+	}
+
+	return -1;
+}
+
+size_t lf(btree_size)(const struct lf(btree) *t)
+{
+	return t->size;
+}
+
+void lf(btree_iter)(struct lf(btree) *t, struct lf(btree_it) *it)
+{
+	it->t = t;
+	it->n = NULL;
+
+	if (t->size)
+		it->n = lfi(btree_select_node)(t, 0, &it->i);
+}
+
+void lf(btree_iter_from)(struct lf(btree) *t,
+			 struct lf(btree_it) *it,
+			 ptrdiff_t index)
+{
+	it->t = t;
+	it->n = lfi(btree_select_node)(t, index, &it->i);
+}
+
+struct lf(entry) lf(btree_iter_next)(struct lf(btree_it) *it)
+{
+	struct lf(entry) e = lfi(btree_entry_of)(it->t, it->n, it->i);
+
+	if (it->n != NULL)
+		lfi(btree_successor)(it->t, &it->n, &it->i);
+
+	return e;
+}
+
+struct lf(entry) lf(btree_iter_prev)(struct lf(btree_it) *it)
+{
+	struct lf(entry) e = lfi(btree_entry_of)(it->t, it->n, it->i);
+
+	if (it->n != NULL)
+		lfi(btree_predecessor)(it->t, &it->n, &it->i);
+
+	return e;
+}
@@ -0,0 +1,408 @@
+#ifndef LF_HEADERONLY
+#include "util.h"
+#include "../include/config.h"
+#include "../include/dict.h"
+#include "../include/hashmap.h"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* Index slots hold the position of an entry plus one, zero is empty. Slots of
+ * the removed entries are kept as tombstones until the index is rebuilt. */
+#define LF_DICT_INDEX_EMPTY 0
+
+/* Returned by dict_find() if the key is not found. */
+#define LF_DICT_NO_ENTRY SIZE_MAX
+
+#if LF_DICT_INITIAL_CAP < 8 || \
+	(LF_DICT_INITIAL_CAP & (LF_DICT_INITIAL_CAP - 1)) != 0
+#error "LF_DICT_INITIAL_CAP must be a power of two, not less than 8"
+#endif
+
+/* Number of entries a dict can hold with the given number of index slots.
+ * Removed entries also count until the entries are compacted. */
+#define lf_dict_usable(cap) ((cap) / 4 * 3)
+
+/* Width of an index slot in bytes, wide enough for lf_dict_usable(cap). */
+#define lf_dict_index_width(cap) \
+	((cap) <= UINT8_MAX + 1 ? 1 : (cap) <= UINT16_MAX + 1 ? 2 : \
+	 (cap) <= UINT32_MAX ? 4 : 8)
+
+/* Values are aligned to sizeof(size_t)-byte boundary in the entries. */
+#define lf_dict_stride(d) \
+	(sizeof(struct lfi(dict_entry)) + \
+	 ((d)->value_size + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t))
+
+#define lf_dict_entry_at(entries, i) \
+	((struct lfi(dict_entry) *) &((char *) entries)[(i) * lf_dict_stride(d)])
+
+#define lf_dict_entry_is_removed(e) ((e)->keylen == SIZE_MAX)
+
+#define lf_dict_key_is_inline(keylen) \
+	((keylen) <= LF_HASHMAP_INLINE_KEY_SIZE)
+
+#define lf_dict_entry_key(e) \
+	(lf_dict_key_is_inline((e)->keylen) ? \
+	 (const void *) (e)->key.bytes : (e)->key.ptr)
+
+
+/* Get the position of a key in the entries, or LF_DICT_NO_ENTRY. If the last
+ * argument is not NULL, the empty index slot ending the probe sequence is
+ * stored in it. */
+lfi_fdecl(size_t, dict_find)(struct lf(dict) *,
+			     uint64_t,
+			     const void *, size_t,
+			     size_t *);
+
+/* Rebuilds the index table from the entries. */
+lfi_fdecl(void, dict_reindex)(struct lf(dict) *);
+
+/* Moves the entries to the front of the array in place, dropping the removed
+ * ones, and rebuilds the index table. */
+lfi_fdecl(void, dict_compact)(struct lf(dict) *);
+
+/* Moves the entries to a new block with the given number of index slots,
+ * dropping the removed ones. */
+lfi_fdecl(int, dict_resize)(struct lf(dict) *, size_t);
+
+
+inline lfi_fdecl(size_t, dict_index_get)(struct lf(dict) *d, size_t i)
+{
+	switch (lf_dict_index_width(d->cap)) {
+	case 1:
+		return ((uint8_t *) d->index)[i];
+	case 2:
+		return ((uint16_t *) d->index)[i];
+	case 4:
+		return ((uint32_t *) d->index)[i];
+	default:
+		return ((uint64_t *) d->index)[i];
+	}
+}
+
+inline lfi_fdecl(void, dict_index_set)(struct lf(dict) *d,
+				       size_t i,
+				       size_t ix)
+{
+	switch (lf_dict_index_width(d->cap)) {
+	case 1:
+		((uint8_t *) d->index)[i] = ix;
+		break;
+	case 2:
+		((uint16_t *) d->index)[i] = ix;
+		break;
+	case 4:
+		((uint32_t *) d->index)[i] = ix;
+		break;
+	default:
+		((uint64_t *) d->index)[i] = ix;
+	}
+}
+
+/* Allocates the index table and the entries in a single block. One more entry
+ * than usable is allocated, used as a scratch entry. */
+lfi_fdecl(int, dict_alloc)(struct lf(dict) *d, size_t cap)
+{
+	/* The index table of at least 8 slots keeps the entries aligned. */
+	size_t index_size = cap * lf_dict_index_width(cap);
+	char *block = malloc(index_size +
+			     (lf_dict_usable(cap) + 1) * lf_dict_stride(d));
+
+	if (block == NULL)
+		return 1;
+
+	memset(block, LF_DICT_INDEX_EMPTY, index_size);
+
+	d->index = block;
+	d->entries = (struct lfi(dict_entry) *) &block[index_size];
+	d->cap = cap;
+
+	return 0;
+}
+
+int lf(dict_init)(struct lf(dict) *d,
+		  size_t value_size,
+		  uint64_t (*hash)(const void *, size_t))
+{
+	d->len = 0;
+	d->used = 0;
+	d->value_size = value_size;
+	d->hash = hash == NULL ? lf(hashmap_default_hash) : hash;
+
+	return lfi(dict_alloc)(d, LF_DICT_INITIAL_CAP);
+}
+
+void lf(dict_destroy)(struct lf(dict) *d)
+{
+	for (size_t i = 0; i < d->len; i++) {
+		struct lfi(dict_entry) *e = lf_dict_entry_at(d->entries, i);
+
+		if (!lf_dict_entry_is_removed(e) &&
+		    !lf_dict_key_is_inline(e->keylen))
+			free((void *) e->key.ptr);
+	}
+
+	free(d->index);
+}
+
+void *lf(dict_get)(struct lf(dict) *d, const void *key)
+{
+	return lf(dict_get2)(d, key, strlen(key));
+}
+
+void *lf(dict_get2)(struct lf(dict) *d, const void *key, size_t keylen)
+{
+	size_t i = lfi(dict_find)(d, d->hash(key, keylen), key, keylen, NULL);
+
+	if (i == LF_DICT_NO_ENTRY)
+		return NULL;
+
+	return lf_dict_entry_at(d->entries, i)->value;
+}
+
+void *lf(dict_insert)(struct lf(dict) *d, const void *key, const void *value)
+{
+	return lf(dict_insert2)(d, key, strlen(key), value);
+}
+
+void *lf(dict_insert2)(struct lf(dict) *d,
+		       const void *key,
+		       size_t keylen,
+		       const void *value)
+{
+	uint64_t hash = d->hash(key, keylen);
+	size_t slot;
+
+	lf_debug_assert(lfi(dict_find)(d, hash, key, keylen, &slot) ==
+			LF_DICT_NO_ENTRY, "dict contains the element");
+
+	void *new_key = NULL;
+
+	if (!lf_dict_key_is_inline(keylen)) {
+		new_key = malloc(keylen);
+
+		if (new_key == NULL)
+			return NULL;
+
+		memcpy(new_key, key, keylen);
+	}
+
+	/* If the removed entries make up the most of the array, they are
+	 * dropped without growing. */
+	if (d->len == lf_dict_usable(d->cap)) {
+		if (d->used * 2 < d->len) {
+			lfi(dict_compact)(d);
+		} else if (lfi(dict_resize)(d, d->cap * 2)) {
+			free(new_key);
+
+			return NULL;
+		}
+	}
+
+	/* Finds the empty slot ending the probe sequence. */
+	size_t mask = d->cap - 1;
+
+	for (slot = hash & mask;
+	     lfi(dict_index_get)(d, slot) != LF_DICT_INDEX_EMPTY;
+	     slot = (slot + 1) & mask)
+		;
+
+	struct lfi(dict_entry) *e = lf_dict_entry_at(d->entries, d->len);
+
+	e->hash = hash;
+	e->keylen = keylen;
+
+	if (new_key != NULL)
+		e->key.ptr = new_key;
+	else
+		memcpy(e->key.bytes, key, keylen);
+
+	if (d->value_size && value != NULL)
+		memcpy(e->value, value, d->value_size);
+
+	lfi(dict_index_set)(d, slot, ++d->len);
+	d->used++;
+
+	return e->value;
+}
+
+const void *lf(dict_remove)(struct lf(dict) *d, const void *key)
+{
+	return lf(dict_remove2)(d, key, strlen(key));
+}
+
+const void *lf(dict_remove2)(struct lf(dict) *d,
+			     const void *key,
+			     size_t keylen)
+{
+	size_t i = lfi(dict_find)(d, d->hash(key, keylen), key, keylen, NULL);
+
+	if (i == LF_DICT_NO_ENTRY)
+		return NULL;
+
+	struct lfi(dict_entry) *e = lf_dict_entry_at(d->entries, i);
+	struct lfi(dict_entry) *hold =
+		lf_dict_entry_at(d->entries, lf_dict_usable(d->cap));
+
+	/* Entry may be overwritten by compaction. */
+	memcpy(hold->value, e->value, d->value_size);
+
+	if (!lf_dict_key_is_inline(e->keylen))
+		free((void *) e->key.ptr);
+
+	e->keylen = SIZE_MAX;
+	d->used--;
+
+	/* Keeps iteration proportional to the number of entries. */
+	if (d->used * 2 < d->len - d->used)
+		lfi(dict_compact)(d);
+
+	return hold->value;
+}
+
+void lf(dict_iter)(struct lf(dict) *d, struct lf(dict_it) *it)
+{
+	it->d = d;
+	it->i = 0;
+}
+
+struct lf(entry) lf(dict_iter_next)(struct lf(dict_it) *it)
+{
+	struct lf(dict) *d = it->d;
+
+	while (it->i < d->len) {
+		struct lfi(dict_entry) *e = lf_dict_entry_at(d->entries, it->i++);
+
+		if (!lf_dict_entry_is_removed(e))
+			return (struct lf(entry)) {
+				.key = lf_dict_entry_key(e),
+				.keylen = e->keylen,
+				.value = e->value
+			};
+	}
+
+	return lfi_sentinel_entry;
+}
+
+void lf(dict_xinit)(struct lf(dict) *d,
+		    size_t value_size,
+		    uint64_t (*hash)(const void *, size_t))
+{
+	lf_unwrap(lf(dict_init)(d, value_size, hash));
+}
+
+void *lf(dict_xinsert)(struct lf(dict) *d, const void *key, const void *value)
+{
+	void *insert_res = lf(dict_insert)(d, key, value);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+void *lf(dict_xinsert2)(struct lf(dict) *d,
+			const void *key,
+			size_t keylen,
+			const void *value)
+{
+	void *insert_res = lf(dict_insert2)(d, key, keylen, value);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+
+lfi_fdecl(size_t, dict_find)(struct lf(dict) *d,
+			     uint64_t hash,
+			     const void *key,
+			     size_t keylen,
+			     size_t *slot)
+{
+	size_t mask = d->cap - 1;
+
+	for (size_t i = hash & mask;; i = (i + 1) & mask) {
+		size_t ix = lfi(dict_index_get)(d, i);
+
+		if (ix == LF_DICT_INDEX_EMPTY) {
+			if (slot != NULL)
+				*slot = i;
+
+			return LF_DICT_NO_ENTRY;
+		}
+
+		struct lfi(dict_entry) *e = lf_dict_entry_at(d->entries, ix - 1);
+
+		/* Removed entries never match, as their keylen is SIZE_MAX. */
+		if (e->hash == hash && e->keylen == keylen &&
+		    memcmp(lf_dict_entry_key(e), key, keylen) == 0)
+			return ix - 1;
+	}
+}
+
+lfi_fdecl(void, dict_reindex)(struct lf(dict) *d)
+{
+	size_t mask = d->cap - 1;
+
+	memset(d->index, LF_DICT_INDEX_EMPTY,
+	       d->cap * lf_dict_index_width(d->cap));
+
+	for (size_t i = 0; i < d->len; i++) {
+		size_t slot = lf_dict_entry_at(d->entries, i)->hash & mask;
+
+		while (lfi(dict_index_get)(d, slot) != LF_DICT_INDEX_EMPTY)
+			slot = (slot + 1) & mask;
+
+		lfi(dict_index_set)(d, slot, i + 1);
+	}
+}
+
+lfi_fdecl(void, dict_compact)(struct lf(dict) *d)
+{
+	size_t len = 0;
+
+	for (size_t i = 0; i < d->len; i++) {
+		struct lfi(dict_entry) *e = lf_dict_entry_at(d->entries, i);
+
+		if (lf_dict_entry_is_removed(e))
+			continue;
+
+		if (i != len)
+			memcpy(lf_dict_entry_at(d->entries, len), e,
+			       lf_dict_stride(d));
+
+		len++;
+	}
+
+	d->len = len;
+
+	lfi(dict_reindex)(d);
+}
+
+lfi_fdecl(int, dict_resize)(struct lf(dict) *d, size_t cap)
+{
+	struct lf(dict) old = *d;
+
+	if (lfi(dict_alloc)(d, cap))
+		return 1;
+
+	d->len = 0;
+
+	for (size_t i = 0; i < old.len; i++) {
+		struct lfi(dict_entry) *e = lf_dict_entry_at(old.entries, i);
+
+		if (!lf_dict_entry_is_removed(e))
+			memcpy(lf_dict_entry_at(d->entries, d->len++), e,
+			       lf_dict_stride(d));
+	}
+
+	lfi(dict_reindex)(d);
+
+	free(old.index);
+
+	return 0;
+}
@@ -1,80 +1,533 @@
 #ifndef LF_HEADERONLY
+/* mmap() for the hashmap snapshots, sched_yield() for the chashmap locks. */
+#define _POSIX_C_SOURCE 200809L
+
 #include "util.h"
 #include "../include/config.h"
 #include "../include/hashmap.h"
+#include "../include/chashmap.h"
+#include "hashmap_ctrl.h"
 #endif
 
+#include <limits.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <stdio.h>
+
+/* Header-only users get the mapping, and the chashmap locks yield the
+ * processor while waiting, only if they enable POSIX. */
+#if defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 200112L
+#define LF_HASHMAP_MMAP
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define lf_chashmap_yield() sched_yield()
+#else
+#define lf_chashmap_yield() ((void) 0)
+#endif
+
+
+/* Bitmask of all the slots of a group, see hashmap_ctrl.h. */
+#define LF_HASHMAP_GROUP_MASK ((uint32_t) 0xffff)
+
+/* Number of keys hashed and prefetched together by hashmap_get_many(). */
+#define LF_HASHMAP_PREFETCH_BATCH 32
+
+/* Returned by hashmap_find() if the key is not found. */
+#define LF_HASHMAP_NO_SLOT SIZE_MAX
+
+#if LF_HASHMAP_INITIAL_CAP < LF_HASHMAP_GROUP_WIDTH || \
+	(LF_HASHMAP_INITIAL_CAP & (LF_HASHMAP_INITIAL_CAP - 1)) != 0
+#error "LF_HASHMAP_INITIAL_CAP must be a power of two, not less than 16"
+#endif
+
+/* Values are aligned to sizeof(size_t)-byte boundary in the entries. */
+#define lf_hashmap_stride(m) \
+	(sizeof(struct lfi(hashmap_entry)) + \
+	 ((m)->value_size + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t))
 
-#define LF_HASHMAP_TOMBSTONE SIZE_MAX
+/* Size of the allocation holding a table of the given capacity. */
+#define lf_hashmap_table_size(m, cap) \
+	((cap) + ((cap) + 1) * lf_hashmap_stride(m))
 
 #define lf_hashmap_entry_at(entries, i) \
 	((struct lfi(hashmap_entry) *) &((char *) entries) \
-	 [i * (sizeof(struct lfi(hashmap_entry)) + m->value_size)])
+	 [(i) * lf_hashmap_stride(m)])
+
+#define lf_hashmap_key_is_inline(keylen) \
+	((keylen) <= LF_HASHMAP_INLINE_KEY_SIZE)
+
+/* NULL if the key of a mapped file lies out of its key section. */
+#define lf_hashmap_entry_key(e) \
+	(lf_hashmap_key_is_inline((e)->keylen) ? \
+	 (const void *) (e)->key.bytes : \
+	 m->keys != NULL ? lfi(hashmap_mapped_key)(m, e) : \
+	 (e)->key.ptr)
+
+/* Counters of the operations, see hashmap_stats(). */
+#ifdef LF_HASHMAP_COUNTERS
+#define lf_hashmap_count(m, counter, n) ((m)->counters.counter += (n))
+
+/* Takes the counts made through a view of the hashmap, such as the old table
+ * during incremental rehashing. */
+#define lf_hashmap_count_merge(m, view) ((m)->counters = (view)->counters)
+#else
+#define lf_hashmap_count(m, counter, n) ((void) 0)
+#define lf_hashmap_count_merge(m, view) ((void) 0)
+#endif
 
+/* Snapshot files start with this magic, followed by an integer telling the
+ * byte order of the writer. */
+#define LF_HASHMAP_FILE_MAGIC "libfun\0hashmap1"
+#define LF_HASHMAP_FILE_BYTE_ORDER UINT64_C(0x0102030405060708)
+
+/* Sections of the snapshot files are aligned to cache lines. */
+#define lf_hashmap_file_align(off) (((off) + 63) / 64 * 64)
+
+/* Header of the snapshot files. */
+struct lfi(hashmap_file_header) {
+	char magic[16];
+	uint64_t byte_order;
+
+	/* Hash of a fixed string, to check the hash function. */
+	uint64_t hash_check;
+
+	uint64_t inline_key_size;
+	uint64_t stride;
+	uint64_t value_size;
+	uint64_t flags;
+	uint64_t cap;
+	uint64_t used;
+
+	uint64_t ctrl_offset;
+	uint64_t entries_offset;
+	uint64_t keys_offset;
+	uint64_t keys_size;
+};
 
-/* https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function */
-lfi_fdecl(uint64_t, hashmap_fnv_hash)(const char *, size_t);
 
-/* Normally, insert copies the key. But for rehashing, this function is
- * used. */
-lfi_fdecl(void *, hashmap_insert2_nocopy)(struct lf(hashmap) *,
-					  const void *,
-					  size_t, const void *);
+/* Linear probe sequence over the control groups. The first group is entered
+ * at the home slot of the hash, and the slots of it preceding the home slot
+ * are visited last, after wrapping around the table. */
+struct lfi(hashmap_probe) {
+	/* First slot of the current group. */
+	size_t base;
 
-/* Rehash the hashmap to a bigger hash bucket. */
+	/* Slots of the current group that are part of the sequence. */
+	uint32_t valid;
+
+	/* Slots of the home group preceding the home slot. */
+	uint32_t wrap;
+
+	size_t visit;
+};
+
+
+/* Inserts a key that is not in the hashmap. */
+lfi_fdecl(void *, hashmap_insert_new)(struct lf(hashmap) *,
+				      uint64_t,
+				      const void *, size_t,
+				      const void *,
+				      size_t);
+
+/* Moves the entries to a bucket with the given capacity, using the hashes
+ * stored in the entries. */
 lfi_fdecl(int, hashmap_rehash)(struct lf(hashmap) *, size_t);
 
-/* Get an entry, key-value pair. */
-lfi_fdecl(struct lfi(hashmap_entry) *, hashmap_get2_entry)(struct lf(hashmap) *,
-							   const void *,
-							   size_t);
+/* Allocates a bucket with the given capacity, and keeps the current one as
+ * the old table, whose entries are migrated by the following insert and remove
+ * operations. */
+lfi_fdecl(int, hashmap_rehash_incremental)(struct lf(hashmap) *, size_t);
+
+/* Get the slot index of a key, or LF_HASHMAP_NO_SLOT. If the last argument
+ * is not NULL, the first free slot seen in the probe sequence is stored in
+ * it. */
+lfi_fdecl(size_t, hashmap_find)(struct lf(hashmap) *,
+				uint64_t,
+				const void *, size_t,
+				size_t *);
+
+/* Claims a slot for a new entry with the given hash, the caller fills the
+ * entry. The last argument is a free slot in the probe sequence of the hash
+ * if already known, or LF_HASHMAP_NO_SLOT. */
+lfi_fdecl(size_t, hashmap_claim)(struct lf(hashmap) *, uint64_t, size_t);
+
+/* Empties the slot of a removed entry. */
+lfi_fdecl(void, hashmap_release)(struct lf(hashmap) *, size_t);
+
+/* Get an entry from the table, or from the old table during incremental
+ * rehashing. */
+lfi_fdecl(struct lfi(hashmap_entry) *, hashmap_get_entry)(struct lf(hashmap) *,
+							  uint64_t,
+							  const void *,
+							  size_t);
+
+/* Moves the entries in the next given number of slots of the old table to
+ * the table, in incremental rehashing. */
+lfi_fdecl(void, hashmap_migrate)(struct lf(hashmap) *, size_t);
+
+/* hashmap_get_or_insert2() and hashmap_remove2() with the hash of the key
+ * already computed. */
+lfi_fdecl(void *, hashmap_get_or_insert_hashed)(struct lf(hashmap) *,
+						uint64_t,
+						const void *, size_t,
+						const void *,
+						bool *);
+
+lfi_fdecl(const void *, hashmap_remove_hashed)(struct lf(hashmap) *,
+					       uint64_t,
+					       const void *, size_t);
+
+
+/* Keys of a mapped file are checked as they are read, rather than when the
+ * file is opened, so that opening does not read the entries. */
+inline lfi_fdecl(const void *, hashmap_mapped_key)(
+	const struct lf(hashmap) *m,
+	const struct lfi(hashmap_entry) *e)
+{
+	if (e->keylen > m->keys_size ||
+	    e->key.offset > m->keys_size - e->keylen)
+		return NULL;
+
+	return &m->keys[e->key.offset];
+}
+
+inline lfi_fdecl(void, hashmap_probe_start)(struct lf(hashmap) *m,
+					    uint64_t hash,
+					    struct lfi(hashmap_probe) *p)
+{
+	size_t home = hash & (m->cap - 1);
+	unsigned offset = home % LF_HASHMAP_GROUP_WIDTH;
+
+	p->base = home - offset;
+	p->valid = (LF_HASHMAP_GROUP_MASK << offset) & LF_HASHMAP_GROUP_MASK;
+	p->wrap = ~p->valid & LF_HASHMAP_GROUP_MASK;
+	p->visit = 0;
+}
+
+/* Advances to the next group, returns false if all slots are visited. */
+inline lfi_fdecl(bool, hashmap_probe_next)(struct lf(hashmap) *m,
+					   struct lfi(hashmap_probe) *p)
+{
+	size_t groups = m->cap / LF_HASHMAP_GROUP_WIDTH;
+
+	if (++p->visit > groups)
+		return false;
+
+	p->base = (p->base + LF_HASHMAP_GROUP_WIDTH) & (m->cap - 1);
+	p->valid = p->visit == groups ? p->wrap : LF_HASHMAP_GROUP_MASK;
+
+	return p->valid != 0;
+}
+
+/* Maximum number of used and deleted slots of a table of the given capacity.
+ * At least one slot is kept empty, so that the probe sequences end. */
+lfi_fdecl(size_t, hashmap_grow_at)(struct lf(hashmap) *m, size_t cap)
+{
+	size_t n = (size_t) ((double) cap * m->max_load);
+
+	return n < cap ? n : cap - 1;
+}
+
+/* Smallest capacity holding n entries, zero if it overflows. */
+lfi_fdecl(size_t, hashmap_cap_for)(struct lf(hashmap) *m, size_t n)
+{
+	size_t cap = LF_HASHMAP_GROUP_WIDTH;
+
+	while (lfi(hashmap_grow_at)(m, cap) < n) {
+		if (cap > SIZE_MAX / 4)
+			return 0;
+
+		cap *= 2;
+	}
+
+	return cap;
+}
+
+/* Allocates the control bytes and the entries of the given capacity in a
+ * single block. One more entry than the capacity is allocated, used as a
+ * scratch entry. */
+lfi_fdecl(int, hashmap_alloc)(struct lf(hashmap) *m, size_t cap)
+{
+	unsigned char *ctrl = lf_alloc(&m->allocator,
+				       lf_hashmap_table_size(m, cap));
+
+	if (ctrl == NULL)
+		return 1;
+
+	memset(ctrl, LF_HASHMAP_CTRL_EMPTY, cap);
+
+	m->ctrl = ctrl;
+	m->entries = (struct lfi(hashmap_entry) *) &ctrl[cap];
+	m->cap = cap;
+	m->deleted = 0;
+	m->grow_at = lfi(hashmap_grow_at)(m, cap);
+
+	return 0;
+}
+
+/* The old table during incremental rehashing, viewed as a hashmap. Entries
+ * are removed from it by marking their slots deleted, as migration walks its
+ * slots in order. */
+inline lfi_fdecl(struct lf(hashmap), hashmap_old)(struct lf(hashmap) *m)
+{
+	struct lf(hashmap) old = *m;
+
+	old.ctrl = m->old_ctrl;
+	old.entries = (struct lfi(hashmap_entry) *) &m->old_ctrl[m->old_cap];
+	old.cap = m->old_cap;
+	old.flags &= ~LF_HASHMAP_ROBIN_HOOD;
+
+	return old;
+}
+
+/* Distance of the entry in slot i from its home slot. */
+inline lfi_fdecl(size_t, hashmap_distance)(struct lf(hashmap) *m, size_t i)
+{
+	return (i - lf_hashmap_entry_at(m->entries, i)->hash) & (m->cap - 1);
+}
+
+lfi_fdecl(void, hashmap_move)(struct lf(hashmap) *m, size_t to, size_t from)
+{
+	m->ctrl[to] = m->ctrl[from];
+	memcpy(lf_hashmap_entry_at(m->entries, to),
+	       lf_hashmap_entry_at(m->entries, from),
+	       lf_hashmap_stride(m));
+}
+
+/* Robin Hood insertion. The new entry takes the first slot whose entry is
+ * closer to its home slot than the new one would be, and the rest of the
+ * cluster is shifted forward by one slot. */
+lfi_fdecl(size_t, hashmap_claim_robin_hood)(struct lf(hashmap) *m,
+					    uint64_t hash)
+{
+	size_t mask = m->cap - 1;
+	size_t i = hash & mask;
+
+	for (size_t dist = 0; lf_hashmap_ctrl_is_full(m->ctrl[i]); dist++) {
+		if (lfi(hashmap_distance)(m, i) < dist)
+			break;
+
+		i = (i + 1) & mask;
+	}
+
+	size_t j = i;
+
+	while (lf_hashmap_ctrl_is_full(m->ctrl[j]))
+		j = (j + 1) & mask;
+
+	for (; j != i; j = (j - 1) & mask)
+		lfi(hashmap_move)(m, j, (j - 1) & mask);
+
+	m->ctrl[i] = lf_hashmap_tag(hash);
+
+	return i;
+}
+
+/* Backward-shift deletion. The entries following the removed one are moved
+ * back by one slot until an empty slot or an entry at its home slot. */
+lfi_fdecl(void, hashmap_release_robin_hood)(struct lf(hashmap) *m, size_t i)
+{
+	size_t mask = m->cap - 1;
+	size_t j = (i + 1) & mask;
+
+	while (lf_hashmap_ctrl_is_full(m->ctrl[j]) &&
+	       lfi(hashmap_distance)(m, j) != 0) {
+		lfi(hashmap_move)(m, i, j);
+
+		i = j;
+		j = (j + 1) & mask;
+	}
+
+	m->ctrl[i] = LF_HASHMAP_CTRL_EMPTY;
+}
+
+
+/* Unaligned native-endian load of a 64-bit word. */
+inline lfi_fdecl(uint64_t, hashmap_load64)(const unsigned char *p)
+{
+	uint64_t w;
+
+	memcpy(&w, p, sizeof(w));
+
+	return w;
+}
+
+/* MurmurHash3 finalizer. */
+inline lfi_fdecl(uint64_t, hashmap_fmix64)(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccd;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53;
+	h ^= h >> 33;
+
+	return h;
+}
+
+
+uint64_t lf(hashmap_default_hash)(const void *key_, size_t keylen)
+{
+	const unsigned char *key = key_;
+	uint64_t hash = 0x9e3779b97f4a7c15 ^ keylen;
+
+	for (; keylen >= 8; key += 8, keylen -= 8) {
+		/* The word multiply is off the dependency chain, only the
+		 * rotation and a multiply are carried between words. */
+		hash ^= lfi(hashmap_load64)(key) * 0xbf58476d1ce4e5b9;
+		hash = ((hash << 31) | (hash >> 33)) * 0x94d049bb133111eb;
+	}
+
+	if (keylen) {
+		uint64_t tail = 0;
+
+		memcpy(&tail, key, keylen);
 
+		hash ^= tail * 0xbf58476d1ce4e5b9;
+		hash = ((hash << 31) | (hash >> 33)) * 0x94d049bb133111eb;
+	}
+
+	return lfi(hashmap_fmix64)(hash);
+}
 
-lfi_fdecl(uint64_t, hashmap_fnv_hash)(const char *key, size_t keylen)
+/* https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function */
+uint64_t lf(hashmap_fnv_hash)(const void *key_, size_t keylen)
 {
+	const unsigned char *key = key_;
 	uint64_t hash = 0xcbf29ce484222325;
 
 	for (size_t i = 0; i < keylen; i++) {
 		hash *= 0x100000001b3;
-		hash ^= (unsigned char) key[i];
+		hash ^= key[i];
 	}
 
 	return hash;
 }
 
+int lf(hashmap_init)(struct lf(hashmap) *m,
+		     size_t value_size,
+		     uint64_t (*hash)(const void *, size_t),
+		     int flags)
+{
+	return lf(hashmap_init_with)(m, value_size, hash, flags, NULL);
+}
 
-int lf(hashmap_init)(struct lf(hashmap) *m, size_t value_size)
+int lf(hashmap_init_with)(struct lf(hashmap) *m,
+			  size_t value_size,
+			  uint64_t (*hash)(const void *, size_t),
+			  int flags,
+			  const struct lf(allocator) *allocator)
 {
-	m->cap = LF_HASHMAP_INITIAL_CAP;
+	m->allocator = allocator == NULL ? lf(allocator_libc) : *allocator;
 	m->used = 0;
-	/* Align value size to sizeof(size_t)-byte boundary */
-	m->value_size =
-		((value_size + sizeof(size_t) - 1) / sizeof(size_t)) *
-			sizeof(size_t);
+	m->flags = flags;
+	m->hash = hash == NULL ? lf(hashmap_default_hash) : hash;
+	m->value_size = value_size;
+	m->max_load = LF_HASHMAP_MAX_LOAD;
+	m->old_ctrl = NULL;
+	m->mapping = NULL;
+	m->keys = NULL;
+
+#ifdef LF_HASHMAP_COUNTERS
+	memset(&m->counters, 0, sizeof(m->counters));
+#endif
+
+	return lfi(hashmap_alloc)(m, LF_HASHMAP_INITIAL_CAP);
+}
+
+void lf(hashmap_destroy)(struct lf(hashmap) *m)
+{
+	struct lf(hashmap_it) it;
+	struct lf(entry) e;
+
+	if (m->mapping != NULL) {
+#ifdef LF_HASHMAP_MMAP
+		munmap(m->mapping, m->mapping_size);
+#else
+		free(m->mapping);
+#endif
+		return;
+	}
 
-	m->entries = calloc(LF_HASHMAP_INITIAL_CAP,
-			    m->value_size + sizeof(struct lfi(hashmap_entry)));
+	lf(hashmap_iter)(m, &it);
 
-	return m->entries == NULL ? 1 : 0;
+	while (lf(entry_is_valid)(e = lf(hashmap_iter_next)(&it))) {
+		if (!lf_hashmap_key_is_inline(e.keylen))
+			lfi(free)(&m->allocator, (void *) e.key, e.keylen);
+	}
 
+	lfi(free)(&m->allocator, m->old_ctrl,
+		  lf_hashmap_table_size(m, m->old_cap));
+	lfi(free)(&m->allocator, m->ctrl, lf_hashmap_table_size(m, m->cap));
 }
 
-void lf(hashmap_destroy)(struct lf(hashmap) *m)
+int lf(hashmap_reserve)(struct lf(hashmap) *m, size_t n)
 {
-	for (size_t i = 0; i < m->cap; i++) {
-		struct lfi(hashmap_entry) *e = lf_hashmap_entry_at(m->entries, i);
+	if (n <= m->grow_at)
+		return 0;
+
+	size_t cap = lfi(hashmap_cap_for)(m, n);
+
+	if (cap == 0)
+		return 1;
+
+	/* Entries of the old table are moved along with the rest. */
+	if (m->old_ctrl != NULL)
+		lfi(hashmap_migrate)(m, SIZE_MAX);
+
+	return lfi(hashmap_rehash)(m, cap);
+}
+
+void lf(hashmap_clear)(struct lf(hashmap) *m)
+{
+	struct lf(hashmap_it) it;
+	struct lf(entry) e;
+
+	lf_assert(m->mapping == NULL, "hashmap is read-only");
+
+	lf(hashmap_iter)(m, &it);
 
-		if (e->keylen != LF_HASHMAP_TOMBSTONE && e->keylen != 0)
-			free((void *) e->key);
+	while (lf(entry_is_valid)(e = lf(hashmap_iter_next)(&it))) {
+		if (!lf_hashmap_key_is_inline(e.keylen))
+			lfi(free)(&m->allocator, (void *) e.key, e.keylen);
 	}
 
-	free(m->entries);
+	lfi(free)(&m->allocator, m->old_ctrl,
+		  lf_hashmap_table_size(m, m->old_cap));
+	m->old_ctrl = NULL;
+
+	memset(m->ctrl, LF_HASHMAP_CTRL_EMPTY, m->cap);
+	m->used = 0;
+	m->deleted = 0;
+}
+
+int lf(hashmap_shrink_to_fit)(struct lf(hashmap) *m)
+{
+	size_t cap = lfi(hashmap_cap_for)(m, m->used);
+
+	if (cap == m->cap && m->deleted == 0 && m->old_ctrl == NULL)
+		return 0;
+
+	if (m->old_ctrl != NULL)
+		lfi(hashmap_migrate)(m, SIZE_MAX);
+
+	return lfi(hashmap_rehash)(m, cap);
+}
+
+void lf(hashmap_set_max_load)(struct lf(hashmap) *m, double max_load)
+{
+	lf_assert(max_load > 0 && max_load <= 1, "max_load out of range");
+
+	m->max_load = max_load;
+	m->grow_at = lfi(hashmap_grow_at)(m, m->cap);
 }
 
 void *lf(hashmap_get)(struct lf(hashmap) *m, const void *key)
@@ -84,11 +537,53 @@ void *lf(hashmap_get)(struct lf(hashmap) *m, const void *key)
 
 void *lf(hashmap_get2)(struct lf(hashmap) *m, const void *key, size_t keylen)
 {
-	struct lfi(hashmap_entry) *e = lfi(hashmap_get2_entry)(m, key, keylen);
+	struct lfi(hashmap_entry) *e =
+		lfi(hashmap_get_entry)(m, m->hash(key, keylen), key, keylen);
 
 	return e ? e->value : NULL;
 }
 
+size_t lf(hashmap_get_many)(struct lf(hashmap) *m,
+			    size_t n,
+			    const void *const *keys,
+			    const size_t *keylens,
+			    void **values)
+{
+	uint64_t hashes[LF_HASHMAP_PREFETCH_BATCH];
+	size_t found = 0;
+
+	for (size_t batch = 0; batch < n; batch += LF_HASHMAP_PREFETCH_BATCH) {
+		size_t len = n - batch < LF_HASHMAP_PREFETCH_BATCH ?
+			n - batch : LF_HASHMAP_PREFETCH_BATCH;
+
+		/* Start loading the home slots of the whole batch before
+		 * waiting on any of them. */
+		for (size_t k = 0; k < len; k++) {
+			size_t home;
+
+			hashes[k] = m->hash(keys[batch + k], keylens[batch + k]);
+			home = hashes[k] & (m->cap - 1);
+
+			lf_prefetch(&m->ctrl[home]);
+			lf_prefetch(lf_hashmap_entry_at(m->entries, home));
+		}
+
+		for (size_t k = 0; k < len; k++) {
+			struct lfi(hashmap_entry) *e = lfi(hashmap_get_entry)(
+				m, hashes[k], keys[batch + k], keylens[batch + k]);
+
+			if (e != NULL) {
+				values[batch + k] = e->value;
+				found++;
+			} else {
+				values[batch + k] = NULL;
+			}
+		}
+	}
+
+	return found;
+}
+
 const void *lf(hashmap_remove)(struct lf(hashmap) *m, const void *key)
 {
 	return lf(hashmap_remove2)(m, key, strlen(key));
@@ -98,17 +593,7 @@ const void *lf(hashmap_remove2)(struct lf(hashmap) *m,
 				const void *key,
 				size_t keylen)
 {
-	struct lfi(hashmap_entry) *e = lfi(hashmap_get2_entry)(m, key, keylen);
-
-	if (e) {
-		e->keylen = LF_HASHMAP_TOMBSTONE;
-		free((void *) e->key);
-		m->used--;
-
-		return e->value;
-	} else {
-		return NULL;
-	}
+	return lfi(hashmap_remove_hashed)(m, m->hash(key, keylen), key, keylen);
 }
 
 void *lf(hashmap_insert)(struct lf(hashmap) *m, const void *key, const void *value)
@@ -121,164 +606,1072 @@ void *lf(hashmap_insert2)(struct lf(hashmap) *m,
 			  size_t keylen,
 			  const void *value)
 {
-	void *new_key = malloc(keylen);
-
-	if (new_key == NULL)
-		return NULL;
-
-	memcpy(new_key, key, keylen);
+	uint64_t hash = m->hash(key, keylen);
 
-	void *insert_res = lfi(hashmap_insert2_nocopy)(m, new_key, keylen, value);
+	lf_debug_assert(!lfi(hashmap_get_entry)(m, hash, key, keylen),
+			"hashmap contains the element");
 
-	if (insert_res == NULL)
-		free(new_key);
-
-	return insert_res;
+	return lfi(hashmap_insert_new)(m, hash, key, keylen, value,
+				       LF_HASHMAP_NO_SLOT);
 }
 
-void lf(hashmap_iter)(struct lf(hashmap) *m, struct lf(hashmap_it) *it)
+void *lf(hashmap_get_or_insert)(struct lf(hashmap) *m,
+				const void *key,
+				const void *value,
+				bool *inserted)
 {
-	it->m = m;
-	it->i = 0;
+	return lf(hashmap_get_or_insert2)(m, key, strlen(key), value, inserted);
 }
 
-struct lf(entry) lf(hashmap_iter_next)(struct lf(hashmap_it) *it)
+void *lf(hashmap_get_or_insert2)(struct lf(hashmap) *m,
+				 const void *key,
+				 size_t keylen,
+				 const void *value,
+				 bool *inserted)
 {
-	struct lf(hashmap) *m = it->m;
-
-	while (it->i != m->cap) {
-		struct lfi(hashmap_entry) *e =
-			lf_hashmap_entry_at(m->entries, it->i);
-
-		it->i++;
-
-		if (e->keylen != LF_HASHMAP_TOMBSTONE && e->keylen != 0)
-			return (struct lf(entry)) {
-				.key = e->key,
-				.keylen = e->keylen,
-				.value = e->value
-			};
-	}
-
-	return lfi_sentinel_entry;
+	return lfi(hashmap_get_or_insert_hashed)(m, m->hash(key, keylen),
+						 key, keylen, value, inserted);
 }
 
-void lf(hashmap_xinit)(struct lf(hashmap) *m, size_t value_size)
+void *lf(hashmap_upsert)(struct lf(hashmap) *m,
+			 const void *key,
+			 const void *value,
+			 bool *inserted)
 {
-	lf_unwrap(lf(hashmap_init)(m, value_size));
+	return lf(hashmap_upsert2)(m, key, strlen(key), value, inserted);
 }
 
-void *lf(hashmap_xinsert)(struct lf(hashmap) *m,
+void *lf(hashmap_upsert2)(struct lf(hashmap) *m,
 			  const void *key,
-			  const void *value)
+			  size_t keylen,
+			  const void *value,
+			  bool *inserted)
 {
-	void *insert_res = lf(hashmap_insert)(m, key, value);
+	bool inserted_;
+	void *v = lf(hashmap_get_or_insert2)(m, key, keylen, value, &inserted_);
 
-	lf_assert(insert_res != NULL, "insert returned NULL");
+	if (v != NULL && !inserted_ && m->value_size && value != NULL)
+		memcpy(v, value, m->value_size);
 
-	return insert_res;
+	if (inserted != NULL)
+		*inserted = inserted_;
+
+	return v;
 }
 
-void *lf(hashmap_xinsert2)(struct lf(hashmap) *m,
-			   const void *key,
-			   size_t keylen,
-			   const void *value)
+/* Writes n zero bytes, returns non-zero on failure. */
+lfi_fdecl(int, hashmap_file_pad)(FILE *f, size_t n)
 {
-	void *insert_res = lf(hashmap_insert2)(m, key, keylen, value);
+	static const char pad[64];
 
-	lf_assert(insert_res != NULL, "insert returned NULL");
-
-	return insert_res;
+	return n != 0 && fwrite(pad, n, 1, f) != 1;
 }
 
-lfi_fdecl(struct lfi(hashmap_entry) *, hashmap_get2_entry)(struct lf(hashmap) *m,
-							   const void *key,
-							   size_t keylen)
+int lf(hashmap_save)(struct lf(hashmap) *m, const char *path)
 {
-	uint64_t hash = lfi(hashmap_fnv_hash)(key, keylen);
-	size_t start_i = hash % m->cap;
-	size_t i = start_i;
+	size_t stride = lf_hashmap_stride(m);
+	struct lfi(hashmap_file_header) h = {
+		.magic = LF_HASHMAP_FILE_MAGIC,
+		.byte_order = LF_HASHMAP_FILE_BYTE_ORDER,
+		.hash_check = m->hash(LF_HASHMAP_FILE_MAGIC,
+				      sizeof(LF_HASHMAP_FILE_MAGIC)),
+		.inline_key_size = LF_HASHMAP_INLINE_KEY_SIZE,
+		.stride = stride,
+		.value_size = m->value_size,
+		.flags = m->flags & LF_HASHMAP_ROBIN_HOOD,
+	};
+
+	if (m->old_ctrl != NULL)
+		lfi(hashmap_migrate)(m, SIZE_MAX);
+
+	h.cap = m->cap;
+	h.used = m->used;
+	h.ctrl_offset = lf_hashmap_file_align(sizeof(h));
+	h.entries_offset = lf_hashmap_file_align(h.ctrl_offset + m->cap);
+	h.keys_offset = h.entries_offset + m->cap * stride;
+
+	struct lfi(hashmap_entry) *buf = calloc(1, stride);
+	FILE *f = fopen(path, "wb");
+	int err = buf == NULL || f == NULL;
+
+	if (!err)
+		err = fwrite(&h, sizeof(h), 1, f) != 1 ||
+		      lfi(hashmap_file_pad)(f, h.ctrl_offset - sizeof(h)) ||
+		      fwrite(m->ctrl, m->cap, 1, f) != 1 ||
+		      lfi(hashmap_file_pad)(f, h.entries_offset -
+					       h.ctrl_offset - m->cap);
+
+	/* Long keys are written after the entries, in the order of their
+	 * slots. */
+	for (size_t i = 0; !err && i < m->cap; i++) {
+		struct lfi(hashmap_entry) *e = lf_hashmap_entry_at(m->entries, i);
 
-	do {
+		if (lf_hashmap_ctrl_is_full(m->ctrl[i])) {
+			memcpy(buf, e, stride);
+
+			if (!lf_hashmap_key_is_inline(e->keylen)) {
+				buf->key.offset = h.keys_size;
+				h.keys_size += e->keylen;
+			}
+		} else {
+			memset(buf, 0, stride);
+		}
+
+		err = fwrite(buf, stride, 1, f) != 1;
+	}
+
+	for (size_t i = 0; !err && i < m->cap; i++) {
 		struct lfi(hashmap_entry) *e = lf_hashmap_entry_at(m->entries, i);
 
-		if (e->keylen == 0)
-			return NULL;
-		else if (e->keylen == keylen && memcmp(e->key, key, keylen) == 0)
-			return e;
-		else
-			i++;
+		const void *key;
 
-		i %= m->cap;
-	} while (i != start_i);
+		/* A damaged key of a mapped file fails the save. */
+		if (lf_hashmap_ctrl_is_full(m->ctrl[i]) &&
+		    !lf_hashmap_key_is_inline(e->keylen))
+			err = (key = lf_hashmap_entry_key(e)) == NULL ||
+				fwrite(key, e->keylen, 1, f) != 1;
+	}
 
-	/* Hashmap filled up with tombstones */
-	return NULL;
+	/* The size of the key section is known after it is written. */
+	if (!err)
+		err = fseek(f, 0, SEEK_SET) != 0 ||
+		      fwrite(&h, sizeof(h), 1, f) != 1;
+
+	if (f != NULL && fclose(f) != 0)
+		err = 1;
+
+	free(buf);
+
+	return err;
+}
+
+/* Checks the header of a snapshot file of the given size. The sections must
+ * lie in the file without wrapping around, so the counts are checked by
+ * division, as the header may hold any values. The entries are not read, the
+ * keys are checked by hashmap_mapped_key() as they are looked up. */
+lfi_fdecl(bool, hashmap_file_check)(const struct lfi(hashmap_file_header) *h,
+				    size_t size,
+				    uint64_t (*hash)(const void *, size_t))
+{
+	return size >= sizeof(*h) &&
+		memcmp(h->magic, LF_HASHMAP_FILE_MAGIC,
+		       sizeof(h->magic)) == 0 &&
+		h->byte_order == LF_HASHMAP_FILE_BYTE_ORDER &&
+		h->hash_check == hash(LF_HASHMAP_FILE_MAGIC,
+				      sizeof(LF_HASHMAP_FILE_MAGIC)) &&
+		h->inline_key_size == LF_HASHMAP_INLINE_KEY_SIZE &&
+		h->value_size <= size &&
+		h->stride == lf_hashmap_stride(&(struct lf(hashmap)) {
+			.value_size = h->value_size }) &&
+		(h->flags & ~(uint64_t) LF_HASHMAP_ROBIN_HOOD) == 0 &&
+		h->cap >= LF_HASHMAP_GROUP_WIDTH &&
+		(h->cap & (h->cap - 1)) == 0 && h->used <= h->cap &&
+		h->ctrl_offset >= sizeof(*h) && h->ctrl_offset <= size &&
+		h->cap <= size - h->ctrl_offset &&
+		h->entries_offset >= h->ctrl_offset + h->cap &&
+		h->entries_offset <= size &&
+		h->entries_offset % sizeof(size_t) == 0 &&
+		h->cap <= (size - h->entries_offset) / h->stride &&
+		h->keys_offset >= h->entries_offset + h->cap * h->stride &&
+		h->keys_offset <= size && h->keys_size <= size - h->keys_offset;
 }
 
-lfi_fdecl(int, hashmap_rehash)(struct lf(hashmap) *m, size_t old_cap)
+int lf(hashmap_open_mapped)(struct lf(hashmap) *m,
+			    const char *path,
+			    uint64_t (*hash)(const void *, size_t))
 {
-	struct lfi(hashmap_entry) *old_entries = m->entries;
+	void *mapping = NULL;
+	size_t size = 0;
 
-	m->used = 0;
-	m->entries = calloc(m->cap,
-			    m->value_size + sizeof(struct lfi(hashmap_entry)));
+#ifdef LF_HASHMAP_MMAP
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+
+	if (fd < 0)
+		return 1;
+
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		size = st.st_size;
+		mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+
+		if (mapping == MAP_FAILED)
+			mapping = NULL;
+	}
+
+	close(fd);
+#else
+	FILE *f = fopen(path, "rb");
+
+	if (f == NULL)
+		return 1;
+
+	if (fseek(f, 0, SEEK_END) == 0) {
+		long end = ftell(f);
 
-	if (m->entries == NULL)
+		/* Aligned as a mapping would be, for the entries. */
+		if (end > 0 && fseek(f, 0, SEEK_SET) == 0) {
+			size = end;
+			mapping = aligned_alloc(64, lf_hashmap_file_align(size));
+		}
+
+		if (mapping != NULL && fread(mapping, size, 1, f) != 1) {
+			free(mapping);
+			mapping = NULL;
+		}
+	}
+
+	fclose(f);
+#endif
+
+	if (mapping == NULL)
 		return 1;
 
-	for (size_t i = 0; i < old_cap; i++) {
-		struct lfi(hashmap_entry) *e = lf_hashmap_entry_at(old_entries, i);
+	const struct lfi(hashmap_file_header) *h = mapping;
+
+	if (hash == NULL)
+		hash = lf(hashmap_default_hash);
 
-		if (e->keylen != LF_HASHMAP_TOMBSTONE && e->keylen != 0)
-			lfi(hashmap_insert2_nocopy)(m, e->key, e->keylen, e->value);
+	if (!lfi(hashmap_file_check)(h, size, hash)) {
+#ifdef LF_HASHMAP_MMAP
+		munmap(mapping, size);
+#else
+		free(mapping);
+#endif
+		return 1;
 	}
 
-	free(old_entries);
+	m->ctrl = (unsigned char *) mapping + h->ctrl_offset;
+	m->entries = (struct lfi(hashmap_entry) *)
+		((char *) mapping + h->entries_offset);
+	m->cap = h->cap;
+	m->used = h->used;
+	m->deleted = 0;
+	m->value_size = h->value_size;
+	m->hash = hash;
+	m->flags = h->flags;
+	m->allocator = lf(allocator_libc);
+	m->max_load = LF_HASHMAP_MAX_LOAD;
+	m->grow_at = lfi(hashmap_grow_at)(m, m->cap);
+	m->old_ctrl = NULL;
+	m->mapping = mapping;
+	m->mapping_size = size;
+	m->keys = (const char *) mapping + h->keys_offset;
+	m->keys_size = h->keys_size;
+
+#ifdef LF_HASHMAP_COUNTERS
+	memset(&m->counters, 0, sizeof(m->counters));
+#endif
 
 	return 0;
 }
 
-lfi_fdecl(void *, hashmap_insert2_nocopy)(struct lf(hashmap) *m,
-					  const void *key,
-					  size_t keylen,
-					  const void *value)
+/* Adds the slots of a table to the statistics. */
+lfi_fdecl(void, hashmap_stats_table)(struct lf(hashmap) *m,
+				     struct lf(hashmap_stats) *stats,
+				     size_t *probe_total)
 {
-	if (m->cap * 3 < m->used * 4) {
-		size_t old_cap = m->cap;
+	for (size_t i = 0; i < m->cap; i++) {
+		if (m->ctrl[i] == LF_HASHMAP_CTRL_EMPTY) {
+			stats->empty++;
 
-		m->cap *= 2;
+			continue;
+		} else if (m->ctrl[i] == LF_HASHMAP_CTRL_DELETED) {
+			stats->tombstones++;
 
-		if (lfi(hashmap_rehash)(m, old_cap))
-			return NULL;
+			continue;
+		}
+
+		struct lfi(hashmap_entry) *e = lf_hashmap_entry_at(m->entries, i);
+		size_t home = e->hash & (m->cap - 1);
+		size_t probe = (home % LF_HASHMAP_GROUP_WIDTH +
+				((i - home) & (m->cap - 1))) /
+			       LF_HASHMAP_GROUP_WIDTH + 1;
+		size_t bucket = probe - 1;
+
+		if (bucket >= LF_HASHMAP_STATS_HISTOGRAM_SIZE)
+			bucket = LF_HASHMAP_STATS_HISTOGRAM_SIZE - 1;
+
+		stats->live++;
+		stats->probe_histogram[bucket]++;
+		*probe_total += probe;
+
+		if (probe > stats->max_probe)
+			stats->max_probe = probe;
+
+		if (!lf_hashmap_key_is_inline(e->keylen) && m->mapping == NULL)
+			stats->memory += e->keylen;
 	}
+}
 
-	lf_assert(!lf(hashmap_get2)(m, key, keylen),
-		  "hashmap contains the element");
+void lf(hashmap_stats)(struct lf(hashmap) *m, struct lf(hashmap_stats) *stats)
+{
+	size_t probe_total = 0;
 
-	uint64_t hash = lfi(hashmap_fnv_hash)(key, keylen);
-	size_t start_i = hash % m->cap;
-	size_t i = start_i;
+	memset(stats, 0, sizeof(*stats));
 
-	do {
-		struct lfi(hashmap_entry) *e = lf_hashmap_entry_at(m->entries, i);
+	stats->size = m->used;
+	stats->capacity = m->cap;
 
-		if (e->keylen == 0 || e->keylen == LF_HASHMAP_TOMBSTONE) {
-			e->keylen = keylen;
-			e->key = key;
+	lfi(hashmap_stats_table)(m, stats, &probe_total);
 
-			if (m->value_size && value != NULL)
-				memcpy(e->value, value, m->value_size);
+	if (m->old_ctrl != NULL) {
+		struct lf(hashmap) old = lfi(hashmap_old)(m);
 
-			m->used++;
+		stats->old_capacity = old.cap;
+		lfi(hashmap_stats_table)(&old, stats, &probe_total);
+		stats->memory += lf_hashmap_table_size(m, old.cap);
+	}
 
-			return e->value;
-		} else {
-			i++;
-		}
+	if (stats->live)
+		stats->avg_probe = (double) probe_total / stats->live;
+
+	if (m->mapping != NULL)
+		stats->memory += m->mapping_size;
+	else
+		stats->memory += lf_hashmap_table_size(m, m->cap);
+
+#ifdef LF_HASHMAP_COUNTERS
+	stats->lookups = m->counters.lookups;
+	stats->misses = m->counters.misses;
+	stats->probes = m->counters.probes;
+	stats->rehashes = m->counters.rehashes;
+#endif
+}
+
+void lf(hashmap_iter)(struct lf(hashmap) *m, struct lf(hashmap_it) *it)
+{
+	it->m = m;
+	it->i = 0;
+}
+
+struct lf(entry) lf(hashmap_iter_next)(struct lf(hashmap_it) *it)
+{
+	struct lf(hashmap) *m = it->m;
+
+	/* The old table is iterated after the table during incremental
+	 * rehashing. */
+	size_t end = m->cap + (m->old_ctrl != NULL ? m->old_cap : 0);
+
+	while (it->i < end) {
+		size_t i = it->i++;
+		unsigned char *ctrl = m->ctrl;
+		struct lfi(hashmap_entry) *entries = m->entries;
+
+		if (i >= m->cap) {
+			i -= m->cap;
+			ctrl = m->old_ctrl;
+			entries = (struct lfi(hashmap_entry) *) &ctrl[m->old_cap];
+		}
+
+		if (lf_hashmap_ctrl_is_full(ctrl[i])) {
+			struct lfi(hashmap_entry) *e =
+				lf_hashmap_entry_at(entries, i);
+			const void *key = lf_hashmap_entry_key(e);
+
+			/* Skips the damaged keys of a mapped file. */
+			if (key == NULL)
+				continue;
+
+			return (struct lf(entry)) {
+				.key = key,
+				.keylen = e->keylen,
+				.value = e->value
+			};
+		}
+	}
+
+	return lfi_sentinel_entry;
+}
+
+void lf(hashmap_xinit)(struct lf(hashmap) *m,
+		       size_t value_size,
+		       uint64_t (*hash)(const void *, size_t),
+		       int flags)
+{
+	lf_unwrap(lf(hashmap_init)(m, value_size, hash, flags));
+}
+
+void lf(hashmap_xinit_with)(struct lf(hashmap) *m,
+			    size_t value_size,
+			    uint64_t (*hash)(const void *, size_t),
+			    int flags,
+			    const struct lf(allocator) *allocator)
+{
+	lf_unwrap(lf(hashmap_init_with)(m, value_size, hash, flags, allocator));
+}
+
+void lf(hashmap_xreserve)(struct lf(hashmap) *m, size_t n)
+{
+	lf_unwrap(lf(hashmap_reserve)(m, n));
+}
+
+void *lf(hashmap_xinsert)(struct lf(hashmap) *m,
+			  const void *key,
+			  const void *value)
+{
+	void *insert_res = lf(hashmap_insert)(m, key, value);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+void *lf(hashmap_xinsert2)(struct lf(hashmap) *m,
+			   const void *key,
+			   size_t keylen,
+			   const void *value)
+{
+	void *insert_res = lf(hashmap_insert2)(m, key, keylen, value);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+void *lf(hashmap_xget_or_insert)(struct lf(hashmap) *m,
+				 const void *key,
+				 const void *value,
+				 bool *inserted)
+{
+	void *insert_res = lf(hashmap_get_or_insert)(m, key, value, inserted);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+void *lf(hashmap_xget_or_insert2)(struct lf(hashmap) *m,
+				  const void *key,
+				  size_t keylen,
+				  const void *value,
+				  bool *inserted)
+{
+	void *insert_res = lf(hashmap_get_or_insert2)(m, key, keylen, value,
+						      inserted);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+void *lf(hashmap_xupsert)(struct lf(hashmap) *m,
+			  const void *key,
+			  const void *value,
+			  bool *inserted)
+{
+	void *insert_res = lf(hashmap_upsert)(m, key, value, inserted);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+void *lf(hashmap_xupsert2)(struct lf(hashmap) *m,
+			   const void *key,
+			   size_t keylen,
+			   const void *value,
+			   bool *inserted)
+{
+	void *insert_res = lf(hashmap_upsert2)(m, key, keylen, value, inserted);
+
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+/* Concurrent hashmap. It lives beside the hashmap to reuse its internals with
+ * the hashes computed once. */
+
+#define LF_CHASHMAP_WRITER (UINT_MAX / 2 + 1)
+
+/* Spins before yielding the processor while waiting on a lock. */
+#define LF_CHASHMAP_SPIN 64
+
+#if LF_CHASHMAP_STRIPES < 1 || \
+	(LF_CHASHMAP_STRIPES & (LF_CHASHMAP_STRIPES - 1)) != 0
+#error "LF_CHASHMAP_STRIPES must be a power of two"
+#endif
+
+/* Stripes are picked by the bits above the ones picking the slots. */
+#define lf_chashmap_stripe(c, hash) \
+	(&(c)->stripes[((hash) >> 32) & (LF_CHASHMAP_STRIPES - 1)])
+
+inline lfi_fdecl(void, chashmap_wait)(unsigned *spins)
+{
+	if (++*spins < LF_CHASHMAP_SPIN) {
+		lf_cpu_relax();
+	} else {
+		*spins = 0;
+		lf_chashmap_yield();
+	}
+}
+
+inline lfi_fdecl(void, chashmap_read_lock)(atomic_uint *lock)
+{
+	unsigned spins = 0;
+
+	for (;;) {
+		while (atomic_load_explicit(lock, memory_order_relaxed) &
+		       LF_CHASHMAP_WRITER)
+			lfi(chashmap_wait)(&spins);
+
+		if (!(atomic_fetch_add_explicit(lock, 1, memory_order_acquire) &
+		      LF_CHASHMAP_WRITER))
+			return;
+
+		/* A writer took the lock in between. */
+		atomic_fetch_sub_explicit(lock, 1, memory_order_relaxed);
+	}
+}
+
+inline lfi_fdecl(void, chashmap_read_unlock)(atomic_uint *lock)
+{
+	atomic_fetch_sub_explicit(lock, 1, memory_order_release);
+}
+
+inline lfi_fdecl(void, chashmap_write_lock)(atomic_uint *lock)
+{
+	unsigned spins = 0;
+
+	/* The writer bit keeps the new readers out, then the current ones are
+	 * waited on. */
+	for (;;) {
+		while (atomic_load_explicit(lock, memory_order_relaxed) &
+		       LF_CHASHMAP_WRITER)
+			lfi(chashmap_wait)(&spins);
+
+		if (!(atomic_fetch_or_explicit(lock, LF_CHASHMAP_WRITER,
+					       memory_order_acquire) &
+		      LF_CHASHMAP_WRITER))
+			break;
+	}
+
+	while (atomic_load_explicit(lock, memory_order_acquire) !=
+	       LF_CHASHMAP_WRITER)
+		lfi(chashmap_wait)(&spins);
+}
+
+inline lfi_fdecl(void, chashmap_write_unlock)(atomic_uint *lock)
+{
+	atomic_fetch_and_explicit(lock, ~LF_CHASHMAP_WRITER,
+				  memory_order_release);
+}
+
+int lf(chashmap_init)(struct lf(chashmap) *c,
+		      size_t value_size,
+		      uint64_t (*hash)(const void *, size_t),
+		      int flags)
+{
+	c->value_size = value_size;
+	c->hash = hash == NULL ? lf(hashmap_default_hash) : hash;
+	c->stripes = aligned_alloc(_Alignof(struct lfi(chashmap_stripe)),
+				   LF_CHASHMAP_STRIPES *
+				   sizeof(struct lfi(chashmap_stripe)));
+
+	if (c->stripes == NULL)
+		return 1;
+
+	for (size_t i = 0; i < LF_CHASHMAP_STRIPES; i++) {
+		struct lfi(chashmap_stripe) *s = &c->stripes[i];
+
+		atomic_init(&s->lock, 0);
+
+		if (lf(hashmap_init)(&s->m, value_size, c->hash, flags)) {
+			while (i--)
+				lf(hashmap_destroy)(&c->stripes[i].m);
+
+			free(c->stripes);
+
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+void lf(chashmap_destroy)(struct lf(chashmap) *c)
+{
+	for (size_t i = 0; i < LF_CHASHMAP_STRIPES; i++)
+		lf(hashmap_destroy)(&c->stripes[i].m);
+
+	free(c->stripes);
+}
+
+bool lf(chashmap_get)(struct lf(chashmap) *c, const void *key, void *value)
+{
+	return lf(chashmap_get2)(c, key, strlen(key), value);
+}
+
+bool lf(chashmap_get2)(struct lf(chashmap) *c,
+		       const void *key,
+		       size_t keylen,
+		       void *value)
+{
+	uint64_t hash = c->hash(key, keylen);
+	struct lfi(chashmap_stripe) *s = lf_chashmap_stripe(c, hash);
+
+	lfi(chashmap_read_lock)(&s->lock);
+
+	struct lfi(hashmap_entry) *e =
+		lfi(hashmap_get_entry)(&s->m, hash, key, keylen);
+
+	if (e != NULL && value != NULL && c->value_size)
+		memcpy(value, e->value, c->value_size);
+
+	lfi(chashmap_read_unlock)(&s->lock);
+
+	return e != NULL;
+}
+
+int lf(chashmap_upsert)(struct lf(chashmap) *c,
+			const void *key,
+			const void *value,
+			bool *inserted)
+{
+	return lf(chashmap_upsert2)(c, key, strlen(key), value, inserted);
+}
+
+int lf(chashmap_upsert2)(struct lf(chashmap) *c,
+			 const void *key,
+			 size_t keylen,
+			 const void *value,
+			 bool *inserted)
+{
+	uint64_t hash = c->hash(key, keylen);
+	struct lfi(chashmap_stripe) *s = lf_chashmap_stripe(c, hash);
+	bool inserted_;
+
+	lfi(chashmap_write_lock)(&s->lock);
+
+	void *v = lfi(hashmap_get_or_insert_hashed)(&s->m, hash, key, keylen,
+						    value, &inserted_);
+
+	if (v != NULL && !inserted_ && c->value_size && value != NULL)
+		memcpy(v, value, c->value_size);
+
+	lfi(chashmap_write_unlock)(&s->lock);
+
+	if (inserted != NULL)
+		*inserted = inserted_;
+
+	return v == NULL;
+}
+
+bool lf(chashmap_remove)(struct lf(chashmap) *c, const void *key, void *value)
+{
+	return lf(chashmap_remove2)(c, key, strlen(key), value);
+}
+
+bool lf(chashmap_remove2)(struct lf(chashmap) *c,
+			  const void *key,
+			  size_t keylen,
+			  void *value)
+{
+	uint64_t hash = c->hash(key, keylen);
+	struct lfi(chashmap_stripe) *s = lf_chashmap_stripe(c, hash);
+
+	lfi(chashmap_write_lock)(&s->lock);
+
+	const void *v = lfi(hashmap_remove_hashed)(&s->m, hash, key, keylen);
+
+	if (v != NULL && value != NULL && c->value_size)
+		memcpy(value, v, c->value_size);
+
+	lfi(chashmap_write_unlock)(&s->lock);
+
+	return v != NULL;
+}
+
+size_t lf(chashmap_size)(struct lf(chashmap) *c)
+{
+	size_t size = 0;
+
+	for (size_t i = 0; i < LF_CHASHMAP_STRIPES; i++) {
+		struct lfi(chashmap_stripe) *s = &c->stripes[i];
+
+		lfi(chashmap_read_lock)(&s->lock);
+		size += s->m.used;
+		lfi(chashmap_read_unlock)(&s->lock);
+	}
+
+	return size;
+}
+
+void lf(chashmap_xinit)(struct lf(chashmap) *c,
+			size_t value_size,
+			uint64_t (*hash)(const void *, size_t),
+			int flags)
+{
+	lf_unwrap(lf(chashmap_init)(c, value_size, hash, flags));
+}
+
+void lf(chashmap_xupsert)(struct lf(chashmap) *c,
+			  const void *key,
+			  const void *value,
+			  bool *inserted)
+{
+	lf_unwrap(lf(chashmap_upsert)(c, key, value, inserted));
+}
+
+void lf(chashmap_xupsert2)(struct lf(chashmap) *c,
+			   const void *key,
+			   size_t keylen,
+			   const void *value,
+			   bool *inserted)
+{
+	lf_unwrap(lf(chashmap_upsert2)(c, key, keylen, value, inserted));
+}
+
+
+lfi_fdecl(size_t, hashmap_find)(struct lf(hashmap) *m,
+				uint64_t hash,
+				const void *key,
+				size_t keylen,
+				size_t *free_slot)
+{
+	unsigned char tag = lf_hashmap_tag(hash);
+
+	struct lfi(hashmap_probe) p;
+
+	if (free_slot != NULL)
+		*free_slot = LF_HASHMAP_NO_SLOT;
+
+	lfi(hashmap_probe_start)(m, hash, &p);
+
+	do {
+		const unsigned char *group = &m->ctrl[p.base];
+		uint32_t match = lfi(hashmap_group_match)(group, tag) & p.valid;
+
+		lf_hashmap_count(m, probes, 1);
+
+		while (match) {
+			size_t i = p.base + lfi(hashmap_ctz)(match);
+			struct lfi(hashmap_entry) *e =
+				lf_hashmap_entry_at(m->entries, i);
+
+			const void *k;
+
+			if (e->hash == hash && e->keylen == keylen &&
+			    (k = lf_hashmap_entry_key(e)) != NULL &&
+			    memcmp(k, key, keylen) == 0)
+				return i;
+
+			match &= match - 1;
+		}
+
+		if (free_slot != NULL && *free_slot == LF_HASHMAP_NO_SLOT) {
+			uint32_t free_slots =
+				lfi(hashmap_group_match_free)(group) & p.valid;
+
+			if (free_slots)
+				*free_slot = p.base + lfi(hashmap_ctz)(free_slots);
+		}
+
+		if (lfi(hashmap_group_match)(group, LF_HASHMAP_CTRL_EMPTY) &
+		    p.valid)
+			return LF_HASHMAP_NO_SLOT;
+	} while (lfi(hashmap_probe_next)(m, &p));
+
+	/* Hashmap filled up with tombstones */
+	return LF_HASHMAP_NO_SLOT;
+}
+
+lfi_fdecl(size_t, hashmap_claim)(struct lf(hashmap) *m,
+				 uint64_t hash,
+				 size_t i)
+{
+	if (m->flags & LF_HASHMAP_ROBIN_HOOD)
+		return lfi(hashmap_claim_robin_hood)(m, hash);
+
+	if (i == LF_HASHMAP_NO_SLOT) {
+		struct lfi(hashmap_probe) p;
+
+		lfi(hashmap_probe_start)(m, hash, &p);
+
+		do {
+			uint32_t free_slots = lfi(hashmap_group_match_free)(
+				&m->ctrl[p.base]) & p.valid;
+
+			if (free_slots) {
+				i = p.base + lfi(hashmap_ctz)(free_slots);
+				break;
+			}
+		} while (lfi(hashmap_probe_next)(m, &p));
+	}
+
+	lf_assert(i != LF_HASHMAP_NO_SLOT, "hashmap is full");
+
+	if (m->ctrl[i] == LF_HASHMAP_CTRL_DELETED)
+		m->deleted--;
+
+	m->ctrl[i] = lf_hashmap_tag(hash);
+
+	return i;
+}
+
+lfi_fdecl(void, hashmap_release)(struct lf(hashmap) *m, size_t i)
+{
+	if (m->flags & LF_HASHMAP_ROBIN_HOOD) {
+		lfi(hashmap_release_robin_hood)(m, i);
+	} else if (m->ctrl[(i + 1) & (m->cap - 1)] == LF_HASHMAP_CTRL_EMPTY) {
+		/* No probe sequence passes through a slot followed by an
+		 * empty one, so it can be emptied rather than marked
+		 * deleted. */
+		m->ctrl[i] = LF_HASHMAP_CTRL_EMPTY;
+	} else {
+		m->ctrl[i] = LF_HASHMAP_CTRL_DELETED;
+		m->deleted++;
+	}
+}
+
+lfi_fdecl(struct lfi(hashmap_entry) *, hashmap_get_entry)(struct lf(hashmap) *m,
+							  uint64_t hash,
+							  const void *key,
+							  size_t keylen)
+{
+	size_t i = lfi(hashmap_find)(m, hash, key, keylen, NULL);
+
+	lf_hashmap_count(m, lookups, 1);
+
+	if (i != LF_HASHMAP_NO_SLOT)
+		return lf_hashmap_entry_at(m->entries, i);
+
+	if (m->old_ctrl != NULL) {
+		struct lf(hashmap) old = lfi(hashmap_old)(m);
+
+		i = lfi(hashmap_find)(&old, hash, key, keylen, NULL);
+		lf_hashmap_count_merge(m, &old);
+
+		if (i != LF_HASHMAP_NO_SLOT)
+			return lf_hashmap_entry_at(old.entries, i);
+	}
+
+	lf_hashmap_count(m, misses, 1);
+
+	return NULL;
+}
+
+lfi_fdecl(void, hashmap_migrate)(struct lf(hashmap) *m, size_t slots)
+{
+	struct lf(hashmap) old = lfi(hashmap_old)(m);
+
+	for (; slots && m->migrated < old.cap; slots--, m->migrated++) {
+		size_t i = m->migrated;
+
+		if (!lf_hashmap_ctrl_is_full(old.ctrl[i]))
+			continue;
+
+		struct lfi(hashmap_entry) *e = lf_hashmap_entry_at(old.entries, i);
+		size_t j = lfi(hashmap_claim)(m, e->hash, LF_HASHMAP_NO_SLOT);
+
+		memcpy(lf_hashmap_entry_at(m->entries, j), e, lf_hashmap_stride(m));
+
+		/* Lookups in the old table still probe past this slot. */
+		old.ctrl[i] = LF_HASHMAP_CTRL_DELETED;
+	}
+
+	if (m->migrated == old.cap) {
+		lfi(free)(&m->allocator, m->old_ctrl,
+			  lf_hashmap_table_size(m, old.cap));
+		m->old_ctrl = NULL;
+	}
+}
+
+lfi_fdecl(int, hashmap_rehash)(struct lf(hashmap) *m, size_t cap)
+{
+	struct lf(hashmap) old = *m;
+
+	lf_assert(m->mapping == NULL, "hashmap is read-only");
+
+	if (lfi(hashmap_alloc)(m, cap))
+		return 1;
+
+	lf_hashmap_count(m, rehashes, 1);
+
+	for (size_t i = 0; i < old.cap; i++) {
+		if (!lf_hashmap_ctrl_is_full(old.ctrl[i]))
+			continue;
+
+		struct lfi(hashmap_entry) *e = lf_hashmap_entry_at(old.entries, i);
+		size_t j = lfi(hashmap_claim)(m, e->hash, LF_HASHMAP_NO_SLOT);
+
+		memcpy(lf_hashmap_entry_at(m->entries, j), e, lf_hashmap_stride(m));
+	}
+
+	lfi(free)(&m->allocator, old.ctrl, lf_hashmap_table_size(m, old.cap));
+
+	return 0;
+}
+
+lfi_fdecl(int, hashmap_rehash_incremental)(struct lf(hashmap) *m, size_t cap)
+{
+	/* Only one old table is kept. */
+	if (m->old_ctrl != NULL)
+		lfi(hashmap_migrate)(m, SIZE_MAX);
+
+	unsigned char *ctrl = m->ctrl;
+	size_t old_cap = m->cap;
+
+	if (lfi(hashmap_alloc)(m, cap))
+		return 1;
+
+	lf_hashmap_count(m, rehashes, 1);
+
+	m->old_ctrl = ctrl;
+	m->old_cap = old_cap;
+	m->migrated = 0;
+
+	return 0;
+}
+
+lfi_fdecl(void *, hashmap_insert_new)(struct lf(hashmap) *m,
+				      uint64_t hash,
+				      const void *key,
+				      size_t keylen,
+				      const void *value,
+				      size_t free_slot)
+{
+	void *new_key = NULL;
+
+	lf_assert(m->mapping == NULL, "hashmap is read-only");
+
+	if (!lf_hashmap_key_is_inline(keylen)) {
+		new_key = lf_alloc(&m->allocator, keylen);
+
+		if (new_key == NULL)
+			return NULL;
+
+		memcpy(new_key, key, keylen);
+	}
+
+	/* Migration may take the free slot. */
+	if (m->old_ctrl != NULL) {
+		lfi(hashmap_migrate)(m, LF_HASHMAP_MIGRATE_STEP);
+		free_slot = LF_HASHMAP_NO_SLOT;
+	}
+
+	/* Deleted slots lengthen the probe sequences as much as the used ones.
+	 * If they make up the most of the load, the table is rebuilt with the
+	 * same capacity to drop them. */
+	if (m->used + m->deleted >= m->grow_at) {
+		size_t cap = m->cap;
+		int err;
+
+		if (m->used * 2 >= m->grow_at) {
+			cap = lfi(hashmap_cap_for)(m, m->used * 2);
+
+			if (cap == 0) {
+				lfi(free)(&m->allocator, new_key, keylen);
+
+				return NULL;
+			}
+		}
+
+		if (m->flags & LF_HASHMAP_INCREMENTAL)
+			err = lfi(hashmap_rehash_incremental)(m, cap);
+		else
+			err = lfi(hashmap_rehash)(m, cap);
+
+		if (err) {
+			lfi(free)(&m->allocator, new_key, keylen);
+
+			return NULL;
+		}
+
+		free_slot = LF_HASHMAP_NO_SLOT;
+	}
+
+	size_t i = lfi(hashmap_claim)(m, hash, free_slot);
+	struct lfi(hashmap_entry) *e = lf_hashmap_entry_at(m->entries, i);
+
+	e->hash = hash;
+	e->keylen = keylen;
+
+	if (new_key != NULL)
+		e->key.ptr = new_key;
+	else
+		memcpy(e->key.bytes, key, keylen);
+
+	if (m->value_size && value != NULL)
+		memcpy(e->value, value, m->value_size);
+
+	m->used++;
+
+	return e->value;
+}
+
+lfi_fdecl(void *, hashmap_get_or_insert_hashed)(struct lf(hashmap) *m,
+						uint64_t hash,
+						const void *key,
+						size_t keylen,
+						const void *value,
+						bool *inserted)
+{
+	size_t free_slot;
+	size_t i = lfi(hashmap_find)(m, hash, key, keylen, &free_slot);
+	struct lfi(hashmap_entry) *e = NULL;
+
+	if (i != LF_HASHMAP_NO_SLOT) {
+		e = lf_hashmap_entry_at(m->entries, i);
+	} else if (m->old_ctrl != NULL) {
+		struct lf(hashmap) old = lfi(hashmap_old)(m);
+
+		i = lfi(hashmap_find)(&old, hash, key, keylen, NULL);
+		lf_hashmap_count_merge(m, &old);
+
+		if (i != LF_HASHMAP_NO_SLOT)
+			e = lf_hashmap_entry_at(old.entries, i);
+	}
+
+	lf_hashmap_count(m, lookups, 1);
+	lf_hashmap_count(m, misses, e == NULL);
+
+	if (inserted != NULL)
+		*inserted = e == NULL;
+
+	if (e != NULL)
+		return e->value;
+
+	return lfi(hashmap_insert_new)(m, hash, key, keylen, value, free_slot);
+}
+
+lfi_fdecl(const void *, hashmap_remove_hashed)(struct lf(hashmap) *m,
+					       uint64_t hash,
+					       const void *key,
+					       size_t keylen)
+{
+	lf_assert(m->mapping == NULL, "hashmap is read-only");
+
+	if (m->old_ctrl != NULL)
+		lfi(hashmap_migrate)(m, LF_HASHMAP_MIGRATE_STEP);
+
+	struct lf(hashmap) old, *t = m;
+	size_t i = lfi(hashmap_find)(m, hash, key, keylen, NULL);
+
+	if (i == LF_HASHMAP_NO_SLOT && m->old_ctrl != NULL) {
+		old = lfi(hashmap_old)(m);
+		t = &old;
+		i = lfi(hashmap_find)(t, hash, key, keylen, NULL);
+		lf_hashmap_count_merge(m, &old);
+	}
+
+	lf_hashmap_count(m, lookups, 1);
+	lf_hashmap_count(m, misses, i == LF_HASHMAP_NO_SLOT);
+
+	if (i == LF_HASHMAP_NO_SLOT)
+		return NULL;
+
+	struct lfi(hashmap_entry) *e = lf_hashmap_entry_at(t->entries, i);
+	struct lfi(hashmap_entry) *hold = lf_hashmap_entry_at(m->entries, m->cap);
+
+	/* Slot may be overwritten by the following entries. */
+	memcpy(hold->value, e->value, m->value_size);
+
+	if (!lf_hashmap_key_is_inline(e->keylen))
+		lfi(free)(&m->allocator, (void *) e->key.ptr, e->keylen);
 
-		i %= m->cap;
-	} while (i != start_i);
+	lfi(hashmap_release)(t, i);
+	m->used--;
 
-	lf_unreachable;  // GCOVR_EXCL_LINE: unreachable
+	return hold->value;
 }
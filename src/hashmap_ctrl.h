@@ -0,0 +1,216 @@
+#ifndef LF_HASHMAP_CTRL_H
+#define LF_HASHMAP_CTRL_H
+
+#ifndef LF_HEADERONLY
+#include "../include/config.h"
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+/* Control bytes of the hashmaps, one per slot. A full slot holds the 7-bit tag
+ * taken from the top bits of the key hash, empty and deleted slots have the
+ * high bit set. Shared by hashmap.h, typed_hashmap.h and intmap.h. */
+#define LF_HASHMAP_CTRL_EMPTY ((unsigned char) 0x80)
+#define LF_HASHMAP_CTRL_DELETED ((unsigned char) 0xfe)
+
+#define lf_hashmap_ctrl_is_full(c) (((c) & 0x80) == 0)
+
+#define lf_hashmap_tag(hash) ((unsigned char) ((hash) >> 57))
+
+/* Number of control bytes scanned at once. */
+#define LF_HASHMAP_GROUP_WIDTH 16
+
+
+/* Bitmask of the slots in the group whose control byte equals c. */
+inline lfi_fdecl(uint32_t, hashmap_group_match)(const unsigned char *group,
+						unsigned char c)
+{
+#ifdef __SSE2__
+	__m128i ctrl = _mm_loadu_si128((const __m128i *) group);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(c)));
+#else
+	uint32_t mask = 0;
+
+	for (int i = 0; i < LF_HASHMAP_GROUP_WIDTH; i++)
+		mask |= (uint32_t) (group[i] == c) << i;
+
+	return mask;
+#endif
+}
+
+/* Bitmask of the empty or deleted slots in the group. */
+inline lfi_fdecl(uint32_t, hashmap_group_match_free)(const unsigned char *group)
+{
+#ifdef __SSE2__
+	return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) group));
+#else
+	uint32_t mask = 0;
+
+	for (int i = 0; i < LF_HASHMAP_GROUP_WIDTH; i++)
+		mask |= (uint32_t) (group[i] >> 7) << i;
+
+	return mask;
+#endif
+}
+
+/* Index of the lowest set bit, mask must not be zero. */
+inline lfi_fdecl(unsigned, hashmap_ctz)(uint32_t mask)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctz(mask);
+#else
+	unsigned i = 0;
+
+	while (!(mask & 1)) {
+		mask >>= 1;
+		i++;
+	}
+
+	return i;
+#endif
+}
+
+
+/* Tables of the typed hashmaps and of the integer maps: `cap` control bytes
+ * and as many entries of `stride` bytes. Groups are probed in order from the
+ * one holding the home slot, and a probe ends at a group with an empty slot.
+ * The functions are inlined with the entry comparison and hash functions
+ * given to them. */
+#define lf_group_table_first(hash, cap) \
+	((hash) & ((cap) - 1) & ~(size_t) (LF_HASHMAP_GROUP_WIDTH - 1))
+
+/* Slot of the entry for which eq(entry, key) holds in the probe sequence of
+ * the hash, or SIZE_MAX. */
+inline lfi_fdecl(size_t, group_table_find)(
+	const unsigned char *ctrl,
+	const char *entries,
+	size_t cap,
+	size_t stride,
+	uint64_t hash,
+	const void *key,
+	bool (*eq)(const void *entry, const void *key))
+{
+	unsigned char tag = lf_hashmap_tag(hash);
+	size_t g = lf_group_table_first(hash, cap);
+
+	for (;;) {
+		const unsigned char *group = &ctrl[g];
+		uint32_t match = lfi(hashmap_group_match)(group, tag);
+
+		while (match) {
+			size_t i = g + lfi(hashmap_ctz)(match);
+
+			if (eq(&entries[i * stride], key))
+				return i;
+
+			match &= match - 1;
+		}
+
+		if (lfi(hashmap_group_match)(group, LF_HASHMAP_CTRL_EMPTY))
+			return SIZE_MAX;
+
+		g = (g + LF_HASHMAP_GROUP_WIDTH) & (cap - 1);
+	}
+}
+
+/* Claims the first free slot in the probe sequence of the hash, and tags it
+ * with the hash. */
+inline lfi_fdecl(size_t, group_table_claim)(unsigned char *ctrl,
+					    size_t cap,
+					    uint64_t hash,
+					    size_t *deleted)
+{
+	size_t g = lf_group_table_first(hash, cap);
+	uint32_t free_slots;
+
+	while (!(free_slots = lfi(hashmap_group_match_free)(&ctrl[g])))
+		g = (g + LF_HASHMAP_GROUP_WIDTH) & (cap - 1);
+
+	size_t i = g + lfi(hashmap_ctz)(free_slots);
+
+	if (ctrl[i] == LF_HASHMAP_CTRL_DELETED)
+		(*deleted)--;
+
+	ctrl[i] = lf_hashmap_tag(hash);
+
+	return i;
+}
+
+/* Empties the slot of a removed entry. Probes end at a group with an empty
+ * slot, so the slot can be emptied if its group already has one. */
+inline lfi_fdecl(void, group_table_release)(unsigned char *ctrl,
+					    size_t i,
+					    size_t *deleted)
+{
+	size_t g = i & ~(size_t) (LF_HASHMAP_GROUP_WIDTH - 1);
+
+	if (lfi(hashmap_group_match)(&ctrl[g], LF_HASHMAP_CTRL_EMPTY)) {
+		ctrl[i] = LF_HASHMAP_CTRL_EMPTY;
+	} else {
+		ctrl[i] = LF_HASHMAP_CTRL_DELETED;
+		(*deleted)++;
+	}
+}
+
+/* Copies the entries of a table to an empty one, hash(entry) hashing their
+ * keys. */
+inline lfi_fdecl(void, group_table_move)(const unsigned char *old_ctrl,
+					 const char *old_entries,
+					 size_t old_cap,
+					 unsigned char *ctrl,
+					 char *entries,
+					 size_t cap,
+					 size_t stride,
+					 uint64_t (*hash)(const void *entry))
+{
+	size_t deleted = 0;
+
+	for (size_t i = 0; i < old_cap; i++) {
+		if (!lf_hashmap_ctrl_is_full(old_ctrl[i]))
+			continue;
+
+		const char *e = &old_entries[i * stride];
+		size_t j = lfi(group_table_claim)(ctrl, cap, hash(e), &deleted);
+
+		memcpy(&entries[j * stride], e, stride);
+	}
+}
+
+/* Capacity to rehash to before inserting, or zero if the entry fits. Deleted
+ * slots are dropped without growing if they make up the most of the load. */
+inline lfi_fdecl(size_t, group_table_grow)(size_t cap,
+					   size_t used,
+					   size_t deleted)
+{
+	if (used + deleted < cap / 4 * 3)
+		return 0;
+
+	return used * 2 >= cap / 4 * 3 ? cap * 2 : cap;
+}
+
+/* Smallest capacity whose three quarters hold n entries, zero if it
+ * overflows. */
+inline lfi_fdecl(size_t, group_table_cap_for)(size_t n)
+{
+	size_t cap = LF_HASHMAP_GROUP_WIDTH;
+
+	while (cap / 4 * 3 < n) {
+		if (cap > SIZE_MAX / 4)
+			return 0;
+
+		cap *= 2;
+	}
+
+	return cap;
+}
+
+#endif
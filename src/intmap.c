@@ -0,0 +1,304 @@
+#ifndef LF_HEADERONLY
+#include "util.h"
+#include "../include/config.h"
+#include "../include/intmap.h"
+#include "hashmap_ctrl.h"
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* The tables are probed by the table functions of hashmap_ctrl.h, as in the
+ * typed hashmaps. */
+/* Returned by intmap_find() if the key is not found. */
+#define LF_INTMAP_NO_SLOT SIZE_MAX
+
+#define lf_intmap_entry_at(m, i) (&(m)->entries[(i) * (m)->stride])
+
+#define lf_intmap_value_at(m, i) (lf_intmap_entry_at(m, i) + (m)->value_offset)
+
+
+/* Finalizer of MurmurHash3, every input bit affects every output bit. */
+inline lfi_fdecl(uint64_t, intmap_mix)(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= UINT64_C(0xff51afd7ed558ccd);
+	k ^= k >> 33;
+	k *= UINT64_C(0xc4ceb9fe1a85ec53);
+	k ^= k >> 33;
+
+	return k;
+}
+
+/* Values follow the keys, aligned to sizeof(size_t), unless they fit in the
+ * alignment of the key. */
+inline lfi_fdecl(void, intmap_layout)(size_t key_size,
+				      size_t value_size,
+				      size_t *value_offset,
+				      size_t *stride)
+{
+	size_t align = value_size <= key_size ? key_size : sizeof(size_t);
+
+	if (align < key_size)
+		align = key_size;
+
+	*value_offset = (key_size + align - 1) / align * align;
+	*stride = (*value_offset + value_size + align - 1) / align * align;
+}
+
+
+/* Defines the functions of an integer keyed map. The implementations of
+ * u64map and u32map only differ in their key types. */
+#define lf_intmap_define(name, key_t) \
+\
+/* The entry functions given to the table functions. */ \
+inline lfi_fdecl(bool, name##_eq)(const void *entry, const void *key) \
+{ \
+	return *(const key_t *) entry == *(const key_t *) key; \
+} \
+\
+inline lfi_fdecl(uint64_t, name##_hash)(const void *entry) \
+{ \
+	return lfi(intmap_mix)(*(const key_t *) entry); \
+} \
+\
+lfi_fdecl(int, name##_alloc)(struct lf(name) *m, size_t cap) \
+{ \
+	/* The control bytes keep the entries aligned, as cap is a multiple \
+	 * of the group width. One more entry than the capacity is allocated, \
+	 * used as a scratch entry. */ \
+	unsigned char *ctrl = malloc(cap + (cap + 1) * m->stride); \
+\
+	if (ctrl == NULL) \
+		return 1; \
+\
+	memset(ctrl, LF_HASHMAP_CTRL_EMPTY, cap); \
+\
+	m->ctrl = ctrl; \
+	m->entries = (char *) &ctrl[cap]; \
+	m->cap = cap; \
+	m->deleted = 0; \
+\
+	return 0; \
+} \
+\
+lfi_fdecl(size_t, name##_find)(struct lf(name) *m, key_t key, uint64_t hash) \
+{ \
+	return lfi(group_table_find)(m->ctrl, m->entries, m->cap, m->stride, \
+				     hash, &key, lfi(name##_eq)); \
+} \
+\
+lfi_fdecl(int, name##_rehash)(struct lf(name) *m, size_t cap) \
+{ \
+	struct lf(name) old = *m; \
+\
+	if (lfi(name##_alloc)(m, cap)) \
+		return 1; \
+\
+	lfi(group_table_move)(old.ctrl, old.entries, old.cap, m->ctrl, \
+			      m->entries, m->cap, m->stride, \
+			      lfi(name##_hash)); \
+	free(old.ctrl); \
+\
+	return 0; \
+} \
+\
+lfi_fdecl(void *, name##_insert_new)(struct lf(name) *m, \
+				     key_t key, \
+				     uint64_t hash, \
+				     const void *value) \
+{ \
+	size_t cap = lfi(group_table_grow)(m->cap, m->used, m->deleted); \
+\
+	if (cap != 0 && lfi(name##_rehash)(m, cap)) \
+		return NULL; \
+\
+	size_t i = lfi(group_table_claim)(m->ctrl, m->cap, hash, &m->deleted); \
+\
+	*(key_t *) lf_intmap_entry_at(m, i) = key; \
+\
+	if (m->value_size && value != NULL) \
+		memcpy(lf_intmap_value_at(m, i), value, m->value_size); \
+\
+	m->used++; \
+\
+	return lf_intmap_value_at(m, i); \
+} \
+\
+int lf(name##_init)(struct lf(name) *m, size_t value_size) \
+{ \
+	m->used = 0; \
+	m->value_size = value_size; \
+\
+	lfi(intmap_layout)(sizeof(key_t), value_size, \
+			   &m->value_offset, &m->stride); \
+\
+	return lfi(name##_alloc)(m, LF_HASHMAP_INITIAL_CAP); \
+} \
+\
+void lf(name##_destroy)(struct lf(name) *m) \
+{ \
+	free(m->ctrl); \
+} \
+\
+void *lf(name##_get)(struct lf(name) *m, key_t key) \
+{ \
+	size_t i = lfi(name##_find)(m, key, lfi(intmap_mix)(key)); \
+\
+	return i == LF_INTMAP_NO_SLOT ? NULL : lf_intmap_value_at(m, i); \
+} \
+\
+void *lf(name##_insert)(struct lf(name) *m, key_t key, const void *value) \
+{ \
+	uint64_t hash = lfi(intmap_mix)(key); \
+\
+	lf_debug_assert(lfi(name##_find)(m, key, hash) == LF_INTMAP_NO_SLOT, \
+			"map contains the element"); \
+\
+	return lfi(name##_insert_new)(m, key, hash, value); \
+} \
+\
+void *lf(name##_get_or_insert)(struct lf(name) *m, \
+			       key_t key, \
+			       const void *value, \
+			       bool *inserted) \
+{ \
+	uint64_t hash = lfi(intmap_mix)(key); \
+	size_t i = lfi(name##_find)(m, key, hash); \
+\
+	if (inserted != NULL) \
+		*inserted = i == LF_INTMAP_NO_SLOT; \
+\
+	if (i != LF_INTMAP_NO_SLOT) \
+		return lf_intmap_value_at(m, i); \
+\
+	return lfi(name##_insert_new)(m, key, hash, value); \
+} \
+\
+void *lf(name##_upsert)(struct lf(name) *m, \
+			key_t key, \
+			const void *value, \
+			bool *inserted) \
+{ \
+	bool inserted_; \
+	void *v = lf(name##_get_or_insert)(m, key, value, &inserted_); \
+\
+	if (v != NULL && !inserted_ && m->value_size && value != NULL) \
+		memcpy(v, value, m->value_size); \
+\
+	if (inserted != NULL) \
+		*inserted = inserted_; \
+\
+	return v; \
+} \
+\
+const void *lf(name##_remove)(struct lf(name) *m, key_t key) \
+{ \
+	size_t i = lfi(name##_find)(m, key, lfi(intmap_mix)(key)); \
+\
+	if (i == LF_INTMAP_NO_SLOT) \
+		return NULL; \
+\
+	void *hold = lf_intmap_value_at(m, m->cap); \
+\
+	/* Slot may be overwritten by the following entries. */ \
+	memcpy(hold, lf_intmap_value_at(m, i), m->value_size); \
+\
+	lfi(group_table_release)(m->ctrl, i, &m->deleted); \
+	m->used--; \
+\
+	return hold; \
+} \
+\
+int lf(name##_reserve)(struct lf(name) *m, size_t n) \
+{ \
+	size_t cap = lfi(group_table_cap_for)(n); \
+\
+	if (cap == 0) \
+		return 1; \
+\
+	return cap > m->cap ? lfi(name##_rehash)(m, cap) : 0; \
+} \
+\
+void lf(name##_clear)(struct lf(name) *m) \
+{ \
+	memset(m->ctrl, LF_HASHMAP_CTRL_EMPTY, m->cap); \
+	m->used = 0; \
+	m->deleted = 0; \
+} \
+\
+void lf(name##_iter)(struct lf(name) *m, struct lf(name##_it) *it) \
+{ \
+	it->m = m; \
+	it->i = 0; \
+} \
+\
+struct lf(entry) lf(name##_iter_next)(struct lf(name##_it) *it) \
+{ \
+	struct lf(name) *m = it->m; \
+\
+	while (it->i < m->cap) { \
+		size_t i = it->i++; \
+\
+		if (lf_hashmap_ctrl_is_full(m->ctrl[i])) \
+			return (struct lf(entry)) { \
+				.key = lf_intmap_entry_at(m, i), \
+				.keylen = sizeof(key_t), \
+				.value = lf_intmap_value_at(m, i) \
+			}; \
+	} \
+\
+	return lfi_sentinel_entry; \
+} \
+\
+void lf(name##_xinit)(struct lf(name) *m, size_t value_size) \
+{ \
+	lf_unwrap(lf(name##_init)(m, value_size)); \
+} \
+\
+void *lf(name##_xinsert)(struct lf(name) *m, key_t key, const void *value) \
+{ \
+	void *insert_res = lf(name##_insert)(m, key, value); \
+\
+	lf_assert(insert_res != NULL, "insert returned NULL"); \
+\
+	return insert_res; \
+} \
+\
+void *lf(name##_xget_or_insert)(struct lf(name) *m, \
+				key_t key, \
+				const void *value, \
+				bool *inserted) \
+{ \
+	void *insert_res = lf(name##_get_or_insert)(m, key, value, inserted); \
+\
+	lf_assert(insert_res != NULL, "insert returned NULL"); \
+\
+	return insert_res; \
+} \
+\
+void *lf(name##_xupsert)(struct lf(name) *m, \
+			 key_t key, \
+			 const void *value, \
+			 bool *inserted) \
+{ \
+	void *insert_res = lf(name##_upsert)(m, key, value, inserted); \
+\
+	lf_assert(insert_res != NULL, "insert returned NULL"); \
+\
+	return insert_res; \
+} \
+\
+void lf(name##_xreserve)(struct lf(name) *m, size_t n) \
+{ \
+	lf_unwrap(lf(name##_reserve)(m, n)); \
+}
+
+
+lf_intmap_define(u64map, uint64_t)
+
+lf_intmap_define(u32map, uint32_t)
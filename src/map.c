@@ -1,8 +1,10 @@
 #ifndef LF_HEADERONLY
 #include "util.h"
+#include "../include/config.h"
 #include "../include/map.h"
 #endif
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -17,22 +19,283 @@
 
 #define lf_map_node_value(n) (&(n)->kv[lf_map_align((n)->keylen)])
 
+#if (LF_MAP_POOL_MAX_NODE_SIZE) % 16 != 0 || \
+	(LF_MAP_MAX_SLAB_SIZE) < (LF_MAP_POOL_MAX_NODE_SIZE) * 16
+#error "LF_MAP_POOL_MAX_NODE_SIZE must be a multiple of 16, and at most \
+LF_MAP_MAX_SLAB_SIZE / 16"
+#endif
 
-/* Allocates a new node. */
-lfi_fdecl(struct lfi(map_node) *, map_new_node)(const void *key,
-						size_t keylen,
-						const void *value,
-						size_t value_size)
+/* Pooled nodes are rounded up to a multiple of the granule, each multiple is
+ * a size class with its own free list. */
+#define LF_MAP_POOL_GRANULE 16
+
+#define lf_map_pool_class(size) (((size) - 1) / LF_MAP_POOL_GRANULE)
+
+
+/* Slabs are linked to be released along with the map. */
+struct lfi(map_slab) {
+	struct lfi(map_slab) *next;
+	size_t size;
+	max_align_t data[];
+};
+
+/* Slabs holding nodes of more than one map, after a split or a join. Shares
+ * refer to the shares of the maps they were made from, and are released with
+ * them once no map refers to them. */
+struct lfi(map_share) {
+	atomic_size_t refs;
+
+	struct lfi(map_slab) *slabs;
+	struct lfi(map_share) *parents[2];
+
+	/* Links the shares being released. */
+	struct lfi(map_share) *next;
+};
+
+/* Subtree with the number of black nodes on its paths, including its root. */
+struct lfi(map_tree) {
+	struct lfi(map_node) *root;
+	size_t bh;
+};
+
+
+/* Size of the allocation holding the node. */
+inline lfi_fdecl(size_t, map_node_alloc_size)(size_t keylen, size_t value_size)
 {
 	size_t size = lf_map_align(sizeof(struct lfi(map_node)));
-	size_t aligned_keylen = lf_map_align(keylen);
 
 	if (value_size > 0)
-		size += aligned_keylen + value_size;
+		size += lf_map_align(keylen) + value_size;
 	else
 		size += keylen;
 
-	struct lfi(map_node) *n = malloc(size);
+	return size;
+}
+
+/* Starts a new slab. The remaining space of the current slab is abandoned. */
+lfi_fdecl(int, map_pool_grow)(struct lf(map) *m)
+{
+	struct lfi(map_slab) *slab =
+		lf_alloc(&m->allocator,
+			 sizeof(struct lfi(map_slab)) + m->slab_size);
+
+	if (slab == NULL)
+		return 1;
+
+	slab->next = m->slabs;
+	slab->size = m->slab_size;
+
+	m->slabs = slab;
+	m->slab_top = (char *) slab->data;
+	m->slab_left = m->slab_size;
+
+	if (m->slab_size < LF_MAP_MAX_SLAB_SIZE / 2)
+		m->slab_size *= 2;
+	else
+		m->slab_size = LF_MAP_MAX_SLAB_SIZE;
+
+	return 0;
+}
+
+/* Allocates a node from its free list, or from the current slab. */
+lfi_fdecl(void *, map_pool_alloc)(struct lf(map) *m, size_t size)
+{
+	if (size > LF_MAP_POOL_MAX_NODE_SIZE) {
+		void *n = lf_alloc(&m->allocator, size);
+
+		if (n != NULL)
+			m->large_nodes++;
+
+		return n;
+	}
+
+	size_t c = lf_map_pool_class(size);
+	void *n = m->free_nodes[c];
+
+	if (n != NULL) {
+		m->free_nodes[c] = *(void **) n;
+
+		return n;
+	}
+
+	size = (c + 1) * LF_MAP_POOL_GRANULE;
+
+	if (size > m->slab_left && lfi(map_pool_grow)(m))
+		return NULL;
+
+	n = m->slab_top;
+	m->slab_top += size;
+	m->slab_left -= size;
+
+	return n;
+}
+
+/* Pushes the node to the free list of its size class. */
+lfi_fdecl(void, map_pool_free)(struct lf(map) *m, void *n, size_t size)
+{
+	if (size > LF_MAP_POOL_MAX_NODE_SIZE) {
+		lfi(free)(&m->allocator, n, size);
+		m->large_nodes--;
+
+		return;
+	}
+
+	size_t c = lf_map_pool_class(size);
+
+	*(void **) n = m->free_nodes[c];
+	m->free_nodes[c] = n;
+}
+
+lfi_fdecl(void, map_free_slabs)(struct lf(map) *m, struct lfi(map_slab) *slab)
+{
+	while (slab != NULL) {
+		struct lfi(map_slab) *next = slab->next;
+
+		lfi(free)(&m->allocator, slab,
+			  sizeof(struct lfi(map_slab)) + slab->size);
+		slab = next;
+	}
+}
+
+/* Drops a reference to the share, releasing the shares no longer referred
+ * to. */
+lfi_fdecl(void, map_share_release)(struct lf(map) *m,
+				   struct lfi(map_share) *share)
+{
+	if (share == NULL || atomic_fetch_sub(&share->refs, 1) != 1)
+		return;
+
+	share->next = NULL;
+
+	while (share != NULL) {
+		struct lfi(map_share) *next = share->next;
+
+		for (int i = 0; i < 2; i++) {
+			struct lfi(map_share) *parent = share->parents[i];
+
+			if (parent != NULL &&
+			    atomic_fetch_sub(&parent->refs, 1) == 1) {
+				parent->next = next;
+				next = parent;
+			}
+		}
+
+		lfi(map_free_slabs)(m, share->slabs);
+		lfi(free)(&m->allocator, share, sizeof(*share));
+
+		share = next;
+	}
+}
+
+lfi_fdecl(struct lfi(map_share) *, map_share_new)(struct lf(map) *m,
+						  struct lfi(map_slab) *slabs,
+						  struct lfi(map_share) *p1,
+						  struct lfi(map_share) *p2)
+{
+	struct lfi(map_share) *share = lf_alloc(&m->allocator, sizeof(*share));
+
+	if (share == NULL)
+		return NULL;
+
+	atomic_init(&share->refs, 1);
+	share->slabs = slabs;
+	share->parents[0] = p1;
+	share->parents[1] = p2;
+
+	return share;
+}
+
+/* Moves the slabs of `m` to a share, and lets `other` refer to it. `other`
+ * must not have a pool of its own. */
+lfi_fdecl(int, map_pool_share)(struct lf(map) *m, struct lf(map) *other)
+{
+	if (m->slabs != NULL) {
+		struct lfi(map_share) *share =
+			lfi(map_share_new)(m, m->slabs, m->share, NULL);
+
+		if (share == NULL)
+			return 1;
+
+		m->slabs = NULL;
+		m->share = share;
+	}
+
+	if (m->share != NULL)
+		atomic_fetch_add(&m->share->refs, 1);
+
+	other->share = m->share;
+
+	return 0;
+}
+
+/* Moves the pool of `other` to `m`, leaving `other` with an empty pool.
+ * Nodes of either map can then be freed to `m`. */
+lfi_fdecl(int, map_pool_absorb)(struct lf(map) *m, struct lf(map) *other)
+{
+	struct lfi(map_share) *share = m->share;
+
+	if (share == NULL) {
+		share = other->share;
+	} else if (other->share != NULL && other->share != share) {
+		share = lfi(map_share_new)(m, NULL, m->share, other->share);
+
+		if (share == NULL)
+			return 1;
+	} else if (other->share != NULL) {
+		/* Both refer to it, the reference of `other` is dropped. */
+		atomic_fetch_sub(&share->refs, 1);
+	}
+
+	m->share = share;
+	other->share = NULL;
+
+	if (other->slabs != NULL) {
+		struct lfi(map_slab) *tail = other->slabs;
+
+		while (tail->next != NULL)
+			tail = tail->next;
+
+		tail->next = m->slabs;
+		m->slabs = other->slabs;
+	}
+
+	for (size_t c = 0; c < LF_MAP_POOL_MAX_NODE_SIZE / 16; c++) {
+		void *n = other->free_nodes[c];
+
+		if (n == NULL)
+			continue;
+
+		while (*(void **) n != NULL)
+			n = *(void **) n;
+
+		*(void **) n = m->free_nodes[c];
+		m->free_nodes[c] = other->free_nodes[c];
+		other->free_nodes[c] = NULL;
+	}
+
+	if (m->slab_size < other->slab_size)
+		m->slab_size = other->slab_size;
+
+	m->large_nodes += other->large_nodes;
+
+	other->slabs = NULL;
+	other->slab_top = NULL;
+	other->slab_left = 0;
+	other->large_nodes = 0;
+
+	return 0;
+}
+
+/* Allocates a new node. */
+lfi_fdecl(struct lfi(map_node) *, map_new_node)(struct lf(map) *m,
+						const void *key,
+						size_t keylen,
+						const void *value)
+{
+	size_t value_size = m->value_size;
+	struct lfi(map_node) *n =
+		lfi(map_pool_alloc)(m, lfi(map_node_alloc_size)(keylen,
+								 value_size));
 
 	if (n == NULL)
 		return NULL;
@@ -42,6 +305,7 @@ lfi_fdecl(struct lfi(map_node) *, map_new_node)(const void *key,
 	n->keylen = keylen;
 	n->p = n->left = n->right = NULL;
 	n->size = 1;
+	n->prefix = lfi(key_prefix)(key, keylen);
 	n->color = 1;
 
 	if (value_size > 0 && value != NULL)
@@ -177,7 +441,9 @@ lfi_fdecl(void, map_delete_fixup)(struct lf(map) *m,
 		x->color = 0;
 }
 
-lfi_fdecl(void, map_insert_fixup)(struct lf(map) *m, struct lfi(map_node) *z)
+/* Returns true if the root is turned black, which adds a black node to every
+ * path. */
+lfi_fdecl(bool, map_insert_fixup)(struct lf(map) *m, struct lfi(map_node) *z)
 {
 	while (z->p != NULL && z->p->color == 1) {
 		if (z->p == z->p->p->left) {
@@ -223,7 +489,11 @@ lfi_fdecl(void, map_insert_fixup)(struct lf(map) *m, struct lfi(map_node) *z)
 	}
 
 	/* case 0 */
+	bool grown = m->root->color == 1;
+
 	m->root->color = 0;
+
+	return grown;
 }
 
 lfi_fdecl(void, map_transplant)(struct lf(map) *m,
@@ -260,6 +530,83 @@ lfi_fdecl(int, map_default_comparator)(const void *key1, const void *key2,
 	return res;
 }
 
+/* Compares the key of the node to the given one. The default comparison is
+ * decided by the prefixes unless they are equal, without calling through the
+ * pointer. */
+inline lfi_fdecl(int, map_cmp)(const struct lf(map) *m,
+			       const struct lfi(map_node) *n,
+			       const void *key,
+			       size_t keylen,
+			       uint64_t prefix)
+{
+	if (m->cmp != lfi(map_default_comparator))
+		return m->cmp(n->kv, key, n->keylen, keylen);
+
+	if (n->prefix != prefix)
+		return n->prefix < prefix ? -1 : 1;
+
+	return lfi(map_default_comparator)(n->kv, key, n->keylen, keylen);
+}
+
+/* Takes the node out of the tree, without freeing it. */
+lfi_fdecl(void, map_unlink)(struct lf(map) *m, struct lfi(map_node) *z)
+{
+	struct lfi(map_node) *y = z;
+
+	char orig_color = y->color;
+
+	struct lfi(map_node) *x, *x_parent = NULL;
+
+	if (z->left == NULL) {
+		/* case 1 */
+		x = z->right;
+		x_parent = z->p;
+		lfi(map_transplant)(m, z, z->right);
+	} else if (z->right == NULL) {
+		/* case 2 */
+		x = z->left;
+		x_parent = z->p;
+		lfi(map_transplant)(m, z, z->left);
+	} else {
+		/* case 3 */
+		y = z->right;
+
+		while (y->left)
+			y = y->left;
+
+		orig_color = y->color;
+		x = y->right;
+
+		if (y->p == z) {
+			x_parent = y;
+			if (x != NULL)
+				x->p = y;
+		} else {
+			x_parent = y->p;
+			lfi(map_transplant)(m, y, y->right);
+			y->right = z->right;
+			y->right->p = y;
+		}
+
+		lfi(map_transplant)(m, z, y);
+		y->left = z->left;
+		y->left->p = y;
+		y->color = z->color;
+
+		y->size = z->size;
+	}
+
+	struct lfi(map_node) *cur = x_parent;
+	while (cur != NULL) {
+		cur->size--;
+		cur = cur->p;
+	}
+
+	if (orig_color == 0)
+		lfi(map_delete_fixup)(m, x, x_parent);
+}
+
+/* Releases the nodes not allocated from the slabs. */
 lfi_fdecl(void, map_destroy_recursive)(struct lf(map) *m,
 				       struct lfi(map_node) *n)
 {
@@ -267,18 +614,256 @@ lfi_fdecl(void, map_destroy_recursive)(struct lf(map) *m,
 		lfi(map_destroy_recursive)(m, n->left);
 		lfi(map_destroy_recursive)(m, n->right);
 
-		free(n);
+		size_t size = lfi(map_node_alloc_size)(n->keylen,
+						       m->value_size);
+
+		if (size > LF_MAP_POOL_MAX_NODE_SIZE)
+			lfi(free)(&m->allocator, n, size);
+	}
+}
+
+/* Returns the nodes of a partially built tree to the pool. */
+lfi_fdecl(void, map_release_recursive)(struct lf(map) *m,
+				       struct lfi(map_node) *n)
+{
+	if (n != NULL) {
+		lfi(map_release_recursive)(m, n->left);
+		lfi(map_release_recursive)(m, n->right);
+
+		lfi(map_pool_free)(m, n, lfi(map_node_alloc_size)(n->keylen,
+								  m->value_size));
+	}
+}
+
+/* Builds the subtree of the entries in [lo, hi) rooted at their middle entry.
+ * Subtree sizes differ by at most one, so every leaf is on the last two
+ * levels. Nodes on the deepest level of the whole tree are red and the rest
+ * are black, which gives every path the same number of black nodes. Sets
+ * `*err` and returns the part built so far if an allocation fails. */
+lfi_fdecl(struct lfi(map_node) *, map_build)(struct lf(map) *m,
+					     const void *const *keys,
+					     const size_t *keylens,
+					     const char *values,
+					     size_t lo,
+					     size_t hi,
+					     size_t depth,
+					     size_t red_depth,
+					     bool *err)
+{
+	if (lo == hi)
+		return NULL;
+
+	size_t mid = lo + (hi - lo) / 2;
+	size_t keylen = keylens != NULL ? keylens[mid] : strlen(keys[mid]);
+	const void *value = values != NULL ? &values[mid * m->value_size] : NULL;
+
+	struct lfi(map_node) *n = lfi(map_new_node)(m, keys[mid], keylen, value);
+
+	if (n == NULL) {
+		*err = true;
+
+		return NULL;
+	}
+
+	n->left = lfi(map_build)(m, keys, keylens, values, lo, mid,
+				 depth + 1, red_depth, err);
+	n->right = lfi(map_build)(m, keys, keylens, values, mid + 1, hi,
+				  depth + 1, red_depth, err);
+
+	if (n->left != NULL)
+		n->left->p = n;
+	if (n->right != NULL)
+		n->right->p = n;
+
+	n->size = hi - lo;
+	n->color = depth == red_depth && depth > 0;
+
+	return n;
+}
+
+lfi_fdecl(size_t, map_black_height)(struct lfi(map_node) *n)
+{
+	size_t bh = 0;
+
+	for (; n != NULL; n = n->left)
+		bh += !n->color;
+
+	return bh;
+}
+
+/* Makes the child of a node with `bh` black nodes on its paths a tree of its
+ * own. Roots of trees are black. */
+lfi_fdecl(struct lfi(map_tree), map_detach)(struct lfi(map_node) *parent,
+					    size_t bh,
+					    struct lfi(map_node) *n)
+{
+	struct lfi(map_tree) t = { n, bh - !parent->color };
+
+	if (n != NULL) {
+		n->p = NULL;
+
+		if (n->color) {
+			n->color = 0;
+			t.bh++;
+		}
+	}
+
+	return t;
+}
+
+/* Joins the trees with `x` in between, all keys of `l` are less than the key
+ * of `x` and all keys of `r` are greater. The root of the shorter tree
+ * replaces a black node of the same black height on the near spine of the
+ * taller one, under the red `x`, and the insert fixup restores the colors. */
+lfi_fdecl(struct lfi(map_tree), map_join3)(struct lfi(map_tree) l,
+					   struct lfi(map_node) *x,
+					   struct lfi(map_tree) r)
+{
+	x->left = l.root;
+	x->right = r.root;
+	x->size = lf_map_node_size(l.root) + lf_map_node_size(r.root) + 1;
+
+	if (l.bh == r.bh) {
+		x->p = NULL;
+		x->color = 0;
+
+		if (l.root != NULL)
+			l.root->p = x;
+		if (r.root != NULL)
+			r.root->p = x;
+
+		return (struct lfi(map_tree)) { x, l.bh + 1 };
+	}
+
+	bool taller_left = l.bh > r.bh;
+	struct lfi(map_tree) tall = taller_left ? l : r;
+	struct lfi(map_tree) short_ = taller_left ? r : l;
+
+	struct lfi(map_node) *cur = tall.root;
+	struct lfi(map_node) *p = NULL;
+	size_t bh = tall.bh;
+	size_t add = lf_map_node_size(short_.root) + 1;
+
+	while (bh > short_.bh || lf_map_node_color(cur) == 1) {
+		bh -= !cur->color;
+		cur->size += add;
+		p = cur;
+		cur = taller_left ? cur->right : cur->left;
+	}
+
+	if (taller_left) {
+		x->left = cur;
+		p->right = x;
+	} else {
+		x->right = cur;
+		p->left = x;
+	}
+
+	if (cur != NULL)
+		cur->p = x;
+	if (short_.root != NULL)
+		short_.root->p = x;
+
+	x->p = p;
+	x->color = 1;
+	x->size = lf_map_node_size(x->left) + lf_map_node_size(x->right) + 1;
+
+	struct lf(map) t = { .root = tall.root };
+	bool grown = lfi(map_insert_fixup)(&t, x);
+
+	return (struct lfi(map_tree)) { t.root, tall.bh + grown };
+}
+
+/* Splits the tree into the keys less than the key, and the rest. If `eq` is
+ * not NULL, the node matching the key is detached to `*eq` rather than
+ * going to the right. */
+lfi_fdecl(void, map_split_tree)(const struct lf(map) *m,
+				struct lfi(map_tree) t,
+				const void *key,
+				size_t keylen,
+				uint64_t prefix,
+				struct lfi(map_tree) *l,
+				struct lfi(map_tree) *r,
+				struct lfi(map_node) **eq)
+{
+	struct lfi(map_node) *n = t.root;
+
+	if (n == NULL) {
+		*l = *r = t;
+
+		return;
+	}
+
+	struct lfi(map_tree) left = lfi(map_detach)(n, t.bh, n->left);
+	struct lfi(map_tree) right = lfi(map_detach)(n, t.bh, n->right);
+	struct lfi(map_tree) part;
+
+	int cmp = lfi(map_cmp)(m, n, key, keylen, prefix);
+
+	if (cmp == 0 && eq != NULL) {
+		*eq = n;
+		*l = left;
+		*r = right;
+	} else if (cmp >= 0) {
+		lfi(map_split_tree)(m, left, key, keylen, prefix, l, &part,
+				    eq);
+		*r = lfi(map_join3)(part, n, right);
+	} else {
+		lfi(map_split_tree)(m, right, key, keylen, prefix, &part, r,
+				    eq);
+		*l = lfi(map_join3)(left, n, part);
 	}
 }
 
+/* Merges the trees, freeing the nodes of `b` whose keys are in `a`. */
+lfi_fdecl(struct lfi(map_tree), map_union_tree)(struct lf(map) *m,
+						struct lfi(map_tree) a,
+						struct lfi(map_tree) b)
+{
+	struct lfi(map_node) *n = a.root;
+
+	if (n == NULL)
+		return b;
+	if (b.root == NULL)
+		return a;
+
+	struct lfi(map_tree) al = lfi(map_detach)(n, a.bh, n->left);
+	struct lfi(map_tree) ar = lfi(map_detach)(n, a.bh, n->right);
+	struct lfi(map_tree) bl, br;
+	struct lfi(map_node) *dup = NULL;
+
+	lfi(map_split_tree)(m, b, n->kv, n->keylen, n->prefix, &bl, &br, &dup);
+
+	if (dup != NULL)
+		lfi(map_pool_free)(m, dup, lfi(map_node_alloc_size)(dup->keylen,
+								    m->value_size));
+
+	struct lfi(map_tree) l = lfi(map_union_tree)(m, al, bl);
+	struct lfi(map_tree) r = lfi(map_union_tree)(m, ar, br);
+
+	return lfi(map_join3)(l, n, r);
+}
+
+lfi_fdecl(bool, map_compatible)(const struct lf(map) *m,
+				const struct lf(map) *other)
+{
+	return m->value_size == other->value_size && m->cmp == other->cmp &&
+	       m->allocator.alloc == other->allocator.alloc &&
+	       m->allocator.realloc == other->allocator.realloc &&
+	       m->allocator.free == other->allocator.free &&
+	       m->allocator.ctx == other->allocator.ctx;
+}
+
 lfi_fdecl(struct lfi(map_node) *, map_get2_node)(struct lf(map) *m,
 						 const void *key,
 						 size_t keylen)
 {
 	struct lfi(map_node) *cur = m->root;
 
+	uint64_t prefix = lfi(key_prefix)(key, keylen);
+
 	while (cur != NULL) {
-		int cmp = m->cmp(cur->kv, key, cur->keylen, keylen);
+		int cmp = lfi(map_cmp)(m, cur, key, keylen, prefix);
 
 		if (cmp < 0)
 			cur = cur->right;
@@ -369,11 +954,51 @@ lfi_fdecl(struct lfi(map_node) *, map_predecessor)(struct lfi(map_node) *n)
 	return y;
 }
 
-/* Constructs a map_entry from a node, or the exhaustion sentinel if NULL. */
-lfi_fdecl(struct lf(entry), map_entry_of)(struct lfi(map_node) *n)
+/* Returns the first node with a key not less than the key, or greater than
+ * the key if `upper`. Sets `*pred` to the node preceding it and `*rank` to its
+ * rank, unless they are NULL. */
+lfi_fdecl(struct lfi(map_node) *, map_bound)(const struct lf(map) *m,
+					     const void *key,
+					     size_t keylen,
+					     bool upper,
+					     struct lfi(map_node) **pred,
+					     size_t *rank)
 {
-	if (n == NULL)
-		return lfi_sentinel_entry;
+	struct lfi(map_node) *cur = m->root;
+	struct lfi(map_node) *bound = NULL;
+	struct lfi(map_node) *before = NULL;
+
+	uint64_t prefix = lfi(key_prefix)(key, keylen);
+	size_t r = 0;
+
+	while (cur != NULL) {
+		int cmp = lfi(map_cmp)(m, cur, key, keylen, prefix);
+
+		if (cmp < 0 || (upper && cmp == 0)) {
+			r += lf_map_node_size(cur->left) + 1;
+			before = cur;
+
+			cur = cur->right;
+		} else {
+			bound = cur;
+
+			cur = cur->left;
+		}
+	}
+
+	if (pred != NULL)
+		*pred = before;
+	if (rank != NULL)
+		*rank = r;
+
+	return bound;
+}
+
+/* Constructs a map_entry from a node, or the exhaustion sentinel if NULL. */
+lfi_fdecl(struct lf(entry), map_entry_of)(struct lfi(map_node) *n)
+{
+	if (n == NULL)
+		return lfi_sentinel_entry;
 
 	return (struct lf(entry)) {
 		.key = n->kv,
@@ -382,17 +1007,140 @@ lfi_fdecl(struct lf(entry), map_entry_of)(struct lfi(map_node) *n)
 	};
 }
 
+/* Links the new node under the leaf position of its key, searched from the
+ * root. */
+lfi_fdecl(void, map_insert_node)(struct lf(map) *m, struct lfi(map_node) *n)
+{
+	if (m->root == NULL) {
+		m->root = n;
+	} else {
+		struct lfi(map_node) *cur = m->root;
+
+		struct lfi(map_node) *p;
+		int cmp = 0;
+
+		while (cur != NULL) {
+			p = cur;
+			cur->size++;
+
+			cmp = lfi(map_cmp)(m, cur, n->kv, n->keylen, n->prefix);
+
+			lf_assert(cmp != 0, "map already contains the element");
+
+			if (cmp < 0)
+				cur = cur->right;
+			else if (cmp > 0)
+				cur = cur->left;
+		}
+
+		if (cmp < 0)
+			p->right = n;
+		else if (cmp > 0)
+			p->left = n;
+
+		n->p = p;
+	}
+
+	lfi(map_insert_fixup)(m, n);
+}
+
+/* Links the new node after the largest one if its key is larger. Sizes are
+ * counted on the way down the right spine, and restored if it is not. */
+lfi_fdecl(bool, map_append_node)(struct lf(map) *m, struct lfi(map_node) *n)
+{
+	struct lfi(map_node) *p = m->root;
+
+	if (p == NULL) {
+		m->root = n;
+		lfi(map_insert_fixup)(m, n);
+
+		return true;
+	}
+
+	for (p->size++; p->right != NULL; p->size++)
+		p = p->right;
+
+	if (lfi(map_cmp)(m, p, n->kv, n->keylen, n->prefix) >= 0) {
+		for (; p != NULL; p = p->p)
+			p->size--;
+
+		return false;
+	}
+
+	p->right = n;
+	n->p = p;
+
+	lfi(map_insert_fixup)(m, n);
+
+	return true;
+}
+
+/* Finds the leaf position of the key if it is next to the hint node. Returns
+ * false if it is not, without searching further. */
+lfi_fdecl(bool, map_hint_position)(const struct lf(map) *m,
+				   struct lfi(map_node) *h,
+				   const void *key,
+				   size_t keylen,
+				   uint64_t prefix,
+				   struct lfi(map_node) **parent,
+				   bool *left)
+{
+	int cmp = lfi(map_cmp)(m, h, key, keylen, prefix);
+
+	lf_assert(cmp != 0, "map already contains the element");
+
+	/* The key falls between the hint and its neighbour, below whichever
+	 * of them has a free child on that side. */
+	if (cmp < 0) {
+		struct lfi(map_node) *next = lfi(map_successor)(h);
+
+		if (next != NULL &&
+		    lfi(map_cmp)(m, next, key, keylen, prefix) <= 0)
+			return false;
+
+		*left = h->right != NULL;
+		*parent = *left ? next : h;
+	} else {
+		struct lfi(map_node) *prev = lfi(map_predecessor)(h);
+
+		if (prev != NULL &&
+		    lfi(map_cmp)(m, prev, key, keylen, prefix) >= 0)
+			return false;
+
+		*left = h->left == NULL;
+		*parent = *left ? h : prev;
+	}
+
+	return true;
+}
+
 
 int lf(map_init)(struct lf(map) *m,
 		 size_t value_size,
 		 int (*cmp)(const void *, const void *, size_t, size_t))
 {
+	return lf(map_init_with)(m, value_size, cmp, NULL);
+}
+
+int lf(map_init_with)(struct lf(map) *m,
+		      size_t value_size,
+		      int (*cmp)(const void *, const void *, size_t, size_t),
+		      const struct lf(allocator) *allocator)
+{
+	m->allocator = allocator == NULL ? lf(allocator_libc) : *allocator;
+	m->slabs = NULL;
+	m->share = NULL;
+	m->slab_top = NULL;
+	m->slab_left = 0;
+	m->slab_size = LF_MAP_POOL_MAX_NODE_SIZE * 16;
+	m->large_nodes = 0;
+	memset(m->free_nodes, 0, sizeof(m->free_nodes));
 	m->root = NULL;
 	m->value_size = value_size;
 	m->cmp = cmp == NULL ? lfi(map_default_comparator) : cmp;
 
 	if (m->value_size)
-		m->hold_value = malloc(value_size);
+		m->hold_value = lf_alloc(&m->allocator, value_size);
 	else
 		m->hold_value = (void *) 1;
 
@@ -406,12 +1154,25 @@ void lf(map_xinit)(struct lf(map) *m,
 	lf_unwrap(lf(map_init)(m, value_size, cmp));
 }
 
+void lf(map_xinit_with)(struct lf(map) *m,
+			size_t value_size,
+			int (*cmp)(const void *, const void *, size_t, size_t),
+			const struct lf(allocator) *allocator)
+{
+	lf_unwrap(lf(map_init_with)(m, value_size, cmp, allocator));
+}
+
 void lf(map_destroy)(struct lf(map) *m)
 {
-	lfi(map_destroy_recursive)(m, m->root);
+	/* Only the large nodes are released one by one. */
+	if (m->large_nodes)
+		lfi(map_destroy_recursive)(m, m->root);
+
+	lfi(map_free_slabs)(m, m->slabs);
+	lfi(map_share_release)(m, m->share);
 
 	if (m->value_size)
-		free(m->hold_value);
+		lfi(free)(&m->allocator, m->hold_value, m->value_size);
 }
 
 void *lf(map_get)(struct lf(map) *m, const void *key)
@@ -446,58 +1207,213 @@ void *lf(map_insert2)(struct lf(map) *m,
 		      const void *value)
 {
 	struct lfi(map_node) *n =
-		lfi(map_new_node)(key, keylen, value, m->value_size);
+		lfi(map_new_node)(m, key, keylen, value);
 
 	if (n == NULL)
 		return NULL;
 
-	if (m->root == NULL) {
-		m->root = n;
-	} else {
-		struct lfi(map_node) *cur = m->root;
+	lfi(map_insert_node)(m, n);
 
-		struct lfi(map_node) *p;
-		int cmp = 0;
+	return lf_map_node_value(n);
+}
 
-		while (cur != NULL) {
-			p = cur;
-			cur->size++;
+void *lf(map_xinsert2)(struct lf(map) *m,
+		       const void *key,
+		       size_t keylen,
+		       const void *value)
+{
+	void *insert_res = lf(map_insert2)(m, key, keylen, value);
 
-			cmp = m->cmp(cur->kv, key, cur->keylen, keylen);
+	lf_assert(insert_res != NULL, "insert returned NULL");
 
-			lf_assert(cmp != 0, "map already contains the element");
+	return insert_res;
+}
 
-			if (cmp < 0)
-				cur = cur->right;
-			else if (cmp > 0)
-				cur = cur->left;
-		}
+void *lf(map_insert_hint)(struct lf(map) *m,
+			  struct lf(map_it) *hint,
+			  const void *key,
+			  const void *value)
+{
+	return lf(map_insert_hint2)(m, hint, key, strlen(key), value);
+}
 
-		if (cmp < 0)
-			p->right = n;
-		else if (cmp > 0)
-			p->left = n;
+void *lf(map_xinsert_hint)(struct lf(map) *m,
+			   struct lf(map_it) *hint,
+			   const void *key,
+			   const void *value)
+{
+	void *insert_res = lf(map_insert_hint)(m, hint, key, value);
 
-		n->p = p;
+	lf_assert(insert_res != NULL, "insert returned NULL");
+
+	return insert_res;
+}
+
+/* Sizes of the ancestors are still updated, but by following the parents
+ * rather than comparing the key on the way down. */
+void *lf(map_insert_hint2)(struct lf(map) *m,
+			   struct lf(map_it) *hint,
+			   const void *key,
+			   size_t keylen,
+			   const void *value)
+{
+	struct lfi(map_node) *n =
+		lfi(map_new_node)(m, key, keylen, value);
+
+	if (n == NULL)
+		return NULL;
+
+	struct lfi(map_node) *h = hint != NULL ? hint->n : NULL;
+	struct lfi(map_node) *parent;
+	bool left;
+
+	if (h == NULL) {
+		if (!lfi(map_append_node)(m, n))
+			lfi(map_insert_node)(m, n);
+	} else if (lfi(map_hint_position)(m, h, key, keylen, n->prefix,
+					  &parent, &left)) {
+		lfi(map_attach)(m, parent, n, left);
+	} else {
+		lfi(map_insert_node)(m, n);
 	}
 
-	lfi(map_insert_fixup)(m, n);
+	if (hint != NULL) {
+		hint->m = m;
+		hint->n = n;
+		hint->end = NULL;
+		hint->rend = NULL;
+	}
 
 	return lf_map_node_value(n);
 }
 
-void *lf(map_xinsert2)(struct lf(map) *m,
-		       const void *key,
-		       size_t keylen,
-		       const void *value)
+void *lf(map_xinsert_hint2)(struct lf(map) *m,
+			    struct lf(map_it) *hint,
+			    const void *key,
+			    size_t keylen,
+			    const void *value)
 {
-	void *insert_res = lf(map_insert2)(m, key, keylen, value);
+	void *insert_res = lf(map_insert_hint2)(m, hint, key, keylen, value);
 
 	lf_assert(insert_res != NULL, "insert returned NULL");
 
 	return insert_res;
 }
 
+lfi_export_fdecl(struct lfi(map_node) *, map_alloc_node)(struct lf(map) *m)
+{
+	struct lfi(map_node) *n =
+		lfi(map_pool_alloc)(m, lfi(map_node_alloc_size)(0,
+								 m->value_size));
+
+	if (n != NULL) {
+		n->keylen = 0;
+		n->prefix = 0;
+	}
+
+	return n;
+}
+
+lfi_export_fdecl(void, map_attach)(struct lf(map) *m,
+				   struct lfi(map_node) *p,
+				   struct lfi(map_node) *n,
+				   bool left)
+{
+	n->p = p;
+	n->left = n->right = NULL;
+	n->size = 1;
+	n->color = 1;
+
+	if (p == NULL)
+		m->root = n;
+	else if (left)
+		p->left = n;
+	else
+		p->right = n;
+
+	for (; p != NULL; p = p->p)
+		p->size++;
+
+	lfi(map_insert_fixup)(m, n);
+}
+
+lfi_export_fdecl(void, map_delete_node)(struct lf(map) *m,
+					struct lfi(map_node) *n)
+{
+	lfi(map_unlink)(m, n);
+	lfi(map_pool_free)(m, n, lfi(map_node_alloc_size)(n->keylen,
+							   m->value_size));
+}
+
+int lf(map_build_sorted)(struct lf(map) *m,
+			 const void *const *keys,
+			 const void *values,
+			 size_t n)
+{
+	return lf(map_build_sorted2)(m, keys, NULL, values, n);
+}
+
+int lf(map_build_sorted2)(struct lf(map) *m,
+			  const void *const *keys,
+			  const size_t *keylens,
+			  const void *values,
+			  size_t n)
+{
+	lf_assert(m->root == NULL, "map is not empty");
+
+#ifndef NDEBUG
+	for (size_t i = 1; i < n; i++) {
+		size_t keylen1 = keylens != NULL ? keylens[i - 1] :
+			strlen(keys[i - 1]);
+		size_t keylen2 = keylens != NULL ? keylens[i] : strlen(keys[i]);
+
+		lf_debug_assert(m->cmp(keys[i - 1], keys[i],
+				       keylen1, keylen2) < 0,
+				"keys are not sorted");
+	}
+#endif
+
+	if (n == 0)
+		return 0;
+
+	/* Depth of the deepest level, floor(log2(n)). */
+	size_t red_depth = 0;
+
+	while (n >> red_depth > 1)
+		red_depth++;
+
+	bool err = false;
+	struct lfi(map_node) *root = lfi(map_build)(m, keys, keylens, values,
+						    0, n, 0, red_depth, &err);
+
+	if (err) {
+		lfi(map_release_recursive)(m, root);
+
+		return 1;
+	}
+
+	m->root = root;
+
+	return 0;
+}
+
+void lf(map_xbuild_sorted)(struct lf(map) *m,
+			   const void *const *keys,
+			   const void *values,
+			   size_t n)
+{
+	lf_unwrap(lf(map_build_sorted)(m, keys, values, n));
+}
+
+void lf(map_xbuild_sorted2)(struct lf(map) *m,
+			    const void *const *keys,
+			    const size_t *keylens,
+			    const void *values,
+			    size_t n)
+{
+	lf_unwrap(lf(map_build_sorted2)(m, keys, keylens, values, n));
+}
+
 const void *lf(map_remove)(struct lf(map) *m, const void *key)
 {
 	return lf(map_remove2)(m, key, strlen(key));
@@ -513,63 +1429,127 @@ const void *lf(map_remove2)(struct lf(map) *m, const void *key, size_t keylen)
 	if (m->value_size)
 		memcpy(m->hold_value, lf_map_node_value(z), m->value_size);
 
-	struct lfi(map_node) *y = z;
+	lfi(map_unlink)(m, z);
 
-	char orig_color = y->color;
+	lfi(map_pool_free)(m, z, lfi(map_node_alloc_size)(z->keylen,
+							   m->value_size));
 
-	struct lfi(map_node) *x, *x_parent = NULL;
+	return m->hold_value;
+}
 
-	if (z->left == NULL) {
-		/* case 1 */
-		x = z->right;
-		x_parent = z->p;
-		lfi(map_transplant)(m, z, z->right);
-	} else if (z->right == NULL) {
-		/* case 2 */
-		x = z->left;
-		x_parent = z->p;
-		lfi(map_transplant)(m, z, z->left);
-	} else {
-		/* case 3 */
-		y = z->right;
+int lf(map_split)(struct lf(map) *m, const void *key, struct lf(map) *right)
+{
+	return lf(map_split2)(m, key, strlen(key), right);
+}
 
-		while (y->left)
-			y = y->left;
+int lf(map_split2)(struct lf(map) *m,
+		   const void *key,
+		   size_t keylen,
+		   struct lf(map) *right)
+{
+	if (lf(map_init_with)(right, m->value_size, m->cmp, &m->allocator))
+		return 1;
 
-		orig_color = y->color;
-		x = y->right;
+	if (lfi(map_pool_share)(m, right)) {
+		lf(map_destroy)(right);
 
-		if (y->p == z) {
-			x_parent = y;
-			if (x != NULL)
-				x->p = y;
-		} else {
-			x_parent = y->p;
-			lfi(map_transplant)(m, y, y->right);
-			y->right = z->right;
-			y->right->p = y;
-		}
+		return 1;
+	}
 
-		lfi(map_transplant)(m, z, y);
-		y->left = z->left;
-		y->left->p = y;
-		y->color = z->color;
+	/* Large nodes are not counted one by one, the count is only an upper
+	 * bound from now on. */
+	right->large_nodes = m->large_nodes;
 
-		y->size = z->size;
-	}
+	struct lfi(map_tree) t = { m->root, lfi(map_black_height)(m->root) };
+	struct lfi(map_tree) l, r;
 
-	struct lfi(map_node) *cur = x_parent;
-	while (cur != NULL) {
-		cur->size--;
-		cur = cur->p;
-	}
+	lfi(map_split_tree)(m, t, key, keylen, lfi(key_prefix)(key, keylen),
+			    &l, &r, NULL);
 
-	if (orig_color == 0)
-		lfi(map_delete_fixup)(m, x, x_parent);
+	m->root = l.root;
+	right->root = r.root;
 
-	free(z);
+	return 0;
+}
 
-	return m->hold_value;
+int lf(map_join)(struct lf(map) *m, struct lf(map) *other)
+{
+	lf_assert(lfi(map_compatible)(m, other), "maps are not compatible");
+
+	if (lfi(map_pool_absorb)(m, other))
+		return 1;
+
+	struct lfi(map_node) *x = other->root;
+
+	if (x == NULL)
+		return 0;
+
+	while (x->left != NULL)
+		x = x->left;
+
+#ifndef NDEBUG
+	struct lfi(map_node) *max = m->root;
+
+	while (max != NULL && max->right != NULL)
+		max = max->right;
+
+	lf_debug_assert(max == NULL ||
+			m->cmp(max->kv, x->kv, max->keylen, x->keylen) < 0,
+			"key ranges of the maps overlap");
+#endif
+
+	lfi(map_unlink)(other, x);
+
+	struct lfi(map_tree) l = { m->root, lfi(map_black_height)(m->root) };
+	struct lfi(map_tree) r = {
+		other->root, lfi(map_black_height)(other->root)
+	};
+
+	m->root = lfi(map_join3)(l, x, r).root;
+	other->root = NULL;
+
+	return 0;
+}
+
+int lf(map_union)(struct lf(map) *m, struct lf(map) *other)
+{
+	lf_assert(lfi(map_compatible)(m, other), "maps are not compatible");
+
+	if (lfi(map_pool_absorb)(m, other))
+		return 1;
+
+	struct lfi(map_tree) a = { m->root, lfi(map_black_height)(m->root) };
+	struct lfi(map_tree) b = {
+		other->root, lfi(map_black_height)(other->root)
+	};
+
+	m->root = lfi(map_union_tree)(m, a, b).root;
+	other->root = NULL;
+
+	return 0;
+}
+
+void lf(map_xsplit)(struct lf(map) *m, const void *key, struct lf(map) *right)
+{
+	lf_unwrap(lf(map_split)(m, key, right));
+}
+
+void lf(map_xsplit2)(struct lf(map) *m,
+		     const void *key,
+		     size_t keylen,
+		     struct lf(map) *right)
+{
+	lf_unwrap(lf(map_split2)(m, key, keylen, right));
+}
+
+void lf(map_xjoin)(struct lf(map) *m, struct lf(map) *other)
+{
+	lf_unwrap(lf(map_join)(m, other));
+}
+
+void lf(map_xunion)(struct lf(map) *m, struct lf(map) *other)
+{
+	lf_unwrap(lf(map_union)(m, other));
 }
 
 struct lf(entry) lf(map_select)(struct lf(map) *m, ptrdiff_t i)
@@ -591,10 +1571,11 @@ size_t lf(map_rank2)(const struct lf(map) *m, const void *key, size_t keylen)
 {
 	struct lfi(map_node) *cur = m->root;
 
+	uint64_t prefix = lfi(key_prefix)(key, keylen);
 	size_t rank = 0;
 
 	while (cur != NULL) {
-		int cmp = m->cmp(cur->kv, key, cur->keylen, keylen);
+		int cmp = lfi(map_cmp)(m, cur, key, keylen, prefix);
 
 		if (cmp < 0) {
 			rank += lf_map_node_size(cur->left) + 1;
@@ -623,14 +1604,103 @@ void lf(map_iter_from)(struct lf(map) *m,
 {
 	it->m = m;
 	it->n = lfi(map_select_node)(m, i);
+	it->end = NULL;
+	it->rend = NULL;
+}
+
+void lf(map_lower_bound)(struct lf(map) *m,
+			 struct lf(map_it) *it,
+			 const void *key)
+{
+	lf(map_lower_bound2)(m, it, key, strlen(key));
+}
+
+void lf(map_lower_bound2)(struct lf(map) *m,
+			  struct lf(map_it) *it,
+			  const void *key,
+			  size_t keylen)
+{
+	it->m = m;
+	it->n = lfi(map_bound)(m, key, keylen, false, NULL, NULL);
+	it->end = NULL;
+	it->rend = NULL;
+}
+
+void lf(map_upper_bound)(struct lf(map) *m,
+			 struct lf(map_it) *it,
+			 const void *key)
+{
+	lf(map_upper_bound2)(m, it, key, strlen(key));
+}
+
+void lf(map_upper_bound2)(struct lf(map) *m,
+			  struct lf(map_it) *it,
+			  const void *key,
+			  size_t keylen)
+{
+	it->m = m;
+	it->n = lfi(map_bound)(m, key, keylen, true, NULL, NULL);
+	it->end = NULL;
+	it->rend = NULL;
+}
+
+void lf(map_iter_range)(struct lf(map) *m,
+			struct lf(map_it) *it,
+			const void *lo,
+			const void *hi)
+{
+	lf(map_iter_range2)(m, it, lo, strlen(lo), hi, strlen(hi));
 }
 
+void lf(map_iter_range2)(struct lf(map) *m,
+			 struct lf(map_it) *it,
+			 const void *lo,
+			 size_t lolen,
+			 const void *hi,
+			 size_t hilen)
+{
+	lf_debug_assert(m->cmp(lo, hi, lolen, hilen) <= 0,
+			"range bounds are not in order");
+
+	it->m = m;
+	it->n = lfi(map_bound)(m, lo, lolen, false, &it->rend, NULL);
+	it->end = lfi(map_bound)(m, hi, hilen, false, NULL, NULL);
+}
+
+size_t lf(map_count_range)(const struct lf(map) *m,
+			   const void *lo,
+			   const void *hi)
+{
+	return lf(map_count_range2)(m, lo, strlen(lo), hi, strlen(hi));
+}
+
+size_t lf(map_count_range2)(const struct lf(map) *m,
+			    const void *lo,
+			    size_t lolen,
+			    const void *hi,
+			    size_t hilen)
+{
+	size_t lo_rank, hi_rank;
+
+	lfi(map_bound)(m, lo, lolen, false, NULL, &lo_rank);
+	lfi(map_bound)(m, hi, hilen, false, NULL, &hi_rank);
+
+	return hi_rank > lo_rank ? hi_rank - lo_rank : 0;
+}
+
+/* The bounds of a range are the nodes just outside of it, which end the
+ * iteration in either direction. */
 struct lf(entry) lf(map_iter_next)(struct lf(map_it) *it)
 {
 	struct lfi(map_node) *cur = it->n;
 
-	if (cur != NULL)
-		it->n = lfi(map_successor)(cur);
+	if (cur == NULL || cur == it->end || cur == it->rend) {
+		it->n = NULL;
+
+		return lfi_sentinel_entry;
+	}
+
+	it->n = lfi(map_successor)(cur);
 
 	return lfi(map_entry_of)(cur);
 }
@@ -639,8 +1709,13 @@ struct lf(entry) lf(map_iter_prev)(struct lf(map_it) *it)
 {
 	struct lfi(map_node) *cur = it->n;
 
-	if (cur != NULL)
-		it->n = lfi(map_predecessor)(cur);
+	if (cur == NULL || cur == it->end || cur == it->rend) {
+		it->n = NULL;
+
+		return lfi_sentinel_entry;
+	}
+
+	it->n = lfi(map_predecessor)(cur);
 
 	return lfi(map_entry_of)(cur);
 }
@@ -0,0 +1,875 @@
+#ifndef LF_HEADERONLY
+#include "util.h"
+#include "../include/config.h"
+#include "../include/pmap.h"
+#endif
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define lf_pmap_align(i) \
+	(((i) + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t))
+
+#define lf_pmap_node_size(n) ((n) == NULL ? 0 : (n)->size)
+
+#define lf_pmap_node_value(n) (&(n)->kv[lf_pmap_align((n)->keylen)])
+
+/* Weight balance of Adams' trees, with the parameters shown by Hirai and
+ * Yamamoto to keep the trees balanced after a single rotation. Weights are
+ * the subtree sizes plus one. A subtree weighs at most DELTA times its
+ * sibling, and a double rotation is used if the inner grandchild weighs at
+ * least GAMMA times the outer one. */
+#define LF_PMAP_DELTA 3
+#define LF_PMAP_GAMMA 2
+
+#define lf_pmap_weight(n) (lf_pmap_node_size(n) + 1)
+
+
+/* Size of the allocation holding the node. */
+inline lfi_fdecl(size_t, pmap_node_alloc_size)(size_t keylen,
+					       size_t value_size)
+{
+	size_t size = lf_pmap_align(sizeof(struct lfi(pmap_node)));
+
+	if (value_size > 0)
+		size += lf_pmap_align(keylen) + value_size;
+	else
+		size += keylen;
+
+	return size;
+}
+
+lfi_fdecl(void, pmap_free_node)(struct lf(pmap) *m, struct lfi(pmap_node) *n)
+{
+	lfi(free)(&m->allocator, n,
+		  lfi(pmap_node_alloc_size)(n->keylen, m->value_size));
+}
+
+/* Compares the key of the node to the given one, as map_cmp(). */
+inline lfi_fdecl(int, pmap_cmp)(const struct lf(pmap) *m,
+				const struct lfi(pmap_node) *n,
+				const void *key,
+				size_t keylen,
+				uint64_t prefix)
+{
+	if (m->cmp != NULL)
+		return m->cmp(n->kv, key, n->keylen, keylen);
+
+	if (n->prefix != prefix)
+		return n->prefix < prefix ? -1 : 1;
+
+	int res = memcmp(n->kv, key, n->keylen < keylen ? n->keylen : keylen);
+
+	if (res == 0 && n->keylen != keylen)
+		return n->keylen < keylen ? -1 : 1;
+
+	return res;
+}
+
+
+/* Updates allocate their nodes in a generation of their own, which they may
+ * modify until the new root is published. Published nodes are immutable. */
+lfi_fdecl(void, pmap_begin)(struct lf(pmap) *m)
+{
+	m->gen++;
+	m->fresh = NULL;
+	m->replaced = NULL;
+}
+
+lfi_fdecl(struct lfi(pmap_node) *, pmap_alloc_node)(struct lf(pmap) *m,
+						    size_t keylen)
+{
+	struct lfi(pmap_node) *n =
+		lf_alloc(&m->allocator,
+			 lfi(pmap_node_alloc_size)(keylen, m->value_size));
+
+	if (n == NULL)
+		return NULL;
+
+	n->gen = m->gen;
+	n->next = m->fresh;
+	m->fresh = n;
+
+	return n;
+}
+
+/* Marks the published node as replaced by the update. Readers do not look at
+ * the links, so they are written while the node is still shared. */
+lfi_fdecl(void, pmap_replace)(struct lf(pmap) *m, struct lfi(pmap_node) *n)
+{
+	lf_debug_assert(n->gen != m->gen, "replacing a node of the update");
+
+	n->next = m->replaced;
+	m->replaced = n;
+}
+
+/* Returns the node itself if it belongs to the update, a copy of it
+ * otherwise. Returns NULL if a memory allocation failure occurs. */
+lfi_fdecl(struct lfi(pmap_node) *, pmap_own)(struct lf(pmap) *m,
+					     struct lfi(pmap_node) *n)
+{
+	if (n->gen == m->gen)
+		return n;
+
+	struct lfi(pmap_node) *copy = lfi(pmap_alloc_node)(m, n->keylen);
+
+	if (copy == NULL)
+		return NULL;
+
+	memcpy(copy->kv, n->kv,
+	       lfi(pmap_node_alloc_size)(n->keylen, m->value_size) -
+	       lf_pmap_align(sizeof(struct lfi(pmap_node))));
+
+	copy->left = n->left;
+	copy->right = n->right;
+	copy->size = n->size;
+	copy->keylen = n->keylen;
+	copy->prefix = n->prefix;
+
+	lfi(pmap_replace)(m, n);
+
+	return copy;
+}
+
+/* Drops the nodes of a failed update, the published version is intact. */
+lfi_fdecl(void, pmap_abort)(struct lf(pmap) *m)
+{
+	while (m->fresh != NULL) {
+		struct lfi(pmap_node) *n = m->fresh;
+
+		m->fresh = n->next;
+		lfi(pmap_free_node)(m, n);
+	}
+
+	m->replaced = NULL;
+}
+
+/* Oldest epoch a reader may still be reading in, SIZE_MAX if none. */
+lfi_fdecl(size_t, pmap_min_epoch)(struct lf(pmap) *m)
+{
+	size_t min = SIZE_MAX;
+
+	for (struct lf(pmap_reader) *r =
+		     atomic_load_explicit(&m->readers, memory_order_acquire);
+	     r != NULL; r = r->next) {
+		size_t e = atomic_load(&r->epoch);
+
+		if (e != 0 && e < min)
+			min = e;
+	}
+
+	return min;
+}
+
+/* Publishes the new root, and retires the nodes it replaced in the current
+ * epoch. A reader announcing an older epoch may have loaded a root older than
+ * the nodes were retired from, so they are freed once all of the readers have
+ * moved past it.
+ *
+ * Sequentially consistent ordering of the root store and the loads of the
+ * epochs pairs with the readers storing their epoch before loading the root:
+ * either the reader is seen, or it loads the new root. */
+lfi_fdecl(void, pmap_commit)(struct lf(pmap) *m, struct lfi(pmap_node) *root)
+{
+	size_t epoch = atomic_load_explicit(&m->epoch, memory_order_relaxed);
+
+	atomic_store(&m->root, root);
+
+	while (m->replaced != NULL) {
+		struct lfi(pmap_node) *n = m->replaced;
+
+		m->replaced = n->next;
+
+		n->retired_epoch = epoch;
+		n->next = NULL;
+
+		if (m->retired == NULL)
+			m->retired = n;
+		else
+			m->retired_tail->next = n;
+
+		m->retired_tail = n;
+	}
+
+	m->fresh = NULL;
+
+	atomic_store(&m->epoch, epoch + 1);
+
+	size_t min = lfi(pmap_min_epoch)(m);
+
+	while (m->retired != NULL && m->retired->retired_epoch < min) {
+		struct lfi(pmap_node) *n = m->retired;
+
+		m->retired = n->next;
+		lfi(pmap_free_node)(m, n);
+	}
+}
+
+
+/* Restores the balance of the node, whose subtrees are balanced and whose
+ * weights differ from a balanced pair by at most one entry. The node belongs
+ * to the update. Its size is updated. */
+lfi_fdecl(int, pmap_balance)(struct lf(pmap) *m,
+			     struct lfi(pmap_node) *n,
+			     struct lfi(pmap_node) **out)
+{
+	size_t wl = lf_pmap_weight(n->left);
+	size_t wr = lf_pmap_weight(n->right);
+
+	n->size = wl + wr - 1;
+
+	if (LF_PMAP_DELTA * wl < wr) {
+		struct lfi(pmap_node) *r = lfi(pmap_own)(m, n->right);
+
+		if (r == NULL)
+			return 1;
+
+		if (lf_pmap_weight(r->left) < LF_PMAP_GAMMA *
+		    lf_pmap_weight(r->right)) {
+			n->right = r->left;
+			n->size = lf_pmap_node_size(n->left) +
+				lf_pmap_node_size(n->right) + 1;
+
+			r->left = n;
+			r->size = n->size + lf_pmap_node_size(r->right) + 1;
+
+			*out = r;
+
+			return 0;
+		}
+
+		struct lfi(pmap_node) *rl = lfi(pmap_own)(m, r->left);
+
+		if (rl == NULL)
+			return 1;
+
+		n->right = rl->left;
+		n->size = lf_pmap_node_size(n->left) +
+			lf_pmap_node_size(n->right) + 1;
+
+		r->left = rl->right;
+		r->size = lf_pmap_node_size(r->left) +
+			lf_pmap_node_size(r->right) + 1;
+
+		rl->left = n;
+		rl->right = r;
+		rl->size = n->size + r->size + 1;
+
+		*out = rl;
+
+		return 0;
+	}
+
+	if (LF_PMAP_DELTA * wr < wl) {
+		struct lfi(pmap_node) *l = lfi(pmap_own)(m, n->left);
+
+		if (l == NULL)
+			return 1;
+
+		if (lf_pmap_weight(l->right) < LF_PMAP_GAMMA *
+		    lf_pmap_weight(l->left)) {
+			n->left = l->right;
+			n->size = lf_pmap_node_size(n->left) +
+				lf_pmap_node_size(n->right) + 1;
+
+			l->right = n;
+			l->size = lf_pmap_node_size(l->left) + n->size + 1;
+
+			*out = l;
+
+			return 0;
+		}
+
+		struct lfi(pmap_node) *lr = lfi(pmap_own)(m, l->right);
+
+		if (lr == NULL)
+			return 1;
+
+		n->left = lr->right;
+		n->size = lf_pmap_node_size(n->left) +
+			lf_pmap_node_size(n->right) + 1;
+
+		l->right = lr->left;
+		l->size = lf_pmap_node_size(l->left) +
+			lf_pmap_node_size(l->right) + 1;
+
+		lr->left = l;
+		lr->right = n;
+		lr->size = l->size + n->size + 1;
+
+		*out = lr;
+
+		return 0;
+	}
+
+	*out = n;
+
+	return 0;
+}
+
+/* Key of an update, and whether it is found in the tree. */
+struct lfi(pmap_key) {
+	const void *key;
+	size_t keylen;
+	uint64_t prefix;
+	bool found;
+};
+
+/* Copies the path to the key, and inserts or replaces its node. */
+lfi_fdecl(int, pmap_upsert_rec)(struct lf(pmap) *m,
+				struct lfi(pmap_node) *t,
+				struct lfi(pmap_key) *k,
+				const void *value,
+				struct lfi(pmap_node) **out)
+{
+	struct lfi(pmap_node) *n;
+
+	if (t == NULL) {
+		n = lfi(pmap_alloc_node)(m, k->keylen);
+
+		if (n == NULL)
+			return 1;
+
+		memcpy(n->kv, k->key, k->keylen);
+
+		n->left = n->right = NULL;
+		n->size = 1;
+		n->keylen = k->keylen;
+		n->prefix = k->prefix;
+
+		if (m->value_size > 0 && value != NULL)
+			memcpy(lf_pmap_node_value(n), value, m->value_size);
+
+		*out = n;
+
+		return 0;
+	}
+
+	int cmp = lfi(pmap_cmp)(m, t, k->key, k->keylen, k->prefix);
+
+	if (cmp == 0) {
+		k->found = true;
+
+		if ((n = lfi(pmap_own)(m, t)) == NULL)
+			return 1;
+
+		if (m->value_size > 0 && value != NULL)
+			memcpy(lf_pmap_node_value(n), value, m->value_size);
+
+		*out = n;
+
+		return 0;
+	}
+
+	struct lfi(pmap_node) *child;
+
+	if (lfi(pmap_upsert_rec)(m, cmp > 0 ? t->left : t->right, k, value,
+				 &child))
+		return 1;
+
+	if ((n = lfi(pmap_own)(m, t)) == NULL)
+		return 1;
+
+	if (cmp > 0)
+		n->left = child;
+	else
+		n->right = child;
+
+	if (k->found) {
+		*out = n;
+
+		return 0;
+	}
+
+	return lfi(pmap_balance)(m, n, out);
+}
+
+/* Takes the smallest node out of the nonempty subtree, or the largest one.
+ * The node itself is left unchanged. */
+lfi_fdecl(int, pmap_remove_edge)(struct lf(pmap) *m,
+				 struct lfi(pmap_node) *t,
+				 bool max,
+				 struct lfi(pmap_node) **edge,
+				 struct lfi(pmap_node) **out)
+{
+	struct lfi(pmap_node) *next = max ? t->right : t->left;
+
+	if (next == NULL) {
+		*edge = t;
+		*out = max ? t->left : t->right;
+
+		return 0;
+	}
+
+	struct lfi(pmap_node) *child;
+
+	if (lfi(pmap_remove_edge)(m, next, max, edge, &child))
+		return 1;
+
+	struct lfi(pmap_node) *n = lfi(pmap_own)(m, t);
+
+	if (n == NULL)
+		return 1;
+
+	if (max)
+		n->right = child;
+	else
+		n->left = child;
+
+	return lfi(pmap_balance)(m, n, out);
+}
+
+/* Copies the path to the key, and removes its node. The output is the
+ * subtree itself if the key is not found. */
+lfi_fdecl(int, pmap_remove_rec)(struct lf(pmap) *m,
+				struct lfi(pmap_node) *t,
+				struct lfi(pmap_key) *k,
+				struct lfi(pmap_node) **out)
+{
+	if (t == NULL) {
+		*out = NULL;
+
+		return 0;
+	}
+
+	int cmp = lfi(pmap_cmp)(m, t, k->key, k->keylen, k->prefix);
+	struct lfi(pmap_node) *n;
+
+	if (cmp != 0) {
+		struct lfi(pmap_node) *child;
+
+		if (lfi(pmap_remove_rec)(m, cmp > 0 ? t->left : t->right, k,
+					 &child))
+			return 1;
+
+		if (!k->found) {
+			*out = t;
+
+			return 0;
+		}
+
+		if ((n = lfi(pmap_own)(m, t)) == NULL)
+			return 1;
+
+		if (cmp > 0)
+			n->left = child;
+		else
+			n->right = child;
+
+		return lfi(pmap_balance)(m, n, out);
+	}
+
+	k->found = true;
+
+	if (t->left == NULL || t->right == NULL) {
+		lfi(pmap_replace)(m, t);
+		*out = t->left != NULL ? t->left : t->right;
+
+		return 0;
+	}
+
+	/* The node is replaced by the nearest key of its heavier subtree. */
+	bool max = t->left->size > t->right->size;
+	struct lfi(pmap_node) *edge;
+	struct lfi(pmap_node) *child;
+
+	if (lfi(pmap_remove_edge)(m, max ? t->left : t->right, max, &edge,
+				  &child))
+		return 1;
+
+	if ((n = lfi(pmap_own)(m, edge)) == NULL)
+		return 1;
+
+	n->left = max ? child : t->left;
+	n->right = max ? t->right : child;
+
+	lfi(pmap_replace)(m, t);
+
+	return lfi(pmap_balance)(m, n, out);
+}
+
+lfi_fdecl(void, pmap_destroy_recursive)(struct lf(pmap) *m,
+					struct lfi(pmap_node) *n)
+{
+	while (n != NULL) {
+		struct lfi(pmap_node) *right = n->right;
+
+		lfi(pmap_destroy_recursive)(m, n->left);
+		lfi(pmap_free_node)(m, n);
+
+		n = right;
+	}
+}
+
+lfi_fdecl(const struct lfi(pmap_node) *, pmap_get2_node)(
+	struct lf(pmap_snapshot) s,
+	const void *key,
+	size_t keylen)
+{
+	const struct lfi(pmap_node) *cur = s.root;
+	uint64_t prefix = s.m->cmp == NULL ? lfi(key_prefix)(key, keylen) : 0;
+
+	while (cur != NULL) {
+		int cmp = lfi(pmap_cmp)(s.m, cur, key, keylen, prefix);
+
+		if (cmp == 0)
+			break;
+
+		cur = cmp > 0 ? cur->left : cur->right;
+	}
+
+	return cur;
+}
+
+lfi_fdecl(struct lf(entry), pmap_entry_of)(const struct lfi(pmap_node) *n)
+{
+	if (n == NULL)
+		return lfi_sentinel_entry;
+
+	return (struct lf(entry)) {
+		.key = n->kv,
+		.keylen = n->keylen,
+		.value = (void *) lf_pmap_node_value(n),
+	};
+}
+
+lfi_fdecl(void, pmap_push_left)(struct lf(pmap_it) *it,
+				const struct lfi(pmap_node) *n)
+{
+	for (; n != NULL; n = n->left) {
+		lf_assert(it->top < LF_PMAP_MAX_HEIGHT, "overflow");
+
+		it->stack[it->top++] = n;
+	}
+}
+
+
+int lf(pmap_init)(struct lf(pmap) *m,
+		  size_t value_size,
+		  int (*cmp)(const void *, const void *, size_t, size_t))
+{
+	return lf(pmap_init_with)(m, value_size, cmp, NULL);
+}
+
+int lf(pmap_init_with)(struct lf(pmap) *m,
+		       size_t value_size,
+		       int (*cmp)(const void *, const void *, size_t, size_t),
+		       const struct lf(allocator) *allocator)
+{
+	m->allocator = allocator == NULL ? lf(allocator_libc) : *allocator;
+	m->retired = NULL;
+	m->retired_tail = NULL;
+	m->gen = 0;
+	m->fresh = NULL;
+	m->replaced = NULL;
+	m->value_size = value_size;
+	m->cmp = cmp;
+
+	/* Epoch zero marks the readers that are not reading. */
+	atomic_init(&m->root, NULL);
+	atomic_init(&m->epoch, 1);
+	atomic_init(&m->readers, NULL);
+
+	return 0;
+}
+
+void lf(pmap_xinit)(struct lf(pmap) *m,
+		    size_t value_size,
+		    int (*cmp)(const void *, const void *, size_t, size_t))
+{
+	lf_unwrap(lf(pmap_init)(m, value_size, cmp));
+}
+
+void lf(pmap_xinit_with)(struct lf(pmap) *m,
+			 size_t value_size,
+			 int (*cmp)(const void *, const void *, size_t, size_t),
+			 const struct lf(allocator) *allocator)
+{
+	lf_unwrap(lf(pmap_init_with)(m, value_size, cmp, allocator));
+}
+
+void lf(pmap_destroy)(struct lf(pmap) *m)
+{
+	lfi(pmap_destroy_recursive)(m, atomic_load_explicit(
+					    &m->root, memory_order_relaxed));
+
+	while (m->retired != NULL) {
+		struct lfi(pmap_node) *n = m->retired;
+
+		m->retired = n->next;
+		lfi(pmap_free_node)(m, n);
+	}
+
+	struct lf(pmap_reader) *r =
+		atomic_load_explicit(&m->readers, memory_order_relaxed);
+
+	while (r != NULL) {
+		struct lf(pmap_reader) *next = r->next;
+
+		free(r);
+		r = next;
+	}
+}
+
+int lf(pmap_upsert)(struct lf(pmap) *m,
+		    const void *key,
+		    const void *value,
+		    bool *inserted)
+{
+	return lf(pmap_upsert2)(m, key, strlen(key), value, inserted);
+}
+
+void lf(pmap_xupsert)(struct lf(pmap) *m,
+		      const void *key,
+		      const void *value,
+		      bool *inserted)
+{
+	lf_unwrap(lf(pmap_upsert)(m, key, value, inserted));
+}
+
+int lf(pmap_upsert2)(struct lf(pmap) *m,
+		     const void *key,
+		     size_t keylen,
+		     const void *value,
+		     bool *inserted)
+{
+	struct lfi(pmap_key) k = {
+		.key = key,
+		.keylen = keylen,
+		.prefix = m->cmp == NULL ? lfi(key_prefix)(key, keylen) : 0,
+		.found = false,
+	};
+	struct lfi(pmap_node) *root;
+
+	lfi(pmap_begin)(m);
+
+	if (lfi(pmap_upsert_rec)(m, atomic_load_explicit(
+					 &m->root, memory_order_relaxed),
+				 &k, value, &root)) {
+		lfi(pmap_abort)(m);
+
+		return 1;
+	}
+
+	lfi(pmap_commit)(m, root);
+
+	if (inserted != NULL)
+		*inserted = !k.found;
+
+	return 0;
+}
+
+void lf(pmap_xupsert2)(struct lf(pmap) *m,
+		       const void *key,
+		       size_t keylen,
+		       const void *value,
+		       bool *inserted)
+{
+	lf_unwrap(lf(pmap_upsert2)(m, key, keylen, value, inserted));
+}
+
+int lf(pmap_remove)(struct lf(pmap) *m, const void *key, bool *removed)
+{
+	return lf(pmap_remove2)(m, key, strlen(key), removed);
+}
+
+void lf(pmap_xremove)(struct lf(pmap) *m, const void *key, bool *removed)
+{
+	lf_unwrap(lf(pmap_remove)(m, key, removed));
+}
+
+int lf(pmap_remove2)(struct lf(pmap) *m,
+		     const void *key,
+		     size_t keylen,
+		     bool *removed)
+{
+	struct lfi(pmap_key) k = {
+		.key = key,
+		.keylen = keylen,
+		.prefix = m->cmp == NULL ? lfi(key_prefix)(key, keylen) : 0,
+		.found = false,
+	};
+	struct lfi(pmap_node) *root;
+
+	lfi(pmap_begin)(m);
+
+	if (lfi(pmap_remove_rec)(m, atomic_load_explicit(
+					 &m->root, memory_order_relaxed),
+				 &k, &root)) {
+		lfi(pmap_abort)(m);
+
+		return 1;
+	}
+
+	/* Nothing is copied if the key is not found. */
+	if (k.found)
+		lfi(pmap_commit)(m, root);
+
+	if (removed != NULL)
+		*removed = k.found;
+
+	return 0;
+}
+
+void lf(pmap_xremove2)(struct lf(pmap) *m,
+		       const void *key,
+		       size_t keylen,
+		       bool *removed)
+{
+	lf_unwrap(lf(pmap_remove2)(m, key, keylen, removed));
+}
+
+struct lf(pmap_snapshot) lf(pmap_current)(struct lf(pmap) *m)
+{
+	return (struct lf(pmap_snapshot)) {
+		.m = m,
+		.root = atomic_load_explicit(&m->root, memory_order_relaxed),
+	};
+}
+
+struct lf(pmap_reader) *lf(pmap_reader_new)(struct lf(pmap) *m)
+{
+	struct lf(pmap_reader) *r =
+		atomic_load_explicit(&m->readers, memory_order_acquire);
+
+	for (; r != NULL; r = r->next)
+		if (!atomic_load_explicit(&r->used, memory_order_relaxed) &&
+		    !atomic_exchange_explicit(&r->used, true,
+					      memory_order_acquire))
+			return r;
+
+	/* Readers are shared with the threads, and taken from the libc heap
+	 * rather than from the allocator of the writer. */
+	r = aligned_alloc(_Alignof(struct lf(pmap_reader)), sizeof(*r));
+
+	if (r == NULL)
+		return NULL;
+
+	atomic_init(&r->epoch, 0);
+	atomic_init(&r->used, true);
+	r->m = m;
+	r->next = atomic_load_explicit(&m->readers, memory_order_relaxed);
+
+	while (!atomic_compare_exchange_weak_explicit(&m->readers, &r->next, r,
+						      memory_order_release,
+						      memory_order_relaxed))
+		;
+
+	return r;
+}
+
+void lf(pmap_reader_release)(struct lf(pmap_reader) *r)
+{
+	lf_debug_assert(atomic_load_explicit(&r->epoch,
+					     memory_order_relaxed) == 0,
+			"reader is reading");
+
+	atomic_store_explicit(&r->used, false, memory_order_release);
+}
+
+/* The epoch is announced before the root is loaded, see pmap_commit(). */
+struct lf(pmap_snapshot) lf(pmap_read_begin)(struct lf(pmap_reader) *r)
+{
+	atomic_store(&r->epoch, atomic_load(&r->m->epoch));
+
+	return (struct lf(pmap_snapshot)) {
+		.m = r->m,
+		.root = atomic_load(&r->m->root),
+	};
+}
+
+void lf(pmap_read_end)(struct lf(pmap_reader) *r)
+{
+	atomic_store_explicit(&r->epoch, 0, memory_order_release);
+}
+
+const void *lf(pmap_get)(struct lf(pmap_snapshot) s, const void *key)
+{
+	return lf(pmap_get2)(s, key, strlen(key));
+}
+
+const void *lf(pmap_get2)(struct lf(pmap_snapshot) s,
+			  const void *key,
+			  size_t keylen)
+{
+	const struct lfi(pmap_node) *n = lfi(pmap_get2_node)(s, key, keylen);
+
+	return n != NULL ? lf_pmap_node_value(n) : NULL;
+}
+
+size_t lf(pmap_size)(struct lf(pmap_snapshot) s)
+{
+	return lf_pmap_node_size(s.root);
+}
+
+struct lf(entry) lf(pmap_select)(struct lf(pmap_snapshot) s, ptrdiff_t i_)
+{
+	size_t i = lfi(circular_index)(i_, lf(pmap_size)(s));
+	const struct lfi(pmap_node) *cur = s.root;
+
+	while (lf_pmap_node_size(cur->left) != i) {
+		if (lf_pmap_node_size(cur->left) > i) {
+			cur = cur->left;
+		} else {
+			i -= lf_pmap_node_size(cur->left) + 1;
+			cur = cur->right;
+		}
+	}
+
+	return lfi(pmap_entry_of)(cur);
+}
+
+size_t lf(pmap_rank)(struct lf(pmap_snapshot) s, const void *key)
+{
+	return lf(pmap_rank2)(s, key, strlen(key));
+}
+
+size_t lf(pmap_rank2)(struct lf(pmap_snapshot) s,
+		      const void *key,
+		      size_t keylen)
+{
+	const struct lfi(pmap_node) *cur = s.root;
+	uint64_t prefix = s.m->cmp == NULL ? lfi(key_prefix)(key, keylen) : 0;
+	size_t rank = 0;
+
+	while (cur != NULL) {
+		int cmp = lfi(pmap_cmp)(s.m, cur, key, keylen, prefix);
+
+		if (cmp == 0)
+			return rank + lf_pmap_node_size(cur->left);
+
+		if (cmp < 0) {
+			rank += lf_pmap_node_size(cur->left) + 1;
+			cur = cur->right;
+		} else {
+			cur = cur->left;
+		}
+	}
+
+	return -1;
+}
+
+void lf(pmap_iter)(struct lf(pmap_snapshot) s, struct lf(pmap_it) *it)
+{
+	it->m = s.m;
+	it->top = 0;
+
+	lfi(pmap_push_left)(it, s.root);
+}
+
+struct lf(entry) lf(pmap_iter_next)(struct lf(pmap_it) *it)
+{
+	if (it->top == 0)
+		return lfi_sentinel_entry;
+
+	const struct lfi(pmap_node) *n = it->stack[--it->top];
+
+	lfi(pmap_push_left)(it, n->right);
+
+	return lfi(pmap_entry_of)(n);
+}
@@ -11,22 +11,37 @@
 
 int lf(stack_init)(struct lf(stack) *s, size_t item_size)
 {
+	return lf(stack_init_with)(s, item_size, NULL);
+}
+
+void lf(stack_xinit)(struct lf(stack) *s, size_t item_size)
+{
+	lf_unwrap(lf(stack_init)(s, item_size));
+}
+
+int lf(stack_init_with)(struct lf(stack) *s,
+			size_t item_size,
+			const struct lf(allocator) *allocator)
+{
+	s->allocator = allocator == NULL ? lf(allocator_libc) : *allocator;
 	s->cap = LF_STACK_INITIAL_CAP;
 	s->len = 0;
 	s->item_size = item_size;
-	s->data = malloc(item_size * LF_STACK_INITIAL_CAP);
+	s->data = lf_alloc(&s->allocator, item_size * LF_STACK_INITIAL_CAP);
 
 	return s->data == NULL ? 1 : 0;
 }
 
-void lf(stack_xinit)(struct lf(stack) *s, size_t item_size)
+void lf(stack_xinit_with)(struct lf(stack) *s,
+			  size_t item_size,
+			  const struct lf(allocator) *allocator)
 {
-	lf_unwrap(lf(stack_init)(s, item_size));
+	lf_unwrap(lf(stack_init_with)(s, item_size, allocator));
 }
 
 void lf(stack_destroy)(struct lf(stack) *s)
 {
-	free(s->data);
+	lfi(free)(&s->allocator, s->data, s->cap * s->item_size);
 }
 
 const void *lf(stack_pop)(struct lf(stack) *s)
@@ -43,15 +58,15 @@ const void *lf(stack_pop)(struct lf(stack) *s)
 void *lf(stack_push)(struct lf(stack) *s, const void *item)
 {
 	if (s->len == s->cap) {
-		s->cap *= 2;
-
-		void *new_data = realloc(s->data, s->cap * s->item_size);
+		void *new_data = lf_realloc(&s->allocator, s->data,
+					    s->cap * s->item_size,
+					    s->cap * 2 * s->item_size);
 
 		if (new_data == NULL)
 			return NULL;
-		else
-			s->data = new_data;
 
+		s->data = new_data;
+		s->cap *= 2;
 	}
 
 	void *item_on_stack = &s->data[s->len * s->item_size];
@@ -1,12 +1,15 @@
 #ifndef LF_UTIL_H
 
 #ifndef LF_HEADERONLY
+#include "../include/allocator.h"
 #include "../include/common.h"
 #include "../include/config.h"
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>  // IWYU pragma: export
+#include <string.h>
 
 
 /** @brief Assertion macro that prints formatted error message if failed. */
@@ -41,9 +44,32 @@
 
 #endif
 
+/** @brief Identical to lf_assert(), but only checked if `NDEBUG` is not
+ * defined. Used for the checks too costly for the release builds. */
+#ifdef NDEBUG
+#define lf_debug_assert(c, ...) ((void) 0)
+#else
+#define lf_debug_assert(c, ...) lf_assert(c, __VA_ARGS__)
+#endif
+
 /** @brief Counterpart of the assert(), expects the condition to be false. */
 #define lf_unwrap(c) lf_assert(!(c), "discarded result indicate error")
 
+/** @brief Hints the processor to fetch the cache line of the address. */
+#if defined(__GNUC__) || defined(__clang__)
+#define lf_prefetch(addr) __builtin_prefetch(addr)
+#else
+#define lf_prefetch(addr) ((void) (addr))
+#endif
+
+/** @brief Hints the processor that the thread is spinning on a lock. */
+#if defined(__SSE2__)
+#include <emmintrin.h>  // IWYU pragma: export
+#define lf_cpu_relax() _mm_pause()
+#else
+#define lf_cpu_relax() ((void) 0)
+#endif
+
 /** @brief Unreachable assertion. */
 #define lf_unreachable do { lf_assert(0, "unreachable"); abort(); } while (0)
 
@@ -59,6 +85,36 @@ inline lfi_fdecl(size_t, circular_index)(ptrdiff_t index, size_t size)
 	return index;
 }
 
+/* Allocation through the allocator of a container. */
+#define lf_alloc(a, size) ((a)->alloc((a)->ctx, (size)))
+#define lf_realloc(a, ptr, old_size, size) \
+	((a)->realloc((a)->ctx, (ptr), (old_size), (size)))
+
+/* Releases the allocation, if not NULL, as free(). */
+inline lfi_fdecl(void, free)(const struct lf(allocator) *a,
+			     void *ptr,
+			     size_t size)
+{
+	if (ptr != NULL)
+		a->free(a->ctx, ptr, size);
+}
+
+/* First 8 bytes of the key, zero padded, as a big-endian integer. Prefixes
+ * compare as the keys do when ordered by their bytes, unless they are
+ * equal. */
+inline lfi_fdecl(uint64_t, key_prefix)(const void *key, size_t keylen)
+{
+	unsigned char bytes[8] = { 0 };
+	uint64_t prefix = 0;
+
+	memcpy(bytes, key, keylen < 8 ? keylen : 8);
+
+	for (int i = 0; i < 8; i++)
+		prefix = prefix << 8 | bytes[i];
+
+	return prefix;
+}
+
 #define lfi_sentinel_entry ((struct lf(entry)) { .key = NULL, })
 
 
@@ -0,0 +1,227 @@
+#include "../../include/allocator.h"
+#include "../../include/hashmap.h"
+#include "../../include/map.h"
+#include "../../include/stack.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define N 4000
+
+
+/* Allocator checking that the sizes given back match the allocations. */
+struct counter {
+	size_t allocs;
+	size_t bytes;
+};
+
+struct header {
+	size_t size;
+	max_align_t align;
+};
+
+static void *counting_alloc(void *ctx, size_t size)
+{
+	struct counter *c = ctx;
+	struct header *h = malloc(sizeof(struct header) + size);
+
+	if (h == NULL)
+		return NULL;
+
+	h->size = size;
+	c->allocs++;
+	c->bytes += size;
+
+	return h + 1;
+}
+
+static void counting_free(void *ctx, void *ptr, size_t size)
+{
+	struct counter *c = ctx;
+	struct header *h = (struct header *) ptr - 1;
+
+	assert(h->size == size);
+	c->allocs--;
+	c->bytes -= size;
+
+	free(h);
+}
+
+static void *counting_realloc(void *ctx, void *ptr, size_t old_size,
+			      size_t size)
+{
+	void *new_ptr = counting_alloc(ctx, size);
+
+	if (new_ptr != NULL) {
+		memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+		counting_free(ctx, ptr, old_size);
+	}
+
+	return new_ptr;
+}
+
+static void key_of(char *key, size_t size, int i)
+{
+	snprintf(key, size, "key-%d-with-a-long-suffix", i);
+}
+
+static void test_counting(void)
+{
+	struct counter c = { 0 };
+	struct lf(allocator) a = {
+		.alloc = counting_alloc,
+		.realloc = counting_realloc,
+		.free = counting_free,
+		.ctx = &c,
+	};
+	char key[48];
+
+	struct lf(stack) s;
+
+	lf(stack_xinit_with)(&s, sizeof(int), &a);
+
+	for (int i = 0; i < N; i++)
+		lf(stack_xpush)(&s, &i);
+
+	for (int i = N - 1; i >= 0; i--)
+		assert(*(int *) lf(stack_pop)(&s) == i);
+
+	lf(stack_destroy)(&s);
+	assert(c.allocs == 0 && c.bytes == 0);
+
+	for (int flags = 0; flags < 4; flags++) {
+		struct lf(hashmap) m;
+
+		lf(hashmap_xinit_with)(&m, sizeof(int), NULL, flags, &a);
+
+		for (int i = 0; i < N; i++) {
+			key_of(key, sizeof(key), i);
+			lf(hashmap_xinsert)(&m, key, &i);
+		}
+
+		for (int i = 0; i < N; i += 2) {
+			key_of(key, sizeof(key), i);
+			assert(*(int *) lf(hashmap_remove)(&m, key) == i);
+		}
+
+		for (int i = 1; i < N; i += 2) {
+			key_of(key, sizeof(key), i);
+			assert(*(int *) lf(hashmap_get)(&m, key) == i);
+		}
+
+		lf(hashmap_destroy)(&m);
+		assert(c.allocs == 0 && c.bytes == 0);
+	}
+
+	struct lf(map) m;
+
+	lf(map_xinit_with)(&m, sizeof(int), NULL, &a);
+
+	for (int i = 0; i < N; i++) {
+		key_of(key, sizeof(key), i);
+		lf(map_xinsert)(&m, key, &i);
+	}
+
+	for (int i = 0; i < N; i += 2) {
+		key_of(key, sizeof(key), i);
+		assert(*(int *) lf(map_remove)(&m, key) == i);
+	}
+
+	// nodes are allocated in slabs
+	assert(c.allocs < N / 64);
+
+	lf(map_destroy)(&m);
+	assert(c.allocs == 0 && c.bytes == 0);
+}
+
+static void test_arena(void)
+{
+	struct lf(arena) arena;
+
+	lf(arena_xinit)(&arena);
+
+	// allocations are aligned and do not overlap
+	char *prev = NULL;
+
+	for (size_t size = 1; size < 3 * LF_ARENA_INITIAL_BLOCK_SIZE; size += 77) {
+		char *p = lf(arena_xalloc)(&arena, size);
+
+		assert((uintptr_t) p % _Alignof(max_align_t) == 0);
+		assert(p != prev);
+		memset(p, 0xab, size);
+		prev = p;
+	}
+
+	// only the latest allocation is released or resized in place
+	struct lf(allocator) a = lf(arena_allocator)(&arena);
+	char *p = a.alloc(a.ctx, 16);
+	char *q = a.alloc(a.ctx, 16);
+
+	memcpy(p, "0123456789abcde", 16);
+	assert(a.realloc(a.ctx, q, 16, 64) == q);
+
+	char *r = a.realloc(a.ctx, p, 16, 64);
+
+	assert(r != p && memcmp(r, "0123456789abcde", 16) == 0);
+
+	a.free(a.ctx, r, 64);
+	assert(a.alloc(a.ctx, 8) == r);
+
+	// empty allocations have addresses of their own
+	char *empty = a.alloc(a.ctx, 0);
+	char *after = a.alloc(a.ctx, 16);
+
+	assert(empty != after);
+	memcpy(after, "0123456789abcde", 16);
+	a.free(a.ctx, empty, 0);
+	memset(a.alloc(a.ctx, 16), 0, 16);
+	assert(memcmp(after, "0123456789abcde", 16) == 0);
+
+	// containers in an arena are torn down with it, without destroying
+	// them
+	struct lf(hashmap) h;
+	struct lf(map) m;
+	struct lf(stack) s;
+	char key[48];
+
+	lf(hashmap_xinit_with)(&h, sizeof(int), NULL, 0, &a);
+	lf(map_xinit_with)(&m, sizeof(int), NULL, &a);
+	lf(stack_xinit_with)(&s, sizeof(int), &a);
+
+	for (int round = 0; round < 3; round++) {
+		for (int i = 0; i < N; i++) {
+			key_of(key, sizeof(key), i);
+			lf(hashmap_xinsert)(&h, key, &i);
+			lf(map_xinsert)(&m, key, &i);
+			lf(stack_xpush)(&s, &i);
+		}
+
+		for (int i = 0; i < N; i++) {
+			key_of(key, sizeof(key), i);
+			assert(*(int *) lf(hashmap_get)(&h, key) == i);
+			assert(*(int *) lf(map_get)(&m, key) == i);
+			assert(*(int *) lf(stack_at)(&s, i) == i);
+		}
+
+		lf(arena_reset)(&arena);
+
+		lf(hashmap_xinit_with)(&h, sizeof(int), NULL, 0, &a);
+		lf(map_xinit_with)(&m, sizeof(int), NULL, &a);
+		lf(stack_xinit_with)(&s, sizeof(int), &a);
+	}
+
+	lf(arena_destroy)(&arena);
+}
+
+
+int main(void)
+{
+	test_counting();
+	test_arena();
+
+	return EXIT_SUCCESS;
+}
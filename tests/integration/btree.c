@@ -0,0 +1,178 @@
+#include "../../include/btree.h"
+#include "../../include/map.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+#define N 20000
+
+
+static size_t key_of(char *key, size_t size, int i)
+{
+	// short keys are stored in the nodes, long ones out of them
+	if (i % 3)
+		return snprintf(key, size, "%08d", i);
+	else
+		return snprintf(key, size, "%08d-with-a-long-suffix", i);
+}
+
+static int reverse_cmp(const void *key1, const void *key2,
+		       size_t keylen1, size_t keylen2)
+{
+	int res = memcmp(key1, key2, keylen1 < keylen2 ? keylen1 : keylen2);
+
+	if (res == 0)
+		res = (keylen1 > keylen2) - (keylen1 < keylen2);
+
+	return -res;
+}
+
+/* The btree must hold the same entries as the map, in the same order. */
+static void check(struct lf(btree) *t, struct lf(map) *m)
+{
+	struct lf(btree_it) it;
+	struct lf(map_it) mit;
+	struct lf(entry) e, me;
+	size_t n = lf(map_size)(m);
+
+	assert(lf(btree_size)(t) == n);
+
+	lf(btree_iter)(t, &it);
+	lf(map_iter)(m, &mit);
+
+	for (size_t i = 0; i < n; i++) {
+		e = lf(btree_iter_next)(&it);
+		me = lf(map_iter_next)(&mit);
+
+		assert(lf(entry_is_valid)(e));
+		assert(e.keylen == me.keylen);
+		assert(memcmp(e.key, me.key, e.keylen) == 0);
+		assert(*(int *) e.value == *(int *) me.value);
+		assert(lf(btree_rank2)(t, e.key, e.keylen) == i);
+	}
+
+	assert(!lf(entry_is_valid)(lf(btree_iter_next)(&it)));
+
+	if (n == 0)
+		return;
+
+	// backwards from the last entry
+	lf(btree_iter_from)(t, &it, -1);
+
+	for (size_t i = n; i > 0; i--) {
+		e = lf(btree_iter_prev)(&it);
+		me = lf(map_select)(m, i - 1);
+
+		assert(e.keylen == me.keylen);
+		assert(memcmp(e.key, me.key, e.keylen) == 0);
+	}
+
+	assert(!lf(entry_is_valid)(lf(btree_iter_prev)(&it)));
+
+	for (size_t i = 0; i < n; i += 97) {
+		e = lf(btree_select)(t, i);
+		me = lf(map_select)(m, i);
+
+		assert(e.keylen == me.keylen);
+		assert(memcmp(e.key, me.key, e.keylen) == 0);
+	}
+}
+
+static void test_random(int (*cmp)(const void *, const void *,
+				   size_t, size_t))
+{
+	struct lf(btree) t;
+	struct lf(map) m;
+	char key[48];
+	int *order = malloc(N * sizeof(int));
+
+	lf(btree_xinit)(&t, sizeof(int), cmp);
+	lf(map_xinit)(&m, sizeof(int), cmp);
+
+	for (int i = 0; i < N; i++)
+		order[i] = i;
+
+	for (int i = N - 1; i > 0; i--) {
+		int j = rand() % (i + 1), tmp = order[i];
+
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+
+	for (int i = 0; i < N; i++) {
+		size_t keylen = key_of(key, sizeof(key), order[i]);
+
+		lf(btree_xinsert2)(&t, key, keylen, &order[i]);
+		lf(map_xinsert2)(&m, key, keylen, &order[i]);
+	}
+
+	check(&t, &m);
+
+	for (int i = 0; i < N; i++) {
+		size_t keylen = key_of(key, sizeof(key), i);
+
+		assert(*(int *) lf(btree_get2)(&t, key, keylen) == i);
+	}
+
+	assert(lf(btree_get)(&t, "missing") == NULL);
+	assert(lf(btree_rank)(&t, "missing") == (size_t) -1);
+	assert(lf(btree_remove)(&t, "missing") == NULL);
+
+	// removals in random order, with a few reinsertions
+	for (int i = 0; i < N; i++) {
+		size_t keylen = key_of(key, sizeof(key), order[i]);
+
+		assert(*(int *) lf(btree_remove2)(&t, key, keylen) ==
+		       order[i]);
+		assert(lf(map_remove2)(&m, key, keylen));
+		assert(lf(btree_get2)(&t, key, keylen) == NULL);
+
+		if (i % 7 == 0) {
+			lf(btree_xinsert2)(&t, key, keylen, &order[i]);
+			lf(map_xinsert2)(&m, key, keylen, &order[i]);
+		}
+
+		if (i % 4000 == 0)
+			check(&t, &m);
+	}
+
+	check(&t, &m);
+
+	lf(btree_destroy)(&t);
+	lf(map_destroy)(&m);
+	free(order);
+}
+
+static void test_empty(void)
+{
+	struct lf(btree) t;
+	struct lf(btree_it) it;
+
+	lf(btree_xinit)(&t, 0, NULL);
+
+	lf(btree_iter)(&t, &it);
+	assert(!lf(entry_is_valid)(lf(btree_iter_next)(&it)));
+
+	// value-less entries, removing all of them frees the root
+	assert(lf(btree_xinsert)(&t, "a", NULL) != NULL);
+	assert(lf(btree_remove)(&t, "a") != NULL);
+	assert(lf(btree_size)(&t) == 0 && t.root == NULL);
+
+	lf(btree_destroy)(&t);
+}
+
+
+int main(void)
+{
+	srand(time(NULL));
+
+	test_empty();
+	test_random(NULL);
+	test_random(reverse_cmp);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,99 @@
+#include "../../include/chashmap.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <threads.h>
+
+
+#define THREADS 4
+#define KEYS_PER_THREAD 4096
+
+
+static struct lf(chashmap) c;
+
+
+// each writer owns a range of keys, readers check all of them
+static int writer(void *arg)
+{
+	int base = *(int *) arg * KEYS_PER_THREAD;
+
+	for (int round = 0; round < 4; round++) {
+		for (int i = 0; i < KEYS_PER_THREAD; i++) {
+			int key = base + i, value = key * round;
+			bool inserted;
+
+			lf(chashmap_xupsert2)(&c, &key, sizeof(int), &value,
+					      &inserted);
+			assert(inserted == (round % 2 == 0));
+		}
+
+		for (int i = 0; i < KEYS_PER_THREAD; i++) {
+			int key = base + i, value;
+
+			assert(lf(chashmap_get2)(&c, &key, sizeof(int), &value));
+			assert(value == key * round);
+
+			// odd rounds remove all keys of the thread
+			if (round % 2) {
+				assert(lf(chashmap_remove2)(&c, &key,
+							    sizeof(int),
+							    &value));
+				assert(value == key * round);
+				assert(!lf(chashmap_get2)(&c, &key, sizeof(int),
+							  NULL));
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int reader(void *arg)
+{
+	(void) arg;
+
+	for (int round = 0; round < 16; round++) {
+		for (int key = 0; key < THREADS * KEYS_PER_THREAD; key++) {
+			int value;
+
+			if (lf(chashmap_get2)(&c, &key, sizeof(int), &value))
+				assert(value % (key ? key : 1) == 0);
+		}
+	}
+
+	return 0;
+}
+
+
+int main(void)
+{
+	thrd_t writers[THREADS], readers[THREADS];
+	int ids[THREADS];
+
+	lf(chashmap_xinit)(&c, sizeof(int), NULL, 0);
+
+	for (int i = 0; i < THREADS; i++) {
+		ids[i] = i;
+		assert(thrd_create(&writers[i], writer, &ids[i]) == thrd_success);
+		assert(thrd_create(&readers[i], reader, NULL) == thrd_success);
+	}
+
+	for (int i = 0; i < THREADS; i++) {
+		thrd_join(writers[i], NULL);
+		thrd_join(readers[i], NULL);
+	}
+
+	assert(lf(chashmap_size)(&c) == 0);
+
+	// string keys, longer than the inline keys
+	assert(!lf(chashmap_upsert)(&c, "a key stored on the heap", NULL, NULL));
+	assert(lf(chashmap_get)(&c, "a key stored on the heap", NULL));
+	assert(lf(chashmap_size)(&c) == 1);
+	assert(lf(chashmap_remove)(&c, "a key stored on the heap", NULL));
+	assert(!lf(chashmap_remove)(&c, "a key stored on the heap", NULL));
+
+	lf(chashmap_destroy)(&c);
+
+	return EXIT_SUCCESS;
+}
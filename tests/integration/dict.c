@@ -0,0 +1,126 @@
+#include "../../include/dict.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+#define KEYSPACE 4096
+
+
+static void key_of(int i, char *buf, size_t *keylen)
+{
+	// every third key is too long to be stored inline
+	*keylen = snprintf(buf, 48, i % 3 ? "%d" : "a-longer-key-%d-xxxxxxxx", i);
+}
+
+
+int main(void)
+{
+	srand(time(NULL));
+
+	static bool present[KEYSPACE];
+	static int order[KEYSPACE];
+	char buf[48];
+	size_t keylen;
+
+	struct lf(dict) d;
+
+	lf(dict_xinit)(&d, sizeof(int), NULL);
+
+	for (int round = 0; round < 64; round++) {
+		int n = 0;
+
+		for (int i = 0; i < 1024; i++) {
+			int key = rand() % KEYSPACE;
+
+			key_of(key, buf, &keylen);
+
+			if (present[key]) {
+				const int *value =
+					lf(dict_remove2)(&d, buf, keylen);
+
+				assert(value && *value == key);
+				assert(!lf(dict_get2)(&d, buf, keylen));
+			} else {
+				assert(!lf(dict_get2)(&d, buf, keylen));
+				lf(dict_xinsert2)(&d, buf, keylen, &key);
+			}
+
+			present[key] = !present[key];
+		}
+
+		for (int key = 0; key < KEYSPACE; key++) {
+			key_of(key, buf, &keylen);
+
+			int *value = lf(dict_get2)(&d, buf, keylen);
+
+			if (present[key]) {
+				assert(value && *value == key);
+				n++;
+			} else {
+				assert(value == NULL);
+			}
+		}
+
+		assert(d.used == (size_t) n);
+
+		// removed entries do not outnumber the others
+		assert(d.len - d.used <= d.used * 2 + 1);
+	}
+
+	lf(dict_destroy)(&d);
+
+	// iteration follows the insertion order, skipping removed entries
+	lf(dict_xinit)(&d, sizeof(int), NULL);
+
+	for (int i = 0; i < KEYSPACE; i++) {
+		key_of(i, buf, &keylen);
+		lf(dict_xinsert2)(&d, buf, keylen, &i);
+	}
+
+	int n = 0;
+
+	for (int i = 0; i < KEYSPACE; i++) {
+		if (i % 5 == 0) {
+			key_of(i, buf, &keylen);
+			assert(lf(dict_remove2)(&d, buf, keylen));
+		} else {
+			order[n++] = i;
+		}
+	}
+
+	struct lf(dict_it) it;
+	struct lf(entry) e;
+	int count = 0;
+
+	lf(dict_iter)(&d, &it);
+
+	while (lf(entry_is_valid)(e = lf(dict_iter_next)(&it))) {
+		int i = order[count++];
+
+		key_of(i, buf, &keylen);
+
+		assert(*(int *) e.value == i);
+		assert(e.keylen == keylen && !memcmp(e.key, buf, keylen));
+	}
+
+	assert(count == n);
+
+	lf(dict_destroy)(&d);
+
+	// small dicts keep a narrow index table
+	lf(dict_xinit)(&d, 0, NULL);
+	lf(dict_xinsert)(&d, "key", NULL);
+
+	assert(lf(dict_get)(&d, "key"));
+	assert(!lf(dict_get)(&d, "other"));
+	assert((char *) d.entries - (char *) d.index == (ptrdiff_t) d.cap);
+
+	lf(dict_destroy)(&d);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,89 @@
+#include "../../include/hashmap.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+#define KEYSPACE 4096
+
+
+int main(void)
+{
+	srand(time(NULL));
+
+	static bool present[KEYSPACE];
+
+	struct lf(hashmap) m;
+
+	for (int mode = 0; mode < 2; mode++) {
+		lf(hashmap_xinit)(&m, sizeof(int), NULL,
+				  mode ? LF_HASHMAP_ROBIN_HOOD : 0);
+
+		memset(present, 0, sizeof(present));
+
+		// keep the map at a steady size while replacing its keys
+		for (int i = 0; i < 1024; i++) {
+			int key = rand() % KEYSPACE;
+
+			if (!present[key]) {
+				lf(hashmap_xinsert2)(&m, &key, sizeof(int), &key);
+				present[key] = true;
+			}
+		}
+
+		for (int round = 0; round < 256; round++) {
+			for (int i = 0; i < 512; i++) {
+				int key = rand() % KEYSPACE;
+
+				if (present[key]) {
+					const int *value = lf(hashmap_remove2)(
+						&m, &key, sizeof(int));
+
+					assert(value && *value == key);
+					assert(!lf(hashmap_get2)(&m, &key,
+								 sizeof(int)));
+				} else {
+					int *value = lf(hashmap_xinsert2)(
+						&m, &key, sizeof(int), NULL);
+
+					*value = key;
+				}
+
+				present[key] = !present[key];
+			}
+
+			for (int key = 0; key < KEYSPACE; key++) {
+				int *value = lf(hashmap_get2)(&m, &key,
+							      sizeof(int));
+
+				if (present[key])
+					assert(value && *value == key);
+				else
+					assert(value == NULL);
+			}
+		}
+
+		size_t count = 0;
+		struct lf(hashmap_it) it;
+		struct lf(entry) e;
+
+		lf(hashmap_iter)(&m, &it);
+
+		while (lf(entry_is_valid)(e = lf(hashmap_iter_next)(&it))) {
+			assert(present[*(int *) e.key]);
+			count++;
+		}
+
+		for (int key = 0; key < KEYSPACE; key++)
+			count -= present[key];
+
+		assert(count == 0);
+
+		lf(hashmap_destroy)(&m);
+	}
+
+	return EXIT_SUCCESS;
+}
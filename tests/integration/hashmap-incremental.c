@@ -0,0 +1,108 @@
+#include "../../include/hashmap.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define LIMIT 6000
+
+
+// all keys below limit, except the multiples of skip, must be present
+void check(struct lf(hashmap) *m, int limit, int skip)
+{
+	size_t count = 0;
+
+	for (int key = 0; key < LIMIT; key++) {
+		int *value = lf(hashmap_get2)(m, &key, sizeof(int));
+
+		if (key < limit && (skip == 0 || key % skip)) {
+			assert(value && *value == key);
+			count++;
+		} else {
+			assert(value == NULL);
+		}
+	}
+
+	struct lf(hashmap_it) it;
+	struct lf(entry) e;
+
+	lf(hashmap_iter)(m, &it);
+
+	while (lf(entry_is_valid)(e = lf(hashmap_iter_next)(&it))) {
+		assert(*(int *) e.key == *(int *) e.value);
+		count--;
+	}
+
+	assert(count == 0);
+}
+
+int main(void)
+{
+	struct lf(hashmap) m;
+
+	for (int mode = 0; mode < 2; mode++) {
+		lf(hashmap_xinit)(&m, sizeof(int), NULL,
+				  LF_HASHMAP_INCREMENTAL |
+				  (mode ? LF_HASHMAP_ROBIN_HOOD : 0));
+
+		// lookups and iteration see both tables while migrating
+		for (int key = 0; key < LIMIT; key++) {
+			lf(hashmap_xinsert2)(&m, &key, sizeof(int), &key);
+
+			if (key % 17 == 0)
+				check(&m, key + 1, 0);
+		}
+
+		check(&m, LIMIT, 0);
+
+		// removals from both tables
+		lf(hashmap_destroy)(&m);
+		lf(hashmap_xinit)(&m, sizeof(int), NULL,
+				  LF_HASHMAP_INCREMENTAL |
+				  (mode ? LF_HASHMAP_ROBIN_HOOD : 0));
+
+		for (int key = 0; key < LIMIT; key++) {
+			lf(hashmap_xinsert2)(&m, &key, sizeof(int), &key);
+
+			if (key % 3 == 0 && key >= 300) {
+				int removed = key - 300;
+
+				assert(*(int *) lf(hashmap_remove2)(
+					&m, &removed, sizeof(int)) == removed);
+			}
+		}
+
+		for (int key = LIMIT - 300; key < LIMIT; key++) {
+			if (key % 3 == 0)
+				assert(lf(hashmap_remove2)(&m, &key, sizeof(int)));
+		}
+
+		check(&m, LIMIT, 3);
+
+		// long keys are moved between the tables without copying
+		char key[64];
+
+		for (int i = 0; i < 1000; i++) {
+			memset(key, 'a' + i % 26, sizeof(key));
+			memcpy(key, &i, sizeof(int));
+
+			bool inserted;
+
+			lf(hashmap_xupsert2)(&m, key, sizeof(key), &i, &inserted);
+			assert(inserted);
+		}
+
+		for (int i = 0; i < 1000; i++) {
+			memset(key, 'a' + i % 26, sizeof(key));
+			memcpy(key, &i, sizeof(int));
+
+			assert(*(int *) lf(hashmap_get2)(&m, key, sizeof(key)) ==
+			       i);
+		}
+
+		lf(hashmap_destroy)(&m);
+	}
+
+	return EXIT_SUCCESS;
+}
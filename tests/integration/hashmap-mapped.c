@@ -0,0 +1,184 @@
+#include "../../include/hashmap.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define N 5000
+
+#define SNAPSHOT "hashmap-mapped.snapshot"
+
+/* Byte offsets of the fields of the file header, see hashmap_save(). */
+#define HEADER_CAP 64
+#define HEADER_KEYS_OFFSET 96
+#define HEADER_KEYS_SIZE 104
+
+
+static size_t key_of(int i, char *buf)
+{
+	// every other key is too long to be stored inline
+	return snprintf(buf, 48, i % 2 ? "%d" : "a-long-key-stored-apart-%d", i);
+}
+
+static uint64_t read_field(long offset)
+{
+	FILE *f = fopen(SNAPSHOT, "rb");
+	uint64_t v;
+
+	assert(f && !fseek(f, offset, SEEK_SET) && fread(&v, sizeof(v), 1, f));
+	assert(!fclose(f));
+
+	return v;
+}
+
+static void write_field(long offset, uint64_t v)
+{
+	FILE *f = fopen(SNAPSHOT, "r+b");
+
+	assert(f && !fseek(f, offset, SEEK_SET) && fwrite(&v, sizeof(v), 1, f));
+	assert(!fclose(f));
+}
+
+
+int main(void)
+{
+	char key[48];
+	size_t keylen;
+
+	for (int mode = 0; mode < 4; mode++) {
+		struct lf(hashmap) m, mapped;
+		uint64_t (*hash)(const void *, size_t) =
+			mode % 2 ? lf(hashmap_fnv_hash) : NULL;
+
+		lf(hashmap_xinit)(&m, sizeof(int), hash,
+				  mode < 2 ? LF_HASHMAP_INCREMENTAL :
+					     LF_HASHMAP_ROBIN_HOOD);
+
+		for (int i = 0; i < N; i++) {
+			keylen = key_of(i, key);
+			lf(hashmap_xinsert2)(&m, key, keylen, &i);
+		}
+
+		// removed keys leave tombstones behind
+		for (int i = 0; i < N; i += 7) {
+			keylen = key_of(i, key);
+			assert(lf(hashmap_remove2)(&m, key, keylen));
+		}
+
+		assert(!lf(hashmap_save)(&m, SNAPSHOT));
+		lf(hashmap_destroy)(&m);
+
+		// the file is checked against the hash function
+		assert(lf(hashmap_open_mapped)(&mapped, SNAPSHOT,
+					       mode % 2 ? NULL :
+					       lf(hashmap_fnv_hash)));
+
+		assert(!lf(hashmap_open_mapped)(&mapped, SNAPSHOT, hash));
+
+		for (int i = 0; i < 2 * N; i++) {
+			keylen = key_of(i, key);
+
+			int *value = lf(hashmap_get2)(&mapped, key, keylen);
+
+			if (i < N && i % 7)
+				assert(value && *value == i);
+			else
+				assert(value == NULL);
+		}
+
+		struct lf(hashmap_it) it;
+		struct lf(entry) e;
+		int count = 0;
+
+		lf(hashmap_iter)(&mapped, &it);
+
+		while (lf(entry_is_valid)(e = lf(hashmap_iter_next)(&it))) {
+			int i = *(int *) e.value;
+
+			keylen = key_of(i, key);
+
+			assert(e.keylen == keylen && !memcmp(e.key, key, keylen));
+			count++;
+		}
+
+		assert(count == N - (N + 6) / 7);
+
+		lf(hashmap_destroy)(&mapped);
+	}
+
+	// damaged files are rejected, not read out of bounds
+	struct lf(hashmap) m, mapped;
+
+	lf(hashmap_xinit)(&m, sizeof(int), NULL, 0);
+
+	for (int i = 0; i < 100; i++) {
+		keylen = key_of(i, key);
+		lf(hashmap_xinsert2)(&m, key, keylen, &i);
+	}
+
+	assert(!lf(hashmap_save)(&m, SNAPSHOT));
+	lf(hashmap_destroy)(&m);
+
+	uint64_t cap = read_field(HEADER_CAP);
+	uint64_t keys_offset = read_field(HEADER_KEYS_OFFSET);
+	uint64_t keys_size = read_field(HEADER_KEYS_SIZE);
+
+	assert(!lf(hashmap_open_mapped)(&mapped, SNAPSHOT, NULL));
+	lf(hashmap_destroy)(&mapped);
+
+	// sections wrapping around
+	write_field(HEADER_CAP, UINT64_C(1) << 60);
+	assert(lf(hashmap_open_mapped)(&mapped, SNAPSHOT, NULL));
+	write_field(HEADER_CAP, cap);
+
+	write_field(HEADER_KEYS_SIZE, -keys_offset);
+	assert(lf(hashmap_open_mapped)(&mapped, SNAPSHOT, NULL));
+
+	// the key past the end of its section is neither found nor iterated
+	struct lf(hashmap_it) it;
+	int found = 0, count = 0;
+
+	write_field(HEADER_KEYS_SIZE, keys_size - 1);
+	assert(!lf(hashmap_open_mapped)(&mapped, SNAPSHOT, NULL));
+
+	for (int i = 0; i < 100; i++) {
+		keylen = key_of(i, key);
+		found += lf(hashmap_get2)(&mapped, key, keylen) != NULL;
+	}
+
+	lf(hashmap_iter)(&mapped, &it);
+
+	while (lf(entry_is_valid)(lf(hashmap_iter_next)(&it)))
+		count++;
+
+	assert(found == 99 && count == 99);
+	assert(lf(hashmap_save)(&mapped, SNAPSHOT ".copy"));
+	lf(hashmap_destroy)(&mapped);
+	remove(SNAPSHOT ".copy");
+	write_field(HEADER_KEYS_SIZE, keys_size);
+
+	// truncated file
+	FILE *f = fopen(SNAPSHOT, "r+b");
+	char *bytes = malloc(keys_offset + keys_size);
+
+	assert(f && bytes && fread(bytes, keys_offset + keys_size, 1, f));
+	assert(!fclose(f));
+	assert((f = fopen(SNAPSHOT, "wb")) != NULL);
+	assert(fwrite(bytes, keys_offset + keys_size - 1, 1, f) && !fclose(f));
+	assert(lf(hashmap_open_mapped)(&mapped, SNAPSHOT, NULL));
+	free(bytes);
+
+	// other files are rejected
+	f = fopen(SNAPSHOT, "wb");
+
+	assert(f && fputs("not a hashmap", f) >= 0 && !fclose(f));
+	assert(lf(hashmap_open_mapped)(&mapped, SNAPSHOT, NULL));
+
+	assert(!remove(SNAPSHOT));
+	assert(lf(hashmap_open_mapped)(&mapped, SNAPSHOT, NULL));
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,108 @@
+#include "../../include/hashmap.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define N 10000
+
+
+static void check(struct lf(hashmap) *m, int from, int to)
+{
+	char key[48];
+
+	for (int i = from; i < to; i++) {
+		snprintf(key, sizeof(key), "key-%d-with-a-long-suffix", i);
+
+		int *value = lf(hashmap_get)(m, key);
+
+		assert(value && *value == i);
+	}
+
+	assert(m->used == (size_t) (to - from));
+}
+
+static void fill(struct lf(hashmap) *m, int from, int to)
+{
+	char key[48];
+
+	for (int i = from; i < to; i++) {
+		snprintf(key, sizeof(key), "key-%d-with-a-long-suffix", i);
+		lf(hashmap_xinsert)(m, key, &i);
+	}
+}
+
+
+int main(void)
+{
+	struct lf(hashmap) m;
+
+	for (int flags = 0; flags < 4; flags++) {
+		lf(hashmap_xinit)(&m, sizeof(int), NULL, flags);
+
+		// a reserved map does not rehash while it is filled
+		lf(hashmap_xreserve)(&m, N);
+
+		size_t cap = m.cap;
+		void *ctrl = m.ctrl;
+
+		assert(m.grow_at >= N);
+
+		fill(&m, 0, N);
+
+		assert(m.cap == cap && m.ctrl == ctrl);
+		check(&m, 0, N);
+
+		// reserving less than the capacity does nothing
+		lf(hashmap_xreserve)(&m, N / 2);
+		assert(m.cap == cap && m.ctrl == ctrl);
+
+		// a cleared map keeps its table
+		lf(hashmap_clear)(&m);
+
+		assert(m.used == 0 && m.cap == cap && m.ctrl == ctrl);
+		assert(!lf(hashmap_get)(&m, "key-0-with-a-long-suffix"));
+
+		fill(&m, N, 2 * N);
+
+		assert(m.cap == cap && m.ctrl == ctrl);
+		check(&m, N, 2 * N);
+
+		// shrinking keeps the entries
+		char key[48];
+
+		for (int i = N; i < 2 * N - 100; i++) {
+			snprintf(key, sizeof(key), "key-%d-with-a-long-suffix", i);
+			assert(lf(hashmap_remove)(&m, key));
+		}
+
+		assert(!lf(hashmap_shrink_to_fit)(&m));
+
+		assert(m.cap == 256 && m.deleted == 0);
+		check(&m, 2 * N - 100, 2 * N);
+
+		lf(hashmap_destroy)(&m);
+	}
+
+	// the map grows in time with a lower load factor
+	lf(hashmap_xinit)(&m, sizeof(int), NULL, 0);
+
+	lf(hashmap_set_max_load)(&m, 0.5);
+	fill(&m, 0, N);
+
+	assert(m.used * 2 <= m.cap);
+	check(&m, 0, N);
+
+	// and keeps a free slot with the highest one
+	lf(hashmap_set_max_load)(&m, 1);
+	fill(&m, N, 4 * N);
+
+	assert(m.used < m.cap);
+	check(&m, 0, 4 * N);
+
+	lf(hashmap_destroy)(&m);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,101 @@
+#include "../../include/hashmap.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+
+#define N 5000
+
+
+static void check_slots(struct lf(hashmap) *m, struct lf(hashmap_stats) *s)
+{
+	size_t histogram = 0;
+
+	lf(hashmap_stats)(m, s);
+
+	for (size_t i = 0; i < LF_HASHMAP_STATS_HISTOGRAM_SIZE; i++)
+		histogram += s->probe_histogram[i];
+
+	assert(s->size == m->used);
+	assert(s->live == s->size);
+	assert(histogram == s->live);
+	assert(s->live + s->tombstones + s->empty ==
+	       s->capacity + s->old_capacity);
+
+	if (s->live) {
+		assert(s->max_probe >= 1);
+		assert(s->avg_probe >= 1 && s->avg_probe <= s->max_probe);
+	} else {
+		assert(s->max_probe == 0 && s->avg_probe == 0);
+	}
+
+	assert(s->memory > s->capacity);
+}
+
+
+int main(void)
+{
+	struct lf(hashmap) m;
+	struct lf(hashmap_stats) s;
+	char key[48];
+
+	for (int flags = 0; flags < 4; flags++) {
+		lf(hashmap_xinit)(&m, sizeof(int), NULL, flags);
+
+		check_slots(&m, &s);
+		assert(s.size == 0 && s.empty == s.capacity);
+
+		for (int i = 0; i < N; i++) {
+			snprintf(key, sizeof(key), "key-%d-with-a-long-suffix", i);
+			lf(hashmap_xinsert)(&m, key, &i);
+
+			if (i % 500 == 0)
+				check_slots(&m, &s);
+		}
+
+		check_slots(&m, &s);
+		assert(s.size == N);
+
+		size_t memory = s.memory;
+
+		// removed entries leave tombstones or empty slots
+		for (int i = 0; i < N; i += 2) {
+			snprintf(key, sizeof(key), "key-%d-with-a-long-suffix", i);
+			assert(lf(hashmap_remove)(&m, key));
+		}
+
+		check_slots(&m, &s);
+		assert(s.size == N / 2);
+
+		// out of line keys are freed with their entries
+		assert(s.memory < memory);
+
+#ifdef LF_HASHMAP_COUNTERS
+		uint64_t lookups = s.lookups, misses = s.misses;
+
+		assert(s.rehashes > 0);
+		assert(s.probes >= s.lookups);
+
+		for (int i = 0; i < N; i++) {
+			snprintf(key, sizeof(key), "key-%d-with-a-long-suffix", i);
+			lf(hashmap_get)(&m, key);
+		}
+
+		lf(hashmap_stats)(&m, &s);
+		assert(s.lookups == lookups + N);
+		assert(s.misses == misses + N / 2);
+#else
+		assert(s.lookups == 0 && s.misses == 0);
+		assert(s.probes == 0 && s.rehashes == 0);
+#endif
+
+		lf(hashmap_clear)(&m);
+		check_slots(&m, &s);
+		assert(s.size == 0 && s.tombstones == 0);
+
+		lf(hashmap_destroy)(&m);
+	}
+
+	return 0;
+}
@@ -0,0 +1,80 @@
+#include "../../include/hashmap.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+int main(void)
+{
+	struct lf(hashmap) m;
+
+	for (int mode = 0; mode < 2; mode++) {
+		lf(hashmap_xinit)(&m, sizeof(int), NULL,
+				  mode ? LF_HASHMAP_ROBIN_HOOD : 0);
+
+		// count the occurrences of the keys
+		for (int i = 0; i < 8192; i++) {
+			int key = i % 1000, zero = 0;
+			bool inserted;
+
+			int *count = lf(hashmap_xget_or_insert2)(&m, &key,
+								 sizeof(int),
+								 &zero,
+								 &inserted);
+
+			assert(inserted == (i < 1000));
+
+			(*count)++;
+		}
+
+		for (int key = 0; key < 1000; key++)
+			assert(*(int *) lf(hashmap_get2)(&m, &key, sizeof(int)) ==
+			       8192 / 1000 + (key < 8192 % 1000));
+
+		// upsert overwrites the existing values
+		for (int key = 0; key < 2000; key += 2) {
+			bool inserted;
+
+			int *value = lf(hashmap_xupsert2)(&m, &key, sizeof(int),
+							  &key, &inserted);
+
+			assert(*value == key);
+			assert(inserted == (key >= 1000));
+		}
+
+		for (int key = 0; key < 2000; key++) {
+			int *value = lf(hashmap_get2)(&m, &key, sizeof(int));
+
+			if (key % 2 == 0)
+				assert(value && *value == key);
+			else if (key < 1000)
+				assert(value && *value == 8192 / 1000 +
+					(key < 8192 % 1000));
+			else
+				assert(value == NULL);
+		}
+
+		// get_or_insert must not insert a key twice after removals
+		for (int key = 0; key < 1000; key++)
+			assert(lf(hashmap_remove2)(&m, &key, sizeof(int)));
+
+		for (int key = 0; key < 2000; key++) {
+			bool inserted;
+
+			lf(hashmap_xget_or_insert2)(&m, &key, sizeof(int), &key,
+						    &inserted);
+			assert(inserted == (key < 1000 || key % 2));
+		}
+
+		assert(*(int *) lf(hashmap_xupsert)(&m, "key", &(int) { 7 },
+						    NULL) == 7);
+		assert(*(int *) lf(hashmap_xget_or_insert)(&m, "key", &(int) { 8 },
+							   NULL) == 7);
+
+		lf(hashmap_destroy)(&m);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -15,7 +15,9 @@ int main(void)
 	for (int _fuzz = 0; _fuzz < 128; _fuzz++) {
 		int elem_size = rand() % 32;
 
-		lf(hashmap_xinit)(&m, elem_size);
+		lf(hashmap_xinit)(&m, elem_size,
+				  _fuzz % 2 ? lf(hashmap_fnv_hash) : NULL,
+				  _fuzz % 4 < 2 ? 0 : LF_HASHMAP_ROBIN_HOOD);
 
 		char value[elem_size + 1];
 
@@ -23,7 +25,7 @@ int main(void)
 			value[i] = rand() % 255;
 
 		int limit = rand() % 4096;
-		char values[limit];
+		char values[limit + 1];
 
 		size_t values_total = 0;
 
@@ -77,32 +79,65 @@ int main(void)
 			assert(!lf(hashmap_get2)(&m, &i, sizeof(int)));
 		}
 
-		int limit3 = limit2 % ((rand() % 1024) + 4);
-		// now insert size_t keyed elements
-		for (size_t i = 0; i < (size_t) limit3; i += 4) {
-			void *val = lf(hashmap_xinsert2)(&m, &i, sizeof(size_t), NULL);
+		// batched lookup agrees with the single lookups
+		int batch_keys[limit + 1];
+		const void *batch_key_ptrs[limit + 1];
+		size_t batch_keylens[limit + 1];
+		void *batch_values[limit + 1];
 
-			if (elem_size)
-				memcpy(val, &i, elem_size);
+		for (int i = 0; i <= limit; i++) {
+			batch_keys[i] = limit - i;
+			batch_key_ptrs[i] = &batch_keys[i];
+			batch_keylens[i] = sizeof(int);
 		}
 
-		// check size_t keyed elements
+		size_t found = lf(hashmap_get_many)(&m, limit + 1, batch_key_ptrs,
+						    batch_keylens, batch_values);
+
+		assert(found == (size_t) (limit - (limit2 + 1) / 2));
+
+		for (int i = 0; i <= limit; i++)
+			assert(batch_values[i] ==
+			       lf(hashmap_get2)(&m, &batch_keys[i], sizeof(int)));
+
 		size_t inserted_size = sizeof(size_t);
 
 		if ((size_t) elem_size < inserted_size)
 			inserted_size = elem_size;
 
+		int limit3 = limit2 % ((rand() % 1024) + 4);
+		// now insert size_t keyed elements
+		for (size_t i = 0; i < (size_t) limit3; i += 4) {
+			void *val = lf(hashmap_xinsert2)(&m, &i, sizeof(size_t), NULL);
+
+			memcpy(val, &i, inserted_size);
+		}
+
+		// check size_t keyed elements
 		for (size_t i = 0; i < (size_t) limit3; i += 4)
 			assert(!memcmp(lf(hashmap_get2)(&m, &i, sizeof(size_t)),
 							&i, inserted_size));
 
-		lf(hashmap_xinsert)(&m, "inserting string", "the string value");
+		// values are copied as elem_size bytes
+		char str_value[32] = "the string value";
+
+		lf(hashmap_xinsert)(&m, "inserting string", str_value);
 		assert(lf(hashmap_get)(&m, "inserting string"));
 		assert(!strncmp(lf(hashmap_remove)(&m, "inserting string"),
 						   "the string value",
 						   elem_size));
 		assert(!lf(hashmap_remove)(&m, "inserting string"));
 
+		// keys longer than the inline key size are stored on heap
+		const char *long_key = "inserting a key that does not fit in "
+				       "the entry";
+
+		char long_value[32] = "long key value";
+
+		lf(hashmap_xinsert)(&m, long_key, long_value);
+		assert(!strncmp(lf(hashmap_get)(&m, long_key), "long key value",
+				elem_size));
+
 		lf(hashmap_destroy)(&m);
 	}
 
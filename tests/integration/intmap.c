@@ -0,0 +1,108 @@
+#include "../../include/intmap.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+#define KEYSPACE 8192
+
+
+int main(void)
+{
+	srand(time(NULL));
+
+	static bool present[KEYSPACE];
+
+	struct lf(u64map) m;
+	bool inserted;
+
+	lf(u64map_xinit)(&m, sizeof(uint64_t));
+
+	for (int round = 0; round < 64; round++) {
+		for (int i = 0; i < 2048; i++) {
+			// keys differ in their high bits as well
+			uint64_t k = rand() % KEYSPACE;
+			uint64_t key = k << 40 | k, value = key + round;
+
+			if (present[k]) {
+				const uint64_t *v = lf(u64map_remove)(&m, key);
+
+				assert(v && *v >= key && *v <= key + round);
+				assert(!lf(u64map_get)(&m, key));
+			} else {
+				uint64_t *v = lf(u64map_xget_or_insert)(
+					&m, key, &value, &inserted);
+
+				assert(inserted && *v == value);
+			}
+
+			present[k] = !present[k];
+		}
+
+		size_t n = 0;
+
+		for (uint64_t k = 0; k < KEYSPACE; k++) {
+			uint64_t *v = lf(u64map_get)(&m, k << 40 | k);
+
+			assert(present[k] == (v != NULL));
+			n += present[k];
+		}
+
+		struct lf(u64map_it) it;
+		struct lf(entry) e;
+
+		lf(u64map_iter)(&m, &it);
+
+		while (lf(entry_is_valid)(e = lf(u64map_iter_next)(&it))) {
+			uint64_t key = *(const uint64_t *) e.key;
+
+			assert(e.keylen == sizeof(uint64_t));
+			assert(present[key & 0xffffffffff]);
+			assert(*(uint64_t *) e.value >= key);
+			n--;
+		}
+
+		assert(n == 0);
+	}
+
+	lf(u64map_destroy)(&m);
+
+	// small values make 8-byte entries with 32-bit keys
+	struct lf(u32map) s;
+	uint32_t value;
+
+	lf(u32map_xinit)(&s, sizeof(uint32_t));
+	assert(s.stride == 8);
+
+	lf(u32map_xreserve)(&s, 100000);
+
+	unsigned char *ctrl = s.ctrl;
+
+	for (uint32_t key = 0; key < 100000; key++) {
+		value = ~key;
+		lf(u32map_xinsert)(&s, key, &value);
+	}
+
+	assert(s.ctrl == ctrl);
+
+	for (uint32_t key = 0; key < 200000; key++) {
+		uint32_t *v = lf(u32map_get)(&s, key);
+
+		assert(key < 100000 ? v && *v == ~key : v == NULL);
+	}
+
+	value = 7;
+	assert(*(uint32_t *) lf(u32map_xupsert)(&s, 3, &value, &inserted) == 7);
+	assert(!inserted);
+
+	lf(u32map_clear)(&s);
+	assert(!lf(u32map_get)(&s, 3));
+
+	lf(u32map_destroy)(&s);
+
+	return EXIT_SUCCESS;
+}
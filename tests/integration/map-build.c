@@ -0,0 +1,140 @@
+#include "../../include/map.h"
+#include "map-check.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static int reverse(const void *key1,
+		   const void *key2,
+		   size_t keylen1,
+		   size_t keylen2)
+{
+	(void) keylen1;
+	(void) keylen2;
+
+	return *(const int *) key2 - *(const int *) key1;
+}
+
+
+int main(void)
+{
+	struct lf(map) m;
+
+	/* Sizes around the powers of two, where the last level is full or
+	 * holds a single node. */
+	for (size_t n = 0; n < 300; n++) {
+		char (*strs)[8] = malloc(sizeof(*strs) * (n + 1));
+		const void **keys = malloc(sizeof(*keys) * (n + 1));
+		int *values = malloc(sizeof(*values) * (n + 1));
+
+		for (size_t i = 0; i < n; i++) {
+			snprintf(strs[i], sizeof(strs[i]), "%05zu", i);
+			keys[i] = strs[i];
+			values[i] = (int) i * 3;
+		}
+
+		lf(map_xinit)(&m, sizeof(int), NULL);
+		lf(map_xbuild_sorted)(&m, keys, values, n);
+
+		assert(lf(map_size)(&m) == n);
+		assert(m.root == NULL || m.root->color == 0);
+		check(m.root, NULL);
+
+		for (size_t i = 0; i < n; i++) {
+			assert(*(int *) lf(map_get)(&m, strs[i]) == (int) i * 3);
+			assert(lf(map_rank)(&m, strs[i]) == i);
+
+			struct lf(entry) e = lf(map_select)(&m, i);
+
+			assert(e.keylen == 5 && memcmp(e.key, strs[i], 5) == 0);
+		}
+
+		/* The tree stays valid for the following updates. */
+		for (size_t i = 0; i < n; i += 2) {
+			assert(lf(map_remove)(&m, strs[i]) != NULL);
+			check(m.root, NULL);
+		}
+
+		for (size_t i = 0; i < n; i += 2) {
+			lf(map_xinsert)(&m, strs[i], &values[i]);
+			check(m.root, NULL);
+		}
+
+		assert(lf(map_size)(&m) == n);
+
+		lf(map_destroy)(&m);
+
+		free(strs);
+		free(keys);
+		free(values);
+	}
+
+	/* Custom comparator, non-null-terminated keys and no values. */
+	{
+		size_t n = 100000;
+		int *ints = malloc(sizeof(*ints) * n);
+		const void **keys = malloc(sizeof(*keys) * n);
+		size_t *keylens = malloc(sizeof(*keylens) * n);
+
+		for (size_t i = 0; i < n; i++) {
+			ints[i] = (int) (n - i);
+			keys[i] = &ints[i];
+			keylens[i] = sizeof(int);
+		}
+
+		lf(map_xinit)(&m, 0, reverse);
+		lf(map_xbuild_sorted2)(&m, keys, keylens, NULL, n);
+
+		assert(lf(map_size)(&m) == n);
+		assert(m.root->color == 0);
+		check(m.root, NULL);
+
+		struct lf(map_it) it;
+		size_t i = 0;
+
+		lf(map_iter)(&m, &it);
+
+		for (struct lf(entry) e = lf(map_iter_next)(&it);
+		     lf(entry_is_valid)(e); e = lf(map_iter_next)(&it))
+			assert(*(const int *) e.key == ints[i++]);
+
+		assert(i == n);
+
+		lf(map_destroy)(&m);
+
+		free(ints);
+		free(keys);
+		free(keylens);
+	}
+
+	/* Keys larger than the pooled nodes. */
+	{
+		size_t n = 100;
+		char (*strs)[512] = malloc(sizeof(*strs) * n);
+		const void **keys = malloc(sizeof(*keys) * n);
+
+		for (size_t i = 0; i < n; i++) {
+			memset(strs[i], 'a', sizeof(strs[i]) - 1);
+			snprintf(strs[i], 4, "%03zu", i);
+			strs[i][3] = 'a';
+			strs[i][sizeof(strs[i]) - 1] = '\0';
+			keys[i] = strs[i];
+		}
+
+		lf(map_xinit)(&m, sizeof(int), NULL);
+		lf(map_xbuild_sorted)(&m, keys, NULL, n);
+
+		assert(m.large_nodes == n);
+		check(m.root, NULL);
+
+		lf(map_destroy)(&m);
+
+		free(strs);
+		free(keys);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,29 @@
+#ifndef LF_MAP_CHECK_H
+#define LF_MAP_CHECK_H
+
+#include "../../include/map.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+
+/* Checks the red-black and size invariants, returns the black height. */
+static inline size_t check(struct lfi(map_node) *n, struct lfi(map_node) *p)
+{
+	if (n == NULL)
+		return 1;
+
+	assert(n->p == p);
+	assert(!(n->color && p != NULL && p->color));
+
+	size_t left = check(n->left, n);
+	size_t right = check(n->right, n);
+
+	assert(left == right);
+	assert(n->size == 1 + (n->left ? n->left->size : 0) +
+	       (n->right ? n->right->size : 0));
+
+	return left + !n->color;
+}
+
+#endif
@@ -0,0 +1,161 @@
+#include "../../include/map.h"
+#include "map-check.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define N 4096
+
+
+static size_t calls;
+
+
+static int counting(const void *key1,
+		    const void *key2,
+		    size_t keylen1,
+		    size_t keylen2)
+{
+	int x = *(const int *) key1;
+	int y = *(const int *) key2;
+
+	(void) keylen1;
+	(void) keylen2;
+	calls++;
+
+	return (x > y) - (x < y);
+}
+
+/* Asserts that the map holds the keys 0 to n - 1, each mapped to itself. */
+static void check_keys(struct lf(map) *m, int n)
+{
+	struct lf(map_it) it;
+	int i = 0;
+
+	check(m->root, NULL);
+	assert(lf(map_size)(m) == (size_t) n);
+
+	lf(map_iter)(m, &it);
+
+	for (struct lf(entry) e = lf(map_iter_next)(&it);
+	     lf(entry_is_valid)(e); e = lf(map_iter_next)(&it), i++) {
+		assert(*(const int *) e.key == i);
+		assert(*(int *) e.value == i);
+	}
+
+	assert(i == n);
+}
+
+
+int main(void)
+{
+	struct lf(map) m;
+	struct lf(map_it) it;
+
+	// appending to the end, a comparison per key
+	lf(map_xinit)(&m, sizeof(int), counting);
+	calls = 0;
+
+	for (int i = 0; i < N; i++)
+		lf(map_xinsert_hint2)(&m, NULL, &i, sizeof(i), &i);
+
+	assert(calls == N - 1);
+	check_keys(&m, N);
+	lf(map_destroy)(&m);
+
+	// descending keys, each inserted before the previous one
+	lf(map_xinit)(&m, sizeof(int), counting);
+	calls = 0;
+
+	for (int i = N - 1; i >= 0; i--)
+		lf(map_xinsert_hint2)(&m, i == N - 1 ? NULL : &it, &i,
+				      sizeof(i), &i);
+
+	assert(calls <= 2 * N);
+	check_keys(&m, N);
+	lf(map_destroy)(&m);
+
+	// even keys first, then the odd keys after their predecessors
+	lf(map_xinit)(&m, sizeof(int), counting);
+
+	for (int i = 0; i < N; i += 2)
+		lf(map_xinsert_hint2)(&m, NULL, &i, sizeof(i), &i);
+
+	calls = 0;
+
+	for (int i = 1; i < N; i += 2) {
+		int prev = i - 1;
+
+		lf(map_lower_bound2)(&m, &it, &prev, sizeof(prev));
+		calls = 0;
+		lf(map_xinsert_hint2)(&m, &it, &i, sizeof(i), &i);
+		assert(calls <= 2);
+		assert(*(const int *) lf(map_iter_next)(&it).key == i);
+		assert(i == N - 1 ||
+		       *(const int *) lf(map_iter_next)(&it).key == i + 1);
+	}
+
+	check_keys(&m, N);
+	lf(map_destroy)(&m);
+
+	// wrong hints fall back to searching from the root
+	lf(map_xinit)(&m, sizeof(int), counting);
+	srand(3);
+
+	int *keys = malloc(sizeof(*keys) * N);
+
+	for (int i = 0; i < N; i++)
+		keys[i] = i;
+
+	for (int i = N - 1; i > 0; i--) {
+		int j = rand() % (i + 1), tmp = keys[i];
+
+		keys[i] = keys[j];
+		keys[j] = tmp;
+	}
+
+	lf(map_lower_bound2)(&m, &it, &keys[0], sizeof(int));
+
+	for (int i = 0; i < N; i++) {
+		struct lf(map_it) *hint = i % 3 ? &it : NULL;
+
+		if (i % 5 == 0 && i > 0)
+			lf(map_iter_from)(&m, &it, rand() % i);
+
+		lf(map_xinsert_hint2)(&m, hint, &keys[i], sizeof(int),
+				      &keys[i]);
+
+		if (i % 512 == 0)
+			check(m.root, NULL);
+	}
+
+	check_keys(&m, N);
+	free(keys);
+	lf(map_destroy)(&m);
+
+	// string keys, and a range handle that is unbounded after inserting
+	char key[8];
+
+	lf(map_xinit)(&m, 0, NULL);
+
+	for (int i = 0; i < 100; i += 10) {
+		snprintf(key, sizeof(key), "%03d", i);
+		assert(lf(map_insert_hint)(&m, NULL, key, NULL));
+	}
+
+	lf(map_iter_range)(&m, &it, "020", "040");
+	lf(map_iter_next)(&it);
+	lf(map_xinsert_hint)(&m, &it, "035", NULL);
+	lf(map_xinsert_hint)(&m, &it, "095", NULL);
+	assert(lf(map_size)(&m) == 12);
+	assert(strncmp(lf(map_iter_next)(&it).key, "095", 3) == 0);
+	assert(!lf(entry_is_valid)(lf(map_iter_next)(&it)));
+	assert(lf(map_rank)(&m, "035") == 4);
+
+	check(m.root, NULL);
+	lf(map_destroy)(&m);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,140 @@
+#include "../../include/map.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define N 500
+
+/* Even numbers from 0 are the keys, so the bounds fall both on and between
+ * the keys. */
+static void key_of(char *buf, int i)
+{
+	snprintf(buf, 8, "%06d", i);
+}
+
+static int number_of(struct lf(entry) e)
+{
+	char buf[8];
+
+	assert(e.keylen == 6);
+
+	memcpy(buf, e.key, 6);
+	buf[6] = '\0';
+
+	return atoi(buf);
+}
+
+
+int main(void)
+{
+	struct lf(map) m;
+	struct lf(map_it) it;
+	struct lf(entry) e;
+	char key[8], lo[8], hi[8];
+
+	lf(map_xinit)(&m, sizeof(int), NULL);
+
+	/* Empty map. */
+	key_of(key, 0);
+	lf(map_lower_bound)(&m, &it, key);
+	e = lf(map_iter_next)(&it);
+	assert(!lf(entry_is_valid)(e));
+	assert(lf(map_count_range)(&m, key, key) == 0);
+
+	for (int i = 0; i < N; i++) {
+		key_of(key, i * 2);
+		lf(map_xinsert)(&m, key, &i);
+	}
+
+	for (int i = 0; i <= N * 2 + 1; i++) {
+		key_of(key, i);
+
+		/* First key >= i is the next even number. */
+		int first = (i + 1) / 2 * 2;
+
+		lf(map_lower_bound)(&m, &it, key);
+		e = lf(map_iter_next)(&it);
+
+		if (first >= N * 2) {
+			assert(!lf(entry_is_valid)(e));
+		} else {
+			assert(number_of(e) == first);
+			assert(*(int *) e.value == first / 2);
+		}
+
+		/* First key > i. */
+		first = i / 2 * 2 + 2;
+
+		lf(map_upper_bound2)(&m, &it, key, 6);
+		e = lf(map_iter_next)(&it);
+
+		if (first >= N * 2)
+			assert(!lf(entry_is_valid)(e));
+		else
+			assert(number_of(e) == first);
+
+		/* Going back from the upper bound gives the last key <= i. */
+		if (first < N * 2) {
+			lf(map_upper_bound2)(&m, &it, key, 6);
+			e = lf(map_iter_prev)(&it);
+			assert(number_of(e) == first);
+			e = lf(map_iter_prev)(&it);
+			assert(number_of(e) == first - 2);
+		}
+	}
+
+	for (int l = -1; l <= N * 2 + 1; l += 7) {
+		for (int h = l; h <= N * 2 + 1; h += 5) {
+			key_of(lo, l < 0 ? 0 : l);
+			key_of(hi, h < 0 ? 0 : h);
+
+			if (l < 0)
+				lo[0] = '\0';
+
+			int expected = 0;
+
+			for (int i = l < 0 ? 0 : l; i < h; i++)
+				expected += i % 2 == 0 && i < N * 2;
+
+			assert(lf(map_count_range)(&m, lo, hi) == (size_t) expected);
+
+			/* Forward over the range. */
+			int count = 0;
+			int prev = -1;
+
+			lf(map_iter_range)(&m, &it, lo, hi);
+
+			for (e = lf(map_iter_next)(&it); lf(entry_is_valid)(e);
+			     e = lf(map_iter_next)(&it)) {
+				int k = number_of(e);
+
+				assert(k >= l && k < h && k > prev);
+				prev = k;
+				count++;
+			}
+
+			assert(count == expected);
+
+			/* Stays finished. */
+			e = lf(map_iter_next)(&it);
+			assert(!lf(entry_is_valid)(e));
+
+			/* Backward from the first entry stops at the range. */
+			lf(map_iter_range)(&m, &it, lo, hi);
+			e = lf(map_iter_prev)(&it);
+
+			if (expected > 0)
+				assert(number_of(e) == (l < 0 ? 0 : (l + 1) / 2 * 2));
+
+			e = lf(map_iter_prev)(&it);
+			assert(!lf(entry_is_valid)(e));
+		}
+	}
+
+	lf(map_destroy)(&m);
+
+	return EXIT_SUCCESS;
+}
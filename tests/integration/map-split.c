@@ -0,0 +1,265 @@
+#include "../../include/map.h"
+#include "map-check.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static void check_map(struct lf(map) *m)
+{
+	assert(m->root == NULL || m->root->color == 0);
+	check(m->root, NULL);
+}
+
+static void key_of(char *buf, int i)
+{
+	snprintf(buf, 8, "%06d", i);
+}
+
+/* Asserts that the map holds the keys in [lo, hi) with the given step, each
+ * with the value of the key plus `add`. */
+static void check_keys(struct lf(map) *m, int lo, int hi, int step, int add)
+{
+	struct lf(map_it) it;
+	char key[8];
+	int i = lo;
+
+	if (lo >= hi) {
+		assert(lf(map_size)(m) == 0);
+
+		return;
+	}
+
+	lf(map_iter)(m, &it);
+
+	for (struct lf(entry) e = lf(map_iter_next)(&it); lf(entry_is_valid)(e);
+	     e = lf(map_iter_next)(&it)) {
+		key_of(key, i);
+		assert(e.keylen == 6 && memcmp(e.key, key, 6) == 0);
+		assert(*(int *) e.value == i + add);
+		i += step;
+	}
+
+	assert(i >= hi && i - step < hi);
+	assert(lf(map_size)(m) == (size_t) ((hi - lo + step - 1) / step));
+}
+
+static void fill(struct lf(map) *m, int lo, int hi, int step, int add)
+{
+	char key[8];
+
+	lf(map_xinit)(m, sizeof(int), NULL);
+
+	/* Inserted out of order, for trees of varied shapes. */
+	for (int k = 0; k < 3; k++) {
+		for (int i = lo + k * step; i < hi; i += 3 * step) {
+			int value = i + add;
+
+			key_of(key, i);
+			lf(map_xinsert)(m, key, &value);
+		}
+	}
+}
+
+
+int main(void)
+{
+	struct lf(map) m, right, other;
+	char key[8];
+
+	/* Splits at and between the keys, and joins the halves back. */
+	for (int at = -1; at <= 1002; at += 13) {
+		fill(&m, 0, 1000, 2, 0);
+
+		key_of(key, at < 0 ? 0 : at);
+		lf(map_xsplit)(&m, key, &right);
+
+		check_map(&m);
+		check_map(&right);
+
+		int mid = at < 0 ? 0 : at > 1000 ? 1000 : (at + 1) / 2 * 2;
+
+		check_keys(&m, 0, mid, 2, 0);
+		check_keys(&right, mid, 1000, 2, 0);
+
+		/* Both maps take new entries and free their nodes. */
+		for (int i = 1; i < 1000; i += 2) {
+			key_of(key, i);
+			lf(map_xinsert)(i < mid ? &m : &right, key, &i);
+		}
+
+		for (int i = 1; i < 1000; i += 2) {
+			key_of(key, i);
+			assert(lf(map_remove)(i < mid ? &m : &right, key) != NULL);
+		}
+
+		lf(map_xjoin)(&m, &right);
+
+		check_map(&m);
+		check_keys(&m, 0, 1000, 2, 0);
+		assert(lf(map_size)(&right) == 0);
+
+		/* Destroyed in either order. */
+		if (at % 2) {
+			lf(map_destroy)(&m);
+			lf(map_destroy)(&right);
+		} else {
+			lf(map_destroy)(&right);
+			lf(map_destroy)(&m);
+		}
+	}
+
+	/* Joins of maps of different heights. */
+	for (int n = 0; n < 600; n += 37) {
+		for (int k = 0; k < 600; k += 53) {
+			fill(&m, 0, n, 1, 0);
+			fill(&other, n, n + k, 1, 0);
+
+			lf(map_xjoin)(&m, &other);
+
+			check_map(&m);
+			check_keys(&m, 0, n + k, 1, 0);
+
+			/* other stays usable. */
+			key_of(key, 0);
+			lf(map_xinsert)(&other, key, NULL);
+			assert(lf(map_size)(&other) == 1);
+
+			lf(map_destroy)(&other);
+			lf(map_destroy)(&m);
+		}
+	}
+
+	/* Unions of overlapping maps keep the values of the map. */
+	for (int n = 0; n < 400; n += 41) {
+		fill(&m, 0, 3 * n, 3, 0);
+		fill(&other, 0, 2 * n, 2, 1);
+
+		lf(map_xunion)(&m, &other);
+
+		check_map(&m);
+		assert(lf(map_size)(&other) == 0);
+
+		size_t size = 0;
+
+		for (int i = 0; i < 3 * n; i++) {
+			bool in_m = i % 3 == 0;
+			bool in_other = i % 2 == 0 && i < 2 * n;
+
+			key_of(key, i);
+
+			int *v = lf(map_get)(&m, key);
+
+			if (in_m || in_other) {
+				assert(v != NULL && *v == i + !in_m);
+				size++;
+			} else {
+				assert(v == NULL);
+			}
+		}
+
+		assert(lf(map_size)(&m) == size);
+
+		lf(map_destroy)(&other);
+		lf(map_destroy)(&m);
+	}
+
+	/* Rebalancing shards, the maps end up holding nodes of each other's
+	 * slabs. */
+	{
+		struct lf(map) shards[4];
+
+		for (int s = 0; s < 4; s++)
+			fill(&shards[s], s * 1000, (s + 1) * 1000, 1, 0);
+
+		for (int round = 0; round < 50; round++) {
+			int s = round % 3;
+			struct lf(map) *a = &shards[s];
+			struct lf(map) *b = &shards[s + 1];
+
+			/* Moves the first entries of b to a, or the last ones
+			 * of a to b. */
+			if (round % 2 && lf(map_size)(b) > 1) {
+				struct lf(entry) e = lf(map_select)(b, lf(map_size)(b) / 2);
+
+				lf(map_xsplit2)(b, e.key, e.keylen, &right);
+				lf(map_xjoin)(a, b);
+				lf(map_destroy)(b);
+				*b = right;
+			} else if (lf(map_size)(a) > 1) {
+				struct lf(entry) e = lf(map_select)(a, lf(map_size)(a) / 2);
+
+				lf(map_xsplit2)(a, e.key, e.keylen, &right);
+				lf(map_xjoin)(&right, b);
+				lf(map_destroy)(b);
+				*b = right;
+			}
+
+			/* Churn on the shards. */
+			for (int t = 0; t < 4; t++) {
+				if (lf(map_size)(&shards[t]) == 0)
+					continue;
+
+				struct lf(entry) e = lf(map_select)(&shards[t], 0);
+				int value;
+
+				memcpy(key, e.key, 6);
+				key[6] = '\0';
+				value = *(int *) e.value;
+
+				assert(lf(map_remove)(&shards[t], key) != NULL);
+				lf(map_xinsert)(&shards[t], key, &value);
+			}
+		}
+
+		size_t total = 0;
+
+		for (int s = 0; s < 4; s++) {
+			check_map(&shards[s]);
+			total += lf(map_size)(&shards[s]);
+		}
+
+		assert(total == 4000);
+
+		for (int s = 1; s < 4; s++)
+			lf(map_xjoin)(&shards[0], &shards[s]);
+
+		check_keys(&shards[0], 0, 4000, 1, 0);
+
+		for (int s = 3; s >= 0; s--)
+			lf(map_destroy)(&shards[s]);
+	}
+
+	/* Large nodes go with their entries. */
+	{
+		char big[600];
+
+		lf(map_xinit)(&m, sizeof(int), NULL);
+
+		memset(big, 'x', sizeof(big) - 1);
+		big[sizeof(big) - 1] = '\0';
+
+		for (int i = 0; i < 100; i++) {
+			key_of(big, i);
+			big[6] = 'x';
+			lf(map_xinsert)(&m, big, &i);
+		}
+
+		key_of(big, 50);
+		big[6] = '\0';
+		lf(map_xsplit)(&m, big, &right);
+
+		assert(lf(map_size)(&m) == 50);
+		assert(lf(map_size)(&right) == 50);
+
+		big[6] = 'x';
+		assert(lf(map_remove)(&right, big) != NULL);
+
+		lf(map_destroy)(&m);
+		lf(map_destroy)(&right);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -127,16 +127,105 @@ int main(void)
 
 	for (int _fuzz = 0; _fuzz < 256; _fuzz++) {
 		int elem_size = rand() % 32;
+		char value[32] = { 0 };
 
 		lf(map_xinit)(&m, elem_size, NULL);
 
 		for (int i = 0; i < 1024; i++) {
+			memcpy(value, &i, sizeof(int));
+
 			if (lf(map_get2)(&m, &i, sizeof(int)) == NULL)
-				lf(map_xinsert2)(&m, &i, sizeof(int), &i);
+				lf(map_xinsert2)(&m, &i, sizeof(int), value);
 		}
 
 		lf(map_destroy)(&m);
 	}
 
+	// nodes of removed entries are reused, and nodes too large for the
+	// slabs are allocated one by one
+	char key[512];
+
+	lf(map_xinit)(&m, sizeof(int), NULL);
+
+	for (int round = 0; round < 4; round++) {
+		for (int i = 0; i < 1024; i++) {
+			size_t keylen = i % 8 ? 4 + i % 64 : 300 + i % 200;
+
+			memset(key, 'a' + round, keylen);
+			memcpy(key, &i, sizeof(int));
+			lf(map_xinsert2)(&m, key, keylen, &i);
+		}
+
+		for (int i = 0; i < 1024; i++) {
+			size_t keylen = i % 8 ? 4 + i % 64 : 300 + i % 200;
+
+			memset(key, 'a' + round, keylen);
+			memcpy(key, &i, sizeof(int));
+
+			int *value = lf(map_get2)(&m, key, keylen);
+
+			assert(value && *value == i);
+
+			if (round < 3 || i % 2)
+				assert(*(const int *) lf(map_remove2)(&m, key,
+								      keylen)
+				       == i);
+		}
+	}
+
+	assert(lf(map_size)(&m) == 512);
+	assert(m.large_nodes == 128);
+
+	lf(map_destroy)(&m);
+
+	/* Keys with equal prefixes, in ascending order. Zero bytes and the
+	 * end of the key are told apart by the length. */
+	static const struct {
+		const char *key;
+		size_t keylen;
+	} sorted[] = {
+		{ "", 0 },
+		{ "\0", 1 },
+		{ "\0\0", 2 },
+		{ "\0\0\0\0\0\0\0\0\0", 9 },
+		{ "\0\x01", 2 },
+		{ "a", 1 },
+		{ "a\0", 2 },
+		{ "abcdefg", 7 },
+		{ "abcdefg\0", 8 },
+		{ "abcdefg\0\0", 9 },
+		{ "abcdefgh", 8 },
+		{ "abcdefgh\0", 9 },
+		{ "abcdefgha", 9 },
+		{ "abcdefghb", 9 },
+		{ "abcdefgi", 8 },
+		{ "\x7f", 1 },
+		{ "\x80", 1 },
+		{ "\xff\xff\xff\xff\xff\xff\xff\xff", 8 },
+		{ "\xff\xff\xff\xff\xff\xff\xff\xff\xff", 9 },
+	};
+	const size_t count = sizeof(sorted) / sizeof(sorted[0]);
+
+	lf(map_xinit)(&m, sizeof(size_t), NULL);
+
+	for (size_t i = 0; i < count; i++) {
+		size_t j = i * 7 % count;
+
+		lf(map_xinsert2)(&m, sorted[j].key, sorted[j].keylen, &j);
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		struct lf(entry) e = lf(map_select)(&m, i);
+
+		assert(e.keylen == sorted[i].keylen);
+		assert(memcmp(e.key, sorted[i].key, e.keylen) == 0);
+		assert(*(size_t *) e.value == i);
+		assert(lf(map_rank2)(&m, sorted[i].key, sorted[i].keylen) == i);
+		assert(*(size_t *) lf(map_get2)(&m, sorted[i].key,
+						sorted[i].keylen) == i);
+	}
+
+	lf(map_destroy)(&m);
+
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,256 @@
+#include "../../include/map.h"
+#include "../../include/pmap.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+
+#define READERS 3
+#define KEYS 2048
+
+
+/* Checks the weight balance and size invariants, returns the size. */
+static size_t check(const struct lfi(pmap_node) *n)
+{
+	if (n == NULL)
+		return 0;
+
+	size_t left = check(n->left);
+	size_t right = check(n->right);
+
+	assert(n->size == left + right + 1);
+	assert(left + 1 <= 3 * (right + 1) && right + 1 <= 3 * (left + 1));
+
+	return n->size;
+}
+
+static void key_of(char *buf, int i)
+{
+	snprintf(buf, 8, "%06d", i);
+}
+
+static int cmp_int(const void *a, const void *b, size_t alen, size_t blen)
+{
+	int x = *(const int *) a;
+	int y = *(const int *) b;
+
+	(void) alen;
+	(void) blen;
+
+	return (x > y) - (x < y);
+}
+
+
+static struct lf(pmap) shared;
+static atomic_bool done;
+
+/* Every version holds the keys of a range, each mapped to its own value. */
+static int reader(void *arg)
+{
+	struct lf(pmap_reader) *r = lf(pmap_reader_new)(&shared);
+	size_t reads = 0;
+
+	(void) arg;
+	assert(r != NULL);
+
+	while (!atomic_load(&done) || reads == 0) {
+		struct lf(pmap_snapshot) s = lf(pmap_read_begin)(r);
+		size_t size = lf(pmap_size)(s);
+
+		if (size > 0) {
+			int lo = *(const int *) lf(pmap_select)(s, 0).key;
+
+			for (int key = lo; key < lo + (int) size; key++) {
+				const int *v = lf(pmap_get2)(s, &key,
+							     sizeof(key));
+
+				assert(v != NULL && *v == key);
+				assert(lf(pmap_rank2)(s, &key, sizeof(key)) ==
+				       (size_t) (key - lo));
+			}
+		}
+
+		lf(pmap_read_end)(r);
+		reads++;
+	}
+
+	lf(pmap_reader_release)(r);
+
+	return 0;
+}
+
+/* A sliding window of keys, inserted at the top and removed at the bottom. */
+static void concurrent(void)
+{
+	thrd_t readers[READERS];
+
+	lf(pmap_xinit)(&shared, sizeof(int), cmp_int);
+	atomic_init(&done, false);
+
+	for (int i = 0; i < READERS; i++)
+		assert(thrd_create(&readers[i], reader, NULL) == thrd_success);
+
+	for (int key = 0; key < 8 * KEYS; key++) {
+		bool inserted, removed;
+		int old = key - KEYS;
+
+		lf(pmap_xupsert2)(&shared, &key, sizeof(key), &key, &inserted);
+		assert(inserted);
+
+		if (old >= 0) {
+			lf(pmap_xremove2)(&shared, &old, sizeof(old), &removed);
+			assert(removed);
+		}
+	}
+
+	atomic_store(&done, true);
+
+	for (int i = 0; i < READERS; i++)
+		thrd_join(readers[i], NULL);
+
+	check(lf(pmap_current)(&shared).root);
+	assert(lf(pmap_size)(lf(pmap_current)(&shared)) == KEYS);
+
+	// released readers are reused
+	struct lf(pmap_reader) *head = atomic_load(&shared.readers);
+	struct lf(pmap_reader) *r = lf(pmap_reader_new)(&shared);
+
+	assert(r != NULL && atomic_load(&shared.readers) == head);
+	lf(pmap_reader_release)(r);
+
+	lf(pmap_destroy)(&shared);
+}
+
+
+int main(void)
+{
+	struct lf(pmap) p;
+	struct lf(map) m;
+	char key[8];
+	bool inserted, removed;
+
+	lf(pmap_xinit)(&p, sizeof(int), NULL);
+	lf(map_xinit)(&m, sizeof(int), NULL);
+
+	// random upserts and removes, mirrored in a map
+	srand(7);
+
+	for (int i = 0; i < 20000; i++) {
+		int k = rand() % 1000, v = rand();
+
+		key_of(key, k);
+
+		if (rand() % 3) {
+			lf(pmap_xupsert)(&p, key, &v, &inserted);
+			assert(inserted == (lf(map_get)(&m, key) == NULL));
+
+			if (inserted)
+				lf(map_xinsert)(&m, key, &v);
+			else
+				*(int *) lf(map_get)(&m, key) = v;
+		} else {
+			lf(pmap_xremove)(&p, key, &removed);
+			assert(removed == (lf(map_remove)(&m, key) != NULL));
+		}
+
+		if (i % 1000 == 0)
+			check(lf(pmap_current)(&p).root);
+	}
+
+	struct lf(pmap_snapshot) s = lf(pmap_current)(&p);
+	struct lf(pmap_it) it;
+	size_t i = 0;
+
+	check(s.root);
+	assert(lf(pmap_size)(s) == lf(map_size)(&m));
+
+	lf(pmap_iter)(s, &it);
+
+	for (struct lf(entry) e = lf(pmap_iter_next)(&it);
+	     lf(entry_is_valid)(e); e = lf(pmap_iter_next)(&it), i++) {
+		struct lf(entry) me = lf(map_select)(&m, i);
+
+		assert(e.keylen == me.keylen);
+		assert(memcmp(e.key, me.key, e.keylen) == 0);
+		assert(*(int *) e.value == *(int *) me.value);
+		assert(lf(pmap_select)(s, i).key == e.key);
+		assert(lf(pmap_rank2)(s, e.key, e.keylen) == i);
+		assert(*(const int *) lf(pmap_get2)(s, e.key, e.keylen) ==
+		       *(int *) me.value);
+	}
+
+	assert(i == lf(map_size)(&m));
+	assert(lf(pmap_get)(s, "missing") == NULL);
+	assert(lf(pmap_rank)(s, "missing") == (size_t) -1);
+
+	// versions read by a reader are left intact by the following updates
+	struct lf(pmap_reader) *r = lf(pmap_reader_new)(&p);
+
+	assert(r != NULL);
+
+	struct lf(pmap_snapshot) old = lf(pmap_read_begin)(r);
+	size_t old_size = lf(pmap_size)(old);
+
+	for (int k = 0; k < 1000; k++) {
+		int v = -k;
+
+		key_of(key, k);
+
+		if (k % 2)
+			lf(pmap_xremove)(&p, key, NULL);
+		else
+			lf(pmap_xupsert)(&p, key, &v, NULL);
+	}
+
+	check(old.root);
+	assert(lf(pmap_size)(old) == old_size);
+	assert(lf(pmap_size)(lf(pmap_current)(&p)) == 500);
+
+	lf(pmap_iter)(old, &it);
+	i = 0;
+
+	for (struct lf(entry) e = lf(pmap_iter_next)(&it);
+	     lf(entry_is_valid)(e); e = lf(pmap_iter_next)(&it), i++) {
+		struct lf(entry) me = lf(map_select)(&m, i);
+
+		assert(memcmp(e.key, me.key, e.keylen) == 0);
+		assert(*(int *) e.value == *(int *) me.value);
+	}
+
+	lf(pmap_read_end)(r);
+
+	// retired nodes are released by the next update
+	lf(pmap_xremove)(&p, "000000", &removed);
+	assert(removed);
+	assert(p.retired == NULL);
+
+	key_of(key, 2);
+	assert(*(const int *) lf(pmap_get)(lf(pmap_current)(&p), key) == -2);
+	assert(lf(pmap_get)(lf(pmap_current)(&p), "000001") == NULL);
+
+	lf(pmap_xremove)(&p, "000001", &removed);
+	assert(!removed);
+
+	lf(pmap_reader_release)(r);
+
+	// removing everything, in both directions
+	for (int k = 0; k < 1000; k += 2) {
+		key_of(key, k < 500 ? k : 1498 - k);
+		lf(pmap_xremove)(&p, key, NULL);
+	}
+
+	assert(lf(pmap_size)(lf(pmap_current)(&p)) == 0);
+	assert(lf(pmap_current)(&p).root == NULL);
+
+	lf(pmap_destroy)(&p);
+	lf(map_destroy)(&m);
+
+	concurrent();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,129 @@
+#include "../../include/hashmap.h"
+#include "../../include/typed_hashmap.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+#define KEYSPACE 8192
+
+
+struct point {
+	int x, y;
+};
+
+static uint64_t hash_id(uint64_t id)
+{
+	id ^= id >> 33;
+	id *= 0xff51afd7ed558ccdu;
+	id ^= id >> 33;
+
+	return id;
+}
+
+#define eq_id(a, b) ((a) == (b))
+
+LF_TYPED_HASHMAP(id_map, uint64_t, struct point, hash_id, eq_id)
+
+
+static uint64_t hash_str(const char *s)
+{
+	return lf(hashmap_default_hash)(s, strlen(s));
+}
+
+static bool eq_str(const char *a, const char *b)
+{
+	return strcmp(a, b) == 0;
+}
+
+LF_TYPED_HASHMAP(str_map, const char *, int, hash_str, eq_str)
+
+
+int main(void)
+{
+	srand(time(NULL));
+
+	static bool present[KEYSPACE];
+	struct lf(id_map) m;
+	bool inserted;
+
+	assert(!lf(id_map_init)(&m));
+
+	for (int round = 0; round < 64; round++) {
+		for (int i = 0; i < 2048; i++) {
+			uint64_t key = rand() % KEYSPACE;
+			struct point p = { (int) key, round }, removed;
+
+			if (present[key] && rand() % 2) {
+				assert(lf(id_map_remove)(&m, key, &removed));
+				assert(removed.x == (int) key);
+				assert(!lf(id_map_remove)(&m, key, NULL));
+				present[key] = false;
+			} else {
+				struct point *v =
+					lf(id_map_upsert)(&m, key, p, &inserted);
+
+				assert(v && inserted == !present[key]);
+				assert(v->x == (int) key && v->y == round);
+				present[key] = true;
+			}
+		}
+
+		size_t n = 0;
+
+		for (uint64_t key = 0; key < KEYSPACE; key++) {
+			struct point *v = lf(id_map_get)(&m, key);
+
+			assert(present[key] == (v != NULL));
+			assert(v == NULL || v->x == (int) key);
+			n += present[key];
+		}
+
+		assert(lf(id_map_size)(&m) == n);
+
+		struct lf(id_map_it) it;
+		struct lf(id_map_entry) *e;
+
+		lf(id_map_iter)(&m, &it);
+
+		while ((e = lf(id_map_iter_next)(&it)) != NULL) {
+			assert(present[e->key] && e->value.x == (int) e->key);
+			n--;
+		}
+
+		assert(n == 0);
+	}
+
+	lf(id_map_clear)(&m);
+	assert(lf(id_map_size)(&m) == 0 && !lf(id_map_get)(&m, 1));
+
+	// a reserved map does not rehash while it is filled
+	assert(!lf(id_map_reserve)(&m, 100000));
+
+	unsigned char *ctrl = m.ctrl;
+
+	for (uint64_t key = 0; key < 100000; key++)
+		assert(lf(id_map_insert)(&m, key, (struct point) { 0, 0 }));
+
+	assert(m.ctrl == ctrl);
+
+	lf(id_map_destroy)(&m);
+
+	struct lf(str_map) s;
+	int one = 1;
+
+	assert(!lf(str_map_init)(&s));
+	assert(lf(str_map_insert)(&s, "one", one));
+	assert(*lf(str_map_get_or_insert)(&s, "one", 2, &inserted) == 1);
+	assert(!inserted);
+	assert(!lf(str_map_get)(&s, "two"));
+	assert(lf(str_map_remove)(&s, "one", &one) && one == 1);
+
+	lf(str_map_destroy)(&s);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,178 @@
+#include "../../include/map.h"
+#include "../../include/typed_map.h"
+#include "map-check.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+#define KEYSPACE 4096
+
+
+struct point {
+	int x, y;
+};
+
+#define less_id(a, b) ((a) < (b))
+
+LF_TYPED_MAP(id_tree, uint64_t, struct point, less_id)
+
+
+static bool less_str(const char *a, const char *b)
+{
+	return strcmp(a, b) < 0;
+}
+
+LF_TYPED_MAP(str_tree, const char *, int, less_str)
+
+
+int main(void)
+{
+	srand(time(NULL));
+
+	static bool present[KEYSPACE];
+	static struct point values[KEYSPACE];
+
+	struct lf(id_tree) t;
+	struct lf(id_tree_it) it;
+	struct lf(id_tree_entry) *e;
+
+	assert(lf(id_tree_init)(&t) == 0);
+
+	lf(id_tree_iter)(&t, &it);
+	assert(lf(id_tree_iter_next)(&it) == NULL);
+
+	for (int round = 0; round < 200000; round++) {
+		uint64_t key = rand() % KEYSPACE;
+		struct point v = { rand(), round };
+		bool inserted;
+
+		switch (rand() % 4) {
+		case 0:
+			assert(lf(id_tree_upsert)(&t, key, v, &inserted));
+			assert(inserted == !present[key]);
+			present[key] = true;
+			values[key] = v;
+			break;
+		case 1: {
+			struct point *p =
+				lf(id_tree_get_or_insert)(&t, key, v, &inserted);
+
+			assert(p && inserted == !present[key]);
+
+			if (inserted) {
+				present[key] = true;
+				values[key] = v;
+			}
+
+			assert(p->x == values[key].x && p->y == values[key].y);
+			break;
+		}
+		case 2: {
+			struct point removed;
+
+			assert(lf(id_tree_remove)(&t, key, &removed) ==
+			       present[key]);
+
+			if (present[key])
+				assert(removed.y == values[key].y);
+
+			present[key] = false;
+			break;
+		}
+		default: {
+			struct point *p = lf(id_tree_get)(&t, key);
+
+			assert((p != NULL) == present[key]);
+
+			if (p)
+				assert(p->y == values[key].y);
+		}
+		}
+	}
+
+	check(t.m.root, NULL);
+
+	/* Order statistics against the reference. */
+	size_t rank = 0;
+
+	for (uint64_t key = 0; key < KEYSPACE; key++) {
+		if (!present[key]) {
+			assert(lf(id_tree_rank)(&t, key) == (size_t) -1);
+			continue;
+		}
+
+		assert(lf(id_tree_rank)(&t, key) == rank);
+		assert(lf(id_tree_select)(&t, rank)->key == key);
+		rank++;
+	}
+
+	assert(lf(id_tree_size)(&t) == rank);
+
+	/* Lower bound, forward and backward. */
+	for (uint64_t key = 0; key <= KEYSPACE; key += 7) {
+		uint64_t next = key;
+
+		while (next < KEYSPACE && !present[next])
+			next++;
+
+		lf(id_tree_lower_bound)(&t, &it, key);
+		e = lf(id_tree_iter_next)(&it);
+
+		if (next == KEYSPACE) {
+			assert(e == NULL);
+			continue;
+		}
+
+		assert(e->key == next);
+
+		lf(id_tree_lower_bound)(&t, &it, key);
+		e = lf(id_tree_iter_prev)(&it);
+		assert(e->key == next);
+		e = lf(id_tree_iter_prev)(&it);
+
+		if (e != NULL)
+			assert(e->key < key && present[e->key]);
+	}
+
+	size_t count = 0;
+	uint64_t prev = 0;
+
+	lf(id_tree_iter)(&t, &it);
+
+	while ((e = lf(id_tree_iter_next)(&it)) != NULL) {
+		assert(count == 0 || e->key > prev);
+		assert(present[e->key]);
+		prev = e->key;
+		count++;
+	}
+
+	assert(count == rank);
+
+	lf(id_tree_destroy)(&t);
+
+	/* Keys compared by a function, with an allocator. */
+	struct lf(str_tree) s;
+	static const char *words[] = {
+		"pear", "apple", "fig", "banana", "cherry", "date", "grape"
+	};
+
+	assert(lf(str_tree_init_with)(&s, &lf(allocator_libc)) == 0);
+
+	for (int i = 0; i < 7; i++)
+		assert(lf(str_tree_insert)(&s, words[i], i));
+
+	assert(*lf(str_tree_get)(&s, "fig") == 2);
+	assert(lf(str_tree_get)(&s, "kiwi") == NULL);
+	assert(lf(str_tree_rank)(&s, "apple") == 0);
+	assert(lf(str_tree_rank)(&s, "pear") == 6);
+	assert(strcmp(lf(str_tree_select)(&s, -1)->key, "pear") == 0);
+
+	lf(str_tree_destroy)(&s);
+
+	return EXIT_SUCCESS;
+}